@@ -0,0 +1,213 @@
+#include "approval.h"
+
+#include <string.h>
+
+#include "crypto.h"
+
+// REQUEST layout (big-endian, like CTAPHID)
+#define REQ_ID         2
+#define REQ_CHALLENGE  6
+#define REQ_TTL        22
+#define REQ_COMMAND    26
+#define REQ_FLAGS      27
+#define REQ_RP_HASH    28
+#define REQ_RP_LEN     60
+#define REQ_FLAG_RP    0x01
+
+// RESPONSE layout
+#define RESP_ID        2
+#define RESP_VERDICT   6
+#define RESP_SCOPE     7
+#define RESP_MINUTES   8
+#define RESP_USES      10
+
+static void put_be32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+static uint32_t get_be32(const uint8_t *p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static void put_be16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+}
+
+static uint16_t get_be16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static bool ct_equal(const uint8_t *a, const uint8_t *b, size_t len)
+{
+    uint8_t d = 0;
+    for (size_t i = 0; i < len; i++) d |= a[i] ^ b[i];
+    return d == 0;
+}
+
+// HMAC over the request frame and the response header: the verdict is
+// bound to the very request, challenge and RP the key sent.
+static int response_mac(const uint8_t key[APPROVAL_KEY_LEN], const uint8_t *req, size_t req_len,
+                        const uint8_t head[APPROVAL_RESP_HEAD], uint8_t mac[APPROVAL_MAC_LEN])
+{
+    crypto_buf_t parts[] = { { req, req_len }, { head, APPROVAL_RESP_HEAD } };
+    return crypto_hmac_sha256(key, parts, 2, mac);
+}
+
+static int revoke_mac(const uint8_t key[APPROVAL_KEY_LEN], const uint8_t head[6], uint8_t mac[APPROVAL_MAC_LEN])
+{
+    crypto_buf_t part = { head, 6 };
+    return crypto_hmac_sha256(key, &part, 1, mac);
+}
+
+void approval_book_init(approval_book_t *b)
+{
+    memset(b, 0, sizeof(*b));
+    uint8_t r[4];
+    b->next_id = crypto_random(r, sizeof(r)) == 0 ? get_be32(r) : 1;
+}
+
+int approval_open(approval_book_t *b, const approval_ctx_t *ctx, uint32_t ttl_ms, uint64_t now_us,
+                  uint8_t *frame, uint32_t *id)
+{
+    size_t rp_len = ctx->has_rp ? ctx->rp_id_len : 0;
+    if (rp_len > APPROVAL_RP_MAX) rp_len = APPROVAL_RP_MAX;
+
+    // a free slot, else the one closest to expiry
+    approval_slot_t *s = &b->slot[0];
+    for (size_t i = 0; i < APPROVAL_MAX_PENDING; i++) {
+        approval_slot_t *c = &b->slot[i];
+        if (c->id == 0) {
+            s = c;
+            break;
+        }
+        if (c->expires_us < s->expires_us) s = c;
+    }
+
+    uint8_t *f = s->frame;
+    f[0] = APPROVAL_VERSION;
+    f[1] = APPROVAL_TYPE_REQUEST;
+    if (b->next_id == 0) b->next_id = 1;   // 0 marks a free slot
+    uint32_t rid = b->next_id++;
+    put_be32(f + REQ_ID, rid);
+    if (crypto_random(f + REQ_CHALLENGE, APPROVAL_CHALLENGE_LEN) != 0) {
+        s->id = 0;
+        return -1;
+    }
+    put_be32(f + REQ_TTL, ttl_ms);
+    f[REQ_COMMAND] = ctx->command;
+    f[REQ_FLAGS] = ctx->has_rp ? REQ_FLAG_RP : 0;
+    if (ctx->has_rp) memcpy(f + REQ_RP_HASH, ctx->rp_id_hash, 32);
+    else memset(f + REQ_RP_HASH, 0, 32);
+    f[REQ_RP_LEN] = (uint8_t)rp_len;
+    memcpy(f + APPROVAL_REQ_HEAD, ctx->rp_id, rp_len);
+
+    s->id = rid;
+    s->len = (uint8_t)(APPROVAL_REQ_HEAD + rp_len);
+    s->expires_us = now_us + (uint64_t)ttl_ms * 1000u;
+    memcpy(frame, f, s->len);
+    if (id) *id = rid;
+    return s->len;
+}
+
+void approval_drop_all(approval_book_t *b)
+{
+    for (size_t i = 0; i < APPROVAL_MAX_PENDING; i++) b->slot[i].id = 0;
+}
+
+static int check_response(approval_book_t *b, const uint8_t key[APPROVAL_KEY_LEN], const uint8_t *msg,
+                          uint64_t now_us, approval_verdict_t *out)
+{
+    uint32_t rid = get_be32(msg + RESP_ID);
+    approval_slot_t *s = NULL;
+    for (size_t i = 0; rid != 0 && i < APPROVAL_MAX_PENDING; i++) {
+        if (b->slot[i].id == rid) s = &b->slot[i];
+    }
+    if (!s) return APPROVAL_ERR_UNKNOWN;
+
+    uint8_t mac[APPROVAL_MAC_LEN];
+    if (response_mac(key, s->frame, s->len, msg, mac) != 0 ||
+        !ct_equal(mac, msg + APPROVAL_RESP_HEAD, APPROVAL_MAC_LEN)) {
+        return APPROVAL_ERR_MAC;
+    }
+    s->id = 0;
+    if (now_us > s->expires_us) return APPROVAL_ERR_EXPIRED;
+
+    out->type = APPROVAL_TYPE_RESPONSE;
+    out->request_id = rid;
+    out->approve = msg[RESP_VERDICT] == 1;
+    out->grant_scope = out->approve ? msg[RESP_SCOPE] : 0;
+    out->grant_minutes = get_be16(msg + RESP_MINUTES);
+    out->grant_uses = get_be16(msg + RESP_USES);
+    return APPROVAL_OK;
+}
+
+static int check_revoke(approval_book_t *b, const uint8_t key[APPROVAL_KEY_LEN], const uint8_t *msg,
+                        approval_verdict_t *out)
+{
+    uint8_t mac[APPROVAL_MAC_LEN];
+    if (revoke_mac(key, msg, mac) != 0 || !ct_equal(mac, msg + 6, APPROVAL_MAC_LEN)) {
+        return APPROVAL_ERR_MAC;
+    }
+    uint32_t counter = get_be32(msg + 2);
+    if (counter <= b->revoke_counter) return APPROVAL_ERR_REPLAY;
+    b->revoke_counter = counter;
+
+    memset(out, 0, sizeof(*out));
+    out->type = APPROVAL_TYPE_REVOKE;
+    out->request_id = counter;
+    return APPROVAL_OK;
+}
+
+int approval_check(approval_book_t *b, const uint8_t key[APPROVAL_KEY_LEN], const uint8_t *msg, size_t len,
+                   uint64_t now_us, approval_verdict_t *out)
+{
+    if (len < 2 || msg[0] != APPROVAL_VERSION) return APPROVAL_ERR_FORMAT;
+    if (msg[1] == APPROVAL_TYPE_RESPONSE && len == APPROVAL_RESP_LEN) {
+        return check_response(b, key, msg, now_us, out);
+    }
+    if (msg[1] == APPROVAL_TYPE_REVOKE && len == APPROVAL_REVOKE_LEN) {
+        return check_revoke(b, key, msg, out);
+    }
+    return APPROVAL_ERR_FORMAT;
+}
+
+int approval_parse_pair(const uint8_t *msg, size_t len, uint8_t key[APPROVAL_KEY_LEN])
+{
+    if (len != APPROVAL_PAIR_LEN || msg[0] != APPROVAL_VERSION || msg[1] != APPROVAL_TYPE_PAIR) {
+        return APPROVAL_ERR_FORMAT;
+    }
+    memcpy(key, msg + 2, APPROVAL_KEY_LEN);
+    return APPROVAL_OK;
+}
+
+int approval_respond(const uint8_t key[APPROVAL_KEY_LEN], const uint8_t *req, size_t req_len,
+                     const approval_verdict_t *v, uint8_t out[APPROVAL_RESP_LEN])
+{
+    if (req_len < APPROVAL_REQ_HEAD || req[0] != APPROVAL_VERSION || req[1] != APPROVAL_TYPE_REQUEST) {
+        return APPROVAL_ERR_FORMAT;
+    }
+    out[0] = APPROVAL_VERSION;
+    out[1] = APPROVAL_TYPE_RESPONSE;
+    memcpy(out + RESP_ID, req + REQ_ID, 4);
+    out[RESP_VERDICT] = v->approve ? 1 : 0;
+    out[RESP_SCOPE] = v->grant_scope;
+    put_be16(out + RESP_MINUTES, v->grant_minutes);
+    put_be16(out + RESP_USES, v->grant_uses);
+    return response_mac(key, req, req_len, out, out + APPROVAL_RESP_HEAD) == 0 ? APPROVAL_OK : -1;
+}
+
+int approval_revoke(const uint8_t key[APPROVAL_KEY_LEN], uint32_t counter, uint8_t out[APPROVAL_REVOKE_LEN])
+{
+    out[0] = APPROVAL_VERSION;
+    out[1] = APPROVAL_TYPE_REVOKE;
+    put_be32(out + 2, counter);
+    return revoke_mac(key, out, out + 6) == 0 ? APPROVAL_OK : -1;
+}
@@ -0,0 +1,121 @@
+#pragma once
+// Approval messages between the key and the paired phone (spec:
+// shared/protocol/schema/approval_v1.md). The key notifies a REQUEST frame
+// with a fresh ID and challenge and what is being approved; the phone
+// answers with a RESPONSE carrying the same ID, its verdict and an
+// HMAC-SHA256 under the pairing key over the request frame and its own
+// header. A response only counts for a request still outstanding in the
+// book: each is accepted once, so a replayed, stale or foreign write
+// approves nothing, and several requests can be out at once and answered
+// in any order.
+//
+// Platform-neutral (crypto.h only): button_ble uses it on the device,
+// ctaphid-bench on the host. Not thread-safe; one task owns a book.
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define APPROVAL_VERSION       1
+
+#define APPROVAL_TYPE_REQUEST  0x01   // key -> phone
+#define APPROVAL_TYPE_RESPONSE 0x02   // phone -> key
+#define APPROVAL_TYPE_REVOKE   0x03   // phone -> key: drop every grant
+#define APPROVAL_TYPE_PAIR     0x10   // phone -> key: the pairing key
+
+#define APPROVAL_KEY_LEN       32
+#define APPROVAL_CHALLENGE_LEN 16
+#define APPROVAL_MAC_LEN       32
+#define APPROVAL_RP_MAX        64
+
+#define APPROVAL_REQ_HEAD      61     // REQUEST up to the RP ID
+#define APPROVAL_REQ_MAX       (APPROVAL_REQ_HEAD + APPROVAL_RP_MAX)
+#define APPROVAL_RESP_HEAD     12
+#define APPROVAL_RESP_LEN      (APPROVAL_RESP_HEAD + APPROVAL_MAC_LEN)
+#define APPROVAL_REVOKE_LEN    (6 + APPROVAL_MAC_LEN)
+#define APPROVAL_PAIR_LEN      (2 + APPROVAL_KEY_LEN)
+
+// Requests outstanding at once; opening another drops the oldest.
+#ifndef APPROVAL_MAX_PENDING
+#define APPROVAL_MAX_PENDING   4
+#endif
+
+// approval_check() results
+#define APPROVAL_OK            0
+#define APPROVAL_ERR_FORMAT    (-1)   // not a well-formed frame of a known type
+#define APPROVAL_ERR_UNKNOWN   (-2)   // no such request outstanding: answered, dropped or never sent
+#define APPROVAL_ERR_EXPIRED   (-3)   // authentic, but too late; the request is dropped
+#define APPROVAL_ERR_MAC       (-4)   // not from the paired phone; the request stays open
+#define APPROVAL_ERR_REPLAY    (-5)   // revoke with a counter already seen
+
+// What is being approved, shown on the phone.
+typedef struct {
+    uint8_t command;                   // CTAP command byte, 0 for none
+    bool has_rp;
+    uint8_t rp_id_hash[32];
+    uint8_t rp_id_len;
+    char rp_id[APPROVAL_RP_MAX];       // not NUL-terminated
+} approval_ctx_t;
+
+// A checked RESPONSE or REVOKE.
+typedef struct {
+    uint8_t type;                      // APPROVAL_TYPE_RESPONSE or _REVOKE
+    uint32_t request_id;               // RESPONSE; the counter for REVOKE
+    bool approve;
+    uint8_t grant_scope;               // 0 none, 1 the RP, 2 every RP, 3 enrollment
+    uint16_t grant_minutes;
+    uint16_t grant_uses;
+} approval_verdict_t;
+
+typedef struct {
+    uint32_t id;                       // 0: free
+    uint64_t expires_us;
+    uint8_t len;
+    uint8_t frame[APPROVAL_REQ_MAX];
+} approval_slot_t;
+
+typedef struct {
+    approval_slot_t slot[APPROVAL_MAX_PENDING];
+    uint32_t next_id;
+    uint32_t revoke_counter;           // highest accepted since init
+} approval_book_t;
+
+/** Empty book; request IDs start at a random point so they differ per boot. */
+void approval_book_init(approval_book_t *b);
+
+/**
+ * New outstanding request for `ctx`, answerable for `ttl_ms`. Writes the
+ * REQUEST frame to `frame` (APPROVAL_REQ_MAX bytes fit any) and returns its
+ * length, or a negative value if the RNG failed. `*id` gets the request ID.
+ */
+int approval_open(approval_book_t *b, const approval_ctx_t *ctx, uint32_t ttl_ms, uint64_t now_us,
+                  uint8_t *frame, uint32_t *id);
+
+/** Drops every outstanding request; answers to them become APPROVAL_ERR_UNKNOWN. */
+void approval_drop_all(approval_book_t *b);
+
+/**
+ * Checks a RESPONSE or REVOKE written by the phone. On APPROVAL_OK `out`
+ * holds it and a RESPONSE's request is closed.
+ */
+int approval_check(approval_book_t *b, const uint8_t key[APPROVAL_KEY_LEN], const uint8_t *msg, size_t len,
+                   uint64_t now_us, approval_verdict_t *out);
+
+/** The pairing key of a PAIR frame; APPROVAL_ERR_FORMAT if it isn't one. */
+int approval_parse_pair(const uint8_t *msg, size_t len, uint8_t key[APPROVAL_KEY_LEN]);
+
+// The phone's side, for the benchmark and tools.
+
+/** RESPONSE to the REQUEST `req` with verdict `v` (type and request_id ignored). */
+int approval_respond(const uint8_t key[APPROVAL_KEY_LEN], const uint8_t *req, size_t req_len,
+                     const approval_verdict_t *v, uint8_t out[APPROVAL_RESP_LEN]);
+
+/** REVOKE frame with `counter`. */
+int approval_revoke(const uint8_t key[APPROVAL_KEY_LEN], uint32_t counter, uint8_t out[APPROVAL_REVOKE_LEN]);
+
+#ifdef __cplusplus
+}
+#endif
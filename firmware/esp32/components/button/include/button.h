@@ -1,11 +1,24 @@
 #pragma once
 #include <stdbool.h>
+#include <stdint.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
 
-typedef enum { EV_REQUEST=1, EV_APPROVE=2, EV_DENY=3 } event_type_t;
+typedef enum { EV_REQUEST=1, EV_APPROVE=2, EV_DENY=3, EV_REVOKE=4 } event_type_t;
 
-typedef struct { event_type_t type; } button_event_t;
+// What an EV_APPROVE also approves ahead of time (core_grant_t scopes)
+typedef enum { GRANT_NONE=0, GRANT_RP=1, GRANT_HOST=2, GRANT_ENROLL=3 } grant_scope_t;
+
+typedef struct {
+    event_type_t type;
+    // EV_REQUEST/EV_APPROVE/EV_DENY: the CTAPHID park (ctaphid_up_park_id)
+    // asked about; a verdict for an older one is dropped
+    uint32_t park;
+    // EV_APPROVE only; GRANT_NONE approves this request alone
+    grant_scope_t grant;
+    uint16_t grant_minutes;
+    uint16_t grant_uses;     // 0: as many as fit in the time
+} button_event_t;
 
 void button_init(void);
 QueueHandle_t button_get_event_queue(void);
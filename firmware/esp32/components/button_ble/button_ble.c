@@ -18,11 +18,16 @@
 #include "os/os_mbuf.h"
 #include "host/ble_gatt.h"
 #include "host/ble_hs_mbuf.h" 
+#include "host/ble_hs_hci.h"
 #include "host/ble_uuid.h"
 
+#include "approval.h"
 #include "button.h"
+#include "button_ble.h"
+#include "nvs.h"
 
 #include "esp_heap_caps.h"
+#include "esp_timer.h"
 #include "esp_log.h"
 #include <stdlib.h>
 
@@ -32,6 +37,71 @@ void ble_store_config_init(void);
 
 static const char *TAG = "button_ble";
 
+// Link profile (Kconfig "roottap BLE approval link"): slow advertising and
+// a long, latent connection interval while idle; a fast advertising burst
+// and a short interval while a request waits for the phone.
+#ifdef CONFIG_BUTTON_BLE_ADV_IDLE_MS
+#define LINK_ADV_IDLE_MS CONFIG_BUTTON_BLE_ADV_IDLE_MS
+#else
+#define LINK_ADV_IDLE_MS 1000
+#endif
+
+#ifdef CONFIG_BUTTON_BLE_ADV_FAST_MS
+#define LINK_ADV_FAST_MS CONFIG_BUTTON_BLE_ADV_FAST_MS
+#else
+#define LINK_ADV_FAST_MS 30
+#endif
+
+#ifdef CONFIG_BUTTON_BLE_ADV_FAST_WINDOW_MS
+#define LINK_ADV_FAST_WINDOW_MS CONFIG_BUTTON_BLE_ADV_FAST_WINDOW_MS
+#else
+#define LINK_ADV_FAST_WINDOW_MS 30000
+#endif
+
+#ifdef CONFIG_BUTTON_BLE_CONN_FAST_MS
+#define LINK_CONN_FAST_MS CONFIG_BUTTON_BLE_CONN_FAST_MS
+#else
+#define LINK_CONN_FAST_MS 15
+#endif
+
+#ifdef CONFIG_BUTTON_BLE_CONN_IDLE_MS
+#define LINK_CONN_IDLE_MS CONFIG_BUTTON_BLE_CONN_IDLE_MS
+#else
+#define LINK_CONN_IDLE_MS 500
+#endif
+
+#ifdef CONFIG_BUTTON_BLE_CONN_IDLE_LATENCY
+#define LINK_CONN_IDLE_LATENCY CONFIG_BUTTON_BLE_CONN_IDLE_LATENCY
+#else
+#define LINK_CONN_IDLE_LATENCY 4
+#endif
+
+#ifdef CONFIG_BUTTON_BLE_SUPERVISION_MS
+#define LINK_SUPERVISION_MS CONFIG_BUTTON_BLE_SUPERVISION_MS
+#else
+#define LINK_SUPERVISION_MS 6000
+#endif
+
+#ifdef CONFIG_BUTTON_BLE_FAST_HOLD_MS
+#define LINK_FAST_HOLD_MS CONFIG_BUTTON_BLE_FAST_HOLD_MS
+#else
+#define LINK_FAST_HOLD_MS 5000
+#endif
+
+// Core spec: the link must survive every slave-latency skip plus one missed
+// event, or idle connections drop on their own.
+_Static_assert(2 * (1 + LINK_CONN_IDLE_LATENCY) * LINK_CONN_IDLE_MS < LINK_SUPERVISION_MS,
+               "BUTTON_BLE_SUPERVISION_MS must exceed 2 x (1 + idle latency) x idle interval");
+
+#define LINK_DLE_TX_OCTETS 251
+#define LINK_DLE_TX_TIME   2120   // µs for 251 octets on 1M
+
+// a request is answerable as long as CTAPHID waits for it
+#define APPROVAL_TTL_MS    30000
+
+#define NVS_NAMESPACE      "roottap_ble"
+#define NVS_KEY_PAIRING    "approval_key"
+
 // Custom UUIDs (random example). You can regenerate later.
 static const ble_uuid128_t UUID_SVC_UP = BLE_UUID128_INIT(
     0x5a,0x1c,0x2e,0x6f,0x8c,0x77,0x4b,0x6a,0x9e,0x2f,0x21,0xa0,0x9b,0x11,0x73,0xd1);
@@ -45,18 +115,135 @@ static const ble_uuid128_t UUID_CHR_REQUEST = BLE_UUID128_INIT(
 static uint16_t g_confirm_handle;
 static uint16_t g_request_handle = 0;
 static uint16_t g_conn_handle = BLE_HS_CONN_HANDLE_NONE;
-static uint8_t g_last_request_value = 0;  // 0/1 just for reads
+static uint8_t g_last_request[APPROVAL_REQ_MAX];   // for reads after a reconnect
+static uint8_t g_last_request_len;
 static QueueHandle_t s_evt_q;
 static struct ble_npl_event g_notify_ev;
+static struct ble_npl_event g_done_ev;
+static struct ble_npl_callout g_idle_co;
 static volatile bool g_notify_pending;
 
-esp_err_t button_ble_request_approval(void) {
-    if (g_request_handle == 0 || g_conn_handle == BLE_HS_CONN_HANDLE_NONE) {
-        ESP_LOGI(TAG, "EV_REQUEST dropped: BLE not connected or handles not ready");
-        return ESP_ERR_INVALID_STATE;
-    } 
+// Requests the phone may answer and the key its answers are checked with.
+// Host task only; the context of the next request is handed over by
+// button_ble_request_approval() under s_next_lock.
+static approval_book_t s_book;
+static uint8_t s_pairing_key[APPROVAL_KEY_LEN];
+static bool s_paired;
+static portMUX_TYPE s_next_lock = portMUX_INITIALIZER_UNLOCKED;
+static approval_ctx_t s_next_ctx;
+static uint32_t s_next_park;
+// The CTAPHID park the open request was notified for; 0 if none is open.
+static uint32_t s_open_park;
+// Newest park that has ended, from button_ble_approval_done().
+static volatile uint32_t s_ended_park;
+
+// Current link and the request in flight, for the per-request latency log.
+// Written by the host task, except requested_us.
+static struct {
+    bool fast;                  // fast connection parameters asked for
+    uint16_t itvl;              // 1.25 ms units, as negotiated
+    uint16_t latency;
+    uint8_t phy;                // BLE_GAP_LE_PHY_*
+    int64_t requested_us;       // button_ble_request_approval()
+    int64_t notified_us;        // request notify handed to the stack
+} g_link = { .phy = BLE_GAP_LE_PHY_1M };
+
+static void ble_app_advertise(void);
+
+// Fast parameters while a request is out, idle ones otherwise. The phone
+// may refuse or pick other values; CONN_UPDATE reports what was agreed.
+static void link_set_fast(bool fast)
+{
+    if (g_conn_handle == BLE_HS_CONN_HANDLE_NONE || g_link.fast == fast) return;
+    struct ble_gap_upd_params p = {
+        .itvl_min = BLE_GAP_CONN_ITVL_MS(fast ? LINK_CONN_FAST_MS : LINK_CONN_IDLE_MS),
+        .itvl_max = BLE_GAP_CONN_ITVL_MS(fast ? LINK_CONN_FAST_MS : LINK_CONN_IDLE_MS),
+        .latency = fast ? 0 : LINK_CONN_IDLE_LATENCY,
+        .supervision_timeout = BLE_GAP_SUPERVISION_TIMEOUT_MS(LINK_SUPERVISION_MS),
+    };
+    int rc = ble_gap_update_params(g_conn_handle, &p);
+    if (rc != 0) {
+        ESP_LOGW(TAG, "conn params (%s) rc=%d", fast ? "fast" : "idle", rc);
+        return;
+    }
+    g_link.fast = fast;
+}
+
+static void idle_co_cb(struct ble_npl_event *ev)
+{
+    (void)ev;
+    link_set_fast(false);
+}
+
+// 2M PHY and long packets where both ends have them; a refusal just leaves
+// the link on 1M with 27-byte packets.
+static void link_setup(void)
+{
+#if CONFIG_BUTTON_BLE_2M_PHY
+    int rc = ble_gap_set_prefered_le_phy(g_conn_handle, BLE_GAP_LE_PHY_2M_MASK, BLE_GAP_LE_PHY_2M_MASK,
+                                         BLE_GAP_LE_PHY_CODED_ANY);
+    if (rc != 0) ESP_LOGW(TAG, "2M PHY rc=%d", rc);
+#endif
+#if CONFIG_BUTTON_BLE_DLE
+    int dle = ble_hs_hci_util_set_data_len(g_conn_handle, LINK_DLE_TX_OCTETS, LINK_DLE_TX_TIME);
+    if (dle != 0) ESP_LOGW(TAG, "data length rc=%d", dle);
+#endif
+    struct ble_gap_conn_desc desc;
+    if (ble_gap_conn_find(g_conn_handle, &desc) == 0) {
+        g_link.itvl = desc.conn_itvl;
+        g_link.latency = desc.conn_latency;
+    }
+    // requests are up to APPROVAL_REQ_MAX bytes, more than the default MTU
+    int mtu = ble_gattc_exchange_mtu(g_conn_handle, NULL, NULL);
+    if (mtu != 0) ESP_LOGW(TAG, "MTU exchange rc=%d", mtu);
+    g_link.fast = !g_notify_pending;   // force the update below
+    link_set_fast(g_notify_pending);
+}
 
-    // Defer the actual notify to the NimBLE host task to avoid cross-task locking.
+static void load_pairing_key(void)
+{
+    nvs_handle_t h;
+    size_t len = sizeof(s_pairing_key);
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &h) != ESP_OK) return;
+    s_paired = nvs_get_blob(h, NVS_KEY_PAIRING, s_pairing_key, &len) == ESP_OK && len == sizeof(s_pairing_key);
+    nvs_close(h);
+}
+
+static esp_err_t store_pairing_key(const uint8_t key[APPROVAL_KEY_LEN])
+{
+    nvs_handle_t h;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &h);
+    if (err != ESP_OK) return err;
+    err = nvs_set_blob(h, NVS_KEY_PAIRING, key, APPROVAL_KEY_LEN);
+    if (err == ESP_OK) err = nvs_commit(h);
+    nvs_close(h);
+    return err;
+}
+
+// Park numbers only grow (wrapping past 0, which means "none").
+static bool park_ended(uint32_t park)
+{
+    return park && (int32_t)(s_ended_park - park) >= 0;
+}
+
+esp_err_t button_ble_request_approval(const approval_ctx_t *ctx, uint32_t park) {
+    if (g_request_handle == 0) {
+        ESP_LOGI(TAG, "EV_REQUEST dropped: handles not ready");
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!s_paired) {
+        ESP_LOGI(TAG, "EV_REQUEST dropped: no phone paired");
+        return ESP_ERR_INVALID_STATE;
+    }
+    portENTER_CRITICAL(&s_next_lock);
+    s_next_ctx = *ctx;
+    s_next_park = park;
+    portEXIT_CRITICAL(&s_next_lock);
+
+    // Defer the actual notify to the NimBLE host task, which owns the book
+    // and the link. Without a phone it waits there for one to connect,
+    // found sooner by a fast advertising burst.
+    g_link.requested_us = esp_timer_get_time();
     g_notify_pending = true;
     ble_npl_eventq_put(nimble_port_get_dflt_eventq(), &g_notify_ev);
     return ESP_OK;
@@ -65,12 +252,47 @@ esp_err_t button_ble_request_approval(void) {
 static void notify_evt_cb(struct ble_npl_event *ev)
 {
     if (g_request_handle == 0) return;
-    if (g_conn_handle == BLE_HS_CONN_HANDLE_NONE) return;
     if (!g_notify_pending) return;
+    approval_ctx_t next;
+    portENTER_CRITICAL(&s_next_lock);
+    next = s_next_ctx;
+    uint32_t park = s_next_park;
+    portEXIT_CRITICAL(&s_next_lock);
+    if (park_ended(park)) {
+        // over before the phone could be told
+        g_notify_pending = false;
+        return;
+    }
+    if (g_conn_handle == BLE_HS_CONN_HANDLE_NONE) {
+        ble_app_advertise();
+        return;
+    }
     g_notify_pending = false;
 
-    uint8_t v = 1;
-    struct os_mbuf *om = ble_hs_mbuf_from_flat(&v, sizeof(v));
+    // short interval before the notify, so the confirm rides on it; back
+    // to idle once the request can no longer be answered, in case the
+    // phone never does and nothing ends it here
+    link_set_fast(true);
+    ble_npl_callout_reset(&g_idle_co, ble_npl_time_ms_to_ticks32(APPROVAL_TTL_MS + LINK_FAST_HOLD_MS));
+
+    // USB parks one presence request at a time, so a new request closes
+    // the ones before it; the verdict carries the park it was asked for.
+    approval_drop_all(&s_book);
+    s_open_park = 0;
+    uint32_t id = 0;
+    int len = approval_open(&s_book, &next, APPROVAL_TTL_MS, (uint64_t)esp_timer_get_time(),
+                            g_last_request, &id);
+    if (len < 0) {
+        ESP_LOGE(TAG, "request: no randomness");
+        return;
+    }
+    s_open_park = park;
+    g_last_request_len = (uint8_t)len;
+    if (ble_att_mtu(g_conn_handle) < len + 3) {
+        ESP_LOGW(TAG, "ATT MTU %u too small for a %d-byte request", (unsigned)ble_att_mtu(g_conn_handle), len);
+    }
+
+    struct os_mbuf *om = ble_hs_mbuf_from_flat(g_last_request, (uint16_t)len);
     if (!om) {
         ESP_LOGE(TAG, "notify: no mbuf");
         return;
@@ -80,7 +302,48 @@ static void notify_evt_cb(struct ble_npl_event *ev)
     if (rc != 0) {
         ESP_LOGE(TAG, "notify failed rc=%d", rc);
         os_mbuf_free_chain(om);
+        return;
     }
+    g_link.notified_us = esp_timer_get_time();
+    ESP_LOGI(TAG, "request %08x notified", (unsigned)id);
+}
+
+// The parked request ended on the USB side: the phone's request for it is
+// withdrawn, and one still waiting for the phone is not sent.
+static void done_evt_cb(struct ble_npl_event *ev)
+{
+    (void)ev;
+    if (park_ended(s_open_park)) {
+        approval_drop_all(&s_book);
+        s_open_park = 0;
+        ble_npl_callout_reset(&g_idle_co, ble_npl_time_ms_to_ticks32(LINK_FAST_HOLD_MS));
+    }
+    portENTER_CRITICAL(&s_next_lock);
+    uint32_t next_park = s_next_park;
+    portEXIT_CRITICAL(&s_next_lock);
+    if (g_notify_pending && park_ended(next_park)) g_notify_pending = false;
+}
+
+void button_ble_approval_done(uint32_t park)
+{
+    if (g_request_handle == 0) return;
+    s_ended_park = park;
+    ble_npl_eventq_put(nimble_port_get_dflt_eventq(), &g_done_ev);
+}
+
+// One line per approval: notify to confirm (the phone and the user), and
+// request to notify (connecting, if the phone wasn't).
+static void log_round_trip(void)
+{
+    if (!g_link.notified_us) return;
+    int64_t now = esp_timer_get_time();
+    unsigned itvl_us = g_link.itvl * 1250u;
+    ESP_LOGI(TAG, "approval rtt=%lld ms (notify after %lld ms) itvl=%u.%02u ms latency=%u phy=%s",
+             (long long)((now - g_link.notified_us) / 1000),
+             (long long)((g_link.notified_us - g_link.requested_us) / 1000),
+             itvl_us / 1000, (itvl_us % 1000) / 10, (unsigned)g_link.latency,
+             g_link.phy == BLE_GAP_LE_PHY_2M ? "2M" : g_link.phy == BLE_GAP_LE_PHY_CODED ? "coded" : "1M");
+    g_link.notified_us = 0;
 }
 
 // ---- GATT callback: phone writes "confirm" here
@@ -92,18 +355,53 @@ static int confirm_access_cb(uint16_t conn_handle, uint16_t attr_handle,
         return BLE_ATT_ERR_UNLIKELY;
     }
 
-    // Read payload (optional). For now we ignore contents.
-    // You can enforce a token/challenge later.
-    uint8_t buf[64];
+    uint8_t buf[APPROVAL_REQ_MAX];
     int len = OS_MBUF_PKTLEN(ctxt->om);
-    if (len > (int)sizeof(buf)) len = sizeof(buf);
+    if (len > (int)sizeof(buf)) return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
     ble_hs_mbuf_to_flat(ctxt->om, buf, len, NULL);
 
     ESP_LOGI(TAG, "BLE confirm write, len=%d", len);
 
-    button_publish((button_event_t){
-        .type = (buf[0] == 1) ? EV_APPROVE : EV_DENY
-    });
+    // First use: the phone hands over the pairing key, on an encrypted link
+    // (the characteristic requires it) and only while none is stored.
+    uint8_t key[APPROVAL_KEY_LEN];
+    if (approval_parse_pair(buf, len, key) == APPROVAL_OK) {
+        esp_err_t err = s_paired ? ESP_ERR_INVALID_STATE : store_pairing_key(key);
+        if (err == ESP_OK) {
+            memcpy(s_pairing_key, key, sizeof(key));
+            s_paired = true;
+        }
+        ESP_LOGI(TAG, "pair: %s", err == ESP_OK ? "stored" : esp_err_to_name(err));
+        memset(key, 0, sizeof(key));
+        return err == ESP_OK ? 0 : BLE_ATT_ERR_WRITE_NOT_PERMITTED;
+    }
+    if (!s_paired) return BLE_ATT_ERR_WRITE_NOT_PERMITTED;
+
+    approval_verdict_t v;
+    int rc = approval_check(&s_book, s_pairing_key, buf, len, (uint64_t)esp_timer_get_time(), &v);
+    if (rc != APPROVAL_OK) {
+        // stale, replayed or forged: nothing happens, the request stays
+        // with whoever can answer it properly
+        ESP_LOGW(TAG, "confirm ignored: %d", rc);
+        return 0;
+    }
+
+    button_event_t ev = { .type = EV_REVOKE };
+    if (v.type == APPROVAL_TYPE_RESPONSE) {
+        log_round_trip();
+        // stay fast a little: the next sudo of a runbook is likely close
+        ble_npl_callout_reset(&g_idle_co, ble_npl_time_ms_to_ticks32(LINK_FAST_HOLD_MS));
+        ev.type = v.approve ? EV_APPROVE : EV_DENY;
+        // the book holds only the request notified last
+        ev.park = s_open_park;
+        s_open_park = 0;
+        if (v.grant_scope == GRANT_RP || v.grant_scope == GRANT_HOST || v.grant_scope == GRANT_ENROLL) {
+            ev.grant = (grant_scope_t)v.grant_scope;
+            ev.grant_minutes = v.grant_minutes;
+            ev.grant_uses = v.grant_uses;
+        }
+    }
+    button_publish(ev);
 
     return 0;
 }
@@ -118,8 +416,8 @@ static int request_access_cb(uint16_t conn_handle,
         return BLE_ATT_ERR_UNLIKELY;
     }
 
-    // Return 1 byte so the characteristic has a valid "value".
-    return os_mbuf_append(ctxt->om, &g_last_request_value, sizeof(g_last_request_value)) == 0
+    // the last request, for a phone that reconnected after its notify
+    return os_mbuf_append(ctxt->om, g_last_request, g_last_request_len) == 0
            ? 0
            : BLE_ATT_ERR_INSUFFICIENT_RES;
 }
@@ -161,7 +459,7 @@ static const struct ble_gatt_chr_def gatt_chars[] = {
     {
         .uuid = &UUID_CHR_CONFIRM.u,
         .access_cb = confirm_access_cb,
-        .flags = BLE_GATT_CHR_F_WRITE | BLE_GATT_CHR_F_WRITE_NO_RSP,
+        .flags = BLE_GATT_CHR_F_WRITE | BLE_GATT_CHR_F_WRITE_NO_RSP | BLE_GATT_CHR_F_WRITE_ENC,
         .val_handle = &g_confirm_handle,
     },
     { 0 }
@@ -176,15 +474,18 @@ static const struct ble_gatt_svc_def gatt_svcs[] = {
     { 0 }
 };
 
-static void ble_app_advertise(void);
-
 static int gap_event_cb(struct ble_gap_event *event, void *arg)
 {
+    struct ble_gap_conn_desc desc;
+
     switch (event->type) {
         case BLE_GAP_EVENT_CONNECT:
             if (event->connect.status == 0) {
                 g_conn_handle = event->connect.conn_handle;
                 ESP_LOGI(TAG, "Connected (handle=%d)", g_conn_handle);
+                link_setup();
+                // a request that waited for the phone goes out now
+                if (g_notify_pending) ble_npl_eventq_put(nimble_port_get_dflt_eventq(), &g_notify_ev);
             } else {
                 ESP_LOGW(TAG, "Connect failed; status=%d", event->connect.status);
                 ble_app_advertise();
@@ -194,11 +495,33 @@ static int gap_event_cb(struct ble_gap_event *event, void *arg)
         case BLE_GAP_EVENT_DISCONNECT:
             ESP_LOGI(TAG, "Disconnected");
             g_conn_handle = BLE_HS_CONN_HANDLE_NONE;
+            g_link.fast = false;
+            g_link.notified_us = 0;
+            g_link.phy = BLE_GAP_LE_PHY_1M;
+            ble_npl_callout_stop(&g_idle_co);
             ble_app_advertise();
             return 0;
 
         case BLE_GAP_EVENT_ADV_COMPLETE:
-            ble_app_advertise();
+            // the fast burst ran out without a phone: the request it was
+            // for has timed out on the host side by now. Advertising that
+            // ends any other way (a connection, preemption) keeps it.
+            if (event->adv_complete.reason == BLE_HS_ETIMEOUT) g_notify_pending = false;
+            if (g_conn_handle == BLE_HS_CONN_HANDLE_NONE) ble_app_advertise();
+            return 0;
+
+        case BLE_GAP_EVENT_CONN_UPDATE:
+            if (ble_gap_conn_find(event->conn_update.conn_handle, &desc) == 0) {
+                g_link.itvl = desc.conn_itvl;
+                g_link.latency = desc.conn_latency;
+                ESP_LOGI(TAG, "conn params itvl=%u (1.25 ms) latency=%u status=%d",
+                         (unsigned)desc.conn_itvl, (unsigned)desc.conn_latency,
+                         event->conn_update.status);
+            }
+            return 0;
+
+        case BLE_GAP_EVENT_PHY_UPDATE_COMPLETE:
+            if (event->phy_updated.status == 0) g_link.phy = event->phy_updated.tx_phy;
             return 0;
 
         default:
@@ -206,12 +529,23 @@ static int gap_event_cb(struct ble_gap_event *event, void *arg)
     }
 }
 
+// Fast with a request waiting, for the burst window; slow and endless
+// otherwise.
 static void ble_app_advertise(void)
 {
+    bool fast = g_notify_pending;
+    if (ble_gap_adv_active()) {
+        // already fast: let the burst run its course
+        if (fast) return;
+        ble_gap_adv_stop();
+    }
+
     struct ble_gap_adv_params adv_params;
     memset(&adv_params, 0, sizeof(adv_params));
     adv_params.conn_mode = BLE_GAP_CONN_MODE_UND;
     adv_params.disc_mode = BLE_GAP_DISC_MODE_GEN;
+    adv_params.itvl_min = BLE_GAP_ADV_ITVL_MS(fast ? LINK_ADV_FAST_MS : LINK_ADV_IDLE_MS);
+    adv_params.itvl_max = adv_params.itvl_min;
 
     // Advertise name + service UUID
     struct ble_hs_adv_fields fields;
@@ -232,12 +566,12 @@ static void ble_app_advertise(void)
         return;
     }
 
-    rc = ble_gap_adv_start(BLE_OWN_ADDR_PUBLIC, NULL, BLE_HS_FOREVER,
+    rc = ble_gap_adv_start(BLE_OWN_ADDR_PUBLIC, NULL, fast ? LINK_ADV_FAST_WINDOW_MS : BLE_HS_FOREVER,
                            &adv_params, gap_event_cb, NULL);
     if (rc != 0) {
         ESP_LOGE(TAG, "ble_gap_adv_start rc=%d", rc);
     } else {
-        ESP_LOGI(TAG, "Advertising...");
+        ESP_LOGI(TAG, "Advertising every %d ms", fast ? LINK_ADV_FAST_MS : LINK_ADV_IDLE_MS);
     }
 }
 
@@ -264,6 +598,8 @@ esp_err_t button_ble_init(void)
     // Init NimBLE
     nimble_port_init();
     ble_npl_event_init(&g_notify_ev, notify_evt_cb, NULL);
+    ble_npl_event_init(&g_done_ev, done_evt_cb, NULL);
+    ble_npl_callout_init(&g_idle_co, nimble_port_get_dflt_eventq(), idle_co_cb, NULL);
 
     // GAP/GATT services
     ble_svc_gap_init();
@@ -291,6 +627,18 @@ esp_err_t button_ble_init(void)
     ble_hs_cfg.gatts_register_cb = gatt_register_cb;
     ble_hs_cfg.sync_cb = ble_on_sync;
 
+    // Bonded, LE Secure Connections: writes to "confirm" need encryption,
+    // so the phone pairs on its first one.
+    ble_hs_cfg.sm_io_cap = BLE_HS_IO_NO_INPUT_OUTPUT;
+    ble_hs_cfg.sm_bonding = 1;
+    ble_hs_cfg.sm_sc = 1;
+    ble_hs_cfg.sm_our_key_dist = BLE_SM_PAIR_KEY_DIST_ENC | BLE_SM_PAIR_KEY_DIST_ID;
+    ble_hs_cfg.sm_their_key_dist = BLE_SM_PAIR_KEY_DIST_ENC | BLE_SM_PAIR_KEY_DIST_ID;
+
+    approval_book_init(&s_book);
+    load_pairing_key();
+    ESP_LOGI(TAG, "phone %s", s_paired ? "paired" : "not paired yet");
+
     // Start host
     nimble_port_freertos_init(host_task);
     ESP_LOGI(TAG, "button_ble initialized");
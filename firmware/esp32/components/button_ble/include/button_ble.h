@@ -1,6 +1,14 @@
 #pragma once
 #include "esp_err.h"
+#include "approval.h"
 
 esp_err_t button_ble_init(void);
-esp_err_t button_ble_request_approval(void);
+// Notify the paired phone of a request for `ctx` (see approval.h), asked for
+// the CTAPHID park `park`; its verdict comes back as EV_APPROVE/EV_DENY with
+// that park. Fails if no phone is paired; otherwise the notify waits for the
+// phone to connect.
+esp_err_t button_ble_request_approval(const approval_ctx_t *ctx, uint32_t park);
+// Park `park` ended (verdict, CANCEL or timeout): withdraw its request from
+// the phone. Any task.
+void button_ble_approval_done(uint32_t park);
 
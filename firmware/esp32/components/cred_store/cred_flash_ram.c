@@ -0,0 +1,76 @@
+// NOR flash simulated in RAM: the host's store and the benchmarks' scratch
+// store. Writes are refused if they would set a bit, as real flash would
+// silently not, so a store bug that relies on it fails loudly here.
+
+#include "cred_store.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// How much of a `len`-byte operation lands before the power goes.
+static size_t budget(cred_flash_ram_t *ram, size_t len)
+{
+    if (ram->cut) return 0;
+    if (ram->cut_after < 0) return len;
+    if ((long)len > ram->cut_after) {
+        len = (size_t)ram->cut_after;
+        ram->cut = true;
+    }
+    ram->cut_after -= (long)len;
+    return len;
+}
+
+static int ram_read(const cred_flash_t *f, uint32_t addr, void *dst, size_t len)
+{
+    const cred_flash_ram_t *ram = f->user;
+    if (addr > f->size || len > f->size - addr) return -1;
+    memcpy(dst, ram->mem + addr, len);
+    return 0;
+}
+
+static int ram_write(const cred_flash_t *f, uint32_t addr, const void *src, size_t len)
+{
+    cred_flash_ram_t *ram = f->user;
+    const uint8_t *s = src;
+    if (addr > f->size || len > f->size - addr) return -1;
+    if (ram->cut) return 0;
+    for (size_t i = 0; i < len; i++) {
+        if (s[i] & ~ram->mem[addr + i]) return -1;
+    }
+    len = budget(ram, len);
+    for (size_t i = 0; i < len; i++) ram->mem[addr + i] &= s[i];
+    return 0;
+}
+
+static int ram_erase(const cred_flash_t *f, uint32_t addr)
+{
+    cred_flash_ram_t *ram = f->user;
+    if (addr % CRED_FLASH_SECTOR || addr >= f->size) return -1;
+    memset(ram->mem + addr, 0xFF, budget(ram, CRED_FLASH_SECTOR));
+    return 0;
+}
+
+int cred_flash_ram_init(cred_flash_ram_t *ram, uint32_t size)
+{
+    size = (size + CRED_FLASH_SECTOR - 1) / CRED_FLASH_SECTOR * CRED_FLASH_SECTOR;
+    memset(ram, 0, sizeof(*ram));
+    ram->mem = malloc(size);
+    if (!ram->mem) return -1;
+    memset(ram->mem, 0xFF, size);
+    ram->cut_after = -1;
+    ram->flash = (cred_flash_t){
+        .read = ram_read,
+        .write = ram_write,
+        .erase = ram_erase,
+        .size = size,
+        .user = ram,
+    };
+    return 0;
+}
+
+void cred_flash_ram_free(cred_flash_ram_t *ram)
+{
+    if (cred_store_flash() == &ram->flash) (void)cred_store_mount(NULL);
+    free(ram->mem);
+    ram->mem = NULL;
+}
@@ -0,0 +1,826 @@
+// Log-structured credential store; layout and rules in cred_store.h.
+// Records are stored as their in-memory struct: both targets are
+// little-endian and this flash never leaves the device.
+
+#include "cred_store.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#define SECTOR_MAGIC   0x53435452u   // "RTCS"
+#define SEQ_NONE       0xFFFFFFFFu
+#define SLOTS          (CRED_FLASH_SECTOR / CRED_FLASH_SLOT)
+
+// Record states. Each step only clears bits of the previous one.
+#define ST_FREE        0xFF
+#define ST_BEGUN       0xFE   // body being written
+#define ST_VALID       0xFC   // committed
+#define ST_DELETED     0x00
+
+#define KIND_CRED      0x01
+#define KIND_DEVICE    0x02   // secret in `priv`, shared counter; no id
+#define KIND_PIN       0x03   // PIN hash in `priv`, failed attempts as counter
+#define TALLY_BITS     256
+
+#define NIL            0xFFFFu
+#define MAX_SECTORS    (2 * (CRED_STORE_MAX / CRED_STORE_PER_SECTOR) + 4)
+
+_Static_assert((CRED_STORE_MAX & (CRED_STORE_MAX - 1)) == 0,
+               "CRED_STORE_MAX must be a power of two");
+_Static_assert(CRED_STORE_MAX < NIL, "index links are 16-bit");
+
+typedef struct {
+    uint32_t magic;
+    uint32_t erases;
+    uint32_t seq;      // log order of the sector; SEQ_NONE until opened
+} sector_hdr_t;
+
+typedef struct {
+    uint8_t state;
+    uint8_t kind;
+    uint8_t user_id_len;
+    uint8_t resident;
+    uint32_t serial;           // creation order, kept across moves
+    uint32_t count_base;       // signature counter minus the tally
+    uint8_t id[CRED_STORE_ID_LEN];
+    uint8_t rp_id_hash[CRED_STORE_RP_HASH_LEN];
+    uint8_t priv[CRED_STORE_PRIV_LEN];
+    uint8_t user_id[CRED_STORE_USER_ID_MAX];
+    uint8_t reserved[64];      // left erased for later fields
+    uint32_t crc;              // kind .. reserved
+    uint8_t tally[TALLY_BITS / 8];   // one cleared bit per signature
+} record_t;
+
+_Static_assert(sizeof(record_t) == CRED_FLASH_SLOT, "one record per slot");
+
+#define CRC_FROM  offsetof(record_t, kind)
+#define CRC_TO    offsetof(record_t, crc)
+
+typedef struct {
+    uint32_t seq;
+    uint32_t erases;
+    uint8_t next;        // first never-written slot; SLOTS when full
+    uint8_t live;
+    uint8_t dead;
+    bool formatted;      // header written since the last erase
+} sector_t;
+
+// Index entry: enough to find a record and bump its counter without a read.
+typedef struct {
+    uint32_t addr;
+    uint32_t serial;
+    uint32_t count;
+    uint32_t rp_tag;     // rpIdHash bytes 4..7; bytes 0..3 pick the bucket
+    uint16_t id_tag;
+    uint16_t next;       // bucket chain, or free list
+    uint16_t tally;      // bits cleared in the record's tally
+    uint8_t resident;
+    bool used;
+} entry_t;
+
+static const cred_flash_t *s_flash;
+static uint32_t s_nsectors;
+static sector_t s_sectors[MAX_SECTORS];
+static uint32_t s_head;          // sector being appended to, or SEQ_NONE
+static uint32_t s_seq;
+static uint32_t s_serial;
+
+static entry_t s_entries[CRED_STORE_MAX];
+static uint16_t s_buckets[CRED_STORE_MAX];
+static uint16_t s_free;
+static uint32_t s_live;
+static uint32_t s_gc_runs;
+static uint32_t s_gc_moved;
+
+// Records the log holds at most one of: not in the index, kept in RAM.
+typedef struct {
+    entry_t e;
+    uint8_t data[CRED_STORE_PRIV_LEN];
+} single_t;
+
+static single_t s_device;   // wrap secret, shared signature counter
+static single_t s_pin;      // PIN hash, failed attempts
+
+static uint32_t crc32(const uint8_t *p, size_t n)
+{
+    uint32_t c = 0xFFFFFFFFu;
+    while (n--) {
+        c ^= *p++;
+        for (int k = 0; k < 8; k++) c = (c >> 1) ^ (0xEDB88320u & (0u - (c & 1)));
+    }
+    return ~c;
+}
+
+static uint32_t le32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint32_t bucket_of(const uint8_t *rp_id_hash)
+{
+    return le32(rp_id_hash) & (CRED_STORE_MAX - 1);
+}
+
+static uint16_t id_tag(const uint8_t *id)
+{
+    return (uint16_t)(id[0] | id[1] << 8);
+}
+
+static bool all_ff(const void *p, size_t n)
+{
+    const uint8_t *b = p;
+    for (size_t i = 0; i < n; i++) {
+        if (b[i] != 0xFF) return false;
+    }
+    return true;
+}
+
+static uint32_t capacity(void)
+{
+    // less the spare sector and the slots of the device and PIN records
+    uint32_t cap = s_nsectors > 1 ? (s_nsectors - 1) * CRED_STORE_PER_SECTOR - 2 : 0;
+    return cap < CRED_STORE_MAX ? cap : CRED_STORE_MAX;
+}
+
+// ---- flash helpers ----
+
+static int fl_read(uint32_t addr, void *dst, size_t len)
+{
+    return s_flash->read(s_flash, addr, dst, len) == 0 ? 0 : CRED_STORE_ERR_IO;
+}
+
+static int fl_write(uint32_t addr, const void *src, size_t len)
+{
+    return s_flash->write(s_flash, addr, src, len) == 0 ? 0 : CRED_STORE_ERR_IO;
+}
+
+static int set_state(uint32_t addr, uint8_t state)
+{
+    return fl_write(addr + offsetof(record_t, state), &state, 1);
+}
+
+static int erase_sector(uint32_t s)
+{
+    sector_t *sec = &s_sectors[s];
+    if (s_flash->erase(s_flash, s * CRED_FLASH_SECTOR) != 0) return CRED_STORE_ERR_IO;
+    sec->erases++;
+    sec->seq = SEQ_NONE;
+    sec->next = 1;
+    sec->live = 0;
+    sec->dead = 0;
+    // the header keeps the erase count for wear statistics
+    sector_hdr_t h = { .magic = SECTOR_MAGIC, .erases = sec->erases, .seq = SEQ_NONE };
+    sec->formatted = fl_write(s * CRED_FLASH_SECTOR, &h, sizeof(h)) == 0;
+    return 0;
+}
+
+static uint32_t free_sectors(void)
+{
+    uint32_t n = 0;
+    for (uint32_t s = 0; s < s_nsectors; s++) {
+        if (s_sectors[s].seq == SEQ_NONE) n++;
+    }
+    return n;
+}
+
+// Next erased sector after the head in ring order, so erases go round the
+// whole partition instead of wearing out the first few sectors.
+static uint32_t next_erased(void)
+{
+    uint32_t start = s_head == SEQ_NONE ? 0 : s_head + 1;
+    for (uint32_t i = 0; i < s_nsectors; i++) {
+        uint32_t s = (start + i) % s_nsectors;
+        if (s_sectors[s].seq == SEQ_NONE) return s;
+    }
+    return SEQ_NONE;
+}
+
+static int open_sector(uint32_t s)
+{
+    sector_t *sec = &s_sectors[s];
+    uint32_t base = s * CRED_FLASH_SECTOR;
+    if (!sec->formatted) {
+        sector_hdr_t h = { .magic = SECTOR_MAGIC, .erases = sec->erases, .seq = SEQ_NONE };
+        if (fl_write(base, &h, sizeof(h)) != 0) return CRED_STORE_ERR_IO;
+        sec->formatted = true;
+    }
+    uint32_t seq = s_seq + 1;
+    // a torn header can leave a huge seq behind; never hand out "unopened"
+    if (seq == SEQ_NONE) seq = 1;
+    if (fl_write(base + offsetof(sector_hdr_t, seq), &seq, sizeof(seq)) != 0) return CRED_STORE_ERR_IO;
+    s_seq = seq;
+    sec->seq = seq;
+    s_head = s;
+    return 0;
+}
+
+// A slot at the end of the log. Keeps one erased sector back for GC.
+static int alloc_slot(uint32_t *addr)
+{
+    if (s_head == SEQ_NONE || s_sectors[s_head].next >= SLOTS) {
+        if (free_sectors() <= 1) return CRED_STORE_ERR_FULL;
+        int rc = open_sector(next_erased());
+        if (rc != 0) return rc;
+    }
+    sector_t *sec = &s_sectors[s_head];
+    *addr = s_head * CRED_FLASH_SECTOR + sec->next * CRED_FLASH_SLOT;
+    sec->next++;
+    // dead until committed; write_record() moves it to live
+    sec->dead++;
+    return 0;
+}
+
+// BEGUN, body, VALID: a cut before the last step leaves a dead slot.
+static int write_record(uint32_t addr, record_t *r)
+{
+    r->state = ST_BEGUN;
+    memset(r->tally, 0xFF, sizeof(r->tally));
+    r->crc = crc32((const uint8_t *)r + CRC_FROM, CRC_TO - CRC_FROM);
+    int rc = set_state(addr, ST_BEGUN);
+    if (rc == 0) rc = fl_write(addr + CRC_FROM, (const uint8_t *)r + CRC_FROM,
+                               offsetof(record_t, tally) - CRC_FROM);
+    if (rc == 0) rc = set_state(addr, ST_VALID);
+    if (rc != 0) return rc;
+    sector_t *sec = &s_sectors[addr / CRED_FLASH_SECTOR];
+    sec->dead--;
+    sec->live++;
+    return 0;
+}
+
+static int kill_record(uint32_t addr)
+{
+    sector_t *sec = &s_sectors[addr / CRED_FLASH_SECTOR];
+    sec->live--;
+    sec->dead++;
+    return set_state(addr, ST_DELETED);
+}
+
+static bool record_ok(const record_t *r)
+{
+    return r->state == ST_VALID &&
+           (r->kind == KIND_CRED || r->kind == KIND_DEVICE || r->kind == KIND_PIN) &&
+           r->user_id_len <= CRED_STORE_USER_ID_MAX &&
+           r->crc == crc32((const uint8_t *)r + CRC_FROM, CRC_TO - CRC_FROM);
+}
+
+static unsigned tally_of(const record_t *r)
+{
+    unsigned n = 0;
+    for (size_t i = 0; i < sizeof(r->tally); i++) {
+        n += 8u - (unsigned)__builtin_popcount(r->tally[i]);
+    }
+    return n;
+}
+
+// ---- index ----
+
+static void index_reset(void)
+{
+    memset(s_entries, 0, sizeof(s_entries));
+    for (uint32_t i = 0; i < CRED_STORE_MAX; i++) {
+        s_buckets[i] = NIL;
+        s_entries[i].next = (uint16_t)(i + 1 < CRED_STORE_MAX ? i + 1 : NIL);
+    }
+    s_free = 0;
+    s_live = 0;
+}
+
+static int index_add(const record_t *r, uint32_t addr)
+{
+    if (s_free == NIL) return CRED_STORE_ERR_FULL;
+    uint16_t i = s_free;
+    entry_t *e = &s_entries[i];
+    s_free = e->next;
+
+    uint32_t b = bucket_of(r->rp_id_hash);
+    unsigned tally = tally_of(r);
+    *e = (entry_t){
+        .addr = addr,
+        .serial = r->serial,
+        .count = r->count_base + tally,
+        .rp_tag = le32(r->rp_id_hash + 4),
+        .id_tag = id_tag(r->id),
+        .next = s_buckets[b],
+        .tally = (uint16_t)tally,
+        .resident = r->resident,
+        .used = true,
+    };
+    s_buckets[b] = i;
+    s_live++;
+    return i;
+}
+
+static void index_remove(int handle, const uint8_t *rp_id_hash)
+{
+    uint16_t *link = &s_buckets[bucket_of(rp_id_hash)];
+    while (*link != NIL && *link != handle) link = &s_entries[*link].next;
+    if (*link == NIL) return;
+    entry_t *e = &s_entries[handle];
+    *link = e->next;
+    e->used = false;
+    e->next = s_free;
+    s_free = (uint16_t)handle;
+    s_live--;
+}
+
+static entry_t *entry(int handle)
+{
+    if (!s_flash || handle < 0 || handle >= CRED_STORE_MAX || !s_entries[handle].used) return NULL;
+    return &s_entries[handle];
+}
+
+static single_t *single(uint8_t kind)
+{
+    return kind == KIND_DEVICE ? &s_device : kind == KIND_PIN ? &s_pin : NULL;
+}
+
+static void single_set(single_t *one, const record_t *r, uint32_t addr)
+{
+    unsigned tally = tally_of(r);
+    one->e = (entry_t){
+        .addr = addr,
+        .serial = r->serial,
+        .count = r->count_base + tally,
+        .next = NIL,
+        .tally = (uint16_t)tally,
+        .used = true,
+    };
+    memcpy(one->data, r->priv, sizeof(one->data));
+}
+
+static void singles_clear(void)
+{
+    memset(&s_device, 0, sizeof(s_device));
+    memset(&s_pin, 0, sizeof(s_pin));
+}
+
+static bool same_rp(const entry_t *e, const uint8_t *rp_id_hash)
+{
+    uint8_t rp[CRED_STORE_RP_HASH_LEN];
+    return e->rp_tag == le32(rp_id_hash + 4) &&
+           fl_read(e->addr + offsetof(record_t, rp_id_hash), rp, sizeof(rp)) == 0 &&
+           memcmp(rp, rp_id_hash, sizeof(rp)) == 0;
+}
+
+static int lookup(const uint8_t *rp_id_hash, const uint8_t *id)
+{
+    uint32_t tag = le32(rp_id_hash + 4);
+    uint16_t itag = id_tag(id);
+    for (uint16_t i = s_buckets[bucket_of(rp_id_hash)]; i != NIL; i = s_entries[i].next) {
+        const entry_t *e = &s_entries[i];
+        if (e->rp_tag != tag || e->id_tag != itag) continue;
+        // tags matched; id and rpIdHash are adjacent in the record
+        uint8_t key[CRED_STORE_ID_LEN + CRED_STORE_RP_HASH_LEN];
+        if (fl_read(e->addr + offsetof(record_t, id), key, sizeof(key)) != 0) continue;
+        if (memcmp(key, id, CRED_STORE_ID_LEN) == 0 &&
+            memcmp(key + CRED_STORE_ID_LEN, rp_id_hash, CRED_STORE_RP_HASH_LEN) == 0) {
+            return i;
+        }
+    }
+    return CRED_STORE_NONE;
+}
+
+// ---- mount ----
+
+static int scan_sector(uint32_t s)
+{
+    sector_t *sec = &s_sectors[s];
+    record_t r;
+
+    for (uint32_t slot = 1; slot < SLOTS; slot++) {
+        uint32_t addr = s * CRED_FLASH_SECTOR + slot * CRED_FLASH_SLOT;
+        if (fl_read(addr, &r, sizeof(r)) != 0) return CRED_STORE_ERR_IO;
+        if (all_ff(&r, sizeof(r))) continue;
+        sec->next = (uint8_t)(slot + 1);
+        if (!record_ok(&r)) {
+            sec->dead++;
+            continue;
+        }
+        if (r.serial > s_serial) s_serial = r.serial;
+
+        single_t *one = single(r.kind);
+        if (one) {
+            sec->live++;
+            if (!one->e.used) {
+                single_set(one, &r, addr);
+                continue;
+            }
+            // A replacement or a move was cut before the old copy went: the
+            // later record wins, then the higher counter.
+            uint32_t count = r.count_base + tally_of(&r);
+            uint32_t loser = addr;
+            if (r.serial > one->e.serial ||
+                (r.serial == one->e.serial && count > one->e.count)) {
+                loser = one->e.addr;
+                single_set(one, &r, addr);
+            }
+            if (kill_record(loser) != 0) return CRED_STORE_ERR_IO;
+            continue;
+        }
+
+        // Two copies: a move (GC or tally rollover) was cut before it
+        // deleted the old one. Both are complete; keep the higher counter.
+        int dup = lookup(r.rp_id_hash, r.id);
+        if (dup >= 0) {
+            entry_t *e = &s_entries[dup];
+            uint32_t count = r.count_base + tally_of(&r);
+            uint32_t loser = addr;
+            if (count > e->count) {
+                loser = e->addr;
+                e->addr = addr;
+                e->count = count;
+                e->tally = (uint16_t)tally_of(&r);
+            }
+            sec->live++;
+            if (kill_record(loser) != 0) return CRED_STORE_ERR_IO;
+            continue;
+        }
+        // more records than the index holds: only possible with a flash
+        // written by a build with a bigger CRED_STORE_MAX
+        if (index_add(&r, addr) < 0) {
+            sec->dead++;
+            continue;
+        }
+        sec->live++;
+    }
+    return 0;
+}
+
+int cred_store_mount(const cred_flash_t *flash)
+{
+    s_flash = NULL;
+    index_reset();
+    memset(s_sectors, 0, sizeof(s_sectors));
+    s_head = SEQ_NONE;
+    s_seq = 0;
+    s_serial = 0;
+    s_gc_runs = 0;
+    s_gc_moved = 0;
+    singles_clear();
+    if (!flash) return 0;
+
+    s_flash = flash;
+    s_nsectors = flash->size / CRED_FLASH_SECTOR;
+    if (s_nsectors > MAX_SECTORS) s_nsectors = MAX_SECTORS;
+    if (s_nsectors < 2) {
+        s_flash = NULL;
+        return CRED_STORE_ERR_IO;
+    }
+
+    for (uint32_t s = 0; s < s_nsectors; s++) {
+        sector_t *sec = &s_sectors[s];
+        sector_hdr_t h;
+        sec->next = 1;
+        sec->seq = SEQ_NONE;
+        if (fl_read(s * CRED_FLASH_SECTOR, &h, sizeof(h)) != 0) goto fail;
+
+        if (h.magic == SECTOR_MAGIC) {
+            sec->erases = h.erases;
+            sec->formatted = true;
+            if (h.seq == SEQ_NONE) continue;
+            sec->seq = h.seq;
+            if (h.seq > s_seq) {
+                s_seq = h.seq;
+                s_head = s;
+            }
+            if (scan_sector(s) != 0) goto fail;
+            continue;
+        }
+
+        // Unformatted is fine if the sector is blank; anything else is an
+        // erase that was cut short.
+        uint8_t buf[CRED_FLASH_SLOT];
+        bool blank = true;
+        for (uint32_t off = 0; blank && off < CRED_FLASH_SECTOR; off += sizeof(buf)) {
+            if (fl_read(s * CRED_FLASH_SECTOR + off, buf, sizeof(buf)) != 0) goto fail;
+            blank = all_ff(buf, sizeof(buf));
+        }
+        if (!blank && erase_sector(s) != 0) goto fail;
+    }
+    return 0;
+
+fail:
+    s_flash = NULL;
+    index_reset();
+    singles_clear();
+    return CRED_STORE_ERR_IO;
+}
+
+const cred_flash_t *cred_store_flash(void)
+{
+    return s_flash;
+}
+
+// ---- garbage collection ----
+
+// Copies a live record to the end of the log with its counter folded into
+// count_base and a fresh tally, then deletes the old copy.
+static int move_record(entry_t *e, uint32_t count)
+{
+    record_t r;
+    uint32_t dst;
+    int rc = fl_read(e->addr, &r, sizeof(r));
+    if (rc != 0) return rc;
+    rc = alloc_slot(&dst);
+    if (rc != 0) return rc;
+    r.count_base = count;
+    rc = write_record(dst, &r);
+    memset(&r, 0, sizeof(r));
+    if (rc != 0) return rc;
+    rc = kill_record(e->addr);
+    e->addr = dst;
+    e->count = count;
+    e->tally = 0;
+    return rc;
+}
+
+static uint32_t pick_victim(void)
+{
+    uint32_t best = SEQ_NONE;
+    for (uint32_t s = 0; s < s_nsectors; s++) {
+        const sector_t *sec = &s_sectors[s];
+        if (sec->seq == SEQ_NONE || sec->dead == 0) continue;
+        if (s == s_head && sec->next < SLOTS) continue;
+        // most garbage first; among equals the oldest
+        if (best == SEQ_NONE || sec->dead > s_sectors[best].dead ||
+            (sec->dead == s_sectors[best].dead && sec->seq < s_sectors[best].seq)) {
+            best = s;
+        }
+    }
+    return best;
+}
+
+static int gc_sector(uint32_t victim)
+{
+    // the spare sector becomes the head and takes the survivors
+    uint32_t dst = next_erased();
+    if (dst == SEQ_NONE) return CRED_STORE_ERR_FULL;
+    int rc = open_sector(dst);
+    if (rc != 0) return rc;
+
+    record_t r;
+    for (uint32_t slot = 1; slot < s_sectors[victim].next && s_sectors[victim].live; slot++) {
+        uint32_t addr = victim * CRED_FLASH_SECTOR + slot * CRED_FLASH_SLOT;
+        if ((rc = fl_read(addr, &r, sizeof(r))) != 0) break;
+        if (r.state != ST_VALID) continue;
+        single_t *one = single(r.kind);
+        entry_t *e = one ? &one->e : NULL;
+        if (!one) {
+            int h = lookup(r.rp_id_hash, r.id);
+            e = h >= 0 ? &s_entries[h] : NULL;
+        }
+        if (!e || !e->used || e->addr != addr) continue;
+        if ((rc = move_record(e, e->count)) != 0) break;
+        s_gc_moved++;
+    }
+    memset(&r, 0, sizeof(r));
+    if (rc != 0) return rc;
+
+    rc = erase_sector(victim);
+    if (rc == 0) s_gc_runs++;
+    return rc;
+}
+
+int cred_store_gc(void)
+{
+    if (!s_flash) return CRED_STORE_ERR_IO;
+    // only when the next append would need it: every erase costs wear
+    bool head_room = s_head != SEQ_NONE && s_sectors[s_head].next < SLOTS;
+    if (head_room || free_sectors() > 1) return 0;
+    uint32_t victim = pick_victim();
+    if (victim == SEQ_NONE) return 0;
+    int rc = gc_sector(victim);
+    return rc == 0 ? 1 : rc;
+}
+
+static int alloc_or_gc(uint32_t *addr)
+{
+    int rc = alloc_slot(addr);
+    if (rc != CRED_STORE_ERR_FULL) return rc;
+    rc = cred_store_gc();
+    if (rc < 0) return rc;
+    return rc == 1 ? alloc_slot(addr) : CRED_STORE_ERR_FULL;
+}
+
+// ---- public operations ----
+
+int cred_store_find(const uint8_t rp_id_hash[CRED_STORE_RP_HASH_LEN],
+                    const uint8_t *id, size_t id_len)
+{
+    if (!s_flash || id_len != CRED_STORE_ID_LEN) return CRED_STORE_NONE;
+    return lookup(rp_id_hash, id);
+}
+
+int cred_store_next_resident(const uint8_t rp_id_hash[CRED_STORE_RP_HASH_LEN], int after)
+{
+    if (!s_flash) return CRED_STORE_NONE;
+    const entry_t *prev = after >= 0 ? entry(after) : NULL;
+    if (after >= 0 && !prev) return CRED_STORE_NONE;
+
+    // per-RP chains are short: pick the newest one older than `after`
+    int best = CRED_STORE_NONE;
+    for (uint16_t i = s_buckets[bucket_of(rp_id_hash)]; i != NIL; i = s_entries[i].next) {
+        const entry_t *e = &s_entries[i];
+        if (!e->resident || (prev && e->serial >= prev->serial)) continue;
+        if (best >= 0 && e->serial <= s_entries[best].serial) continue;
+        if (same_rp(e, rp_id_hash)) best = i;
+    }
+    return best;
+}
+
+int cred_store_read(int handle, cred_store_cred_t *out)
+{
+    const entry_t *e = entry(handle);
+    if (!e) return CRED_STORE_NONE;
+    record_t r;
+    int rc = fl_read(e->addr, &r, sizeof(r));
+    if (rc == 0 && !record_ok(&r)) rc = CRED_STORE_ERR_IO;
+    if (rc == 0) {
+        memcpy(out->id, r.id, sizeof(out->id));
+        memcpy(out->rp_id_hash, r.rp_id_hash, sizeof(out->rp_id_hash));
+        memcpy(out->priv, r.priv, sizeof(out->priv));
+        memcpy(out->user_id, r.user_id, sizeof(out->user_id));
+        out->user_id_len = r.user_id_len;
+        out->resident = r.resident;
+        out->sign_count = e->count;
+    }
+    memset(&r, 0, sizeof(r));
+    return rc;
+}
+
+int cred_store_insert(const cred_store_cred_t *cred)
+{
+    if (!s_flash) return CRED_STORE_ERR_IO;
+    if (cred_store_full() || cred->user_id_len > CRED_STORE_USER_ID_MAX) return CRED_STORE_ERR_FULL;
+
+    uint32_t addr;
+    int rc = alloc_or_gc(&addr);
+    if (rc != 0) return rc;
+
+    record_t r;
+    memset(&r, 0xFF, sizeof(r));
+    r.kind = KIND_CRED;
+    r.user_id_len = cred->user_id_len;
+    r.resident = cred->resident ? 1 : 0;
+    r.serial = s_serial + 1;
+    r.count_base = cred->sign_count;
+    memcpy(r.id, cred->id, sizeof(r.id));
+    memcpy(r.rp_id_hash, cred->rp_id_hash, sizeof(r.rp_id_hash));
+    memcpy(r.priv, cred->priv, sizeof(r.priv));
+    memcpy(r.user_id, cred->user_id, cred->user_id_len);
+    rc = write_record(addr, &r);
+    if (rc == 0) {
+        s_serial = r.serial;
+        rc = index_add(&r, addr);
+    }
+    memset(&r, 0, sizeof(r));
+    return rc;
+}
+
+int cred_store_delete(int handle)
+{
+    entry_t *e = entry(handle);
+    if (!e) return CRED_STORE_NONE;
+    uint8_t rp[CRED_STORE_RP_HASH_LEN];
+    int rc = fl_read(e->addr + offsetof(record_t, rp_id_hash), rp, sizeof(rp));
+    if (rc == 0) rc = kill_record(e->addr);
+    if (rc == 0) index_remove(handle, rp);
+    return rc;
+}
+
+static int bump(entry_t *e, uint32_t *count)
+{
+    uint32_t next = e->count + 1;
+    int rc;
+
+    if (e->tally < TALLY_BITS) {
+        // clear the next bit: FF, FE, FC, ... 00 within each byte
+        uint8_t b = (uint8_t)(0xFFu << (e->tally % 8 + 1));
+        rc = fl_write(e->addr + offsetof(record_t, tally) + e->tally / 8, &b, 1);
+        if (rc == 0) {
+            e->tally++;
+            e->count = next;
+        }
+    } else {
+        // tally used up: a fresh copy carries the counter on
+        rc = move_record(e, next);
+        if (rc == CRED_STORE_ERR_FULL && cred_store_gc() == 1) rc = move_record(e, next);
+    }
+    if (rc == 0) *count = next;
+    return rc;
+}
+
+int cred_store_bump(int handle, uint32_t *count)
+{
+    entry_t *e = entry(handle);
+    return e ? bump(e, count) : CRED_STORE_NONE;
+}
+
+int cred_store_bump_device(uint32_t *count)
+{
+    return s_flash && s_device.e.used ? bump(&s_device.e, count) : CRED_STORE_NONE;
+}
+
+int cred_store_device_secret(uint8_t out[CRED_STORE_PRIV_LEN])
+{
+    if (!s_flash || !s_device.e.used) return CRED_STORE_NONE;
+    memcpy(out, s_device.data, sizeof(s_device.data));
+    return 0;
+}
+
+// Writes `kind`'s record anew with `data` and its counter at 0, then drops
+// the old one.
+static int single_replace(uint8_t kind, const uint8_t *data, size_t len)
+{
+    single_t *one = single(kind);
+    if (!s_flash) return CRED_STORE_ERR_IO;
+    uint32_t addr;
+    int rc = alloc_or_gc(&addr);
+    if (rc != 0) return rc;
+
+    record_t r;
+    memset(&r, 0xFF, sizeof(r));
+    r.kind = kind;
+    r.user_id_len = 0;
+    r.resident = 0;
+    r.serial = s_serial + 1;
+    r.count_base = 0;
+    memset(r.priv, 0, sizeof(r.priv));
+    memcpy(r.priv, data, len);
+    rc = write_record(addr, &r);
+    if (rc == 0) {
+        // the new copy is complete: a cut from here on still keeps it
+        uint32_t old = one->e.addr;
+        bool had = one->e.used;
+        s_serial = r.serial;
+        single_set(one, &r, addr);
+        if (had) rc = kill_record(old);
+    }
+    memset(&r, 0, sizeof(r));
+    return rc;
+}
+
+int cred_store_set_device_secret(const uint8_t secret[CRED_STORE_PRIV_LEN])
+{
+    return single_replace(KIND_DEVICE, secret, CRED_STORE_PRIV_LEN);
+}
+
+int cred_store_pin(uint8_t hash[CRED_STORE_PIN_HASH_LEN], uint32_t *failures)
+{
+    if (!s_flash || !s_pin.e.used) return CRED_STORE_NONE;
+    memcpy(hash, s_pin.data, CRED_STORE_PIN_HASH_LEN);
+    *failures = s_pin.e.count;
+    return 0;
+}
+
+int cred_store_set_pin(const uint8_t hash[CRED_STORE_PIN_HASH_LEN])
+{
+    return single_replace(KIND_PIN, hash, CRED_STORE_PIN_HASH_LEN);
+}
+
+int cred_store_pin_attempt(uint32_t *failures)
+{
+    return s_flash && s_pin.e.used ? bump(&s_pin.e, failures) : CRED_STORE_NONE;
+}
+
+int cred_store_wipe(void)
+{
+    const cred_flash_t *flash = s_flash;
+    if (!flash) return CRED_STORE_ERR_IO;
+    int rc = 0;
+    for (uint32_t s = 0; s < s_nsectors && rc == 0; s++) {
+        if (s_sectors[s].seq != SEQ_NONE || s_sectors[s].next > 1) rc = erase_sector(s);
+    }
+    // remount to drop the index (and to pick up a partial wipe)
+    int mrc = cred_store_mount(flash);
+    return rc != 0 ? rc : mrc;
+}
+
+size_t cred_store_count(void)
+{
+    return s_flash ? s_live : 0;
+}
+
+bool cred_store_full(void)
+{
+    return !s_flash || s_live >= capacity() || s_free == NIL;
+}
+
+void cred_store_get_stats(cred_store_stats_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    if (!s_flash) return;
+    out->live = s_live;
+    out->capacity = capacity();
+    out->sectors = s_nsectors;
+    out->erase_min = UINT32_MAX;
+    for (uint32_t s = 0; s < s_nsectors; s++) {
+        const sector_t *sec = &s_sectors[s];
+        out->dead += sec->dead;
+        out->free += sec->seq == SEQ_NONE ? (uint32_t)CRED_STORE_PER_SECTOR : (uint32_t)(SLOTS - sec->next);
+        if (sec->erases < out->erase_min) out->erase_min = sec->erases;
+        if (sec->erases > out->erase_max) out->erase_max = sec->erases;
+    }
+    out->gc_runs = s_gc_runs;
+    out->gc_moved = s_gc_moved;
+}
@@ -0,0 +1,65 @@
+// cred_flash_t over the "creds" data partition (docs/setup/OTA/partitions.csv).
+// The partition must not be flash-encrypted: the store clears bits of
+// records in place, which encrypted writes can't do.
+
+#include "cred_store.h"
+
+#include "esp_log.h"
+#include "esp_partition.h"
+
+static const char *TAG = "cred_store";
+
+// subtype 0x40 in partitions.csv: first of the custom data subtypes
+#define CRED_PARTITION_SUBTYPE 0x40
+
+static cred_flash_t s_part_flash;
+static cred_flash_ram_t s_ram;
+
+static int part_read(const cred_flash_t *f, uint32_t addr, void *dst, size_t len)
+{
+    return esp_partition_read(f->user, addr, dst, len) == ESP_OK ? 0 : -1;
+}
+
+static int part_write(const cred_flash_t *f, uint32_t addr, const void *src, size_t len)
+{
+    return esp_partition_write(f->user, addr, src, len) == ESP_OK ? 0 : -1;
+}
+
+static int part_erase(const cred_flash_t *f, uint32_t addr)
+{
+    return esp_partition_erase_range(f->user, addr, CRED_FLASH_SECTOR) == ESP_OK ? 0 : -1;
+}
+
+int cred_store_init(void)
+{
+    const esp_partition_t *part = esp_partition_find_first(
+        ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)CRED_PARTITION_SUBTYPE,
+        CONFIG_CRED_STORE_PARTITION);
+    if (!part) {
+        ESP_LOGW(TAG, "no '%s' partition; credentials kept in RAM until reboot",
+                 CONFIG_CRED_STORE_PARTITION);
+        if (cred_flash_ram_init(&s_ram, 4 * CRED_FLASH_SECTOR) != 0) return -1;
+        return cred_store_mount(&s_ram.flash);
+    }
+    if (part->encrypted) {
+        ESP_LOGE(TAG, "'%s' is encrypted; not usable", part->label);
+        return -1;
+    }
+
+    s_part_flash = (cred_flash_t){
+        .read = part_read,
+        .write = part_write,
+        .erase = part_erase,
+        .size = (uint32_t)part->size,
+        .user = (void *)part,
+    };
+    int rc = cred_store_mount(&s_part_flash);
+    if (rc == 0) {
+        cred_store_stats_t st;
+        cred_store_get_stats(&st);
+        ESP_LOGI(TAG, "%u credentials, %u free slots, erases %u..%u",
+                 (unsigned)st.live, (unsigned)st.free,
+                 (unsigned)st.erase_min, (unsigned)st.erase_max);
+    }
+    return rc;
+}
@@ -0,0 +1,195 @@
+#pragma once
+// Credential store for the Rust core (see core/rust/src/ctap2/credentials.rs):
+// an append-only log of fixed-size records on a dedicated flash partition,
+// with a hash index in RAM keyed by rpIdHash. Lookups touch flash only to
+// confirm a tag match and read the one record; mounting replays the log.
+//
+// Flash layout: 4 KiB sectors of 16 slots of 256 bytes. Slot 0 is the
+// sector header (magic, erase count, log sequence); slots 1..15 hold
+// credential records. A record is written as BEGUN, filled, then flipped to
+// VALID, and deleted by clearing its state byte; the signature counter
+// advances by clearing bits of a tally inside the record. Every update only
+// clears bits, so no record is rewritten in place and a power cut leaves
+// either the old or the new state. One sector is always kept erased so that
+// garbage collection can move live records out of the sector it reclaims.
+//
+// Besides credentials the log holds one device record: the secret that
+// non-resident credential IDs are wrapped under (see
+// core/rust/src/ctap2/key_wrap.rs) and the signature counter those
+// credentials share; and one PIN record: the ClientPIN hash, with the failed
+// attempts counted on the same kind of tally. Both are kept in RAM once
+// mounted and go with a wipe.
+//
+// Not thread-safe: the core calls it from the CTAPHID worker only.
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CRED_STORE_ID_LEN       16
+#define CRED_STORE_RP_HASH_LEN  32
+#define CRED_STORE_PRIV_LEN     32
+#define CRED_STORE_USER_ID_MAX  64
+#define CRED_STORE_PIN_HASH_LEN 16   // LEFT(SHA-256(PIN), 16)
+
+#define CRED_FLASH_SECTOR       4096u
+#define CRED_FLASH_SLOT         256u
+#define CRED_STORE_PER_SECTOR   (CRED_FLASH_SECTOR / CRED_FLASH_SLOT - 1)
+
+// Index capacity, and so the most credentials one mount can hold whatever
+// the partition size.
+#ifndef CRED_STORE_MAX
+#ifdef CONFIG_CRED_STORE_MAX
+#define CRED_STORE_MAX CONFIG_CRED_STORE_MAX
+#else
+#define CRED_STORE_MAX 256
+#endif
+#endif
+
+// cred_store_* error returns
+#define CRED_STORE_ERR_IO    (-1)   // flash failed or store not mounted
+#define CRED_STORE_ERR_FULL  (-2)
+#define CRED_STORE_NONE      (-3)   // no such credential
+
+/**
+ * NOR flash as the store needs it: erase sets a whole sector to 0xFF,
+ * write can only clear bits. `size` is a multiple of CRED_FLASH_SECTOR.
+ * cred_store_flash_esp.c wraps an esp_partition; cred_flash_ram.c keeps
+ * the image in RAM for the host and the benchmarks.
+ */
+typedef struct cred_flash {
+    int (*read)(const struct cred_flash *f, uint32_t addr, void *dst, size_t len);
+    int (*write)(const struct cred_flash *f, uint32_t addr, const void *src, size_t len);
+    int (*erase)(const struct cred_flash *f, uint32_t addr);   // one sector
+    uint32_t size;
+    void *user;
+} cred_flash_t;
+
+typedef struct {
+    uint8_t id[CRED_STORE_ID_LEN];
+    uint8_t rp_id_hash[CRED_STORE_RP_HASH_LEN];
+    uint8_t priv[CRED_STORE_PRIV_LEN];
+    uint8_t user_id[CRED_STORE_USER_ID_MAX];
+    uint8_t user_id_len;
+    uint8_t resident;       // discoverable (rk): found without an allowList
+    uint32_t sign_count;
+} cred_store_cred_t;
+
+/**
+ * Replays the log on `flash` into the index, repairs what a power cut left
+ * behind (unfinished records, duplicate copies from an interrupted move,
+ * half-erased sectors) and makes `flash` the current store. `flash` must
+ * outlive the mount. 0 on success.
+ */
+int cred_store_mount(const cred_flash_t *flash);
+
+/** The flash mounted now, or NULL. */
+const cred_flash_t *cred_store_flash(void);
+
+/** Handle of credential `id` made for `rp_id_hash`, or CRED_STORE_NONE. */
+int cred_store_find(const uint8_t rp_id_hash[CRED_STORE_RP_HASH_LEN],
+                    const uint8_t *id, size_t id_len);
+
+/**
+ * Discoverable credentials of `rp_id_hash`, newest first: pass -1 to get
+ * the first handle and the previous handle to get the next one.
+ * CRED_STORE_NONE after the last.
+ */
+int cred_store_next_resident(const uint8_t rp_id_hash[CRED_STORE_RP_HASH_LEN], int after);
+
+/** Reads the record behind `handle`, with its current signature counter. */
+int cred_store_read(int handle, cred_store_cred_t *out);
+
+/** Appends `cred`, collecting garbage first if needed. Handle or error. */
+int cred_store_insert(const cred_store_cred_t *cred);
+
+int cred_store_delete(int handle);
+
+/** Advances the signature counter of `handle` and stores the new value in
+ *  *count. 0 on success. */
+int cred_store_bump(int handle, uint32_t *count);
+
+/** Copies the device secret out of RAM. CRED_STORE_NONE until one is set. */
+int cred_store_device_secret(uint8_t out[CRED_STORE_PRIV_LEN]);
+
+/** Stores a new device secret, with its counter at 0, in place of the old
+ *  one. 0 on success. */
+int cred_store_set_device_secret(const uint8_t secret[CRED_STORE_PRIV_LEN]);
+
+/** cred_store_bump for the device record's counter. */
+int cred_store_bump_device(uint32_t *count);
+
+/** The PIN hash and the attempts counted as failed since it was last
+ *  stored. CRED_STORE_NONE while no PIN is set. */
+int cred_store_pin(uint8_t hash[CRED_STORE_PIN_HASH_LEN], uint32_t *failures);
+
+/** Stores `hash` as the PIN, with no failed attempts. A correct PIN is
+ *  stored again to clear the count. 0 on success. */
+int cred_store_set_pin(const uint8_t hash[CRED_STORE_PIN_HASH_LEN]);
+
+/** Counts an attempt as failed before the PIN is checked, so cutting the
+ *  power on a wrong guess can't save the retry; new total in *failures. */
+int cred_store_pin_attempt(uint32_t *failures);
+
+/** Erases every sector: all credentials, the device secret and the PIN are gone.
+ *  0 on success. */
+int cred_store_wipe(void);
+
+/**
+ * Reclaims the sector with the most dead records if that frees space.
+ * Inserts do this on their own when the log is full; calling it while idle
+ * takes the cost off a later MakeCredential. 1 if a sector was reclaimed,
+ * 0 if there was nothing worth doing, negative on error.
+ */
+int cred_store_gc(void);
+
+size_t cred_store_count(void);
+
+/** No room for another credential, even after garbage collection. */
+bool cred_store_full(void);
+
+typedef struct {
+    uint32_t live;          // credentials
+    uint32_t dead;          // deleted or superseded records not yet reclaimed
+    uint32_t free;          // slots ready to write
+    uint32_t capacity;      // most credentials this mount can hold
+    uint32_t sectors;
+    uint32_t erase_min;     // per-sector erase counts, for wear
+    uint32_t erase_max;
+    uint32_t gc_runs;       // since mount
+    uint32_t gc_moved;      // records copied by those runs
+} cred_store_stats_t;
+
+void cred_store_get_stats(cred_store_stats_t *out);
+
+/**
+ * RAM-backed flash with NOR semantics (writes AND into the image, erase
+ * fills with 0xFF). `cut_after` >= 0 simulates a power cut after that many
+ * bytes (an erase counts as a sector): the operation in progress stops
+ * part-way and every later one is dropped while reporting success.
+ */
+typedef struct {
+    cred_flash_t flash;
+    uint8_t *mem;
+    long cut_after;
+    bool cut;               // set once the cut has happened
+} cred_flash_ram_t;
+
+/** `size` is rounded up to whole sectors; the image starts erased. */
+int cred_flash_ram_init(cred_flash_ram_t *ram, uint32_t size);
+void cred_flash_ram_free(cred_flash_ram_t *ram);
+
+#ifdef ESP_PLATFORM
+/**
+ * Mounts the "creds" data partition. Without one, falls back to a RAM
+ * image so the device still works, losing credentials on reboot.
+ */
+int cred_store_init(void);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,45 @@
+#pragma once
+// Backend contract behind crypto.h: crypto_mbedtls.c on the device,
+// firmware/host/port/crypto_openssl.c on the host. crypto_pool.c builds the
+// public keygen/sign on top of these. Every function here may run on the
+// pool task and the CTAPHID worker at the same time.
+#include <stdint.h>
+
+#include "crypto.h"
+
+// A signing nonce k prepared ahead of time, blinded by a random t:
+//   r  = x(k·G) mod n
+//   tr = t·r mod n
+//   u  = (k·t)^-1 mod n
+// so that s = u·(t·e + tr·d) = k^-1·(e + r·d), and the private key d only
+// ever meets a random-looking multiplier.
+typedef struct {
+    uint8_t r[32];
+    uint8_t t[32];
+    uint8_t tr[32];
+    uint8_t u[32];
+} crypto_presig_t;
+
+int crypto_impl_keygen(uint8_t priv[CRYPTO_P256_PRIV_LEN], uint8_t pub[CRYPTO_P256_PUB_LEN]);
+
+/** Complete signature, scalar multiplication included. */
+int crypto_impl_sign(const uint8_t priv[CRYPTO_P256_PRIV_LEN],
+                     const uint8_t digest[CRYPTO_SHA256_LEN],
+                     uint8_t sig[CRYPTO_P256_SIG_LEN]);
+
+int crypto_impl_presign(crypto_presig_t *ps);
+
+/** Signature from a prepared nonce: modular arithmetic only. */
+int crypto_impl_sign_presig(const uint8_t priv[CRYPTO_P256_PRIV_LEN],
+                            const uint8_t digest[CRYPTO_SHA256_LEN],
+                            const crypto_presig_t *ps,
+                            uint8_t sig[CRYPTO_P256_SIG_LEN]);
+
+/** Monotonic microseconds, for the refill counters. */
+uint64_t crypto_impl_now_us(void);
+
+/** Overwrites secrets in a way the compiler can't drop. */
+void crypto_wipe(void *p, size_t len);
+
+/** Set by the pool task: called after a consumer took an entry. */
+void crypto_pool_set_waker(void (*wake)(void));
@@ -0,0 +1,340 @@
+// mbedTLS implementation of crypto.h / crypto_impl.h. With
+// CONFIG_MBEDTLS_HARDWARE_MPI and CONFIG_MBEDTLS_HARDWARE_SHA the bignum
+// multiplications and the digests run on the S3's accelerators, which
+// serialize concurrent users (pool task, CTAPHID worker) internally; with
+// CONFIG_MBEDTLS_HARDWARE_AES so does AES-GCM.
+
+#include "crypto.h"
+#include "crypto_impl.h"
+
+#include <stdbool.h>
+
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "mbedtls/aes.h"
+#include "mbedtls/ecdh.h"
+#include "mbedtls/ecdsa.h"
+#include "mbedtls/ecp.h"
+#include "mbedtls/gcm.h"
+#include "mbedtls/md.h"
+#include "mbedtls/sha256.h"
+
+// Loaded once and kept: with MBEDTLS_ECP_FIXED_POINT_OPTIM the group carries
+// the comb table for the base point, which is most of what makes keygen and
+// signing fast. Rebuilding it per call would double the cost.
+static mbedtls_ecp_group s_grp;
+static bool s_ready;
+
+static int rng(void *user, unsigned char *out, size_t len)
+{
+    (void)user;
+    esp_fill_random(out, len);
+    return 0;
+}
+
+int crypto_init(void)
+{
+    if (s_ready) return 0;
+    mbedtls_ecp_group_init(&s_grp);
+    if (mbedtls_ecp_group_load(&s_grp, MBEDTLS_ECP_DP_SECP256R1) != 0) {
+        mbedtls_ecp_group_free(&s_grp);
+        return -1;
+    }
+    s_ready = true;
+    return 0;
+}
+
+int crypto_random(uint8_t *out, size_t len)
+{
+    esp_fill_random(out, len);
+    return 0;
+}
+
+int crypto_sha256(const crypto_buf_t *parts, size_t n, uint8_t out[CRYPTO_SHA256_LEN])
+{
+    mbedtls_sha256_context sha;
+    int rc;
+
+    mbedtls_sha256_init(&sha);
+    rc = mbedtls_sha256_starts(&sha, 0);
+    for (size_t i = 0; rc == 0 && i < n; i++) {
+        rc = mbedtls_sha256_update(&sha, parts[i].p, parts[i].len);
+    }
+    if (rc == 0) rc = mbedtls_sha256_finish(&sha, out);
+    mbedtls_sha256_free(&sha);
+    return rc == 0 ? 0 : -1;
+}
+
+int crypto_hmac_sha256(const uint8_t key[CRYPTO_HMAC_KEY_LEN],
+                       const crypto_buf_t *parts, size_t n,
+                       uint8_t out[CRYPTO_SHA256_LEN])
+{
+    mbedtls_md_context_t md;
+    int rc;
+
+    mbedtls_md_init(&md);
+    rc = mbedtls_md_setup(&md, mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), 1);
+    if (rc == 0) rc = mbedtls_md_hmac_starts(&md, key, CRYPTO_HMAC_KEY_LEN);
+    for (size_t i = 0; rc == 0 && i < n; i++) {
+        rc = mbedtls_md_hmac_update(&md, parts[i].p, parts[i].len);
+    }
+    if (rc == 0) rc = mbedtls_md_hmac_finish(&md, out);
+    mbedtls_md_free(&md);   // zeroizes the padded key
+    return rc == 0 ? 0 : -1;
+}
+
+int crypto_aes_gcm_seal(const uint8_t key[CRYPTO_AES_KEY_LEN],
+                        const uint8_t iv[CRYPTO_GCM_IV_LEN],
+                        const uint8_t *aad, size_t aad_len,
+                        const uint8_t *in, uint8_t *out, size_t len,
+                        uint8_t tag[CRYPTO_GCM_TAG_LEN])
+{
+    mbedtls_gcm_context gcm;
+    int rc;
+
+    mbedtls_gcm_init(&gcm);
+    rc = mbedtls_gcm_setkey(&gcm, MBEDTLS_CIPHER_ID_AES, key, CRYPTO_AES_KEY_LEN * 8);
+    if (rc == 0) {
+        rc = mbedtls_gcm_crypt_and_tag(&gcm, MBEDTLS_GCM_ENCRYPT, len, iv, CRYPTO_GCM_IV_LEN,
+                                       aad, aad_len, in, out, CRYPTO_GCM_TAG_LEN, tag);
+    }
+    mbedtls_gcm_free(&gcm);
+    return rc == 0 ? 0 : -1;
+}
+
+int crypto_aes_gcm_open(const uint8_t key[CRYPTO_AES_KEY_LEN],
+                        const uint8_t iv[CRYPTO_GCM_IV_LEN],
+                        const uint8_t *aad, size_t aad_len,
+                        const uint8_t *in, uint8_t *out, size_t len,
+                        const uint8_t tag[CRYPTO_GCM_TAG_LEN])
+{
+    mbedtls_gcm_context gcm;
+    int rc;
+
+    mbedtls_gcm_init(&gcm);
+    rc = mbedtls_gcm_setkey(&gcm, MBEDTLS_CIPHER_ID_AES, key, CRYPTO_AES_KEY_LEN * 8);
+    // checks the tag in constant time and zeroes `out` on a mismatch
+    if (rc == 0) {
+        rc = mbedtls_gcm_auth_decrypt(&gcm, len, iv, CRYPTO_GCM_IV_LEN, aad, aad_len,
+                                      tag, CRYPTO_GCM_TAG_LEN, in, out);
+    }
+    mbedtls_gcm_free(&gcm);
+    return rc == 0 ? 0 : -1;
+}
+
+static int aes_cbc(const uint8_t *key, const uint8_t *iv, int mode,
+                   const uint8_t *in, uint8_t *out, size_t len)
+{
+    mbedtls_aes_context aes;
+    uint8_t chain[CRYPTO_AES_BLOCK_LEN];
+    int rc;
+
+    if (len % CRYPTO_AES_BLOCK_LEN) return -1;
+    // mbedTLS advances the IV in place
+    for (size_t i = 0; i < sizeof(chain); i++) chain[i] = iv[i];
+    mbedtls_aes_init(&aes);
+    rc = mode == MBEDTLS_AES_ENCRYPT ? mbedtls_aes_setkey_enc(&aes, key, CRYPTO_AES_KEY_LEN * 8)
+                                     : mbedtls_aes_setkey_dec(&aes, key, CRYPTO_AES_KEY_LEN * 8);
+    if (rc == 0) rc = mbedtls_aes_crypt_cbc(&aes, mode, len, chain, in, out);
+    mbedtls_aes_free(&aes);
+    return rc == 0 ? 0 : -1;
+}
+
+int crypto_aes_cbc_encrypt(const uint8_t key[CRYPTO_AES_KEY_LEN],
+                           const uint8_t iv[CRYPTO_AES_BLOCK_LEN],
+                           const uint8_t *in, uint8_t *out, size_t len)
+{
+    return aes_cbc(key, iv, MBEDTLS_AES_ENCRYPT, in, out, len);
+}
+
+int crypto_aes_cbc_decrypt(const uint8_t key[CRYPTO_AES_KEY_LEN],
+                           const uint8_t iv[CRYPTO_AES_BLOCK_LEN],
+                           const uint8_t *in, uint8_t *out, size_t len)
+{
+    return aes_cbc(key, iv, MBEDTLS_AES_DECRYPT, in, out, len);
+}
+
+int crypto_p256_ecdh(const uint8_t priv[CRYPTO_P256_PRIV_LEN],
+                     const uint8_t peer[CRYPTO_P256_PUB_LEN],
+                     uint8_t out[CRYPTO_P256_PRIV_LEN])
+{
+    mbedtls_mpi d, z;
+    mbedtls_ecp_point q;
+    uint8_t point[1 + CRYPTO_P256_PUB_LEN];
+    int rc;
+
+    if (crypto_init() != 0) return -1;
+    point[0] = 0x04;
+    for (size_t i = 0; i < CRYPTO_P256_PUB_LEN; i++) point[1 + i] = peer[i];
+    mbedtls_mpi_init(&d);
+    mbedtls_mpi_init(&z);
+    mbedtls_ecp_point_init(&q);
+
+    rc = mbedtls_ecp_point_read_binary(&s_grp, &q, point, sizeof(point));
+    // an off-curve point would leak the key through an invalid-curve attack
+    if (rc == 0) rc = mbedtls_ecp_check_pubkey(&s_grp, &q);
+    if (rc == 0) rc = mbedtls_mpi_read_binary(&d, priv, CRYPTO_P256_PRIV_LEN);
+    if (rc == 0) rc = mbedtls_ecdh_compute_shared(&s_grp, &z, &q, &d, rng, NULL);
+    if (rc == 0) rc = mbedtls_mpi_write_binary(&z, out, CRYPTO_P256_PRIV_LEN);
+
+    mbedtls_ecp_point_free(&q);
+    mbedtls_mpi_free(&z);
+    mbedtls_mpi_free(&d);
+    return rc == 0 ? 0 : -1;
+}
+
+int crypto_impl_keygen(uint8_t priv[CRYPTO_P256_PRIV_LEN], uint8_t pub[CRYPTO_P256_PUB_LEN])
+{
+    mbedtls_mpi d;
+    mbedtls_ecp_point q;
+    uint8_t point[1 + CRYPTO_P256_PUB_LEN];
+    size_t olen = 0;
+    int rc;
+
+    if (crypto_init() != 0) return -1;
+    mbedtls_mpi_init(&d);
+    mbedtls_ecp_point_init(&q);
+
+    rc = mbedtls_ecp_gen_keypair(&s_grp, &d, &q, rng, NULL);
+    if (rc == 0) rc = mbedtls_mpi_write_binary(&d, priv, CRYPTO_P256_PRIV_LEN);
+    if (rc == 0) {
+        rc = mbedtls_ecp_point_write_binary(&s_grp, &q, MBEDTLS_ECP_PF_UNCOMPRESSED,
+                                            &olen, point, sizeof(point));
+    }
+    if (rc == 0 && olen != sizeof(point)) rc = -1;
+    if (rc == 0) {
+        // drop the 0x04 uncompressed-point prefix
+        for (size_t i = 0; i < CRYPTO_P256_PUB_LEN; i++) pub[i] = point[1 + i];
+    }
+
+    mbedtls_ecp_point_free(&q);
+    mbedtls_mpi_free(&d);   // zeroizes
+    return rc == 0 ? 0 : -1;
+}
+
+int crypto_impl_sign(const uint8_t priv[CRYPTO_P256_PRIV_LEN],
+                     const uint8_t digest[CRYPTO_SHA256_LEN],
+                     uint8_t sig[CRYPTO_P256_SIG_LEN])
+{
+    mbedtls_mpi d, r, s;
+    int rc;
+
+    if (crypto_init() != 0) return -1;
+    mbedtls_mpi_init(&d);
+    mbedtls_mpi_init(&r);
+    mbedtls_mpi_init(&s);
+
+    rc = mbedtls_mpi_read_binary(&d, priv, CRYPTO_P256_PRIV_LEN);
+    // RFC 6979 nonce, so a weak RNG can't leak the key; the RNG only blinds.
+    if (rc == 0) {
+        rc = mbedtls_ecdsa_sign_det_ext(&s_grp, &r, &s, &d, digest, CRYPTO_SHA256_LEN,
+                                        MBEDTLS_MD_SHA256, rng, NULL);
+    }
+    if (rc == 0) rc = mbedtls_mpi_write_binary(&r, sig, 32);
+    if (rc == 0) rc = mbedtls_mpi_write_binary(&s, sig + 32, 32);
+
+    mbedtls_mpi_free(&s);
+    mbedtls_mpi_free(&r);
+    mbedtls_mpi_free(&d);
+    return rc == 0 ? 0 : -1;
+}
+
+// Presignatures take k and the blinding t from the hardware RNG (a true RNG
+// while the radio is on, as it is for BLE) instead of RFC 6979: the message
+// isn't known yet when the nonce is made.
+int crypto_impl_presign(crypto_presig_t *ps)
+{
+    mbedtls_mpi k, t, x, r, tr, u;
+    mbedtls_ecp_point kg;
+    uint8_t point[1 + CRYPTO_P256_PUB_LEN];
+    size_t olen = 0;
+    int rc;
+
+    if (crypto_init() != 0) return -1;
+    mbedtls_mpi_init(&k);
+    mbedtls_mpi_init(&t);
+    mbedtls_mpi_init(&x);
+    mbedtls_mpi_init(&r);
+    mbedtls_mpi_init(&tr);
+    mbedtls_mpi_init(&u);
+    mbedtls_ecp_point_init(&kg);
+
+    rc = mbedtls_ecp_gen_keypair(&s_grp, &k, &kg, rng, NULL);
+    if (rc == 0) {
+        rc = mbedtls_ecp_point_write_binary(&s_grp, &kg, MBEDTLS_ECP_PF_UNCOMPRESSED,
+                                            &olen, point, sizeof(point));
+    }
+    if (rc == 0) rc = mbedtls_mpi_read_binary(&x, point + 1, 32);
+    if (rc == 0) rc = mbedtls_mpi_mod_mpi(&r, &x, &s_grp.N);
+    if (rc == 0 && mbedtls_mpi_cmp_int(&r, 0) == 0) rc = -1;
+    if (rc == 0) rc = mbedtls_ecp_gen_privkey(&s_grp, &t, rng, NULL);
+    if (rc == 0) rc = mbedtls_mpi_mul_mpi(&tr, &t, &r);
+    if (rc == 0) rc = mbedtls_mpi_mod_mpi(&tr, &tr, &s_grp.N);
+    if (rc == 0) rc = mbedtls_mpi_mul_mpi(&u, &k, &t);
+    if (rc == 0) rc = mbedtls_mpi_mod_mpi(&u, &u, &s_grp.N);
+    if (rc == 0) rc = mbedtls_mpi_inv_mod(&u, &u, &s_grp.N);
+    if (rc == 0) rc = mbedtls_mpi_write_binary(&r, ps->r, sizeof(ps->r));
+    if (rc == 0) rc = mbedtls_mpi_write_binary(&t, ps->t, sizeof(ps->t));
+    if (rc == 0) rc = mbedtls_mpi_write_binary(&tr, ps->tr, sizeof(ps->tr));
+    if (rc == 0) rc = mbedtls_mpi_write_binary(&u, ps->u, sizeof(ps->u));
+    if (rc != 0) crypto_wipe(ps, sizeof(*ps));
+
+    mbedtls_ecp_point_free(&kg);
+    mbedtls_mpi_free(&u);
+    mbedtls_mpi_free(&tr);
+    mbedtls_mpi_free(&r);
+    mbedtls_mpi_free(&x);
+    mbedtls_mpi_free(&t);
+    mbedtls_mpi_free(&k);
+    return rc == 0 ? 0 : -1;
+}
+
+int crypto_impl_sign_presig(const uint8_t priv[CRYPTO_P256_PRIV_LEN],
+                            const uint8_t digest[CRYPTO_SHA256_LEN],
+                            const crypto_presig_t *ps,
+                            uint8_t sig[CRYPTO_P256_SIG_LEN])
+{
+    mbedtls_mpi d, e, t, tr, u, s, tmp;
+    int rc;
+
+    if (crypto_init() != 0) return -1;
+    mbedtls_mpi_init(&d);
+    mbedtls_mpi_init(&e);
+    mbedtls_mpi_init(&t);
+    mbedtls_mpi_init(&tr);
+    mbedtls_mpi_init(&u);
+    mbedtls_mpi_init(&s);
+    mbedtls_mpi_init(&tmp);
+
+    // s = u * (t*e + tr*d) mod n
+    rc = mbedtls_mpi_read_binary(&d, priv, CRYPTO_P256_PRIV_LEN);
+    if (rc == 0) rc = mbedtls_mpi_read_binary(&e, digest, CRYPTO_SHA256_LEN);
+    if (rc == 0) rc = mbedtls_mpi_read_binary(&t, ps->t, sizeof(ps->t));
+    if (rc == 0) rc = mbedtls_mpi_read_binary(&tr, ps->tr, sizeof(ps->tr));
+    if (rc == 0) rc = mbedtls_mpi_read_binary(&u, ps->u, sizeof(ps->u));
+    if (rc == 0) rc = mbedtls_mpi_mul_mpi(&s, &t, &e);
+    if (rc == 0) rc = mbedtls_mpi_mul_mpi(&tmp, &tr, &d);
+    if (rc == 0) rc = mbedtls_mpi_add_mpi(&s, &s, &tmp);
+    if (rc == 0) rc = mbedtls_mpi_mod_mpi(&s, &s, &s_grp.N);
+    if (rc == 0) rc = mbedtls_mpi_mul_mpi(&s, &s, &u);
+    if (rc == 0) rc = mbedtls_mpi_mod_mpi(&s, &s, &s_grp.N);
+    if (rc == 0 && mbedtls_mpi_cmp_int(&s, 0) == 0) rc = -1;
+    if (rc == 0) {
+        for (size_t i = 0; i < 32; i++) sig[i] = ps->r[i];
+        rc = mbedtls_mpi_write_binary(&s, sig + 32, 32);
+    }
+
+    mbedtls_mpi_free(&tmp);
+    mbedtls_mpi_free(&s);
+    mbedtls_mpi_free(&u);
+    mbedtls_mpi_free(&tr);
+    mbedtls_mpi_free(&t);
+    mbedtls_mpi_free(&e);
+    mbedtls_mpi_free(&d);
+    return rc == 0 ? 0 : -1;
+}
+
+uint64_t crypto_impl_now_us(void)
+{
+    return (uint64_t)esp_timer_get_time();
+}
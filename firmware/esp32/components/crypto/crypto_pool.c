@@ -0,0 +1,173 @@
+// Precomputed key pairs and signing nonces behind crypto_p256_keygen() and
+// crypto_p256_sign(). Each pool is a single-producer/single-consumer ring
+// (same scheme as ctaphid_ring.h): the refiller owns `tail`, the consumer
+// owns `head`. A consumed slot is wiped before it is handed back.
+
+#include <stdatomic.h>
+#include <string.h>
+
+#include "crypto.h"
+#include "crypto_impl.h"
+
+_Static_assert((CRYPTO_POOL_KEYS & (CRYPTO_POOL_KEYS - 1)) == 0,
+               "CRYPTO_POOL_KEYS must be a power of two");
+_Static_assert((CRYPTO_POOL_PRESIGS & (CRYPTO_POOL_PRESIGS - 1)) == 0,
+               "CRYPTO_POOL_PRESIGS must be a power of two");
+
+typedef struct {
+    uint8_t priv[CRYPTO_P256_PRIV_LEN];
+    uint8_t pub[CRYPTO_P256_PUB_LEN];
+} keypair_t;
+
+static keypair_t s_keys[CRYPTO_POOL_KEYS];
+static atomic_uint s_keys_head;
+static atomic_uint s_keys_tail;
+
+static crypto_presig_t s_presigs[CRYPTO_POOL_PRESIGS];
+static atomic_uint s_presigs_head;
+static atomic_uint s_presigs_tail;
+
+static atomic_bool s_enabled = true;
+static atomic_flag s_refilling = ATOMIC_FLAG_INIT;
+static void (*s_wake)(void);
+
+// written by the refiller only, read by anyone
+static atomic_uint s_keys_made;
+static atomic_uint s_presigs_made;
+static _Atomic uint64_t s_refill_us;
+// written by the consumer only
+static atomic_uint s_keys_hit;
+static atomic_uint s_keys_miss;
+static atomic_uint s_presigs_hit;
+static atomic_uint s_presigs_miss;
+
+void crypto_wipe(void *p, size_t len)
+{
+    volatile uint8_t *v = p;
+    while (len--) *v++ = 0;
+}
+
+void crypto_pool_set_waker(void (*wake)(void))
+{
+    s_wake = wake;
+}
+
+static unsigned fill_level(atomic_uint *head, atomic_uint *tail)
+{
+    return atomic_load_explicit(tail, memory_order_acquire) -
+           atomic_load_explicit(head, memory_order_acquire);
+}
+
+static void consumed(atomic_uint *counter)
+{
+    atomic_fetch_add_explicit(counter, 1, memory_order_relaxed);
+    if (s_wake) s_wake();
+}
+
+int crypto_p256_keygen(uint8_t priv[CRYPTO_P256_PRIV_LEN], uint8_t pub[CRYPTO_P256_PUB_LEN])
+{
+    if (atomic_load(&s_enabled)) {
+        unsigned head = atomic_load_explicit(&s_keys_head, memory_order_relaxed);
+        unsigned tail = atomic_load_explicit(&s_keys_tail, memory_order_acquire);
+        if (head != tail) {
+            keypair_t *kp = &s_keys[head & (CRYPTO_POOL_KEYS - 1)];
+            memcpy(priv, kp->priv, sizeof(kp->priv));
+            memcpy(pub, kp->pub, sizeof(kp->pub));
+            crypto_wipe(kp, sizeof(*kp));
+            atomic_store_explicit(&s_keys_head, head + 1, memory_order_release);
+            consumed(&s_keys_hit);
+            return 0;
+        }
+    }
+    consumed(&s_keys_miss);
+    return crypto_impl_keygen(priv, pub);
+}
+
+int crypto_p256_sign(const uint8_t priv[CRYPTO_P256_PRIV_LEN],
+                     const uint8_t digest[CRYPTO_SHA256_LEN],
+                     uint8_t sig[CRYPTO_P256_SIG_LEN])
+{
+    if (atomic_load(&s_enabled)) {
+        unsigned head = atomic_load_explicit(&s_presigs_head, memory_order_relaxed);
+        unsigned tail = atomic_load_explicit(&s_presigs_tail, memory_order_acquire);
+        if (head != tail) {
+            crypto_presig_t *ps = &s_presigs[head & (CRYPTO_POOL_PRESIGS - 1)];
+            int rc = crypto_impl_sign_presig(priv, digest, ps, sig);
+            // a nonce is never used twice, whatever happened
+            crypto_wipe(ps, sizeof(*ps));
+            atomic_store_explicit(&s_presigs_head, head + 1, memory_order_release);
+            if (rc == 0) {
+                consumed(&s_presigs_hit);
+                return 0;
+            }
+        }
+    }
+    consumed(&s_presigs_miss);
+    return crypto_impl_sign(priv, digest, sig);
+}
+
+static bool refill_presig(void)
+{
+    unsigned tail = atomic_load_explicit(&s_presigs_tail, memory_order_relaxed);
+    unsigned head = atomic_load_explicit(&s_presigs_head, memory_order_acquire);
+    if (tail - head >= CRYPTO_POOL_PRESIGS) return false;
+    if (crypto_impl_presign(&s_presigs[tail & (CRYPTO_POOL_PRESIGS - 1)]) != 0) return false;
+    atomic_store_explicit(&s_presigs_tail, tail + 1, memory_order_release);
+    atomic_fetch_add_explicit(&s_presigs_made, 1, memory_order_relaxed);
+    return true;
+}
+
+static bool refill_key(void)
+{
+    unsigned tail = atomic_load_explicit(&s_keys_tail, memory_order_relaxed);
+    unsigned head = atomic_load_explicit(&s_keys_head, memory_order_acquire);
+    if (tail - head >= CRYPTO_POOL_KEYS) return false;
+    keypair_t *kp = &s_keys[tail & (CRYPTO_POOL_KEYS - 1)];
+    if (crypto_impl_keygen(kp->priv, kp->pub) != 0) return false;
+    atomic_store_explicit(&s_keys_tail, tail + 1, memory_order_release);
+    atomic_fetch_add_explicit(&s_keys_made, 1, memory_order_relaxed);
+    return true;
+}
+
+unsigned crypto_pool_refill(unsigned max_items)
+{
+    if (atomic_flag_test_and_set(&s_refilling)) return 0;
+
+    unsigned added = 0;
+    uint64_t t0 = crypto_impl_now_us();
+    while (added < max_items) {
+        if (refill_presig() || refill_key()) {
+            added++;
+        } else {
+            break;
+        }
+    }
+    if (added) atomic_fetch_add_explicit(&s_refill_us, crypto_impl_now_us() - t0, memory_order_relaxed);
+
+    atomic_flag_clear(&s_refilling);
+    return added;
+}
+
+bool crypto_pool_needs_refill(void)
+{
+    return fill_level(&s_presigs_head, &s_presigs_tail) < CRYPTO_POOL_PRESIGS ||
+           fill_level(&s_keys_head, &s_keys_tail) < CRYPTO_POOL_KEYS;
+}
+
+void crypto_pool_set_enabled(bool enabled)
+{
+    atomic_store(&s_enabled, enabled);
+}
+
+void crypto_pool_get_stats(crypto_pool_stats_t *out)
+{
+    out->keys = fill_level(&s_keys_head, &s_keys_tail);
+    out->presigs = fill_level(&s_presigs_head, &s_presigs_tail);
+    out->keys_made = atomic_load_explicit(&s_keys_made, memory_order_relaxed);
+    out->presigs_made = atomic_load_explicit(&s_presigs_made, memory_order_relaxed);
+    out->keys_hit = atomic_load_explicit(&s_keys_hit, memory_order_relaxed);
+    out->keys_miss = atomic_load_explicit(&s_keys_miss, memory_order_relaxed);
+    out->presigs_hit = atomic_load_explicit(&s_presigs_hit, memory_order_relaxed);
+    out->presigs_miss = atomic_load_explicit(&s_presigs_miss, memory_order_relaxed);
+    out->refill_us = atomic_load_explicit(&s_refill_us, memory_order_relaxed);
+}
@@ -0,0 +1,51 @@
+// Keeps the crypto pools full from a low-priority task: refills only use
+// CPU that nothing else wants, and a consumer wakes it after taking an entry.
+
+#include "crypto.h"
+#include "crypto_impl.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+
+#ifndef CRYPTO_POOL_TASK_STACK
+#define CRYPTO_POOL_TASK_STACK 4096
+#endif
+
+#ifndef CRYPTO_POOL_TASK_PRIO
+#define CRYPTO_POOL_TASK_PRIO (tskIDLE_PRIORITY + 1)
+#endif
+
+static const char *TAG = "crypto_pool";
+
+static TaskHandle_t s_task = NULL;
+
+static void wake(void)
+{
+    if (s_task) xTaskNotifyGive(s_task);
+}
+
+static void crypto_pool_task(void *arg)
+{
+    (void)arg;
+    while (1) {
+        // one entry per pass, so a fresh wake-up is never more than one
+        // scalar multiplication away from being seen
+        if (crypto_pool_refill(1) == 0) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        }
+    }
+}
+
+int crypto_pool_task_start(void)
+{
+    if (s_task) return 0;
+    if (xTaskCreate(crypto_pool_task, "crypto_pool", CRYPTO_POOL_TASK_STACK, NULL,
+                    CRYPTO_POOL_TASK_PRIO, &s_task) != pdPASS) {
+        ESP_LOGE(TAG, "xTaskCreate failed");
+        s_task = NULL;
+        return -1;
+    }
+    crypto_pool_set_waker(wake);
+    return 0;
+}
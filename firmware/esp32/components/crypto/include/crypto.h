@@ -0,0 +1,142 @@
+#pragma once
+// P-256 / SHA-256 / AES primitives for the Rust core (see
+// core/rust/src/crypto.rs).
+// crypto_mbedtls.c backs them with mbedTLS on the device, where the S3's
+// bignum and SHA accelerators do the heavy lifting; firmware/host provides
+// an OpenSSL implementation with the same contract.
+//
+// Key generation and signing draw on a pool of precomputed key pairs and
+// signing nonces (crypto_pool.c) that is refilled while the device is idle,
+// so the work left after the user approves is a few modular multiplications.
+// One consumer (the core, on the CTAPHID worker) and one refiller at a time.
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CRYPTO_SHA256_LEN   32
+#define CRYPTO_P256_PRIV_LEN 32   // big-endian scalar
+#define CRYPTO_P256_PUB_LEN  64   // x || y, big-endian
+#define CRYPTO_P256_SIG_LEN  64   // r || s, big-endian
+#define CRYPTO_HMAC_KEY_LEN  32
+#define CRYPTO_AES_KEY_LEN   32   // AES-256
+#define CRYPTO_GCM_IV_LEN    12
+#define CRYPTO_GCM_TAG_LEN   16
+#define CRYPTO_AES_BLOCK_LEN 16
+
+#ifndef CRYPTO_POOL_KEYS
+#ifdef CONFIG_CRYPTO_POOL_KEYS
+#define CRYPTO_POOL_KEYS CONFIG_CRYPTO_POOL_KEYS
+#else
+#define CRYPTO_POOL_KEYS 4       // must be a power of two
+#endif
+#endif
+
+#ifndef CRYPTO_POOL_PRESIGS
+#ifdef CONFIG_CRYPTO_POOL_PRESIGS
+#define CRYPTO_POOL_PRESIGS CONFIG_CRYPTO_POOL_PRESIGS
+#else
+#define CRYPTO_POOL_PRESIGS 8    // must be a power of two
+#endif
+#endif
+
+typedef struct {
+    const uint8_t *p;
+    size_t len;
+} crypto_buf_t;
+
+/** Loads the curve and precomputed tables. Optional: the first operation
+ *  does it otherwise, on the critical path. 0 on success. */
+int crypto_init(void);
+
+/** Fills `out` from the hardware/OS RNG. 0 on success. */
+int crypto_random(uint8_t *out, size_t len);
+
+/** SHA-256 over the concatenation of `parts`. 0 on success. */
+int crypto_sha256(const crypto_buf_t *parts, size_t n, uint8_t out[CRYPTO_SHA256_LEN]);
+
+/** HMAC-SHA256 over the concatenation of `parts`. 0 on success. */
+int crypto_hmac_sha256(const uint8_t key[CRYPTO_HMAC_KEY_LEN],
+                       const crypto_buf_t *parts, size_t n,
+                       uint8_t out[CRYPTO_SHA256_LEN]);
+
+/** AES-256-GCM: encrypts `len` bytes of `in` into `out` (which may be the
+ *  same buffer) and authenticates them with `aad`. 0 on success. */
+int crypto_aes_gcm_seal(const uint8_t key[CRYPTO_AES_KEY_LEN],
+                        const uint8_t iv[CRYPTO_GCM_IV_LEN],
+                        const uint8_t *aad, size_t aad_len,
+                        const uint8_t *in, uint8_t *out, size_t len,
+                        uint8_t tag[CRYPTO_GCM_TAG_LEN]);
+
+/** Inverse of crypto_aes_gcm_seal. -1 if the tag doesn't match, in which
+ *  case `out` holds nothing of the plaintext. */
+int crypto_aes_gcm_open(const uint8_t key[CRYPTO_AES_KEY_LEN],
+                        const uint8_t iv[CRYPTO_GCM_IV_LEN],
+                        const uint8_t *aad, size_t aad_len,
+                        const uint8_t *in, uint8_t *out, size_t len,
+                        const uint8_t tag[CRYPTO_GCM_TAG_LEN]);
+
+/** AES-256-CBC without padding, for PIN/UV auth protocol 2: `len` is a
+ *  multiple of CRYPTO_AES_BLOCK_LEN and `out` may be `in`. 0 on success. */
+int crypto_aes_cbc_encrypt(const uint8_t key[CRYPTO_AES_KEY_LEN],
+                           const uint8_t iv[CRYPTO_AES_BLOCK_LEN],
+                           const uint8_t *in, uint8_t *out, size_t len);
+
+int crypto_aes_cbc_decrypt(const uint8_t key[CRYPTO_AES_KEY_LEN],
+                           const uint8_t iv[CRYPTO_AES_BLOCK_LEN],
+                           const uint8_t *in, uint8_t *out, size_t len);
+
+/** ECDH: the x coordinate of priv·peer. -1 if `peer` is not a point on
+ *  the curve. */
+int crypto_p256_ecdh(const uint8_t priv[CRYPTO_P256_PRIV_LEN],
+                     const uint8_t peer[CRYPTO_P256_PUB_LEN],
+                     uint8_t out[CRYPTO_P256_PRIV_LEN]);
+
+/** Fresh P-256 key pair, from the pool when it has one. 0 on success. */
+int crypto_p256_keygen(uint8_t priv[CRYPTO_P256_PRIV_LEN], uint8_t pub[CRYPTO_P256_PUB_LEN]);
+
+/** ECDSA signature over a SHA-256 digest, using a pooled nonce when there
+ *  is one. 0 on success. */
+int crypto_p256_sign(const uint8_t priv[CRYPTO_P256_PRIV_LEN],
+                     const uint8_t digest[CRYPTO_SHA256_LEN],
+                     uint8_t sig[CRYPTO_P256_SIG_LEN]);
+
+typedef struct {
+    uint32_t keys;           // key pairs ready now
+    uint32_t presigs;        // signing nonces ready now
+    uint32_t keys_made;      // produced by refills since boot
+    uint32_t presigs_made;
+    uint32_t keys_hit;       // keygen served from the pool
+    uint32_t keys_miss;      // ... or computed on demand
+    uint32_t presigs_hit;
+    uint32_t presigs_miss;
+    uint64_t refill_us;      // time spent refilling; made / refill_us is the rate
+} crypto_pool_stats_t;
+
+/**
+ * Precomputes up to `max_items` entries (nonces first, they are used on
+ * every assertion) until both pools are full. Returns the number added; 0
+ * when full or another refill is running. On the device the pool task calls
+ * this; the host build calls it from its idle loop.
+ */
+unsigned crypto_pool_refill(unsigned max_items);
+
+/** True when a refill would add something. */
+bool crypto_pool_needs_refill(void);
+
+/** Off: every operation is computed on demand (cold), for benchmarking. */
+void crypto_pool_set_enabled(bool enabled);
+
+void crypto_pool_get_stats(crypto_pool_stats_t *out);
+
+#ifdef ESP_PLATFORM
+/** Starts the idle-priority task that keeps the pools full. */
+int crypto_pool_task_start(void);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,21 +1,28 @@
 #include "ctaphid.h"
-#include "freertos/FreeRTOS.h"
-#include "freertos/task.h"
-#include "esp_log.h"
-#include "esp_random.h"
-#include "esp_system.h"
-#include "esp_timer.h"
+#include "ctaphid_capture.h"
+#include "ctaphid_port.h"
+#include "ctaphid_trace.h"
+#include <stdbool.h>
 #include <string.h>
 
 #include "core_api.h"   // your Rust FFI header
 
 static const char *TAG = "ctaphid";
 
+// Per-frame logging: compiled out unless CONFIG_CTAPHID_LOG_FRAMES.
+#if CTAPHID_LOG_FRAMES
+#define LOG_FRAME(...) CTAPHID_LOGI(TAG, __VA_ARGS__)
+#else
+#define LOG_FRAME(...) do { } while (0)
+#endif
+
 // ---- internal constants ----
 #define INIT_PAYLOAD_MAX (CTAPHID_REPORT_LEN - 7)  // 57
 #define CONT_PAYLOAD_MAX (CTAPHID_REPORT_LEN - 5)  // 59
-#define MAX_MSG_SIZE     1024                      // tune later
-#define MSG_TIMEOUT_US   (3 * 1000 * 1000ULL)      // 3s reassembly timeout
+#define MAX_MSG_SIZE     CTAPHID_MAX_MSG_SIZE
+#define MSG_TIMEOUT_US   (3 * 1000 * 1000ULL)      // 3s without a frame aborts reassembly
+#define UP_TIMEOUT_US    (30 * 1000 * 1000ULL)     // phone approval window
+#define KEEPALIVE_US     (CTAPHID_KEEPALIVE_MS * 1000ULL)
 
 // CTAPHID error codes (payload for CTAPHID_ERROR)
 #define ERR_INVALID_CMD   0x01
@@ -24,6 +31,10 @@ static const char *TAG = "ctaphid";
 #define ERR_INVALID_SEQ   0x04
 #define ERR_MSG_TIMEOUT   0x05
 #define ERR_CHANNEL_BUSY  0x06
+#define ERR_INVALID_CHANNEL 0x0B
+
+// CTAP2 status returned in a CBOR response after CTAPHID_CANCEL
+#define CTAP2_ERR_KEEPALIVE_CANCEL 0x2D
 
 // ---- helpers ----
 static uint32_t be32(const uint8_t *p) {
@@ -43,61 +54,267 @@ static void put_be16(uint8_t *p, uint16_t v) {
     p[1] = v & 0xFF;
 }
 
-static void send_error(ctaphid_ctx_t *ctx, uint32_t cid, uint8_t err)
+// IN report queue. Every reservation and commit goes through these so that a
+// capture sees each report the moment it is published.
+static uint8_t *tx_reserve(ctaphid_ctx_t *ctx)
+{
+    uint8_t *r = ctx->io.tx_reserve(ctx->io.tx_user);
+#if CTAPHID_CAPTURE_ENABLED
+    if (r) {
+        if (ctx->cap_reserved < CTAPHID_CAPTURE_SLOTS) ctx->cap_slot[ctx->cap_reserved] = r;
+        ctx->cap_reserved++;
+    }
+#endif
+    return r;
+}
+
+static int tx_commit(ctaphid_ctx_t *ctx)
+{
+#if CTAPHID_CAPTURE_ENABLED
+    if (ctx->cap_reserved && ctaphid_capture_active()) {
+        uint64_t now_us = ctaphid_port_now_us();
+        unsigned kept = ctx->cap_reserved < CTAPHID_CAPTURE_SLOTS ? ctx->cap_reserved : CTAPHID_CAPTURE_SLOTS;
+        for (unsigned i = 0; i < kept; i++) ctaphid_capture_record(CTAPHID_CAP_IN, now_us, ctx->cap_slot[i]);
+        if (ctx->cap_reserved > kept) ctaphid_capture_lose(ctx->cap_reserved - kept);
+    }
+    ctx->cap_reserved = 0;
+#endif
+    return ctx->io.tx_commit(ctx->io.tx_user);
+}
+
+static void tx_abort(ctaphid_ctx_t *ctx)
 {
-    uint8_t r[CTAPHID_REPORT_LEN] = {0};
-    put_be32(r, cid);
-    r[4] = (uint8_t)(CTAPHID_ERROR | 0x80);
-    put_be16(&r[5], 1);
-    r[7] = err;
-    ctx->io.send_report(ctx->io.send_user, r);
+#if CTAPHID_CAPTURE_ENABLED
+    ctx->cap_reserved = 0;
+#endif
+    ctx->io.tx_abort(ctx->io.tx_user);
 }
 
-// Thin wrapper; pacing is handled in usb_hid via queuing.
-static int send_report_retry(ctaphid_ctx_t *ctx, const uint8_t *r)
+#if CTAPHID_CAPTURE_ENABLED
+#define CAPTURE_EVENT(type, ts, arg, uses, ttl) ctaphid_capture_event((type), (ts), (arg), (uses), (ttl))
+#else
+#define CAPTURE_EVENT(type, ts, arg, uses, ttl) do { } while (0)
+#endif
+
+// Frames one outgoing message directly in reserved IN report slots. The init
+// frame's BCNT is patched once the total length is known, then all frames are
+// committed at once.
+typedef struct {
+    ctaphid_ctx_t *ctx;
+    uint32_t cid;
+    uint8_t cmd;
+    uint8_t seq;
+    uint8_t *init;       // first reserved report, NULL until the first chunk
+    uint8_t *last;       // most recent report
+    size_t last_cap;     // payload capacity of `last`
+    size_t tx_payload;   // payload bytes that fit in the reserved reports
+    bool can_spill;      // streaming CBOR only: BCNT isn't known until the end
+    uint8_t *spill;      // pool buffer taking the rest once the IN queue is full
+} frame_sink_t;
+
+static void sink_begin(frame_sink_t *fs, ctaphid_ctx_t *ctx, uint32_t cid, uint8_t cmd)
 {
-    return ctx->io.send_report(ctx->io.send_user, r);
+    fs->ctx = ctx;
+    fs->cid = cid;
+    fs->cmd = cmd;
+    fs->seq = 0;
+    fs->init = NULL;
+    fs->last = NULL;
+    fs->last_cap = 0;
+    fs->tx_payload = 0;
+    fs->can_spill = false;
+    fs->spill = NULL;
 }
 
+// core_chunk_fn: reserve the next report, write its header, hand out its payload area.
+// The init frame can't be committed before BCNT is known, so if the queue
+// fills up with our own reservations the remainder goes to a pool buffer and
+// is framed after the init frame is out. Sinks that know their length up
+// front (send_msg) commit as they go and never spill.
+static uint8_t *sink_next(void *user, size_t *cap)
+{
+    frame_sink_t *fs = (frame_sink_t *)user;
+    // The spill buffer already runs to MAX_MSG_SIZE; frame capacities add up
+    // to exactly MAX_MSG_SIZE at 129 frames.
+    if (fs->spill || fs->tx_payload >= MAX_MSG_SIZE) return NULL;
+
+    uint8_t *r = tx_reserve(fs->ctx);
+    if (!r) {
+        if (!fs->init || !fs->can_spill) return NULL;
+        fs->spill = ctaphid_pool_alloc(&fs->ctx->pool);
+        if (!fs->spill) return NULL;
+        *cap = MAX_MSG_SIZE - fs->tx_payload;
+        return fs->spill;
+    }
+
+    put_be32(r, fs->cid);
+    fs->last = r;
+    if (!fs->init) {
+        fs->init = r;
+        r[4] = (uint8_t)(fs->cmd | 0x80);
+        fs->last_cap = INIT_PAYLOAD_MAX;
+        fs->tx_payload += INIT_PAYLOAD_MAX;
+        *cap = INIT_PAYLOAD_MAX;
+        return &r[7];
+    }
+    r[4] = fs->seq++; // continuation packet uses seq in byte4
+    fs->last_cap = CONT_PAYLOAD_MAX;
+    fs->tx_payload += CONT_PAYLOAD_MAX;
+    *cap = CONT_PAYLOAD_MAX;
+    return &r[5];
+}
+
+static void sink_abort(frame_sink_t *fs)
+{
+    if (fs->init) tx_abort(fs->ctx);
+    fs->init = NULL;
+    ctaphid_pool_free(&fs->ctx->pool, fs->spill);
+    fs->spill = NULL;
+}
+
+// Patch BCNT, zero the unused tail of the last frame and publish everything.
+static int sink_finish(frame_sink_t *fs, uint16_t len)
+{
+    size_t cap = 0;
+    if (!fs->init && !sink_next(fs, &cap)) return -1;   // empty message still needs its init frame
+    put_be16(&fs->init[5], len);
+
+    if (!fs->spill) {
+        size_t pad = fs->tx_payload - len;
+        if (pad) memset(fs->last + CTAPHID_REPORT_LEN - pad, 0, pad);
+        int rc = tx_commit(fs->ctx);
+        CTAPHID_TRACE(CTAPHID_TR_TX, fs->cid, fs->cmd, fs->seq + 1, rc != 0);
+        return rc;
+    }
+
+    // Init frame goes out first; the spilled tail then streams behind it
+    // under normal backpressure.
+    int rc = tx_commit(fs->ctx);
+    size_t spilled = len - fs->tx_payload;
+    for (size_t off = 0; off < spilled && rc == 0; off += CONT_PAYLOAD_MAX) {
+        uint8_t *r = tx_reserve(fs->ctx);
+        if (!r) { rc = -1; break; }
+        size_t n = spilled - off > CONT_PAYLOAD_MAX ? CONT_PAYLOAD_MAX : spilled - off;
+        put_be32(r, fs->cid);
+        r[4] = fs->seq++;
+        memcpy(&r[5], fs->spill + off, n);
+        if (n < CONT_PAYLOAD_MAX) memset(&r[5 + n], 0, CONT_PAYLOAD_MAX - n);
+        rc = tx_commit(fs->ctx);
+    }
+    ctaphid_pool_free(&fs->ctx->pool, fs->spill);
+    fs->spill = NULL;
+    CTAPHID_TRACE(CTAPHID_TR_TX, fs->cid, fs->cmd, fs->seq + 1, rc != 0);
+    return rc;
+}
+
+// Length is known up front, so BCNT goes into the init frame immediately and
+// every frame is committed as soon as it is written. Messages longer than the
+// TX queue stream through it under backpressure from usb_hid.
 static void send_msg(ctaphid_ctx_t *ctx, uint32_t cid, uint8_t cmd, const uint8_t *payload, uint16_t len)
 {
-    uint8_t r[CTAPHID_REPORT_LEN];
-    memset(r, 0, sizeof(r));
-    put_be32(r, cid);
-    r[4] = (uint8_t)(cmd | 0x80);
-    put_be16(&r[5], len);
-
-    uint16_t n0 = len > INIT_PAYLOAD_MAX ? INIT_PAYLOAD_MAX : len;
-    if (n0) memcpy(&r[7], payload, n0);
-    int rc = send_report_retry(ctx, r);
-    ESP_LOGI(TAG, "send_msg init cid=%08x cmd=%02x len=%u n0=%u rc=%d", (unsigned)cid, cmd, (unsigned)len, (unsigned)n0, rc);
-    if (rc != 0) ESP_LOGW(TAG, "send_report init rc=%d", rc);
-
-    uint16_t off = n0;
-    uint8_t seq = 0;
-
-    while (off < len) {
-        memset(r, 0, sizeof(r));
-        put_be32(r, cid);
-        r[4] = seq; // continuation packet uses seq in byte4
-        uint16_t n = (len - off) > CONT_PAYLOAD_MAX ? CONT_PAYLOAD_MAX : (len - off);
-        memcpy(&r[5], payload + off, n);
-        rc = send_report_retry(ctx, r);
-        ESP_LOGI(TAG, "send_msg cont cid=%08x seq=%u n=%u rc=%d", (unsigned)cid, (unsigned)seq, (unsigned)n, rc);
-        if (rc != 0) ESP_LOGW(TAG, "send_report cont rc=%d seq=%u", rc, (unsigned)seq);
+    frame_sink_t fs;
+    sink_begin(&fs, ctx, cid, cmd);
+
+    uint16_t off = 0;
+    do {
+        size_t cap = 0;
+        uint8_t *dst = sink_next(&fs, &cap);
+        if (!dst) {
+            // Frames already out are a truncated message the host times out on.
+            ctx->tx_dropped++;
+            tx_abort(ctx);
+            CTAPHID_LOGW(TAG, "send_msg cid=%08x cmd=%02x: tx stalled, dropped at %u/%u",
+                     (unsigned)cid, cmd, (unsigned)off, (unsigned)len);
+            CTAPHID_TRACE(CTAPHID_TR_TX, cid, cmd, fs.init ? fs.seq + 1 : 0, 1);
+            return;
+        }
+        if (off == 0) put_be16(&fs.init[5], len);
+
+        size_t remaining = (size_t)(len - off);
+        uint16_t n = (uint16_t)(remaining > cap ? cap : remaining);
+        if (n) memcpy(dst, payload + off, n);
+        if (n < cap) memset(dst + n, 0, cap - n);
         off += n;
-        seq++;
+
+        tx_commit(ctx);
+    } while (off < len);
+
+    CTAPHID_TRACE(CTAPHID_TR_TX, cid, cmd, fs.seq + 1, 0);
+    LOG_FRAME("send_msg cid=%08x cmd=%02x len=%u", (unsigned)cid, cmd, (unsigned)len);
+}
+
+static void send_error(ctaphid_ctx_t *ctx, uint32_t cid, uint8_t err)
+{
+    CTAPHID_TRACE(CTAPHID_TR_ERR, cid, CTAPHID_ERROR, 0, err);
+    send_msg(ctx, cid, CTAPHID_ERROR, &err, 1);
+}
+
+static void chan_free(ctaphid_ctx_t *ctx, ctaphid_chan_t *ch)
+{
+    if (ch->buf != ch->inline_buf) ctaphid_pool_free(&ctx->pool, ch->buf);
+    ch->buf = ch->inline_buf;
+    ch->cid = 0;
+    ch->cmd = 0;
+    ch->len = 0;
+    ch->got = 0;
+    ch->next_seq = 0;
+    ch->started_at_us = 0;
+    ch->last_rx_us = 0;
+}
+
+// Drop the parked request without answering it (caller answers if needed).
+static void up_abort(ctaphid_ctx_t *ctx)
+{
+    ctx->up_chan = NULL;
+    core_set_user_presence(ctx->core_mem, sizeof(ctx->core_mem), CORE_UP_CLEAR);
+    if (ctx->io.up_done) ctx->io.up_done(ctx->io.up_user, ctx->up_park);
+}
+
+static ctaphid_chan_t *chan_find(ctaphid_ctx_t *ctx, uint32_t cid)
+{
+    if (cid == 0) return NULL;
+    for (size_t i = 0; i < CTAPHID_MAX_CHANNELS; i++) {
+        if (ctx->chan[i].cid == cid) return &ctx->chan[i];
     }
+    return NULL;
 }
 
-static void reset_reassembly(ctaphid_ctx_t *ctx)
+// Free slot if any, otherwise evict the least recently active one. The evicted
+// client gets ERR_MSG_TIMEOUT right away instead of waiting out its own timer.
+static ctaphid_chan_t *chan_alloc(ctaphid_ctx_t *ctx)
 {
-    ctx->cur_cid = 0;
-    ctx->cur_cmd = 0;
-    ctx->cur_len = 0;
-    ctx->got = 0;
-    ctx->next_seq = 0;
-    ctx->started_at_us = 0;
+    ctaphid_chan_t *lru = &ctx->chan[0];
+    for (size_t i = 0; i < CTAPHID_MAX_CHANNELS; i++) {
+        ctaphid_chan_t *ch = &ctx->chan[i];
+        if (ch->cid == 0) return ch;
+        if (ch == ctx->up_chan) continue;
+        if (lru == ctx->up_chan || ch->last_rx_us < lru->last_rx_us) lru = ch;
+    }
+    uint32_t evicted = lru->cid;
+    if (lru == ctx->up_chan) up_abort(ctx);
+    chan_free(ctx, lru);
+    CTAPHID_LOGW(TAG, "evict cid=%08x", (unsigned)evicted);
+    CTAPHID_TRACE(CTAPHID_TR_EVICT, evicted, 0, 0, 0);
+    send_error(ctx, evicted, ERR_MSG_TIMEOUT);
+    return lru;
+}
+
+// Abort every reassembly that has been silent for longer than MSG_TIMEOUT_US.
+// Returns true if `cid` was among them.
+static bool chan_expire(ctaphid_ctx_t *ctx, uint64_t now_us, uint32_t cid)
+{
+    bool hit = false;
+    for (size_t i = 0; i < CTAPHID_MAX_CHANNELS; i++) {
+        ctaphid_chan_t *ch = &ctx->chan[i];
+        if (ch->cid == 0 || ch == ctx->up_chan) continue;
+        if (now_us - ch->last_rx_us <= MSG_TIMEOUT_US) continue;
+        uint32_t expired_cid = ch->cid;
+        CTAPHID_TRACE(CTAPHID_TR_EXPIRE, expired_cid, ch->cmd, ch->next_seq, 0);
+        chan_free(ctx, ch);
+        send_error(ctx, expired_cid, ERR_MSG_TIMEOUT);
+        if (expired_cid == cid) hit = true;
+    }
+    return hit;
 }
 
 static uint32_t alloc_cid(void)
@@ -105,7 +322,7 @@ static uint32_t alloc_cid(void)
     uint32_t cid = 0;
     // avoid broadcast/zero; no persistence so collisions are still possible but unlikely
     do {
-        cid = esp_random();
+        cid = ctaphid_port_random();
     } while (cid == 0 || cid == CTAPHID_BROADCAST_CID);
     return cid;
 }
@@ -115,75 +332,220 @@ void ctaphid_init(ctaphid_ctx_t *ctx, const ctaphid_io_t *io)
 {
     memset(ctx, 0, sizeof(*ctx));
     ctx->io = *io;
+    ctaphid_pool_init(&ctx->pool);
+    for (size_t i = 0; i < CTAPHID_MAX_CHANNELS; i++) {
+        ctx->chan[i].buf = ctx->chan[i].inline_buf;
+    }
 
     // init Rust core (placement)
     size_t need = core_ctx_size();
     if (need > sizeof(ctx->core_mem)) {
-        ESP_LOGE(TAG, "core_ctx_size=%u too big for core_mem=%u", (unsigned)need, (unsigned)sizeof(ctx->core_mem));
+        CTAPHID_LOGE(TAG, "core_ctx_size=%u too big for core_mem=%u", (unsigned)need, (unsigned)sizeof(ctx->core_mem));
     } else {
         int rc = core_init(ctx->core_mem, sizeof(ctx->core_mem));
-        ESP_LOGI(TAG, "core_init rc=%d", rc);
+        CTAPHID_LOGI(TAG, "core_init rc=%d", rc);
     }
 }
 
-static void handle_complete_message(ctaphid_ctx_t *ctx)
+static void send_cbor_status(ctaphid_ctx_t *ctx, uint32_t cid, uint8_t status)
 {
-    const uint8_t *msg = ctx->buf;
-    size_t msg_len = ctx->cur_len;
-    uint32_t cid = ctx->cur_cid;
-    uint8_t cmd = ctx->cur_cmd;
+    // For CTAP2 over CBOR, return 1-byte CTAP status in CBOR response payload.
+    uint8_t st[1] = {status};
+    send_msg(ctx, cid, CTAPHID_CBOR, st, 1);
+}
 
-    // reset reassembly state
-    reset_reassembly(ctx);
+static void send_keepalive(ctaphid_ctx_t *ctx, uint32_t cid, uint8_t status)
+{
+    uint8_t st[1] = {status};
+    send_msg(ctx, cid, CTAPHID_KEEPALIVE, st, 1);
+}
 
-    if (cmd == CTAPHID_PING) {
-        send_msg(ctx, cid, CTAPHID_PING, msg, (uint16_t)msg_len);
-        return;
+static void up_finish(ctaphid_ctx_t *ctx, int verdict);
+
+static void up_park(ctaphid_ctx_t *ctx, ctaphid_chan_t *ch)
+{
+    uint64_t now_us = ctaphid_port_now_us();
+    ctx->up_chan = ch;
+    if (++ctx->up_park == 0) ctx->up_park = 1;
+    ctx->up_since_us = now_us;
+    ctx->up_keepalive_us = now_us;
+    CTAPHID_TRACE(CTAPHID_TR_UP_PARK, ch->cid, CTAPHID_CBOR, ch->len ? ch->buf[0] : 0, 0);
+    send_keepalive(ctx, ch->cid, CTAPHID_STATUS_UPNEEDED);
+    if (ctx->io.up_request) {
+        ctx->io.up_request(ctx->io.up_user, ch->cid);
+    } else {
+        up_finish(ctx, CORE_UP_DENIED);
     }
+}
 
-    if (cmd == CTAPHID_CBOR) {
-        size_t out_len = 0;
-        int rc = core_handle_request(
-            ctx->core_mem, sizeof(ctx->core_mem),
-            msg, msg_len,
-            ctx->core_resp, sizeof(ctx->core_resp),
-            &out_len
-        );
-
-        if (rc != 0) {
-            // For CTAP2 over CBOR, return 1-byte CTAP status in CBOR response payload.
-            uint8_t err1[1] = {(uint8_t)rc};
-            send_msg(ctx, cid, CTAPHID_CBOR, err1, 1);
-            return;
-        }
-        send_msg(ctx, cid, CTAPHID_CBOR, ctx->core_resp, (uint16_t)out_len);
+// Runs the core on a complete CBOR message. Returns true if the request was
+// parked on the user-presence gate, in which case the slot must be kept.
+static bool run_cbor(ctaphid_ctx_t *ctx, ctaphid_chan_t *ch)
+{
+    uint32_t cid = ch->cid;
+    if (ctx->cancel_cid == cid) {
+        send_cbor_status(ctx, cid, CTAP2_ERR_KEEPALIVE_CANCEL);
+        return false;
+    }
+
+    frame_sink_t fs;
+    sink_begin(&fs, ctx, cid, CTAPHID_CBOR);
+    fs.can_spill = true;
+    core_sink_t sink = { .next = sink_next, .user = &fs };
+
+    size_t out_len = 0;
+    int rc = core_handle_request_stream(
+        ctx->core_mem, sizeof(ctx->core_mem),
+        ch->buf, ch->len,
+        &sink,
+        &out_len
+    );
+    CTAPHID_TRACE(CTAPHID_TR_CBOR, cid, CTAPHID_CBOR, ch->len ? ch->buf[0] : 0, rc);
+    if (rc != 0 || ctx->cancel_cid == cid) {
+        sink_abort(&fs);
+    }
+
+    // One presence prompt at a time; other channels keep being served. The
+    // core turns a second one away before it changes anything.
+    if (rc == CORE_STATUS_UP_BUSY || (rc == CORE_STATUS_UP_PENDING && ctx->up_chan && ctx->up_chan != ch)) {
+        send_error(ctx, cid, ERR_CHANNEL_BUSY);
+        return false;
+    }
+    if (rc == CORE_STATUS_UP_PENDING) {
+        up_park(ctx, ch);
+        return ctx->up_chan == ch;
+    }
+    if (ctx->cancel_cid == cid) {
+        rc = CTAP2_ERR_KEEPALIVE_CANCEL;
+    }
+    if (rc != 0) {
+        send_cbor_status(ctx, cid, (uint8_t)rc);
+        return false;
+    }
+    if (sink_finish(&fs, (uint16_t)out_len) < 0) {
+        CTAPHID_LOGW(TAG, "cbor cid=%08x: tx queue full", (unsigned)cid);
+    }
+    return false;
+}
+
+void ctaphid_request_cancel(ctaphid_ctx_t *ctx, uint32_t cid)
+{
+    ctx->cancel_cid = cid;
+}
+
+// Runs to completion before the next frame is looked at, so the core only ever
+// sees one request at a time regardless of how many channels are reassembling.
+static void handle_complete_message(ctaphid_ctx_t *ctx, ctaphid_chan_t *ch)
+{
+    if (ch->cmd == CTAPHID_CBOR) {
+        if (run_cbor(ctx, ch)) return;
+    } else if (ch->cmd == CTAPHID_PING) {
+        send_msg(ctx, ch->cid, CTAPHID_PING, ch->buf, ch->len);
+    } else {
+        send_error(ctx, ch->cid, ERR_INVALID_CMD);
+    }
+    chan_free(ctx, ch);
+}
+
+static void up_finish(ctaphid_ctx_t *ctx, int verdict)
+{
+    ctaphid_chan_t *ch = ctx->up_chan;
+    if (!ch) return;
+    ctx->up_chan = NULL;
+    CTAPHID_TRACE(CTAPHID_TR_UP_DONE, ch->cid, CTAPHID_CBOR, 0, verdict);
+    if (ctx->io.up_done) ctx->io.up_done(ctx->io.up_user, ctx->up_park);
+
+    send_keepalive(ctx, ch->cid, CTAPHID_STATUS_PROCESSING);
+    core_set_user_presence(ctx->core_mem, sizeof(ctx->core_mem), verdict);
+    if (run_cbor(ctx, ch)) return;
+    core_set_user_presence(ctx->core_mem, sizeof(ctx->core_mem), CORE_UP_CLEAR);
+    chan_free(ctx, ch);
+}
+
+void ctaphid_up_resolve(ctaphid_ctx_t *ctx, int verdict)
+{
+    CAPTURE_EVENT(CTAPHID_CAP_UP, ctaphid_port_now_us(), (uint8_t)verdict, 0, 0);
+    up_finish(ctx, verdict);
+}
+
+uint32_t ctaphid_up_park_id(const ctaphid_ctx_t *ctx)
+{
+    return ctx->up_chan ? ctx->up_park : 0;
+}
+
+int ctaphid_up_prompt(ctaphid_ctx_t *ctx, core_up_prompt_t *out)
+{
+    if (!ctx->up_chan) return -1;
+    return core_up_prompt(ctx->core_mem, sizeof(ctx->core_mem), out);
+}
+
+void ctaphid_up_grant(ctaphid_ctx_t *ctx, const core_grant_t *grant)
+{
+    CAPTURE_EVENT(CTAPHID_CAP_GRANT, ctaphid_port_now_us(), grant->scope, grant->uses, grant->ttl_s);
+    if (!ctx->up_chan) return;
+    int rc = core_grant_presence(ctx->core_mem, sizeof(ctx->core_mem), grant);
+    if (rc != 0) {
+        CTAPHID_LOGW(TAG, "grant scope=%u refused: 0x%02x", (unsigned)grant->scope, (unsigned)rc);
+    }
+    up_finish(ctx, CORE_UP_APPROVED);
+}
+
+void ctaphid_up_revoke(ctaphid_ctx_t *ctx)
+{
+    CAPTURE_EVENT(CTAPHID_CAP_REVOKE, ctaphid_port_now_us(), 0, 0, 0);
+    (void)core_revoke_grants(ctx->core_mem, sizeof(ctx->core_mem));
+}
+
+void ctaphid_tick(ctaphid_ctx_t *ctx)
+{
+    uint64_t now_us = ctaphid_port_now_us();
+
+#if CTAPHID_CAPTURE_ENABLED
+    // idle ticks change nothing; leaving them out keeps captures small
+    if (ctaphid_capture_active() && !ctaphid_idle(ctx)) {
+        ctaphid_capture_event(CTAPHID_CAP_TICK, now_us, 0, 0, 0);
+    }
+#endif
+    (void)chan_expire(ctx, now_us, 0);
+
+    ctaphid_chan_t *ch = ctx->up_chan;
+    if (!ch) return;
+    if (now_us - ctx->up_since_us > UP_TIMEOUT_US) {
+        up_finish(ctx, CORE_UP_TIMEOUT);
         return;
     }
+    if (now_us - ctx->up_keepalive_us >= KEEPALIVE_US) {
+        ctx->up_keepalive_us = now_us;
+        send_keepalive(ctx, ch->cid, CTAPHID_STATUS_UPNEEDED);
+    }
+}
 
-    send_error(ctx, cid, ERR_INVALID_CMD);
+bool ctaphid_idle(const ctaphid_ctx_t *ctx)
+{
+    for (size_t i = 0; i < CTAPHID_MAX_CHANNELS; i++) {
+        if (ctx->chan[i].cid != 0) return false;
+    }
+    return true;
 }
 
 void ctaphid_on_report(ctaphid_ctx_t *ctx, const uint8_t *report, size_t len)
 {
     if (len != CTAPHID_REPORT_LEN) return;
 
-    int64_t now_us = esp_timer_get_time();
+    uint64_t now_us = ctaphid_port_now_us();
+#if CTAPHID_CAPTURE_ENABLED
+    ctaphid_capture_record(CTAPHID_CAP_OUT, now_us, report);
+#endif
 
     uint32_t cid = be32(report);
     uint8_t b4 = report[4];
-    ESP_LOGI(TAG, "on_report cid=%08x b4=%02x len=%u", (unsigned)cid, b4, (unsigned)len);
-
-    // timeout handling for in-flight message before processing new frame
-    if (ctx->cur_len && ctx->started_at_us) {
-        uint32_t expired_cid = ctx->cur_cid;
-        if (now_us - (int64_t)ctx->started_at_us > (int64_t)MSG_TIMEOUT_US) {
-            reset_reassembly(ctx);
-            send_error(ctx, expired_cid, ERR_MSG_TIMEOUT);
-            // drop stray continuation for timed-out transaction
-            if ((b4 & 0x80) == 0 && cid == expired_cid) {
-                return;
-            }
-        }
+    CTAPHID_TRACE(CTAPHID_TR_RX, cid, (b4 & 0x80) ? b4 : 0, (b4 & 0x80) ? 0 : b4, 0);
+    LOG_FRAME("on_report cid=%08x b4=%02x len=%u", (unsigned)cid, b4, (unsigned)len);
+
+    // timeout handling for in-flight messages before processing new frame
+    if (chan_expire(ctx, now_us, cid) && (b4 & 0x80) == 0) {
+        // drop stray continuation for timed-out transaction
+        return;
     }
 
     if (b4 & 0x80) {
@@ -192,21 +554,29 @@ void ctaphid_on_report(ctaphid_ctx_t *ctx, const uint8_t *report, size_t len)
         uint16_t total = be16(&report[5]);
         const uint8_t *p = &report[7];
         uint16_t n = total > INIT_PAYLOAD_MAX ? INIT_PAYLOAD_MAX : total;
+        ctaphid_chan_t *ch = chan_find(ctx, cid);
 
         if (total > MAX_MSG_SIZE) { send_error(ctx, cid, ERR_INVALID_LEN); return; }
 
         if (cmd == CTAPHID_CANCEL) {
             if (total != 0) { send_error(ctx, cid, ERR_INVALID_LEN); return; }
-            if (ctx->cur_len && cid == ctx->cur_cid) {
-                reset_reassembly(ctx);
+            CTAPHID_TRACE(CTAPHID_TR_CANCEL, cid, CTAPHID_CANCEL, 0, !ch ? 0 : ch == ctx->up_chan ? 1 : 2);
+            if (ch && ch == ctx->up_chan) {
+                up_abort(ctx);
+                send_cbor_status(ctx, cid, CTAP2_ERR_KEEPALIVE_CANCEL);
             }
+            if (ch) chan_free(ctx, ch);
+            // Everything queued ahead of this frame has now seen the cancel.
+            if (ctx->cancel_cid == cid) ctx->cancel_cid = 0;
             return;
         }
 
         if (cmd == CTAPHID_INIT) {
             // INIT request payload is 8-byte nonce
             if (total != 8) { send_error(ctx, cid, ERR_INVALID_LEN); return; }
-            if (cid != CTAPHID_BROADCAST_CID) { /* spec allows init on non-broadcast too */ }
+            // INIT on an allocated channel resynchronizes it: drop whatever was pending.
+            if (ch && ch == ctx->up_chan) up_abort(ctx);
+            if (ch) chan_free(ctx, ch);
 
             uint8_t resp[17] = {0};
             // resp: nonce(8) + newCID(4) + ver(1) + vMajor(1) + vMinor(1) + vBuild(1) + caps(1)
@@ -223,46 +593,71 @@ void ctaphid_on_report(ctaphid_ctx_t *ctx, const uint8_t *report, size_t len)
             return;
         }
 
-        if (ctx->cur_len != 0) {
+        if (cid == 0 || cid == CTAPHID_BROADCAST_CID) {
+            send_error(ctx, cid, ERR_INVALID_CHANNEL);
+            return;
+        }
+
+        // A channel carries one transaction at a time; other channels are unaffected.
+        if (ch) {
             send_error(ctx, cid, ERR_CHANNEL_BUSY);
             return;
         }
 
         // start reassembly for PING/CBOR/etc
-        ctx->cur_cid = cid;
-        ctx->cur_cmd = cmd;
-        ctx->cur_len = total;
-        ctx->got = 0;
-        ctx->next_seq = 0;
-        ctx->started_at_us = (uint64_t)now_us;
+        uint8_t *buf = NULL;
+        if (total > CTAPHID_INLINE_MSG_SIZE) {
+            buf = ctaphid_pool_alloc(&ctx->pool);
+            if (!buf) { send_error(ctx, cid, ERR_CHANNEL_BUSY); return; }
+        }
+        ch = chan_alloc(ctx);
+        ch->buf = buf ? buf : ch->inline_buf;
+        ch->cid = cid;
+        ch->cmd = cmd;
+        ch->len = total;
+        ch->got = 0;
+        ch->next_seq = 0;
+        ch->started_at_us = now_us;
+        ch->last_rx_us = now_us;
 
         if (n) {
-            memcpy(ctx->buf, p, n);
-            ctx->got = n;
+            memcpy(ch->buf, p, n);
+            ch->got = n;
         }
 
-        if (ctx->got >= ctx->cur_len) {
-            handle_complete_message(ctx);
+        if (ch->got >= ch->len) {
+            handle_complete_message(ctx, ch);
         }
         return;
     } else {
         // CONT frame
         uint8_t seq = b4;
         const uint8_t *p = &report[5];
+        ctaphid_chan_t *ch = chan_find(ctx, cid);
 
-        if (ctx->cur_len == 0) { send_error(ctx, cid, ERR_INVALID_SEQ); return; }
-        if (cid != ctx->cur_cid) { send_error(ctx, cid, ERR_INVALID_SEQ); return; }
-        if (seq != ctx->next_seq) { send_error(ctx, cid, ERR_INVALID_SEQ); return; }
+        if (!ch) { send_error(ctx, cid, ERR_INVALID_SEQ); return; }
+        if (ch == ctx->up_chan) { send_error(ctx, cid, ERR_CHANNEL_BUSY); return; }
+        if (seq != ch->next_seq) {
+            chan_free(ctx, ch);
+            send_error(ctx, cid, ERR_INVALID_SEQ);
+            return;
+        }
 
-        uint16_t remaining = (uint16_t)(ctx->cur_len - ctx->got);
+        uint16_t remaining = (uint16_t)(ch->len - ch->got);
         uint16_t n = remaining > CONT_PAYLOAD_MAX ? CONT_PAYLOAD_MAX : remaining;
 
-        memcpy(ctx->buf + ctx->got, p, n);
-        ctx->got += n;
-        ctx->next_seq++;
+        memcpy(ch->buf + ch->got, p, n);
+        ch->got += n;
+        ch->next_seq++;
+        ch->last_rx_us = now_us;
 
-        if (ctx->got >= ctx->cur_len) {
-            handle_complete_message(ctx);
+        if (ch->got >= ch->len) {
+            handle_complete_message(ctx, ch);
         }
     }
 }
+
+void ctaphid_get_pool_stats(const ctaphid_ctx_t *ctx, ctaphid_pool_stats_t *out)
+{
+    ctaphid_pool_get_stats(&ctx->pool, out);
+}
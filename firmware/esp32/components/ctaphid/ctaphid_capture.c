@@ -0,0 +1,114 @@
+#include "ctaphid_capture.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+_Static_assert(sizeof(ctaphid_cap_rec_t) == 80, "capture record layout");
+_Static_assert(sizeof(ctaphid_cap_file_hdr_t) == 32, "capture header layout");
+
+// no RAM for the ring in builds that never record
+#if CTAPHID_CAPTURE_ENABLED
+#define RING_DEPTH CTAPHID_CAPTURE_DEPTH
+#else
+#define RING_DEPTH 1
+#endif
+
+static ctaphid_cap_rec_t s_ring[RING_DEPTH];
+static atomic_bool s_on;
+static atomic_uint s_total;   // records since start, kept or not
+static atomic_uint s_lost;
+static ctaphid_capture_sink_fn s_sink;
+static void *s_sink_user;
+
+void ctaphid_capture_start(ctaphid_capture_sink_fn sink, void *user)
+{
+    atomic_store_explicit(&s_on, false, memory_order_relaxed);
+    s_sink = sink;
+    s_sink_user = user;
+    atomic_store_explicit(&s_total, 0, memory_order_relaxed);
+    atomic_store_explicit(&s_lost, 0, memory_order_relaxed);
+    atomic_store_explicit(&s_on, true, memory_order_release);
+}
+
+void ctaphid_capture_stop(void)
+{
+    atomic_store_explicit(&s_on, false, memory_order_release);
+}
+
+bool ctaphid_capture_active(void)
+{
+    return atomic_load_explicit(&s_on, memory_order_acquire);
+}
+
+static void put(const ctaphid_cap_rec_t *rec)
+{
+    unsigned n = atomic_load_explicit(&s_total, memory_order_relaxed);
+    if (s_sink) {
+        s_sink(s_sink_user, rec);
+    } else if (n < RING_DEPTH) {
+        s_ring[n] = *rec;
+    } else {
+        atomic_fetch_add_explicit(&s_lost, 1, memory_order_relaxed);
+    }
+    atomic_store_explicit(&s_total, n + 1, memory_order_release);
+}
+
+void ctaphid_capture_record(uint8_t type, uint64_t ts_us, const uint8_t *data)
+{
+    if (!ctaphid_capture_active()) return;
+    ctaphid_cap_rec_t rec = { .ts_us = ts_us, .type = type };
+    memcpy(rec.data, data, sizeof(rec.data));
+    put(&rec);
+}
+
+void ctaphid_capture_event(uint8_t type, uint64_t ts_us, uint8_t arg, uint16_t uses, uint32_t ttl_s)
+{
+    if (!ctaphid_capture_active()) return;
+    ctaphid_cap_rec_t rec = { .ts_us = ts_us, .type = type, .arg = arg, .uses = uses, .ttl_s = ttl_s };
+    put(&rec);
+}
+
+void ctaphid_capture_lose(unsigned n)
+{
+    if (ctaphid_capture_active()) atomic_fetch_add_explicit(&s_lost, n, memory_order_relaxed);
+}
+
+uint32_t ctaphid_capture_total(void)
+{
+    return atomic_load_explicit(&s_total, memory_order_acquire);
+}
+
+uint32_t ctaphid_capture_lost(void)
+{
+    return atomic_load_explicit(&s_lost, memory_order_relaxed);
+}
+
+void ctaphid_capture_dump(ctaphid_capture_out_fn out, void *user)
+{
+    // 80 bytes as little-endian hex, the file layout of ctaphid_cap_rec_t
+    char line[2 * sizeof(ctaphid_cap_rec_t) + 1];
+    unsigned total = ctaphid_capture_total();
+    unsigned kept = total < RING_DEPTH ? total : RING_DEPTH;
+
+    snprintf(line, sizeof(line), "CAPTURE BEGIN v%d depth=%u total=%u lost=%u",
+             CTAPHID_CAPTURE_VERSION, (unsigned)CTAPHID_CAPTURE_DEPTH, total,
+             (unsigned)ctaphid_capture_lost());
+    out(user, line);
+    if (!s_sink) {
+        for (unsigned i = 0; i < kept; i++) {
+            const ctaphid_cap_rec_t *r = &s_ring[i];
+            uint8_t raw[sizeof(*r)];
+            for (unsigned b = 0; b < 8; b++) raw[b] = (uint8_t)(r->ts_us >> (8 * b));
+            raw[8] = r->type;
+            raw[9] = r->arg;
+            raw[10] = (uint8_t)r->uses;
+            raw[11] = (uint8_t)(r->uses >> 8);
+            for (unsigned b = 0; b < 4; b++) raw[12 + b] = (uint8_t)(r->ttl_s >> (8 * b));
+            memcpy(&raw[16], r->data, sizeof(r->data));
+            for (size_t b = 0; b < sizeof(raw); b++) snprintf(&line[2 * b], 3, "%02x", raw[b]);
+            out(user, line);
+        }
+    }
+    out(user, "CAPTURE END");
+}
@@ -0,0 +1,50 @@
+#include "ctaphid_pool.h"
+#include <string.h>
+
+_Static_assert(CTAPHID_MSG_POOL_COUNT <= 32, "used_mask holds at most 32 buffers");
+
+void ctaphid_pool_init(ctaphid_pool_t *p)
+{
+    p->used_mask = 0;
+    p->in_use = 0;
+    p->peak = 0;
+    p->allocs = 0;
+    p->alloc_fail = 0;
+}
+
+uint8_t *ctaphid_pool_alloc(ctaphid_pool_t *p)
+{
+    for (unsigned i = 0; i < CTAPHID_MSG_POOL_COUNT; i++) {
+        if (p->used_mask & (1u << i)) continue;
+        p->used_mask |= 1u << i;
+        p->in_use++;
+        p->allocs++;
+        if (p->in_use > p->peak) p->peak = p->in_use;
+        return p->buf[i];
+    }
+    p->alloc_fail++;
+    return NULL;
+}
+
+void ctaphid_pool_free(ctaphid_pool_t *p, uint8_t *buf)
+{
+    if (!buf) return;
+    for (unsigned i = 0; i < CTAPHID_MSG_POOL_COUNT; i++) {
+        if (buf != p->buf[i]) continue;
+        if (p->used_mask & (1u << i)) {
+            p->used_mask &= ~(1u << i);
+            p->in_use--;
+        }
+        return;
+    }
+}
+
+void ctaphid_pool_get_stats(const ctaphid_pool_t *p, ctaphid_pool_stats_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    out->count = CTAPHID_MSG_POOL_COUNT;
+    out->in_use = p->in_use;
+    out->peak = p->peak;
+    out->allocs = p->allocs;
+    out->alloc_fail = p->alloc_fail;
+}
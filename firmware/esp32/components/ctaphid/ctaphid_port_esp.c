@@ -0,0 +1,19 @@
+#include "ctaphid_port.h"
+#include "esp_cpu.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+
+uint64_t ctaphid_port_now_us(void)
+{
+    return (uint64_t)esp_timer_get_time();
+}
+
+uint32_t ctaphid_port_random(void)
+{
+    return esp_random();
+}
+
+uint32_t ctaphid_port_cycles(void)
+{
+    return (uint32_t)esp_cpu_get_cycle_count();
+}
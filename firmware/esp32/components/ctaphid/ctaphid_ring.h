@@ -0,0 +1,42 @@
+#pragma once
+// Lock-free single-producer/single-consumer ring of 64-byte HID reports.
+// Producer: TinyUSB task (OUT callback). Consumer: CTAPHID worker task.
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "ctaphid.h"
+
+#ifndef CTAPHID_RX_RING_DEPTH
+#define CTAPHID_RX_RING_DEPTH 16   // must be a power of two
+#endif
+
+_Static_assert((CTAPHID_RX_RING_DEPTH & (CTAPHID_RX_RING_DEPTH - 1)) == 0,
+               "CTAPHID_RX_RING_DEPTH must be a power of two");
+
+typedef struct {
+    uint8_t slot[CTAPHID_RX_RING_DEPTH][CTAPHID_REPORT_LEN];
+    atomic_uint head;   // written by consumer only
+    atomic_uint tail;   // written by producer only
+} ctaphid_ring_t;
+
+static inline bool ctaphid_ring_push(ctaphid_ring_t *r, const uint8_t *report)
+{
+    unsigned tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    unsigned head = atomic_load_explicit(&r->head, memory_order_acquire);
+    if (tail - head >= CTAPHID_RX_RING_DEPTH) return false;
+    memcpy(r->slot[tail & (CTAPHID_RX_RING_DEPTH - 1)], report, CTAPHID_REPORT_LEN);
+    atomic_store_explicit(&r->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+static inline bool ctaphid_ring_pop(ctaphid_ring_t *r, uint8_t *report)
+{
+    unsigned head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+    if (head == tail) return false;
+    memcpy(report, r->slot[head & (CTAPHID_RX_RING_DEPTH - 1)], CTAPHID_REPORT_LEN);
+    atomic_store_explicit(&r->head, head + 1, memory_order_release);
+    return true;
+}
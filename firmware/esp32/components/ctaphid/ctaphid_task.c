@@ -0,0 +1,132 @@
+// CTAPHID worker: drains OUT reports queued by the USB callback and runs the
+// protocol (and the core) outside the TinyUSB task.
+
+#include "ctaphid_task.h"
+#include "ctaphid_ring.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+
+#include "core_api.h"
+
+static const char *TAG = "ctaphid_task";
+
+static ctaphid_ring_t s_rx;
+static ctaphid_ctx_t *s_ctx = NULL;
+static TaskHandle_t s_task = NULL;
+static uint32_t s_rx_dropped = 0;
+static volatile bool s_revoke;
+
+// A verdict from the approval path, handed over whole: a one-slot queue
+// orders the grant with the verdict across cores, which separate volatile
+// and plain stores would not. A newer verdict replaces one not yet taken.
+typedef struct {
+    uint32_t park;        // ctaphid_up_park_id of the request it answers
+    int verdict;          // CORE_UP_*
+    core_grant_t grant;   // sent with an approval when scope != 0
+} up_msg_t;
+static QueueHandle_t s_up_q;
+
+static void ctaphid_task(void *arg)
+{
+    (void)arg;
+    uint8_t report[CTAPHID_REPORT_LEN];
+
+    while (1) {
+        // Sleep until a frame or verdict arrives; while anything is in flight
+        // wake at the KEEPALIVE cadence so timers keep running.
+        TickType_t wait = ctaphid_idle(s_ctx) ? portMAX_DELAY : pdMS_TO_TICKS(CTAPHID_KEEPALIVE_MS);
+        ulTaskNotifyTake(pdTRUE, wait);
+
+        while (ctaphid_ring_pop(&s_rx, report)) {
+            ctaphid_on_report(s_ctx, report, sizeof(report));
+        }
+
+        if (s_revoke) {
+            s_revoke = false;
+            ctaphid_up_revoke(s_ctx);
+        }
+        up_msg_t m;
+        if (xQueueReceive(s_up_q, &m, 0) == pdTRUE) {
+            uint32_t parked = ctaphid_up_park_id(s_ctx);
+            if (m.park != parked) {
+                // a late answer to a request that already ended
+                ESP_LOGW(TAG, "verdict for park %u dropped, parked=%u", (unsigned)m.park, (unsigned)parked);
+            } else if (m.verdict == CORE_UP_APPROVED && m.grant.scope) {
+                ctaphid_up_grant(s_ctx, &m.grant);
+            } else {
+                ctaphid_up_resolve(s_ctx, m.verdict);
+            }
+        }
+
+        ctaphid_tick(s_ctx);
+    }
+}
+
+int ctaphid_task_start(ctaphid_ctx_t *ctx)
+{
+    if (s_task) return 0;
+    s_ctx = ctx;
+    if (!s_up_q) s_up_q = xQueueCreate(1, sizeof(up_msg_t));
+    if (!s_up_q) {
+        ESP_LOGE(TAG, "xQueueCreate failed");
+        return -1;
+    }
+    if (xTaskCreate(ctaphid_task, "ctaphid", CTAPHID_TASK_STACK, NULL, CTAPHID_TASK_PRIO, &s_task) != pdPASS) {
+        ESP_LOGE(TAG, "xTaskCreate failed");
+        s_task = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+bool ctaphid_task_post_report(const uint8_t *report, size_t len)
+{
+    if (!s_task || len != CTAPHID_REPORT_LEN) return false;
+
+    // CANCEL is flagged here, ahead of the queue, so a request that is already
+    // being processed by the worker can observe it. Setting it after the push
+    // would race with the worker clearing it for this very frame.
+    bool cancel = report[4] == (CTAPHID_CANCEL | 0x80);
+    uint32_t cid = 0, prev_cancel = 0;
+    if (cancel) {
+        cid = ((uint32_t)report[0] << 24) | ((uint32_t)report[1] << 16) |
+              ((uint32_t)report[2] << 8) | (uint32_t)report[3];
+        prev_cancel = s_ctx->cancel_cid;
+        ctaphid_request_cancel(s_ctx, cid);
+    }
+
+    if (!ctaphid_ring_push(&s_rx, report)) {
+        // the frame that would clear the flag is gone: take it back
+        if (cancel && s_ctx->cancel_cid == cid) ctaphid_request_cancel(s_ctx, prev_cancel);
+        s_rx_dropped++;
+        ESP_LOGW(TAG, "rx ring full, dropped=%u", (unsigned)s_rx_dropped);
+        return false;
+    }
+    xTaskNotifyGive(s_task);
+    return true;
+}
+
+void ctaphid_task_post_up(uint32_t park, bool approved)
+{
+    if (!s_task) return;
+    up_msg_t m = { .park = park, .verdict = approved ? CORE_UP_APPROVED : CORE_UP_DENIED };
+    xQueueOverwrite(s_up_q, &m);
+    xTaskNotifyGive(s_task);
+}
+
+void ctaphid_task_post_grant(uint32_t park, const core_grant_t *grant)
+{
+    if (!s_task) return;
+    up_msg_t m = { .park = park, .verdict = CORE_UP_APPROVED, .grant = *grant };
+    xQueueOverwrite(s_up_q, &m);
+    xTaskNotifyGive(s_task);
+}
+
+void ctaphid_task_post_revoke(void)
+{
+    if (!s_task) return;
+    s_revoke = true;
+    xTaskNotifyGive(s_task);
+}
@@ -0,0 +1,90 @@
+#include "ctaphid_trace.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+
+#include "ctaphid_port.h"
+
+_Static_assert((CTAPHID_TRACE_DEPTH & (CTAPHID_TRACE_DEPTH - 1)) == 0,
+               "CTAPHID_TRACE_DEPTH must be a power of two");
+
+#define DUMP_CHUNK 16
+
+static ctaphid_trace_rec_t s_ring[CTAPHID_TRACE_DEPTH];
+static atomic_uint s_head;    // next record index, free running
+
+void ctaphid_trace_record(uint8_t ev, uint32_t cid, uint8_t cmd, uint8_t seq, uint8_t rc)
+{
+    unsigned h = atomic_load_explicit(&s_head, memory_order_relaxed);
+    ctaphid_trace_rec_t *r = &s_ring[h & (CTAPHID_TRACE_DEPTH - 1)];
+    r->ts_us = (uint32_t)ctaphid_port_now_us();
+    r->cid = cid;
+    r->ev = ev;
+    r->cmd = cmd;
+    r->seq = seq;
+    r->rc = rc;
+    atomic_store_explicit(&s_head, h + 1, memory_order_release);
+}
+
+// Copies records [from, to) and drops the ones the writer lapped meanwhile.
+static size_t copy_range(ctaphid_trace_rec_t *out, unsigned from, unsigned to)
+{
+    for (unsigned i = from; i != to; i++) {
+        out[i - from] = s_ring[i & (CTAPHID_TRACE_DEPTH - 1)];
+    }
+    atomic_thread_fence(memory_order_acquire);
+    // The writer may already be filling slot `after`, i.e. record after - DEPTH.
+    unsigned after = atomic_load_explicit(&s_head, memory_order_relaxed);
+    unsigned oldest_intact = after - CTAPHID_TRACE_DEPTH + 1;
+    if ((int)(oldest_intact - from) <= 0) return to - from;
+
+    // The first (oldest_intact - from) records may be torn.
+    unsigned skip = oldest_intact - from;
+    if (skip >= to - from) return 0;
+    for (unsigned i = 0; i < to - from - skip; i++) out[i] = out[i + skip];
+    return to - from - skip;
+}
+
+size_t ctaphid_trace_snapshot(ctaphid_trace_rec_t *out, size_t max)
+{
+    unsigned head = atomic_load_explicit(&s_head, memory_order_acquire);
+    size_t avail = head < CTAPHID_TRACE_DEPTH ? head : CTAPHID_TRACE_DEPTH;
+    if (avail > max) avail = max;
+    return copy_range(out, head - (unsigned)avail, head);
+}
+
+uint32_t ctaphid_trace_total(void)
+{
+    return atomic_load_explicit(&s_head, memory_order_acquire);
+}
+
+void ctaphid_trace_clear(void)
+{
+    atomic_store_explicit(&s_head, 0, memory_order_release);
+}
+
+void ctaphid_trace_dump(ctaphid_trace_out_fn out, void *user)
+{
+    char line[64];
+    unsigned head = atomic_load_explicit(&s_head, memory_order_acquire);
+    unsigned avail = head < CTAPHID_TRACE_DEPTH ? head : CTAPHID_TRACE_DEPTH;
+
+    snprintf(line, sizeof(line), "TRACE BEGIN v%d depth=%u total=%u",
+             CTAPHID_TRACE_VERSION, (unsigned)CTAPHID_TRACE_DEPTH, head);
+    out(user, line);
+
+    // Small chunks keep the stack use flat; the writer keeps running.
+    ctaphid_trace_rec_t chunk[DUMP_CHUNK];
+    for (unsigned from = head - avail; from != head;) {
+        unsigned n = head - from > DUMP_CHUNK ? DUMP_CHUNK : head - from;
+        size_t got = copy_range(chunk, from, from + n);
+        for (size_t i = 0; i < got; i++) {
+            const ctaphid_trace_rec_t *r = &chunk[i];
+            snprintf(line, sizeof(line), "%08x%08x%02x%02x%02x%02x",
+                     (unsigned)r->ts_us, (unsigned)r->cid, r->ev, r->cmd, r->seq, r->rc);
+            out(user, line);
+        }
+        from += n;
+    }
+    out(user, "TRACE END");
+}
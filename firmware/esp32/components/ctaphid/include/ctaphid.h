@@ -1,7 +1,12 @@
 #pragma once
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
+#include "core_api.h"
+#include "ctaphid_capture.h"
+#include "ctaphid_pool.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -14,32 +19,103 @@ extern "C" {
 #define CTAPHID_INIT   0x06
 #define CTAPHID_CBOR   0x10
 #define CTAPHID_CANCEL 0x11
+#define CTAPHID_KEEPALIVE 0x3B
 #define CTAPHID_ERROR  0x3F
 
-typedef int (*ctaphid_send_report_fn)(void *user, const uint8_t *report64);
+// KEEPALIVE status byte
+#define CTAPHID_STATUS_PROCESSING 1
+#define CTAPHID_STATUS_UPNEEDED   2
+
+#define CTAPHID_KEEPALIVE_MS 100
+
+typedef uint8_t *(*ctaphid_tx_reserve_fn)(void *user);
+typedef int (*ctaphid_tx_commit_fn)(void *user);
+typedef void (*ctaphid_tx_abort_fn)(void *user);
+typedef void (*ctaphid_up_request_fn)(void *user, uint32_t cid);
+typedef void (*ctaphid_up_done_fn)(void *user, uint32_t park);
 
 typedef struct {
-    // caller provides output function to send 64-byte IN reports (usb_hid_send_report wrapper)
-    ctaphid_send_report_fn send_report;
-    void *send_user;
+    // IN report queue (usb_hid_tx_* wrappers). Messages are framed in place:
+    // reserve returns a free 64-byte slot or NULL, commit publishes every
+    // reserved slot in order, abort drops them.
+    ctaphid_tx_reserve_fn tx_reserve;
+    ctaphid_tx_commit_fn tx_commit;
+    ctaphid_tx_abort_fn tx_abort;
+    void *tx_user;
+    // asks for user presence (phone approval); answer with ctaphid_up_resolve()
+    ctaphid_up_request_fn up_request;
+    // optional: the parked request `park` (ctaphid_up_park_id) got its
+    // verdict, was cancelled or timed out; withdraw whatever asked for it
+    ctaphid_up_done_fn up_done;
+    void *up_user;
 } ctaphid_io_t;
 
-// CTAP HID context (single in-flight message).
-typedef struct ctaphid_ctx {
-    ctaphid_io_t io;
+#ifndef CTAPHID_MAX_CHANNELS
+#ifdef CONFIG_CTAPHID_MAX_CHANNELS
+#define CTAPHID_MAX_CHANNELS CONFIG_CTAPHID_MAX_CHANNELS
+#else
+#define CTAPHID_MAX_CHANNELS 4   // concurrent reassembly slots
+#endif
+#endif
+
+#ifndef CTAPHID_INLINE_MSG_SIZE
+#ifdef CONFIG_CTAPHID_INLINE_MSG_SIZE
+#define CTAPHID_INLINE_MSG_SIZE CONFIG_CTAPHID_INLINE_MSG_SIZE
+#else
+#define CTAPHID_INLINE_MSG_SIZE 256
+#endif
+#endif
+
+// Workspace for the Rust core context; core_ctx_size() must fit.
+#ifndef CTAPHID_CORE_MEM_SIZE
+#define CTAPHID_CORE_MEM_SIZE 1024
+#endif
 
-    // Reassembly state
-    uint32_t cur_cid;
-    uint8_t  cur_cmd;
-    uint16_t cur_len;
+// One reassembly slot, keyed by CID. cid == 0 marks the slot free.
+// `buf` points at `inline_buf` or at a pool buffer for larger messages.
+typedef struct {
+    uint32_t cid;
+    uint8_t  cmd;
+    uint16_t len;
     uint16_t got;
     uint8_t  next_seq;
     uint64_t started_at_us;
-    uint8_t  buf[1024];   // MAX_MSG_SIZE in ctaphid.c
+    uint64_t last_rx_us;   // LRU key and inactivity timeout reference
+    uint8_t *buf;
+    uint8_t  inline_buf[CTAPHID_INLINE_MSG_SIZE];
+} ctaphid_chan_t;
+
+// CTAP HID context. Channels reassemble independently; completed messages
+// are dispatched to the core one at a time from ctaphid_on_report().
+typedef struct ctaphid_ctx {
+    ctaphid_io_t io;
 
-    // core workspace
-    uint8_t core_mem[512];
-    uint8_t core_resp[1024];
+    ctaphid_chan_t chan[CTAPHID_MAX_CHANNELS];
+    ctaphid_pool_t pool;   // large requests and overflowing responses
+
+    // CID named by the most recent CANCEL, set from the USB task ahead of the
+    // frame queue (see ctaphid_request_cancel). 0 = none.
+    volatile uint32_t cancel_cid;
+
+    // CBOR request parked on the user-presence gate; its slot stays allocated
+    // until a verdict, CANCEL or timeout.
+    ctaphid_chan_t *up_chan;
+    uint32_t up_park;   // numbers parks, so a verdict can name the one it is for
+    uint64_t up_since_us;
+    uint64_t up_keepalive_us;
+
+    // messages send_msg gave up on because the IN queue stayed full
+    uint32_t tx_dropped;
+
+#if CTAPHID_CAPTURE_ENABLED
+    // IN reports reserved since the last commit, captured when it happens
+    uint8_t *cap_slot[CTAPHID_CAPTURE_SLOTS];
+    unsigned cap_reserved;
+#endif
+
+    // core workspace (responses are encoded straight into IN report slots);
+    // the core lays its context over it and refuses a misaligned one
+    _Alignas(max_align_t) uint8_t core_mem[CTAPHID_CORE_MEM_SIZE];
 } ctaphid_ctx_t;
 
 void ctaphid_init(ctaphid_ctx_t *ctx, const ctaphid_io_t *io);
@@ -47,6 +123,41 @@ void ctaphid_init(ctaphid_ctx_t *ctx, const ctaphid_io_t *io);
 // feed OUT report from host (exactly 64 bytes)
 void ctaphid_on_report(ctaphid_ctx_t *ctx, const uint8_t *report, size_t len);
 
+// Flag a CANCEL for `cid` before its frame reaches ctaphid_on_report, so a
+// request already in the core answers CTAP2_ERR_KEEPALIVE_CANCEL. May be
+// called from a different task than ctaphid_on_report.
+void ctaphid_request_cancel(ctaphid_ctx_t *ctx, uint32_t cid);
+
+// Deliver the user-presence verdict (CORE_UP_APPROVED/DENIED/TIMEOUT) for the
+// parked request and complete it. Ignored if nothing is waiting.
+void ctaphid_up_resolve(ctaphid_ctx_t *ctx, int verdict);
+
+// What the parked request asks presence for (core_up_prompt). Nonzero if
+// nothing is parked. Call from the task that owns `ctx`, e.g. in up_request.
+int ctaphid_up_prompt(ctaphid_ctx_t *ctx, core_up_prompt_t *out);
+
+// Number of the request parked now, new for every park (a replay that parks
+// again gets a new one); 0 if nothing is parked. Call from the task that
+// owns `ctx`; a verdict for another number is stale.
+uint32_t ctaphid_up_park_id(const ctaphid_ctx_t *ctx);
+
+// Approve the parked request and keep approving what `grant` covers (see
+// core_grant_presence). A grant the core refuses still approves this one.
+void ctaphid_up_grant(ctaphid_ctx_t *ctx, const core_grant_t *grant);
+
+// Drop every presence grant; the next sign-in asks the phone again.
+void ctaphid_up_revoke(ctaphid_ctx_t *ctx);
+
+// Periodic housekeeping: KEEPALIVE while a request waits for presence and
+// reassembly/presence timeouts. Call at least every CTAPHID_KEEPALIVE_MS
+// while ctaphid_idle() is false.
+void ctaphid_tick(ctaphid_ctx_t *ctx);
+
+// True when no channel is reassembling and nothing waits for presence.
+bool ctaphid_idle(const ctaphid_ctx_t *ctx);
+
+void ctaphid_get_pool_stats(const ctaphid_ctx_t *ctx, ctaphid_pool_stats_t *out);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,120 @@
+#pragma once
+// Full-content capture of CTAPHID traffic for record/replay.
+//
+// Where the trace ring (ctaphid_trace.h) keeps 12 bytes of metadata per
+// event, a capture keeps whatever is needed to run a session again: every
+// OUT report as it reached ctaphid_on_report, every IN report as it was
+// committed, and the inputs that don't come from the host - presence
+// verdicts and grants, revocations, housekeeping ticks and (on the host)
+// crypto pool refills - each with the engine's own timestamp.
+//
+// On the device records go to a RAM ring that the "capture" console command
+// dumps as hex text; tooling/trace/ctaphid_capture.py turns the dump into a
+// capture file. roottap-sim --record streams them to a file through a sink.
+// firmware/host's ctaphid-replay feeds a capture back into the engine.
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef ESP_PLATFORM
+#include "sdkconfig.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef CTAPHID_CAPTURE_ENABLED
+#if defined(CONFIG_CTAPHID_CAPTURE) || !defined(ESP_PLATFORM)
+#define CTAPHID_CAPTURE_ENABLED 1
+#else
+#define CTAPHID_CAPTURE_ENABLED 0
+#endif
+#endif
+
+#ifndef CTAPHID_CAPTURE_DEPTH
+#ifdef CONFIG_CTAPHID_CAPTURE_DEPTH
+#define CTAPHID_CAPTURE_DEPTH CONFIG_CTAPHID_CAPTURE_DEPTH
+#else
+#define CTAPHID_CAPTURE_DEPTH 128   // records, 80 bytes each
+#endif
+#endif
+
+// IN reports one message may hold reserved before committing them; more are
+// sent but left out of the capture (counted in ctaphid_capture_lost).
+#define CTAPHID_CAPTURE_SLOTS 32
+
+// Bump when record meanings or the file layout change.
+#define CTAPHID_CAPTURE_VERSION 1
+
+enum {
+    CTAPHID_CAP_OUT = 1,   // OUT report fed to ctaphid_on_report: data
+    CTAPHID_CAP_IN,        // IN report committed: data
+    CTAPHID_CAP_UP,        // ctaphid_up_resolve: arg = CORE_UP_*
+    CTAPHID_CAP_GRANT,     // ctaphid_up_grant: arg = scope, uses, ttl_s
+    CTAPHID_CAP_REVOKE,    // ctaphid_up_revoke
+    CTAPHID_CAP_TICK,      // ctaphid_tick with something in flight
+    CTAPHID_CAP_REFILL,    // crypto_pool_refill: arg = items made (host only)
+};
+
+// 80 bytes, little-endian in files.
+typedef struct {
+    uint64_t ts_us;   // ctaphid_port_now_us() as the engine saw it
+    uint8_t  type;
+    uint8_t  arg;
+    uint16_t uses;
+    uint32_t ttl_s;
+    uint8_t  data[64];
+} ctaphid_cap_rec_t;
+
+// File layout: this header, then records until EOF.
+#define CTAPHID_CAP_MAGIC "RTCAP\r\n\x1a"
+
+#define CTAPHID_CAP_F_SEEDED 0x1   // recorded with a known RNG seed (roottap-sim)
+#define CTAPHID_CAP_F_DEVICE 0x2   // converted from a device dump
+
+typedef struct {
+    char     magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint64_t seed;       // valid with CTAPHID_CAP_F_SEEDED
+    uint32_t rec_size;   // sizeof(ctaphid_cap_rec_t)
+    uint32_t lost;       // records dropped while recording
+} ctaphid_cap_file_hdr_t;
+
+// Receives each record instead of the ring (roottap-sim --record).
+typedef void (*ctaphid_capture_sink_fn)(void *user, const ctaphid_cap_rec_t *rec);
+
+// Receives one line of dump text (no line terminator).
+typedef void (*ctaphid_capture_out_fn)(void *user, const char *line);
+
+// Starts recording, into the ring or to `sink` when not NULL. The ring
+// keeps the first CTAPHID_CAPTURE_DEPTH records and counts the rest as
+// lost: a replay has to start where the session did. May be called from
+// another task (the console); set a sink only before the engine runs.
+void ctaphid_capture_start(ctaphid_capture_sink_fn sink, void *user);
+
+void ctaphid_capture_stop(void);
+
+bool ctaphid_capture_active(void);
+
+// Single writer: the task running the engine.
+void ctaphid_capture_record(uint8_t type, uint64_t ts_us, const uint8_t *data);
+
+// Same, for the event records that carry arg/uses/ttl_s instead of data.
+void ctaphid_capture_event(uint8_t type, uint64_t ts_us, uint8_t arg, uint16_t uses, uint32_t ttl_s);
+
+// Notes records that could not be kept (too many IN slots).
+void ctaphid_capture_lose(unsigned n);
+
+// Records written since the last start, and records lost.
+uint32_t ctaphid_capture_total(void);
+uint32_t ctaphid_capture_lost(void);
+
+// Writes "CAPTURE BEGIN ...", one hex line per ring record, "CAPTURE END".
+// Stop the capture first; the ring is not copied out atomically.
+void ctaphid_capture_dump(ctaphid_capture_out_fn out, void *user);
+
+#ifdef __cplusplus
+}
+#endif
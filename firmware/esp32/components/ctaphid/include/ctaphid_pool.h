@@ -0,0 +1,49 @@
+#pragma once
+#include <stdint.h>
+
+#ifdef ESP_PLATFORM
+#include "sdkconfig.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// CTAPHID spec maximum: 57 + 128 * 59 bytes.
+#define CTAPHID_MAX_MSG_SIZE 7609
+
+#ifndef CTAPHID_MSG_POOL_COUNT
+#ifdef CONFIG_CTAPHID_MSG_POOL_COUNT
+#define CTAPHID_MSG_POOL_COUNT CONFIG_CTAPHID_MSG_POOL_COUNT
+#else
+#define CTAPHID_MSG_POOL_COUNT 2
+#endif
+#endif
+
+// Fixed pool of full-size message buffers. Owned by the CTAPHID worker; not
+// thread-safe.
+typedef struct {
+    uint8_t  buf[CTAPHID_MSG_POOL_COUNT][CTAPHID_MAX_MSG_SIZE];
+    uint32_t used_mask;
+    uint8_t  in_use;
+    uint8_t  peak;
+    uint32_t allocs;
+    uint32_t alloc_fail;
+} ctaphid_pool_t;
+
+typedef struct {
+    uint8_t  count;
+    uint8_t  in_use;
+    uint8_t  peak;         // most buffers ever in use at once
+    uint32_t allocs;
+    uint32_t alloc_fail;   // requests turned away because the pool was empty
+} ctaphid_pool_stats_t;
+
+void ctaphid_pool_init(ctaphid_pool_t *p);
+uint8_t *ctaphid_pool_alloc(ctaphid_pool_t *p);
+void ctaphid_pool_free(ctaphid_pool_t *p, uint8_t *buf);
+void ctaphid_pool_get_stats(const ctaphid_pool_t *p, ctaphid_pool_stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,35 @@
+#pragma once
+// Platform services used by the CTAPHID engine. ctaphid_port_esp.c backs
+// them with esp_timer/esp_random on the device; firmware/host provides a
+// Linux implementation so the protocol path builds and runs off-target.
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Monotonic time in microseconds. */
+uint64_t ctaphid_port_now_us(void);
+
+/** 32 random bits (channel IDs). */
+uint32_t ctaphid_port_random(void);
+
+/** Free-running CPU cycle counter for benchmarks; wraps, so use deltas. */
+uint32_t ctaphid_port_cycles(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef ESP_PLATFORM
+#include "esp_log.h"
+#define CTAPHID_LOGE ESP_LOGE
+#define CTAPHID_LOGW ESP_LOGW
+#define CTAPHID_LOGI ESP_LOGI
+#else
+#include <stdio.h>
+#define CTAPHID_LOG_HOST(lvl, tag, fmt, ...) fprintf(stderr, lvl " (%s) " fmt "\n", tag, ##__VA_ARGS__)
+#define CTAPHID_LOGE(tag, fmt, ...) CTAPHID_LOG_HOST("E", tag, fmt, ##__VA_ARGS__)
+#define CTAPHID_LOGW(tag, fmt, ...) CTAPHID_LOG_HOST("W", tag, fmt, ##__VA_ARGS__)
+#define CTAPHID_LOGI(tag, fmt, ...) CTAPHID_LOG_HOST("I", tag, fmt, ##__VA_ARGS__)
+#endif
@@ -0,0 +1,45 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ctaphid.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef CTAPHID_TASK_STACK
+#define CTAPHID_TASK_STACK 8192
+#endif
+
+#ifndef CTAPHID_TASK_PRIO
+#define CTAPHID_TASK_PRIO 4   // below the TinyUSB task so IN completions are never starved
+#endif
+
+/** Start the CTAPHID worker task that owns `ctx` from now on. */
+int ctaphid_task_start(ctaphid_ctx_t *ctx);
+
+/**
+ * Queue one OUT report for the worker. Safe to call from the TinyUSB task;
+ * copies 64 bytes and never blocks. Returns false if the ring was full and
+ * the report was dropped.
+ */
+bool ctaphid_task_post_report(const uint8_t *report, size_t len);
+
+/**
+ * Forward a user-presence verdict (phone approve/deny) for the parked request
+ * `park` (ctaphid_up_park_id) to the worker. Dropped if that request is no
+ * longer the parked one. Any task.
+ */
+void ctaphid_task_post_up(uint32_t park, bool approved);
+
+/** Approve `park`, and let `grant` approve what follows (ctaphid_up_grant). Any task. */
+void ctaphid_task_post_grant(uint32_t park, const core_grant_t *grant);
+
+/** Drop every presence grant (ctaphid_up_revoke). Any task. */
+void ctaphid_task_post_revoke(void);
+
+#ifdef __cplusplus
+}
+#endif
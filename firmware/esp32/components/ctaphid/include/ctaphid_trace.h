@@ -0,0 +1,96 @@
+#pragma once
+// Hot-path diagnostics for the CTAPHID engine.
+//
+// Per-frame log lines cost a console write over the same USB device for every
+// 64-byte report, so they only exist with CONFIG_CTAPHID_LOG_FRAMES. The
+// trace ring is the cheap alternative: a fixed-size 12-byte record per event,
+// dumped on demand as hex text (ctaphid_trace_dump) and decoded on the host by
+// tooling/trace/ctaphid_trace.py.
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef ESP_PLATFORM
+#include "sdkconfig.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef CTAPHID_LOG_FRAMES
+#ifdef CONFIG_CTAPHID_LOG_FRAMES
+#define CTAPHID_LOG_FRAMES 1
+#else
+#define CTAPHID_LOG_FRAMES 0
+#endif
+#endif
+
+#ifndef CTAPHID_TRACE_ENABLED
+#if defined(CONFIG_CTAPHID_TRACE) || !defined(ESP_PLATFORM)
+#define CTAPHID_TRACE_ENABLED 1
+#else
+#define CTAPHID_TRACE_ENABLED 0
+#endif
+#endif
+
+#ifndef CTAPHID_TRACE_DEPTH
+#ifdef CONFIG_CTAPHID_TRACE_DEPTH
+#define CTAPHID_TRACE_DEPTH CONFIG_CTAPHID_TRACE_DEPTH
+#else
+#define CTAPHID_TRACE_DEPTH 256   // records, power of two
+#endif
+#endif
+
+// Record types. Bump CTAPHID_TRACE_VERSION when meanings change; the decoder
+// keys on it.
+#define CTAPHID_TRACE_VERSION 1
+
+enum {
+    CTAPHID_TR_RX = 1,       // OUT frame: cmd = init cmd | 0x80 or 0, seq = cont seq
+    CTAPHID_TR_TX,           // message queued: cmd, seq = frames, rc = 0 ok / 1 dropped
+    CTAPHID_TR_ERR,          // CTAPHID_ERROR sent: rc = error code
+    CTAPHID_TR_CBOR,         // core finished: seq = CTAP command, rc = CTAP status
+    CTAPHID_TR_UP_PARK,      // request parked on user presence
+    CTAPHID_TR_UP_DONE,      // presence verdict applied: rc = CORE_UP_*
+    CTAPHID_TR_CANCEL,       // CANCEL frame: rc = 0 idle, 1 parked request, 2 reassembly
+    CTAPHID_TR_EXPIRE,       // reassembly timed out
+    CTAPHID_TR_EVICT,        // slot reclaimed for a new channel
+};
+
+typedef struct {
+    uint32_t ts_us;   // low 32 bits of ctaphid_port_now_us()
+    uint32_t cid;
+    uint8_t  ev;
+    uint8_t  cmd;
+    uint8_t  seq;
+    uint8_t  rc;
+} ctaphid_trace_rec_t;
+
+// Receives one line of dump text (no line terminator).
+typedef void (*ctaphid_trace_out_fn)(void *user, const char *line);
+
+// Single writer: the task running the engine.
+void ctaphid_trace_record(uint8_t ev, uint32_t cid, uint8_t cmd, uint8_t seq, uint8_t rc);
+
+// Copies up to `max` of the newest records, oldest first. Safe to call from
+// another task; records overwritten during the copy are left out.
+size_t ctaphid_trace_snapshot(ctaphid_trace_rec_t *out, size_t max);
+
+// Records written since boot (or the last clear), including overwritten ones.
+uint32_t ctaphid_trace_total(void);
+
+void ctaphid_trace_clear(void);
+
+// Writes "TRACE BEGIN ...", one hex line per record and "TRACE END".
+void ctaphid_trace_dump(ctaphid_trace_out_fn out, void *user);
+
+#if CTAPHID_TRACE_ENABLED
+#define CTAPHID_TRACE(ev, cid, cmd, seq, rc) \
+    ctaphid_trace_record((ev), (cid), (uint8_t)(cmd), (uint8_t)(seq), (uint8_t)(rc))
+#else
+#define CTAPHID_TRACE(ev, cid, cmd, seq, rc) do { } while (0)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
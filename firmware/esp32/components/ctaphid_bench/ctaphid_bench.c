@@ -0,0 +1,2424 @@
+#include "ctaphid_bench.h"
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "approval.h"
+#include "core_api.h"
+#include "cred_store.h"
+#include "crypto.h"
+#include "ctaphid.h"
+#include "ctaphid_port.h"
+
+#ifndef CTAPHID_BENCH_TXQ_DEPTH
+#ifdef CONFIG_USB_HID_TXQ_DEPTH
+#define CTAPHID_BENCH_TXQ_DEPTH CONFIG_USB_HID_TXQ_DEPTH
+#else
+#define CTAPHID_BENCH_TXQ_DEPTH 20   // same default as usb_hid
+#endif
+#endif
+
+#ifdef CONFIG_IDF_TARGET
+#define BENCH_PLATFORM CONFIG_IDF_TARGET
+#else
+#define BENCH_PLATFORM "host"
+#endif
+
+#define INIT_PAYLOAD_MAX 57
+#define CONT_PAYLOAD_MAX 59
+#define BUS_POLL_US      1000   // full-speed interrupt endpoint, bInterval 1
+#define MAX_REQS         16
+#define MAX_SAMPLES      512
+#define DEFAULT_REPS     50
+
+#define CTAP_CMD_MAKE_CREDENTIAL 0x01
+#define CTAP_CMD_GET_ASSERTION   0x02
+#define CTAP_CMD_GET_INFO  0x04
+#define CTAP_CMD_CLIENT_PIN 0x06
+#define CTAP_CMD_GET_NEXT_ASSERTION 0x08
+#define CTAP_CMD_SELECTION 0x0B   // always asks for user presence
+
+#define ERR_MSG_TIMEOUT  0x05
+#define ERR_CHANNEL_BUSY 0x06
+#define CTAP2_ERR_KEEPALIVE_CANCEL    0x2D
+#define CTAP2_ERR_NO_CREDENTIALS      0x2E
+#define CTAP2_ERR_USER_ACTION_TIMEOUT 0x2F
+#define CTAP2_ERR_NOT_ALLOWED         0x30
+#define CTAP2_ERR_PIN_INVALID         0x31
+#define CTAP2_ERR_PIN_AUTH_INVALID    0x33
+#define CTAP2_ERR_UNAUTHORIZED_PERMISSION 0x40
+
+// Far beyond the engine's reassembly (3 s) and presence (30 s) timeouts.
+#define BACKDATE_US (60ULL * 1000 * 1000)
+
+typedef enum {
+    EXPECT_ECHO,          // PING payload back
+    EXPECT_INIT,          // INIT response carrying our nonce
+    EXPECT_CBOR_OK,       // CBOR, status 0 and a body
+    EXPECT_CBOR_STATUS,   // CBOR, exactly one status byte == code
+    EXPECT_CBOR_ANY,      // any CBOR response (fuzzing: only liveness counts)
+    EXPECT_ERROR,         // CTAPHID_ERROR == code
+} expect_t;
+
+typedef struct {
+    bool     active;
+    bool     busy_ok;      // ERR_CHANNEL_BUSY is an acceptable answer
+    uint32_t cid;
+    uint8_t  cmd;
+    uint16_t len;
+    uint32_t seed;
+    uint8_t  small[16];    // payload when len <= sizeof(small), else patterned
+    const uint8_t *data;   // caller-owned payload, overrides both
+    expect_t expect;
+    uint8_t  code;
+
+    // OUT frame generator
+    bool     started;
+    bool     sent_all;
+    uint16_t off;
+    uint8_t  seq;
+
+    uint64_t t0_us;        // wall clock at the first frame (or the CANCEL)
+    uint64_t bus0_us;      // modelled bus time at the same point
+} bench_req_t;
+
+typedef struct {
+    uint32_t msgs;
+    uint32_t ok;
+    uint32_t bad;
+    uint32_t busy;
+    uint32_t timeouts;
+    uint32_t keepalives;
+    uint32_t unsolicited;
+    uint32_t framing;
+    uint32_t frames_in;
+    uint32_t frames_out;
+    uint64_t engine_cycles;
+    uint32_t tx_stalls;
+    uint32_t tx_refused;
+    uint32_t tx_high_water;
+    unsigned nsamples;
+    uint32_t lat_us[MAX_SAMPLES];
+    uint32_t bus_us[MAX_SAMPLES];
+} bench_stats_t;
+
+typedef struct {
+    const ctaphid_bench_cfg_t *cfg;
+    ctaphid_ctx_t ctx;
+
+    // IN endpoint: committed reports wait here for the next 1 ms poll
+    uint8_t  txq[CTAPHID_BENCH_TXQ_DEPTH][CTAPHID_REPORT_LEN];
+    unsigned tx_head;
+    unsigned tx_count;
+    unsigned tx_reserved;
+    uint64_t bus_us;
+    // reservations left before usb_hid_tx_reserve starts timing out, as if
+    // the host stopped polling; -1 = no limit
+    int      tx_budget;
+
+    // cycles spent in the model while the engine is on the stack
+    bool     in_engine;
+    uint32_t model_cycles;
+
+    // host side reassembly of IN reports
+    bool     rx_active;
+    uint32_t rx_cid;
+    uint8_t  rx_cmd;
+    uint8_t  rx_seq;
+    uint16_t rx_len;
+    uint16_t rx_got;
+    uint8_t  rx_buf[CTAPHID_MAX_MSG_SIZE];
+
+    // verdict given as soon as a request parks on presence (0 = leave it
+    // parked for CANCEL/timeout scenarios)
+    int up_verdict;
+    // sent along with an approval when its scope is set
+    core_grant_t up_grant;
+    unsigned up_asked;
+    uint32_t up_ended;     // last park reported done
+
+    // body of the last CBOR response that came back with status 0
+    uint8_t  cbor_resp[512];
+    uint16_t cbor_resp_len;
+
+    bench_req_t reqs[MAX_REQS];
+    bench_stats_t st;
+} bench_t;
+
+static bench_t s_bench;
+
+static void put_be32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+static uint32_t be32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint16_t be16(const uint8_t *p)
+{
+    return (uint16_t)(((uint16_t)p[0] << 8) | p[1]);
+}
+
+static uint8_t pattern_byte(uint32_t seed, size_t i)
+{
+    return (uint8_t)(seed * 31u + i * 7u + (i >> 8));
+}
+
+static void emit(bench_t *b, const char *fmt, ...)
+{
+    char line[640];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(line, sizeof(line), fmt, ap);
+    va_end(ap);
+    b->cfg->out(b->cfg->out_user, line);
+}
+
+// ---- engine calls: cycles exclude the IN endpoint model ----
+
+static uint32_t engine_enter(bench_t *b)
+{
+    b->in_engine = true;
+    b->model_cycles = 0;
+    return ctaphid_port_cycles();
+}
+
+static void engine_leave(bench_t *b, uint32_t c0)
+{
+    uint32_t dc = ctaphid_port_cycles() - c0;
+    b->in_engine = false;
+    b->st.engine_cycles += dc - b->model_cycles;
+}
+
+// ---- host side ----
+
+static bench_req_t *req_find(bench_t *b, uint32_t cid)
+{
+    for (size_t i = 0; i < MAX_REQS; i++) {
+        if (b->reqs[i].active && b->reqs[i].cid == cid) return &b->reqs[i];
+    }
+    return NULL;
+}
+
+static bench_req_t *req_add(bench_t *b, uint32_t cid, uint8_t cmd, uint16_t len,
+                            uint32_t seed, expect_t expect, uint8_t code)
+{
+    for (size_t i = 0; i < MAX_REQS; i++) {
+        bench_req_t *r = &b->reqs[i];
+        if (r->active) continue;
+        memset(r, 0, sizeof(*r));
+        r->active = true;
+        r->cid = cid;
+        r->cmd = cmd;
+        r->len = len;
+        r->seed = seed;
+        r->expect = expect;
+        r->code = code;
+        for (size_t k = 0; k < sizeof(r->small); k++) r->small[k] = pattern_byte(seed, k);
+        b->st.msgs++;
+        return r;
+    }
+    return NULL;
+}
+
+static void req_fill(const bench_req_t *r, uint8_t *dst, uint16_t off, uint16_t n)
+{
+    if (r->data) {
+        memcpy(dst, r->data + off, n);
+        return;
+    }
+    if (r->len <= sizeof(r->small)) {
+        memcpy(dst, r->small + off, n);
+        return;
+    }
+    for (uint16_t i = 0; i < n; i++) dst[i] = pattern_byte(r->seed, (size_t)off + i);
+}
+
+static bool payload_matches(const bench_req_t *r, const uint8_t *data, uint16_t len)
+{
+    if (len != r->len) return false;
+    if (len <= sizeof(r->small)) return memcmp(data, r->small, len) == 0;
+    for (uint16_t i = 0; i < len; i++) {
+        if (data[i] != pattern_byte(r->seed, i)) return false;
+    }
+    return true;
+}
+
+static void record_sample(bench_t *b, const bench_req_t *r)
+{
+    if (b->st.nsamples >= MAX_SAMPLES) return;
+    b->st.lat_us[b->st.nsamples] = (uint32_t)(ctaphid_port_now_us() - r->t0_us);
+    b->st.bus_us[b->st.nsamples] = (uint32_t)(b->bus_us - r->bus0_us);
+    b->st.nsamples++;
+}
+
+static void host_msg(bench_t *b, uint32_t cid, uint8_t cmd, const uint8_t *data, uint16_t len)
+{
+    if (cmd == CTAPHID_KEEPALIVE) {
+        b->st.keepalives++;
+        return;
+    }
+
+    bool is_err = cmd == CTAPHID_ERROR && len == 1;
+    if (is_err && data[0] == ERR_CHANNEL_BUSY) b->st.busy++;
+    if (is_err && data[0] == ERR_MSG_TIMEOUT) b->st.timeouts++;
+
+    bench_req_t *r = req_find(b, cid);
+    if (!r) {
+        b->st.unsolicited++;
+        return;
+    }
+
+    bool ok = false;
+    switch (r->expect) {
+    case EXPECT_ECHO:
+        ok = cmd == r->cmd && payload_matches(r, data, len);
+        break;
+    case EXPECT_INIT:
+        ok = cmd == CTAPHID_INIT && len == 17 && memcmp(data, r->small, 8) == 0;
+        break;
+    case EXPECT_CBOR_OK:
+        ok = cmd == CTAPHID_CBOR && len > 1 && data[0] == 0;
+        if (ok && len <= sizeof(b->cbor_resp)) {
+            memcpy(b->cbor_resp, data, len);
+            b->cbor_resp_len = len;
+        }
+        break;
+    case EXPECT_CBOR_STATUS:
+        ok = cmd == CTAPHID_CBOR && len == 1 && data[0] == r->code;
+        break;
+    case EXPECT_CBOR_ANY:
+        ok = cmd == CTAPHID_CBOR && len >= 1;
+        break;
+    case EXPECT_ERROR:
+        ok = is_err && data[0] == r->code;
+        break;
+    }
+    if (!ok && r->busy_ok && is_err && data[0] == ERR_CHANNEL_BUSY) {
+        ok = true;
+    }
+
+    if (ok) {
+        b->st.ok++;
+        record_sample(b, r);
+    } else {
+        b->st.bad++;
+    }
+    r->active = false;
+}
+
+static void host_rx(bench_t *b, const uint8_t *report)
+{
+    uint32_t cid = be32(report);
+    uint8_t b4 = report[4];
+    uint16_t n;
+
+    b->st.frames_out++;
+    if (b4 & 0x80) {
+        if (b->rx_active) b->st.framing++;   // previous message cut short
+        b->rx_active = true;
+        b->rx_cid = cid;
+        b->rx_cmd = (uint8_t)(b4 & 0x7F);
+        b->rx_len = be16(&report[5]);
+        b->rx_seq = 0;
+        if (b->rx_len > CTAPHID_MAX_MSG_SIZE) {
+            b->st.framing++;
+            b->rx_active = false;
+            return;
+        }
+        n = b->rx_len > INIT_PAYLOAD_MAX ? INIT_PAYLOAD_MAX : b->rx_len;
+        memcpy(b->rx_buf, &report[7], n);
+        b->rx_got = n;
+    } else {
+        if (!b->rx_active || cid != b->rx_cid || b4 != b->rx_seq) {
+            b->st.framing++;
+            b->rx_active = false;
+            return;
+        }
+        uint16_t remaining = (uint16_t)(b->rx_len - b->rx_got);
+        n = remaining > CONT_PAYLOAD_MAX ? CONT_PAYLOAD_MAX : remaining;
+        memcpy(b->rx_buf + b->rx_got, &report[5], n);
+        b->rx_got = (uint16_t)(b->rx_got + n);
+        b->rx_seq++;
+    }
+
+    if (b->rx_got >= b->rx_len) {
+        b->rx_active = false;
+        host_msg(b, b->rx_cid, b->rx_cmd, b->rx_buf, b->rx_len);
+    }
+}
+
+// One 1 ms frame interval: the host takes at most one IN report.
+static void bus_poll(bench_t *b)
+{
+    b->bus_us += BUS_POLL_US;
+    if (b->tx_count == 0) return;
+
+    uint32_t c0 = ctaphid_port_cycles();
+    host_rx(b, b->txq[b->tx_head]);
+    b->tx_head = (b->tx_head + 1) % CTAPHID_BENCH_TXQ_DEPTH;
+    b->tx_count--;
+    if (b->in_engine) b->model_cycles += ctaphid_port_cycles() - c0;
+}
+
+static void bus_drain(bench_t *b)
+{
+    while (b->tx_count) bus_poll(b);
+}
+
+// ---- ctaphid_io_t: same contract as usb_hid_tx_* ----
+
+static uint8_t *bench_tx_reserve(void *user)
+{
+    bench_t *b = user;
+    if (b->tx_budget == 0) {
+        b->st.tx_refused++;
+        return NULL;
+    }
+    if (b->tx_budget > 0) b->tx_budget--;
+    if (b->tx_count + b->tx_reserved >= CTAPHID_BENCH_TXQ_DEPTH) {
+        if (b->tx_count == 0) {
+            // only our own reservations: waiting cannot free a slot
+            b->st.tx_refused++;
+            return NULL;
+        }
+        // usb_hid_tx_reserve blocks until the host polls a report out
+        b->st.tx_stalls++;
+        bus_poll(b);
+    }
+    unsigned idx = (b->tx_head + b->tx_count + b->tx_reserved) % CTAPHID_BENCH_TXQ_DEPTH;
+    b->tx_reserved++;
+    if (b->tx_count + b->tx_reserved > b->st.tx_high_water) {
+        b->st.tx_high_water = b->tx_count + b->tx_reserved;
+    }
+    memset(b->txq[idx], 0, CTAPHID_REPORT_LEN);
+    return b->txq[idx];
+}
+
+static int bench_tx_commit(void *user)
+{
+    bench_t *b = user;
+    b->tx_count += b->tx_reserved;
+    b->tx_reserved = 0;
+    return 0;
+}
+
+static void bench_tx_abort(void *user)
+{
+    bench_t *b = user;
+    b->tx_reserved = 0;
+}
+
+static void bench_up_request(void *user, uint32_t cid)
+{
+    bench_t *b = user;
+    (void)cid;
+    b->up_asked++;
+    // same path as a phone that answers instantly
+    if (b->up_verdict == CORE_UP_APPROVED && b->up_grant.scope) {
+        ctaphid_up_grant(&b->ctx, &b->up_grant);
+    } else if (b->up_verdict) {
+        ctaphid_up_resolve(&b->ctx, b->up_verdict);
+    }
+}
+
+static void bench_up_done(void *user, uint32_t park)
+{
+    bench_t *b = user;
+    b->up_ended = park;
+}
+
+// ---- driving the engine ----
+
+static void feed(bench_t *b, const uint8_t *report)
+{
+    bus_poll(b);
+    uint32_t c0 = engine_enter(b);
+    ctaphid_on_report(&b->ctx, report, CTAPHID_REPORT_LEN);
+    engine_leave(b, c0);
+    b->st.frames_in++;
+}
+
+static void tick(bench_t *b)
+{
+    uint32_t c0 = engine_enter(b);
+    ctaphid_tick(&b->ctx);
+    engine_leave(b, c0);
+}
+
+static void feed_next(bench_t *b, bench_req_t *r)
+{
+    uint8_t rep[CTAPHID_REPORT_LEN] = {0};
+    uint16_t n;
+
+    put_be32(rep, r->cid);
+    if (!r->started) {
+        r->started = true;
+        r->t0_us = ctaphid_port_now_us();
+        r->bus0_us = b->bus_us + BUS_POLL_US;
+        rep[4] = (uint8_t)(0x80 | r->cmd);
+        rep[5] = (uint8_t)(r->len >> 8);
+        rep[6] = (uint8_t)r->len;
+        n = r->len > INIT_PAYLOAD_MAX ? INIT_PAYLOAD_MAX : r->len;
+        req_fill(r, &rep[7], 0, n);
+    } else {
+        rep[4] = r->seq++;
+        uint16_t remaining = (uint16_t)(r->len - r->off);
+        n = remaining > CONT_PAYLOAD_MAX ? CONT_PAYLOAD_MAX : remaining;
+        req_fill(r, &rep[5], r->off, n);
+    }
+    r->off = (uint16_t)(r->off + n);
+    r->sent_all = r->off >= r->len;
+    feed(b, rep);
+}
+
+static void feed_cancel(bench_t *b, uint32_t cid)
+{
+    uint8_t rep[CTAPHID_REPORT_LEN] = {0};
+    put_be32(rep, cid);
+    rep[4] = 0x80 | CTAPHID_CANCEL;
+    // ctaphid_task_post_report flags the CANCEL ahead of the queue
+    ctaphid_request_cancel(&b->ctx, cid);
+    feed(b, rep);
+}
+
+// Sends every active request's frames round-robin, one OUT report per poll,
+// then lets the host poll the IN endpoint empty.
+static void pump(bench_t *b)
+{
+    bool more = true;
+    while (more) {
+        more = false;
+        for (size_t i = 0; i < MAX_REQS; i++) {
+            bench_req_t *r = &b->reqs[i];
+            if (!r->active || r->sent_all) continue;
+            feed_next(b, r);
+            if (r->active && !r->sent_all) more = true;
+        }
+    }
+    bus_drain(b);
+}
+
+// Requests still open at this point never got an answer.
+static void settle(bench_t *b)
+{
+    for (size_t i = 0; i < MAX_REQS; i++) {
+        if (b->reqs[i].active) {
+            b->reqs[i].active = false;
+            b->st.bad++;
+        }
+    }
+}
+
+// ---- reporting ----
+
+static int cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static uint32_t pct(const uint32_t *sorted, unsigned n, unsigned p)
+{
+    if (n == 0) return 0;
+    unsigned idx = (n * p + 99) / 100;
+    return sorted[idx ? idx - 1 : 0];
+}
+
+static void scenario_begin(bench_t *b)
+{
+    const ctaphid_io_t io = {
+        .tx_reserve = bench_tx_reserve,
+        .tx_commit = bench_tx_commit,
+        .tx_abort = bench_tx_abort,
+        .tx_user = b,
+        .up_request = bench_up_request,
+        .up_done = bench_up_done,
+        .up_user = b,
+    };
+    memset(&b->st, 0, sizeof(b->st));
+    memset(b->reqs, 0, sizeof(b->reqs));
+    b->tx_head = b->tx_count = b->tx_reserved = 0;
+    b->tx_budget = -1;
+    b->rx_active = false;
+    b->bus_us = 0;
+    b->up_verdict = 0;
+    memset(&b->up_grant, 0, sizeof(b->up_grant));
+    b->up_asked = 0;
+    b->up_ended = 0;
+    b->cbor_resp_len = 0;
+    ctaphid_init(&b->ctx, &io);
+}
+
+// Emits one JSON line; returns 1 if anything went wrong.
+static int scenario_end(bench_t *b, const char *name, unsigned size, unsigned channels, uint64_t t0_us)
+{
+    bench_stats_t *st = &b->st;
+    uint64_t elapsed_us = ctaphid_port_now_us() - t0_us;
+    uint32_t frames = st->frames_in + st->frames_out;
+
+    // a scenario must leave the engine as it found it
+    ctaphid_pool_stats_t pool;
+    ctaphid_get_pool_stats(&b->ctx, &pool);
+    bool leaked = !ctaphid_idle(&b->ctx) || pool.in_use != 0;
+
+    qsort(st->lat_us, st->nsamples, sizeof(st->lat_us[0]), cmp_u32);
+    qsort(st->bus_us, st->nsamples, sizeof(st->bus_us[0]), cmp_u32);
+
+    emit(b,
+         "{\"bench\":\"ctaphid\",\"platform\":\"%s\",\"scenario\":\"%s\","
+         "\"size\":%u,\"channels\":%u,\"msgs\":%u,\"ok\":%u,\"bad\":%u,"
+         "\"busy\":%u,\"timeouts\":%u,\"keepalives\":%u,\"unsolicited\":%u,\"framing\":%u,"
+         "\"frames_in\":%u,\"frames_out\":%u,\"elapsed_us\":%llu,"
+         "\"frames_per_s\":%llu,\"cycles_per_frame\":%llu,"
+         "\"lat_us\":{\"p50\":%u,\"p90\":%u,\"p99\":%u,\"max\":%u},"
+         "\"bus_us\":{\"p50\":%u,\"p90\":%u,\"p99\":%u,\"max\":%u},"
+         "\"tx\":{\"depth\":%u,\"high_water\":%u,\"stalls\":%u,\"refused\":%u},"
+         "\"pool_peak\":%u,\"leaked\":%s}",
+         BENCH_PLATFORM, name, size, channels,
+         (unsigned)st->msgs, (unsigned)st->ok, (unsigned)st->bad,
+         (unsigned)st->busy, (unsigned)st->timeouts, (unsigned)st->keepalives,
+         (unsigned)st->unsolicited, (unsigned)st->framing,
+         (unsigned)st->frames_in, (unsigned)st->frames_out,
+         (unsigned long long)elapsed_us,
+         (unsigned long long)(elapsed_us ? (uint64_t)frames * 1000000ULL / elapsed_us : 0),
+         (unsigned long long)(frames ? st->engine_cycles / frames : 0),
+         (unsigned)pct(st->lat_us, st->nsamples, 50), (unsigned)pct(st->lat_us, st->nsamples, 90),
+         (unsigned)pct(st->lat_us, st->nsamples, 99), (unsigned)pct(st->lat_us, st->nsamples, 100),
+         (unsigned)pct(st->bus_us, st->nsamples, 50), (unsigned)pct(st->bus_us, st->nsamples, 90),
+         (unsigned)pct(st->bus_us, st->nsamples, 99), (unsigned)pct(st->bus_us, st->nsamples, 100),
+         (unsigned)CTAPHID_BENCH_TXQ_DEPTH, (unsigned)st->tx_high_water,
+         (unsigned)st->tx_stalls, (unsigned)st->tx_refused,
+         (unsigned)pool.peak, leaked ? "true" : "false");
+
+    return (st->bad || st->framing || st->unsolicited || leaked) ? 1 : 0;
+}
+
+// ---- scenarios ----
+
+static int run_init(bench_t *b, unsigned reps)
+{
+    scenario_begin(b);
+    uint64_t t0 = ctaphid_port_now_us();
+    for (unsigned i = 0; i < reps; i++) {
+        req_add(b, CTAPHID_BROADCAST_CID, CTAPHID_INIT, 8, i, EXPECT_INIT, 0);
+        pump(b);
+        settle(b);
+    }
+    return scenario_end(b, "init", 8, 1, t0);
+}
+
+static int run_ping(bench_t *b, unsigned reps)
+{
+    static const uint16_t sizes[] = {
+        0, INIT_PAYLOAD_MAX, INIT_PAYLOAD_MAX + 1, 256, 1024, 4096, CTAPHID_MAX_MSG_SIZE,
+    };
+    int failed = 0;
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        scenario_begin(b);
+        uint64_t t0 = ctaphid_port_now_us();
+        for (unsigned i = 0; i < reps; i++) {
+            req_add(b, 0x01000001u, CTAPHID_PING, sizes[s], i, EXPECT_ECHO, 0);
+            pump(b);
+            settle(b);
+        }
+        failed += scenario_end(b, "ping", sizes[s], 1, t0);
+    }
+    return failed;
+}
+
+// Status, then {1: ["FIDO_2_0", "FIDO_2_1"], 3: h'<16-byte aaguid>', ...
+static const uint8_t s_getinfo_head[] = {
+    0x00, 0xa6, 0x01, 0x82,
+    0x68, 'F', 'I', 'D', 'O', '_', '2', '_', '0',
+    0x68, 'F', 'I', 'D', 'O', '_', '2', '_', '1',
+    0x03, 0x50,
+};
+
+static int run_getinfo(bench_t *b, unsigned reps)
+{
+    scenario_begin(b);
+    uint64_t t0 = ctaphid_port_now_us();
+    for (unsigned i = 0; i < reps; i++) {
+        bench_req_t *r = req_add(b, 0x01000001u, CTAPHID_CBOR, 1, i, EXPECT_CBOR_OK, 0);
+        r->small[0] = CTAP_CMD_GET_INFO;
+        pump(b);
+        settle(b);
+        if (b->cbor_resp_len < sizeof(s_getinfo_head) ||
+            memcmp(b->cbor_resp, s_getinfo_head, sizeof(s_getinfo_head)) != 0) {
+            b->st.bad++;
+        }
+        b->cbor_resp_len = 0;
+    }
+    return scenario_end(b, "getinfo", 1, 1, t0);
+}
+
+// N channels each send a PING, frames interleaved round-robin. Large
+// messages compete for the shared pool, so BUSY is an accepted answer.
+static int run_interleave(bench_t *b, unsigned reps)
+{
+    static const uint16_t sizes[] = { 200, 1024 };
+    unsigned nchan = CTAPHID_MAX_CHANNELS < MAX_REQS ? CTAPHID_MAX_CHANNELS : MAX_REQS;
+    int failed = 0;
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        scenario_begin(b);
+        uint64_t t0 = ctaphid_port_now_us();
+        for (unsigned i = 0; i < reps; i++) {
+            for (unsigned c = 0; c < nchan; c++) {
+                bench_req_t *r = req_add(b, 0x02000001u + c, CTAPHID_PING, sizes[s],
+                                         i * nchan + c, EXPECT_ECHO, 0);
+                r->busy_ok = true;
+            }
+            pump(b);
+            settle(b);
+        }
+        failed += scenario_end(b, "interleave", sizes[s], nchan, t0);
+    }
+    return failed;
+}
+
+// A presence-gated request is parked, then hit by a burst of CANCELs: stray
+// ones for idle CIDs, one for a channel mid-reassembly (dropped silently)
+// and finally the real one, which must answer KEEPALIVE_CANCEL. Latency is
+// measured from that last CANCEL. Every park gets a new number, reported
+// done by the CANCEL, so a late verdict for it can be told apart.
+static int run_cancel(bench_t *b, unsigned reps)
+{
+    scenario_begin(b);
+    uint64_t t0 = ctaphid_port_now_us();
+    uint32_t last_park = 0;
+    for (unsigned i = 0; i < reps; i++) {
+        const uint32_t cid = 0x03000001u;
+        const uint32_t partial_cid = 0x03000002u;
+
+        bench_req_t *r = req_add(b, cid, CTAPHID_CBOR, 1, i, EXPECT_CBOR_STATUS,
+                                 CTAP2_ERR_KEEPALIVE_CANCEL);
+        r->small[0] = CTAP_CMD_SELECTION;
+        pump(b);
+        uint32_t park = ctaphid_up_park_id(&b->ctx);
+        if (!b->ctx.up_chan || !park || park == last_park) b->st.bad++;
+        last_park = park;
+
+        bench_req_t *p = req_add(b, partial_cid, CTAPHID_PING, 1024, i, EXPECT_ECHO, 0);
+        feed_next(b, p);
+
+        for (uint32_t k = 0; k < 4; k++) feed_cancel(b, 0x03100000u + k);
+        feed_cancel(b, partial_cid);
+        p->active = false;     // no answer expected
+        b->st.msgs--;
+
+        r->t0_us = ctaphid_port_now_us();
+        r->bus0_us = b->bus_us + BUS_POLL_US;
+        feed_cancel(b, cid);
+        bus_drain(b);
+        settle(b);
+        if (b->up_ended != park || ctaphid_up_park_id(&b->ctx)) b->st.bad++;
+    }
+    return scenario_end(b, "cancel", 1, 2, t0);
+}
+
+// Half-sent messages on every spare channel plus one parked presence request
+// are aged past their timeouts; one tick must answer all of them.
+static int run_timeout(bench_t *b, unsigned reps)
+{
+    unsigned npartial = CTAPHID_MAX_CHANNELS - 1;
+    if (npartial > MAX_REQS - 1) npartial = MAX_REQS - 1;
+
+    scenario_begin(b);
+    uint64_t t0 = ctaphid_port_now_us();
+    for (unsigned i = 0; i < reps; i++) {
+        bench_req_t *up = req_add(b, 0x04000001u, CTAPHID_CBOR, 1, i, EXPECT_CBOR_STATUS,
+                                  CTAP2_ERR_USER_ACTION_TIMEOUT);
+        up->small[0] = CTAP_CMD_SELECTION;
+        pump(b);
+
+        for (unsigned c = 0; c < npartial; c++) {
+            bench_req_t *r = req_add(b, 0x04100001u + c, CTAPHID_PING, 200, i, EXPECT_ERROR,
+                                     ERR_MSG_TIMEOUT);
+            feed_next(b, r);
+        }
+        bus_drain(b);
+
+        for (size_t k = 0; k < CTAPHID_MAX_CHANNELS; k++) {
+            if (b->ctx.chan[k].cid) b->ctx.chan[k].last_rx_us -= BACKDATE_US;
+        }
+        b->ctx.up_since_us -= BACKDATE_US;
+
+        uint64_t now = ctaphid_port_now_us();
+        for (size_t k = 0; k < MAX_REQS; k++) {
+            b->reqs[k].t0_us = now;
+            b->reqs[k].bus0_us = b->bus_us;
+        }
+        tick(b);
+        bus_drain(b);
+        settle(b);
+    }
+    return scenario_end(b, "timeout", 200, npartial + 1, t0);
+}
+
+// ---- realistic CTAP2 requests ----
+
+typedef struct {
+    uint8_t *p;
+    size_t n;
+    size_t cap;
+} cb_t;
+
+static void cb_byte(cb_t *c, uint8_t v)
+{
+    if (c->n < c->cap) c->p[c->n] = v;
+    c->n++;
+}
+
+static void cb_head(cb_t *c, uint8_t major, uint64_t v)
+{
+    major = (uint8_t)(major << 5);
+    if (v < 24) {
+        cb_byte(c, (uint8_t)(major | v));
+    } else if (v <= 0xff) {
+        cb_byte(c, major | 24);
+        cb_byte(c, (uint8_t)v);
+    } else {
+        cb_byte(c, major | 25);
+        cb_byte(c, (uint8_t)(v >> 8));
+        cb_byte(c, (uint8_t)v);
+    }
+}
+
+static void cb_int(cb_t *c, int64_t v)
+{
+    if (v >= 0) cb_head(c, 0, (uint64_t)v);
+    else cb_head(c, 1, (uint64_t)(-1 - v));
+}
+
+static void cb_bstr(cb_t *c, uint32_t seed, size_t len)
+{
+    cb_head(c, 2, len);
+    for (size_t i = 0; i < len; i++) cb_byte(c, pattern_byte(seed, i));
+}
+
+static void cb_bytes(cb_t *c, const uint8_t *p, size_t len)
+{
+    cb_head(c, 2, len);
+    for (size_t i = 0; i < len; i++) cb_byte(c, p[i]);
+}
+
+static void cb_tstr(cb_t *c, const char *s)
+{
+    size_t len = strlen(s);
+    cb_head(c, 3, len);
+    for (size_t i = 0; i < len; i++) cb_byte(c, (uint8_t)s[i]);
+}
+
+// `count` descriptors with patterned 64-byte IDs. A non-NULL `id` takes the
+// last slot, so a lookup has to scan the whole list before it matches.
+static void cb_cred_list(cb_t *c, unsigned count, const uint8_t *id, size_t id_len)
+{
+    cb_head(c, 4, count);
+    for (unsigned i = 0; i < count; i++) {
+        cb_head(c, 5, 2);
+        cb_tstr(c, "id");
+        if (id && i == count - 1) {
+            cb_head(c, 2, id_len);
+            for (size_t k = 0; k < id_len; k++) cb_byte(c, id[k]);
+        } else {
+            cb_bstr(c, 0x100 + i, 64);
+        }
+        cb_tstr(c, "type");
+        cb_tstr(c, "public-key");
+    }
+}
+
+// What a browser sends for a platform-less registration: two algorithms,
+// a full user entity and a four-entry excludeList. `rk` asks for a
+// discoverable credential; `user` seeds the user handle.
+static uint16_t build_make_credential(uint8_t *buf, size_t cap, const char *rp_id,
+                                      bool rk, uint32_t user)
+{
+    cb_t c = { buf, 0, cap };
+    cb_byte(&c, CTAP_CMD_MAKE_CREDENTIAL);
+    cb_head(&c, 5, 6);
+    cb_int(&c, 1);
+    cb_bstr(&c, 1, 32);
+    cb_int(&c, 2);
+    cb_head(&c, 5, 2);
+    cb_tstr(&c, "id");
+    cb_tstr(&c, rp_id);
+    cb_tstr(&c, "name");
+    cb_tstr(&c, "Example Login");
+    cb_int(&c, 3);
+    cb_head(&c, 5, 3);
+    cb_tstr(&c, "id");
+    cb_bstr(&c, user, 32);
+    cb_tstr(&c, "name");
+    cb_tstr(&c, "alice@example.com");
+    cb_tstr(&c, "displayName");
+    cb_tstr(&c, "Alice Example");
+    cb_int(&c, 4);
+    cb_head(&c, 4, 2);
+    cb_head(&c, 5, 2);
+    cb_tstr(&c, "alg");
+    cb_int(&c, -7);
+    cb_tstr(&c, "type");
+    cb_tstr(&c, "public-key");
+    cb_head(&c, 5, 2);
+    cb_tstr(&c, "alg");
+    cb_int(&c, -257);
+    cb_tstr(&c, "type");
+    cb_tstr(&c, "public-key");
+    cb_int(&c, 5);
+    cb_cred_list(&c, 4, NULL, 0);
+    cb_int(&c, 7);
+    cb_head(&c, 5, 1);
+    cb_tstr(&c, "rk");
+    cb_head(&c, 7, rk ? 21 : 20);
+    return c.n <= cap ? (uint16_t)c.n : 0;
+}
+
+// pam_u2f / sudo style assertion with an eight-entry allowList.
+static uint16_t build_get_assertion(uint8_t *buf, size_t cap, const char *rp_id,
+                                    const uint8_t *id, size_t id_len)
+{
+    cb_t c = { buf, 0, cap };
+    cb_byte(&c, CTAP_CMD_GET_ASSERTION);
+    cb_head(&c, 5, 4);
+    cb_int(&c, 1);
+    cb_tstr(&c, rp_id);
+    cb_int(&c, 2);
+    cb_bstr(&c, 3, 32);
+    cb_int(&c, 3);
+    cb_cred_list(&c, 8, id, id_len);
+    cb_int(&c, 5);
+    cb_head(&c, 5, 1);
+    cb_tstr(&c, "up");
+    cb_head(&c, 7, 21);
+    return c.n <= cap ? (uint16_t)c.n : 0;
+}
+
+// Credential ID in a MakeCredential response, found by the fixed layout the
+// core emits (packed attestation, authData under 256 bytes). 0 if it isn't.
+static size_t mc_cred_id(const uint8_t *resp, size_t len, const uint8_t **id)
+{
+    // status, map(3), 1: "packed", 2: bstr with a one-byte length
+    static const uint8_t head[] = {
+        0x00, 0xa3, 0x01, 0x66, 'p', 'a', 'c', 'k', 'e', 'd', 0x02, 0x58,
+    };
+    const size_t auth = sizeof(head) + 1;
+    if (len < auth + 55 || memcmp(resp, head, sizeof(head)) != 0) return 0;
+    size_t n = be16(resp + auth + 53);   // after rpIdHash, flags, signCount, AAGUID
+    if (auth + 55 + n > len) return 0;
+    *id = resp + auth + 55;
+    return n;
+}
+
+// Fresh core state and an empty credential store under a running engine.
+static void core_reset(bench_t *b)
+{
+    (void)core_init(b->ctx.core_mem, sizeof(b->ctx.core_mem));
+    (void)cred_store_wipe();
+}
+
+static uint8_t s_mc_req[768];
+static uint8_t s_ga_req[1024];
+static uint8_t s_ga_other_req[1024];
+static uint8_t s_fuzz_req[1024];
+
+// Realistic requests end to end with presence granted at once: the size is
+// comparable with the ping lines to separate framing from decode and crypto
+// cost. MakeCredential generates a key and signs; the GetAssertion matches
+// nothing and stops after the allowList scan.
+static int run_cbor(bench_t *b, unsigned reps)
+{
+    uint16_t mc_len = build_make_credential(s_mc_req, sizeof(s_mc_req), "login.example.com", false, 2);
+    uint16_t ga_len = build_get_assertion(s_ga_req, sizeof(s_ga_req), "pam://roottap", NULL, 0);
+    int failed = 0;
+
+    scenario_begin(b);
+    b->up_verdict = CORE_UP_APPROVED;
+    uint64_t t0 = ctaphid_port_now_us();
+    for (unsigned i = 0; i < reps; i++) {
+        core_reset(b);   // keep the store from filling up
+        bench_req_t *r = req_add(b, 0x05000001u, CTAPHID_CBOR, mc_len, i, EXPECT_CBOR_OK, 0);
+        r->data = s_mc_req;
+        pump(b);
+        settle(b);
+    }
+    failed += scenario_end(b, "cbor_make_credential", mc_len, 1, t0);
+
+    scenario_begin(b);
+    t0 = ctaphid_port_now_us();
+    for (unsigned i = 0; i < reps; i++) {
+        bench_req_t *r = req_add(b, 0x05000001u, CTAPHID_CBOR, ga_len, i, EXPECT_CBOR_STATUS,
+                                 CTAP2_ERR_NO_CREDENTIALS);
+        r->data = s_ga_req;
+        pump(b);
+        settle(b);
+    }
+    failed += scenario_end(b, "cbor_get_assertion", ga_len, 1, t0);
+    return failed;
+}
+
+// A sudo login: register once, then assert with the credential at the end
+// of the allowList. Each message is a full scan, one SHA-256 over authData
+// and clientDataHash and one ECDSA signature.
+static int run_assert(bench_t *b, unsigned reps)
+{
+    uint16_t mc_len = build_make_credential(s_mc_req, sizeof(s_mc_req), "pam://roottap", false, 2);
+
+    scenario_begin(b);
+    b->up_verdict = CORE_UP_APPROVED;
+    bench_req_t *r = req_add(b, 0x07000001u, CTAPHID_CBOR, mc_len, 0, EXPECT_CBOR_OK, 0);
+    r->data = s_mc_req;
+    pump(b);
+    settle(b);
+
+    const uint8_t *id = NULL;
+    size_t id_len = mc_cred_id(b->cbor_resp, b->cbor_resp_len, &id);
+    uint16_t ga_len = build_get_assertion(s_ga_req, sizeof(s_ga_req), "pam://roottap", id, id_len);
+    bool registered = b->st.ok == 1 && id_len > 0;
+
+    // report the assertions only
+    memset(&b->st, 0, sizeof(b->st));
+    if (!registered) b->st.bad++;
+
+    uint64_t t0 = ctaphid_port_now_us();
+    for (unsigned i = 0; registered && i < reps; i++) {
+        r = req_add(b, 0x07000001u, CTAPHID_CBOR, ga_len, i, EXPECT_CBOR_OK, 0);
+        r->data = s_ga_req;
+        pump(b);
+        settle(b);
+    }
+    return scenario_end(b, "assert", ga_len, 1, t0);
+}
+
+// A runbook of sudo calls. "grant_phone" is every GetAssertion asking the
+// phone (answered at once here, in seconds by a person); "grant_cached" the
+// same run after the phone approved the first call with a grant for the
+// RP, so only that one asks and the rest pass in the core. Then a grant
+// whose uses are spent and a revoked one must send the next sign-in back
+// to the phone. Closes with a {"bench":"grant"} line: prompts per run and
+// the core's grant counters.
+static int run_grant(bench_t *b, unsigned reps)
+{
+    core_grant_stats_t g0, g1;
+    unsigned bad = 0;
+    int failed = 0;
+
+    core_reset(b);
+    scenario_begin(b);
+    core_get_grant_stats(&g0);
+    b->up_verdict = CORE_UP_APPROVED;
+    uint16_t mc_len = build_make_credential(s_mc_req, sizeof(s_mc_req), "pam://roottap", false, 2);
+    bench_req_t *r = req_add(b, 0x0B000001u, CTAPHID_CBOR, mc_len, 0, EXPECT_CBOR_OK, 0);
+    r->data = s_mc_req;
+    pump(b);
+    settle(b);
+
+    const uint8_t *id = NULL;
+    size_t id_len = mc_cred_id(b->cbor_resp, b->cbor_resp_len, &id);
+    uint16_t ga_len = build_get_assertion(s_ga_req, sizeof(s_ga_req), "pam://roottap", id, id_len);
+    bool registered = b->st.ok == 1 && id_len > 0;
+
+    memset(&b->st, 0, sizeof(b->st));
+    if (!registered) b->st.bad++;
+    b->up_asked = 0;
+    uint64_t t0 = ctaphid_port_now_us();
+    for (unsigned i = 0; registered && i < reps; i++) {
+        r = req_add(b, 0x0B000001u, CTAPHID_CBOR, ga_len, i, EXPECT_CBOR_OK, 0);
+        r->data = s_ga_req;
+        pump(b);
+        settle(b);
+    }
+    unsigned phone_prompts = b->up_asked;
+    if (phone_prompts != reps) b->st.bad++;
+    failed |= scenario_end(b, "grant_phone", ga_len, 1, t0);
+
+    // the first call is approved with a grant for the rest of the run
+    memset(&b->st, 0, sizeof(b->st));
+    if (!registered) b->st.bad++;
+    b->up_asked = 0;
+    b->up_grant = (core_grant_t){ .scope = CORE_GRANT_RP, .uses = (uint16_t)reps, .ttl_s = 60 };
+    t0 = ctaphid_port_now_us();
+    for (unsigned i = 0; registered && i <= reps; i++) {
+        r = req_add(b, 0x0B000001u, CTAPHID_CBOR, ga_len, i, EXPECT_CBOR_OK, 0);
+        r->data = s_ga_req;
+        pump(b);
+        settle(b);
+    }
+    b->up_grant.scope = 0;
+    unsigned cached_prompts = b->up_asked;
+    if (cached_prompts != 1) b->st.bad++;
+    failed |= scenario_end(b, "grant_cached", ga_len, 1, t0);
+
+    // uses spent: back to the phone. A host grant, then a revoke: the call
+    // after the grant passes, the one after the revoke asks again.
+    memset(&b->st, 0, sizeof(b->st));
+    b->up_asked = 0;
+    for (unsigned i = 0; registered && i < 4; i++) {
+        if (i == 1) b->up_grant = (core_grant_t){ .scope = CORE_GRANT_HOST, .uses = 0, .ttl_s = 60 };
+        if (i == 3) ctaphid_up_revoke(&b->ctx);
+        r = req_add(b, 0x0B000001u, CTAPHID_CBOR, ga_len, i, EXPECT_CBOR_OK, 0);
+        r->data = s_ga_req;
+        pump(b);
+        settle(b);
+        b->up_grant.scope = 0;
+    }
+    if (!registered || b->up_asked != 3 || b->st.ok != 4 || b->st.bad) bad++;
+
+    // A sign-in for another RP arrives on a second channel while the first
+    // is parked: it is turned away, and the RP grant the phone then sends
+    // covers the parked request's RP only.
+    memset(&b->st, 0, sizeof(b->st));
+    mc_len = build_make_credential(s_mc_req, sizeof(s_mc_req), "ssh://other", false, 3);
+    r = req_add(b, 0x0B000002u, CTAPHID_CBOR, mc_len, 0, EXPECT_CBOR_OK, 0);
+    r->data = s_mc_req;
+    pump(b);
+    settle(b);
+    id_len = mc_cred_id(b->cbor_resp, b->cbor_resp_len, &id);
+    uint16_t other_len = build_get_assertion(s_ga_other_req, sizeof(s_ga_other_req), "ssh://other", id, id_len);
+
+    b->up_verdict = 0;
+    b->up_asked = 0;
+    r = req_add(b, 0x0B000001u, CTAPHID_CBOR, ga_len, 0, EXPECT_CBOR_OK, 0);
+    r->data = s_ga_req;
+    pump(b);
+    r = req_add(b, 0x0B000002u, CTAPHID_CBOR, other_len, 0, EXPECT_ERROR, ERR_CHANNEL_BUSY);
+    r->data = s_ga_other_req;
+    pump(b);
+    ctaphid_up_grant(&b->ctx, &(core_grant_t){ .scope = CORE_GRANT_RP, .uses = 0, .ttl_s = 60 });
+    bus_drain(b);
+    settle(b);
+    b->up_verdict = CORE_UP_APPROVED;
+    r = req_add(b, 0x0B000002u, CTAPHID_CBOR, other_len, 1, EXPECT_CBOR_OK, 0);
+    r->data = s_ga_other_req;
+    pump(b);
+    settle(b);
+    unsigned other_prompts = b->up_asked;   // the parked request's and this one
+    r = req_add(b, 0x0B000001u, CTAPHID_CBOR, ga_len, 1, EXPECT_CBOR_OK, 0);
+    r->data = s_ga_req;
+    pump(b);
+    settle(b);
+    if (!registered || id_len == 0 || other_prompts != 2 || b->up_asked != 2 || b->st.ok != 5 || b->st.bad) {
+        bad++;
+    }
+    ctaphid_up_revoke(&b->ctx);
+
+    core_get_grant_stats(&g1);
+    emit(b,
+         "{\"bench\":\"grant\",\"platform\":\"%s\",\"calls\":%u,\"prompts_phone\":%u,"
+         "\"prompts_cached\":%u,\"granted\":%u,\"hits\":%u,\"misses\":%u,\"expiries\":%u,\"bad\":%u}",
+         BENCH_PLATFORM, reps, phone_prompts, cached_prompts,
+         (unsigned)(g1.granted - g0.granted), (unsigned)(g1.hits - g0.hits),
+         (unsigned)(g1.misses - g0.misses), (unsigned)(g1.expiries - g0.expiries), bad);
+    return failed || bad ? 1 : 0;
+}
+
+// "approve" of shared/protocol/test-vectors/approval_v1.json (key 00..1f)
+static const uint8_t s_vec_request[] = {
+    0x01, 0x01, 0x01, 0x02, 0x03, 0x04, 0xa0, 0xa1, 0xa2, 0xa3, 0xa4, 0xa5,
+    0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xab, 0xac, 0xad, 0xae, 0xaf, 0x00, 0x00,
+    0x75, 0x30, 0x02, 0x01, 0xa3, 0x79, 0xa6, 0xf6, 0xee, 0xaf, 0xb9, 0xa5,
+    0x5e, 0x37, 0x8c, 0x11, 0x80, 0x34, 0xe2, 0x75, 0x1e, 0x68, 0x2f, 0xab,
+    0x9f, 0x2d, 0x30, 0xab, 0x13, 0xd2, 0x12, 0x55, 0x86, 0xce, 0x19, 0x47,
+    0x0b, 0x65, 0x78, 0x61, 0x6d, 0x70, 0x6c, 0x65, 0x2e, 0x63, 0x6f, 0x6d,
+};
+static const uint8_t s_vec_response[] = {
+    0x01, 0x02, 0x01, 0x02, 0x03, 0x04, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x4e, 0x80, 0xd5, 0xe5, 0x95, 0xa4, 0xf5, 0x9e, 0xcf, 0x11, 0xaa, 0x78,
+    0x0b, 0x79, 0x8b, 0x46, 0x46, 0xca, 0x1e, 0x4e, 0x54, 0x7b, 0x22, 0x80,
+    0x83, 0xaa, 0x30, 0x4d, 0x12, 0x7a, 0x6a, 0x7b,
+};
+
+#define APPROVAL_BENCH_TTL_MS 30000
+
+typedef struct {
+    approval_book_t book;
+    uint8_t key[APPROVAL_KEY_LEN];
+    uint8_t req[APPROVAL_MAX_PENDING][APPROVAL_REQ_MAX];
+    int req_len[APPROVAL_MAX_PENDING];
+    uint32_t id[APPROVAL_MAX_PENDING];
+} approval_state_t;
+
+static approval_state_t s_approval;
+
+static int approval_open_n(approval_state_t *a, unsigned n, uint64_t now)
+{
+    approval_ctx_t ctx = { .command = CTAP_CMD_GET_ASSERTION, .has_rp = true, .rp_id_len = 11 };
+    memset(ctx.rp_id_hash, 0x5a, sizeof(ctx.rp_id_hash));
+    memcpy(ctx.rp_id, "example.com", 11);
+    for (unsigned i = 0; i < n; i++) {
+        a->req_len[i] = approval_open(&a->book, &ctx, APPROVAL_BENCH_TTL_MS, now, a->req[i], &a->id[i]);
+        if (a->req_len[i] < 0) return -1;
+    }
+    return 0;
+}
+
+// The phone's answer to request `i`, checked by the key; APPROVAL_* result.
+static int approval_answer(approval_state_t *a, unsigned i, bool approve, uint64_t now, approval_verdict_t *v)
+{
+    approval_verdict_t in = { .approve = approve };
+    uint8_t resp[APPROVAL_RESP_LEN];
+    if (approval_respond(a->key, a->req[i], (size_t)a->req_len[i], &in, resp) != APPROVAL_OK) return -100;
+    return approval_check(&a->book, a->key, resp, sizeof(resp), now, v);
+}
+
+// The approval frames the key and the phone exchange over BLE, without the
+// radio. "verify" times approval_check() on an authentic RESPONSE (one
+// HMAC-SHA256 over request and answer), the phone's approval_respond()
+// untimed before it. The "checks" line runs the rules of
+// shared/protocol/schema/approval_v1.md: the test vector's MAC, four
+// requests answered out of order, and a replayed, tampered, foreign-key,
+// late, superseded and malformed answer, plus a replayed revoke, each of
+// which must approve nothing.
+static int run_approval(bench_t *b, unsigned reps)
+{
+    approval_state_t *a = &s_approval;
+    bench_stats_t *st = &b->st;
+    approval_verdict_t v;
+    uint8_t resp[APPROVAL_RESP_LEN];
+    uint64_t cycles = 0;
+    unsigned fail = 0, bad = 0;
+    uint64_t now = 1000000;
+
+    for (size_t i = 0; i < sizeof(a->key); i++) a->key[i] = (uint8_t)i;
+    approval_book_init(&a->book);
+
+    // same bytes as the Python generator and the Android client
+    approval_verdict_t yes = { .approve = true };
+    if (approval_respond(a->key, s_vec_request, sizeof(s_vec_request), &yes, resp) != APPROVAL_OK ||
+        memcmp(resp, s_vec_response, sizeof(resp)) != 0) {
+        bad++;
+    }
+
+    memset(st, 0, sizeof(*st));
+    if (reps > MAX_SAMPLES) reps = MAX_SAMPLES;
+    for (unsigned i = 0; i < reps; i++) {
+        if (approval_open_n(a, 1, now) != 0) {
+            fail++;
+            continue;
+        }
+        approval_verdict_t in = { .approve = true };
+        (void)approval_respond(a->key, a->req[0], (size_t)a->req_len[0], &in, resp);
+        uint64_t t0 = ctaphid_port_now_us();
+        uint32_t c0 = ctaphid_port_cycles();
+        int rc = approval_check(&a->book, a->key, resp, sizeof(resp), now, &v);
+        cycles += ctaphid_port_cycles() - c0;
+        st->lat_us[st->nsamples++] = (uint32_t)(ctaphid_port_now_us() - t0);
+        if (rc != APPROVAL_OK || !v.approve || v.request_id != a->id[0]) fail++;
+    }
+    qsort(st->lat_us, st->nsamples, sizeof(st->lat_us[0]), cmp_u32);
+    emit(b,
+         "{\"bench\":\"approval\",\"platform\":\"%s\",\"op\":\"verify\",\"reps\":%u,\"fail\":%u,"
+         "\"cycles_per_op\":%llu,\"us\":{\"p50\":%u,\"p90\":%u,\"p99\":%u,\"max\":%u}}",
+         BENCH_PLATFORM, reps, fail, (unsigned long long)(reps ? cycles / reps : 0),
+         (unsigned)pct(st->lat_us, st->nsamples, 50), (unsigned)pct(st->lat_us, st->nsamples, 90),
+         (unsigned)pct(st->lat_us, st->nsamples, 99), (unsigned)pct(st->lat_us, st->nsamples, 100));
+
+    // several outstanding, answered last to first; each once
+    approval_drop_all(&a->book);
+    unsigned out_of_order = 0;
+    if (approval_open_n(a, APPROVAL_MAX_PENDING, now) != 0) bad++;
+    for (unsigned i = APPROVAL_MAX_PENDING; i-- > 0;) {
+        if (approval_answer(a, i, i % 2 == 0, now, &v) == APPROVAL_OK && v.request_id == a->id[i] &&
+            v.approve == (i % 2 == 0)) {
+            out_of_order++;
+        }
+    }
+    if (out_of_order != APPROVAL_MAX_PENDING) bad++;
+    unsigned rejected = 0;
+    if (approval_answer(a, 0, true, now, &v) == APPROVAL_ERR_UNKNOWN) rejected++;   // replay
+
+    // tampered verdict, then a key that isn't the pairing key: the request
+    // stays open for the real answer
+    if (approval_open_n(a, 1, now) != 0) bad++;
+    approval_verdict_t no = { .approve = false };
+    (void)approval_respond(a->key, a->req[0], (size_t)a->req_len[0], &no, resp);
+    resp[6] = 1;
+    if (approval_check(&a->book, a->key, resp, sizeof(resp), now, &v) == APPROVAL_ERR_MAC) rejected++;
+    uint8_t other[APPROVAL_KEY_LEN];
+    memset(other, 0xee, sizeof(other));
+    (void)approval_respond(other, a->req[0], (size_t)a->req_len[0], &yes, resp);
+    if (approval_check(&a->book, a->key, resp, sizeof(resp), now, &v) == APPROVAL_ERR_MAC) rejected++;
+    if (approval_answer(a, 0, false, now, &v) != APPROVAL_OK || v.approve) bad++;
+
+    // too late, then superseded by a newer request
+    if (approval_open_n(a, 1, now) != 0) bad++;
+    if (approval_answer(a, 0, true, now + APPROVAL_BENCH_TTL_MS * 1000ull + 1, &v) == APPROVAL_ERR_EXPIRED) {
+        rejected++;
+    }
+    if (approval_open_n(a, 1, now) != 0) bad++;
+    approval_drop_all(&a->book);
+    if (approval_answer(a, 0, true, now, &v) == APPROVAL_ERR_UNKNOWN) rejected++;
+
+    // malformed: short, wrong version, a PAIR where a RESPONSE goes
+    if (approval_open_n(a, 1, now) != 0) bad++;
+    (void)approval_respond(a->key, a->req[0], (size_t)a->req_len[0], &yes, resp);
+    if (approval_check(&a->book, a->key, resp, sizeof(resp) - 1, now, &v) == APPROVAL_ERR_FORMAT) rejected++;
+    resp[0] = APPROVAL_VERSION + 1;
+    if (approval_check(&a->book, a->key, resp, sizeof(resp), now, &v) == APPROVAL_ERR_FORMAT) rejected++;
+    uint8_t pair[APPROVAL_PAIR_LEN] = { APPROVAL_VERSION, APPROVAL_TYPE_PAIR };
+    if (approval_check(&a->book, a->key, pair, sizeof(pair), now, &v) == APPROVAL_ERR_FORMAT) rejected++;
+    uint8_t got[APPROVAL_KEY_LEN];
+    if (approval_parse_pair(pair, sizeof(pair), got) != APPROVAL_OK) bad++;
+
+    // revoke: each counter once, increasing
+    uint8_t rv[APPROVAL_REVOKE_LEN];
+    (void)approval_revoke(a->key, 5, rv);
+    if (approval_check(&a->book, a->key, rv, sizeof(rv), now, &v) != APPROVAL_OK ||
+        v.type != APPROVAL_TYPE_REVOKE) {
+        bad++;
+    }
+    if (approval_check(&a->book, a->key, rv, sizeof(rv), now, &v) == APPROVAL_ERR_REPLAY) rejected++;
+    (void)approval_revoke(a->key, 4, rv);
+    if (approval_check(&a->book, a->key, rv, sizeof(rv), now, &v) == APPROVAL_ERR_REPLAY) rejected++;
+
+    const unsigned expect_rejected = 10;
+    if (rejected != expect_rejected) bad++;
+    emit(b,
+         "{\"bench\":\"approval\",\"platform\":\"%s\",\"op\":\"checks\",\"pending_max\":%u,"
+         "\"out_of_order\":%u,\"rejected\":%u,\"bad\":%u}",
+         BENCH_PLATFORM, (unsigned)APPROVAL_MAX_PENDING, out_of_order, rejected, bad);
+    return fail || bad ? 1 : 0;
+}
+
+#define NEXT_ACCOUNTS 5
+#define NEXT_USER     0x300u   // user handle seed of account 0
+
+// GetAssertion without an allowList, as a platform sends it to list the
+// accounts it may sign in with.
+static uint16_t build_discover_assertion(uint8_t *buf, size_t cap)
+{
+    cb_t c = { buf, 0, cap };
+    cb_byte(&c, CTAP_CMD_GET_ASSERTION);
+    cb_head(&c, 5, 2);
+    cb_int(&c, 1);
+    cb_tstr(&c, "accounts.example.com");
+    cb_int(&c, 2);
+    cb_bstr(&c, 3, 32);
+    return c.n <= cap ? (uint16_t)c.n : 0;
+}
+
+// The last response carries account `k`'s user handle, `skip` bytes before
+// its end (numberOfCredentials follows it in the first response).
+static bool resp_user_is(const bench_t *b, unsigned k, size_t skip)
+{
+    if (b->cbor_resp_len < 32 + skip) return false;
+    const uint8_t *u = b->cbor_resp + b->cbor_resp_len - skip - 32;
+    for (size_t i = 0; i < 32; i++) {
+        if (u[i] != pattern_byte(NEXT_USER + k, i)) return false;
+    }
+    return true;
+}
+
+// Several accounts on one RP: register NEXT_ACCOUNTS discoverable
+// credentials, then list them. "discover" is the GetAssertion alone (it
+// must report them all in numberOfCredentials and answer with the newest);
+// "next_assertion" is each round of one GetAssertion, a GetNextAssertion
+// per remaining account (newest first, signed from the batch cached in the
+// core, no store scan, no second presence prompt) and one more that must
+// be refused.
+static int run_next(bench_t *b, unsigned reps)
+{
+    int failed = 0;
+
+    core_reset(b);
+    scenario_begin(b);
+    b->up_verdict = CORE_UP_APPROVED;
+    for (unsigned k = 0; k < NEXT_ACCOUNTS; k++) {
+        uint16_t mc_len = build_make_credential(s_mc_req, sizeof(s_mc_req), "accounts.example.com",
+                                                true, NEXT_USER + k);
+        bench_req_t *r = req_add(b, 0x09000001u, CTAPHID_CBOR, mc_len, k, EXPECT_CBOR_OK, 0);
+        r->data = s_mc_req;
+        pump(b);
+        settle(b);
+    }
+    bool registered = b->st.ok == NEXT_ACCOUNTS;
+    uint16_t ga_len = build_discover_assertion(s_ga_req, sizeof(s_ga_req));
+
+    memset(&b->st, 0, sizeof(b->st));
+    if (!registered) b->st.bad++;
+    uint64_t t0 = ctaphid_port_now_us();
+    for (unsigned i = 0; registered && i < reps; i++) {
+        bench_req_t *r = req_add(b, 0x09000001u, CTAPHID_CBOR, ga_len, i, EXPECT_CBOR_OK, 0);
+        r->data = s_ga_req;
+        pump(b);
+        settle(b);
+        bool counted = b->cbor_resp_len > 2 &&
+                       b->cbor_resp[b->cbor_resp_len - 2] == 0x05 &&
+                       b->cbor_resp[b->cbor_resp_len - 1] == NEXT_ACCOUNTS;
+        if (!counted || !resp_user_is(b, NEXT_ACCOUNTS - 1, 2)) b->st.bad++;
+    }
+    failed += scenario_end(b, "discover", ga_len, 1, t0);
+
+    scenario_begin(b);
+    b->up_verdict = CORE_UP_APPROVED;
+    if (!registered) b->st.bad++;
+    t0 = ctaphid_port_now_us();
+    for (unsigned i = 0; registered && i < reps; i++) {
+        bench_req_t *r = req_add(b, 0x09000001u, CTAPHID_CBOR, ga_len, i, EXPECT_CBOR_OK, 0);
+        r->data = s_ga_req;
+        pump(b);
+        settle(b);
+        for (unsigned k = NEXT_ACCOUNTS - 1; k-- > 0;) {
+            r = req_add(b, 0x09000001u, CTAPHID_CBOR, 1, k, EXPECT_CBOR_OK, 0);
+            r->small[0] = CTAP_CMD_GET_NEXT_ASSERTION;
+            pump(b);
+            settle(b);
+            if (!resp_user_is(b, k, 0)) b->st.bad++;
+        }
+        r = req_add(b, 0x09000001u, CTAPHID_CBOR, 1, i, EXPECT_CBOR_STATUS, CTAP2_ERR_NOT_ALLOWED);
+        r->small[0] = CTAP_CMD_GET_NEXT_ASSERTION;
+        pump(b);
+        settle(b);
+    }
+    failed += scenario_end(b, "next_assertion", 1, 1, t0);
+    return failed;
+}
+
+static uint32_t xorshift32(uint32_t *s)
+{
+    uint32_t x = *s;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *s = x;
+}
+
+// Seeded mutations of the realistic requests (bit flips, byte overwrites,
+// truncation). Every message must still get a CBOR answer and leave the
+// engine clean; a decoder fault shows up as a crash or a missing response.
+static int run_fuzz(bench_t *b, unsigned reps)
+{
+    uint16_t mc_len = build_make_credential(s_mc_req, sizeof(s_mc_req), "login.example.com", false, 2);
+    uint16_t ga_len = build_get_assertion(s_ga_req, sizeof(s_ga_req), "pam://roottap", NULL, 0);
+    uint32_t seed = 0x5eed1234u;
+
+    scenario_begin(b);
+    b->up_verdict = CORE_UP_APPROVED;
+    uint64_t t0 = ctaphid_port_now_us();
+    for (unsigned i = 0; i < reps * 20; i++) {
+        bool mc = xorshift32(&seed) & 1;
+        uint16_t len = mc ? mc_len : ga_len;
+        memcpy(s_fuzz_req, mc ? s_mc_req : s_ga_req, len);
+
+        unsigned muts = 1 + xorshift32(&seed) % 4;
+        for (unsigned m = 0; m < muts && len > 1; m++) {
+            uint32_t x = xorshift32(&seed);
+            uint16_t at = (uint16_t)(1 + x % (len - 1));   // keep the command byte
+            switch ((x >> 16) % 3) {
+            case 0: s_fuzz_req[at] ^= (uint8_t)(1u << ((x >> 20) & 7)); break;
+            case 1: s_fuzz_req[at] = (uint8_t)(x >> 24); break;
+            default: len = at; break;
+            }
+        }
+
+        bench_req_t *r = req_add(b, 0x06000001u, CTAPHID_CBOR, len, i, EXPECT_CBOR_ANY, 0);
+        r->data = s_fuzz_req;
+        pump(b);
+        settle(b);
+    }
+    return scenario_end(b, "fuzz", mc_len > ga_len ? mc_len : ga_len, 1, t0);
+}
+
+// ---- crypto primitives, timed directly ----
+
+typedef struct {
+    uint8_t priv[CRYPTO_P256_PRIV_LEN];
+    uint8_t pub[CRYPTO_P256_PUB_LEN];
+    uint8_t digest[CRYPTO_SHA256_LEN];
+    uint8_t sig[CRYPTO_P256_SIG_LEN];
+    uint8_t msg[1024];
+    size_t  msg_len;
+} crypto_state_t;
+
+static crypto_state_t s_crypto;
+
+static int op_sha256(crypto_state_t *c)
+{
+    const crypto_buf_t part = { c->msg, c->msg_len };
+    return crypto_sha256(&part, 1, c->digest);
+}
+
+static int op_keygen(crypto_state_t *c)
+{
+    return crypto_p256_keygen(c->priv, c->pub);
+}
+
+static int op_sign(crypto_state_t *c)
+{
+    return crypto_p256_sign(c->priv, c->digest, c->sig);
+}
+
+// Puts one entry in the pool ahead of a pooled measurement (not timed).
+static void prep_refill(void)
+{
+    (void)crypto_pool_refill(1);
+}
+
+// One JSON line per operation; returns 1 if any call failed. `prep` runs
+// before each call, outside the timed region. `pool` only labels the line.
+static int time_op(bench_t *b, const char *op, unsigned size, int (*fn)(crypto_state_t *),
+                   void (*prep)(void), const char *pool, unsigned reps)
+{
+    bench_stats_t *st = &b->st;
+    uint64_t cycles = 0;
+    unsigned fail = 0;
+
+    memset(st, 0, sizeof(*st));
+    if (reps > MAX_SAMPLES) reps = MAX_SAMPLES;
+    for (unsigned i = 0; i < reps; i++) {
+        if (prep) prep();
+        uint64_t t0 = ctaphid_port_now_us();
+        uint32_t c0 = ctaphid_port_cycles();
+        if (fn(&s_crypto) != 0) fail++;
+        cycles += ctaphid_port_cycles() - c0;
+        st->lat_us[st->nsamples++] = (uint32_t)(ctaphid_port_now_us() - t0);
+    }
+    qsort(st->lat_us, st->nsamples, sizeof(st->lat_us[0]), cmp_u32);
+
+    emit(b,
+         "{\"bench\":\"crypto\",\"platform\":\"%s\",\"op\":\"%s\",\"pool\":\"%s\",\"size\":%u,"
+         "\"reps\":%u,\"fail\":%u,\"cycles_per_op\":%llu,"
+         "\"us\":{\"p50\":%u,\"p90\":%u,\"p99\":%u,\"max\":%u}}",
+         BENCH_PLATFORM, op, pool, size, reps, fail,
+         (unsigned long long)(reps ? cycles / reps : 0),
+         (unsigned)pct(st->lat_us, st->nsamples, 50), (unsigned)pct(st->lat_us, st->nsamples, 90),
+         (unsigned)pct(st->lat_us, st->nsamples, 99), (unsigned)pct(st->lat_us, st->nsamples, 100));
+    return fail ? 1 : 0;
+}
+
+// The primitives on the assertion path, without CTAPHID or CBOR around them.
+// Key generation and signing run twice: "cold" computes everything on
+// demand, "pooled" takes a precomputed entry as after an idle period. The
+// closing "pool" line has the hit/miss and refill counters for the run.
+static int run_crypto(bench_t *b, unsigned reps)
+{
+    crypto_state_t *c = &s_crypto;
+    crypto_pool_stats_t p0, p1;
+    int failed = 0;
+
+    for (size_t i = 0; i < sizeof(c->msg); i++) c->msg[i] = pattern_byte(7, i);
+    // table setup is a one-off; keep it out of the samples
+    if (crypto_init() != 0) return 1;
+
+    c->msg_len = 69;   // authData (37) || clientDataHash (32) of an assertion
+    failed += time_op(b, "sha256", (unsigned)c->msg_len, op_sha256, NULL, "-", reps);
+    c->msg_len = sizeof(c->msg);
+    failed += time_op(b, "sha256", (unsigned)c->msg_len, op_sha256, NULL, "-", reps);
+
+    crypto_pool_set_enabled(false);
+    failed += time_op(b, "p256_keygen", 0, op_keygen, NULL, "cold", reps);
+    failed += time_op(b, "p256_sign", CRYPTO_SHA256_LEN, op_sign, NULL, "cold", reps);
+    crypto_pool_set_enabled(true);
+
+    // start full so each prep_refill() tops up exactly what the last call took
+    while (crypto_pool_refill(CRYPTO_POOL_KEYS + CRYPTO_POOL_PRESIGS) != 0) {
+    }
+    crypto_pool_get_stats(&p0);
+    failed += time_op(b, "p256_keygen", 0, op_keygen, prep_refill, "pooled", reps);
+    failed += time_op(b, "p256_sign", CRYPTO_SHA256_LEN, op_sign, prep_refill, "pooled", reps);
+    crypto_pool_get_stats(&p1);
+
+    uint32_t made = (p1.keys_made - p0.keys_made) + (p1.presigs_made - p0.presigs_made);
+    uint64_t refill_us = p1.refill_us - p0.refill_us;
+    emit(b,
+         "{\"bench\":\"crypto\",\"platform\":\"%s\",\"op\":\"pool\","
+         "\"keys\":%u,\"presigs\":%u,\"keys_hit\":%u,\"keys_miss\":%u,"
+         "\"presigs_hit\":%u,\"presigs_miss\":%u,\"made\":%u,\"refill_us_per_item\":%llu}",
+         BENCH_PLATFORM, (unsigned)p1.keys, (unsigned)p1.presigs,
+         (unsigned)(p1.keys_hit - p0.keys_hit), (unsigned)(p1.keys_miss - p0.keys_miss),
+         (unsigned)(p1.presigs_hit - p0.presigs_hit), (unsigned)(p1.presigs_miss - p0.presigs_miss),
+         (unsigned)made, (unsigned long long)(made ? refill_us / made : 0));
+    return failed;
+}
+
+// ---- credential store on a simulated flash ----
+
+// Store timings: every call counts towards max and mean, every `stride`-th
+// is kept for the percentiles.
+typedef struct {
+    uint32_t cyc[MAX_SAMPLES];
+    unsigned n;
+    unsigned stride;
+    unsigned seen;
+    uint32_t max;
+    uint64_t total;
+    uint64_t t0_us;
+} store_samples_t;
+
+static store_samples_t s_samples;
+static cred_store_cred_t s_cred;
+
+static void samples_begin(store_samples_t *s, unsigned ops)
+{
+    memset(s, 0, sizeof(*s));
+    s->stride = ops / MAX_SAMPLES + 1;
+    s->t0_us = ctaphid_port_now_us();
+}
+
+static void samples_add(store_samples_t *s, uint32_t cycles)
+{
+    if (s->seen++ % s->stride == 0 && s->n < MAX_SAMPLES) s->cyc[s->n++] = cycles;
+    if (cycles > s->max) s->max = cycles;
+    s->total += cycles;
+}
+
+static void store_emit(bench_t *b, unsigned creds, const char *op, store_samples_t *s)
+{
+    uint64_t us = ctaphid_port_now_us() - s->t0_us;
+    qsort(s->cyc, s->n, sizeof(s->cyc[0]), cmp_u32);
+    emit(b,
+         "{\"bench\":\"cred_store\",\"platform\":\"%s\",\"creds\":%u,\"op\":\"%s\",\"calls\":%u,"
+         "\"total_us\":%llu,\"cycles_per_op\":%llu,"
+         "\"cycles\":{\"p50\":%u,\"p90\":%u,\"p99\":%u,\"max\":%u}}",
+         BENCH_PLATFORM, creds, op, s->seen, (unsigned long long)us,
+         (unsigned long long)(s->seen ? s->total / s->seen : 0),
+         (unsigned)pct(s->cyc, s->n, 50), (unsigned)pct(s->cyc, s->n, 90),
+         (unsigned)pct(s->cyc, s->n, 99), (unsigned)s->max);
+}
+
+static uint64_t mix64(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+static void put_mix(uint8_t *dst, size_t len, uint64_t seed)
+{
+    for (size_t i = 0; i < len; i += 8) {
+        uint64_t v = mix64(seed + i);
+        for (size_t k = 0; k < 8 && i + k < len; k++) dst[i + k] = (uint8_t)(v >> (8 * k));
+    }
+}
+
+// Credential `i` of generation `gen`: about four per RP, the first of each
+// discoverable. IDs are random-looking like the core's.
+static cred_store_cred_t *store_cred(uint32_t i, uint32_t gen, uint32_t rps)
+{
+    cred_store_cred_t *c = &s_cred;
+    memset(c, 0, sizeof(*c));
+    put_mix(c->rp_id_hash, sizeof(c->rp_id_hash), (uint64_t)(i % rps) << 8);
+    put_mix(c->id, sizeof(c->id), ((uint64_t)gen << 40 | i) << 8 | 0x80);
+    for (size_t k = 0; k < sizeof(c->priv); k++) c->priv[k] = pattern_byte(i, k);
+    c->user_id_len = 16;
+    for (size_t k = 0; k < c->user_id_len; k++) c->user_id[k] = pattern_byte(gen, i + k);
+    c->resident = i < rps;
+    return c;
+}
+
+static int store_find(uint32_t i, uint32_t gen, uint32_t rps)
+{
+    const cred_store_cred_t *c = store_cred(i, gen, rps);
+    return cred_store_find(c->rp_id_hash, c->id, sizeof(c->id));
+}
+
+// Fill, remount, look up, walk discoverable credentials, count signatures,
+// delete half and refill through garbage collection, then check that a
+// fresh mount sees exactly what should be there.
+static int store_run_size(bench_t *b, unsigned n, unsigned reps)
+{
+    store_samples_t *s = &s_samples;
+    cred_flash_ram_t ram;
+    uint32_t rps = n / 4 + 1;
+    // the live data plus the erased spare: a tight fit, so refilling after
+    // the deletes has to go through garbage collection
+    unsigned sectors = (n + CRED_STORE_PER_SECTOR - 1) / CRED_STORE_PER_SECTOR + 1;
+    unsigned bad = 0;
+    uint32_t seed = 0x570e0000u + n;
+
+    if (n > CRED_STORE_MAX || cred_flash_ram_init(&ram, sectors * CRED_FLASH_SECTOR) != 0) {
+        emit(b, "{\"bench\":\"cred_store\",\"platform\":\"%s\",\"creds\":%u,\"skipped\":true}",
+             BENCH_PLATFORM, n);
+        return 0;
+    }
+    if (cred_store_mount(&ram.flash) != 0) bad++;
+
+    samples_begin(s, n);
+    for (uint32_t i = 0; i < n; i++) {
+        const cred_store_cred_t *c = store_cred(i, 0, rps);
+        uint32_t c0 = ctaphid_port_cycles();
+        int h = cred_store_insert(c);
+        samples_add(s, ctaphid_port_cycles() - c0);
+        if (h < 0) bad++;
+    }
+    store_emit(b, n, "insert", s);
+
+    unsigned mounts = reps < 10 ? reps : 10;
+    samples_begin(s, mounts);
+    for (unsigned i = 0; i < mounts; i++) {
+        uint32_t c0 = ctaphid_port_cycles();
+        if (cred_store_mount(&ram.flash) != 0) bad++;
+        samples_add(s, ctaphid_port_cycles() - c0);
+    }
+    store_emit(b, n, "mount", s);
+    if (cred_store_count() != n) bad++;
+
+    unsigned lookups = reps * 20;
+    samples_begin(s, lookups);
+    for (unsigned k = 0; k < lookups; k++) {
+        const cred_store_cred_t *c = store_cred(xorshift32(&seed) % n, 0, rps);
+        uint32_t c0 = ctaphid_port_cycles();
+        int h = cred_store_find(c->rp_id_hash, c->id, sizeof(c->id));
+        samples_add(s, ctaphid_port_cycles() - c0);
+        if (h < 0) bad++;
+    }
+    store_emit(b, n, "lookup", s);
+
+    // a known RP, an ID from a generation that was never stored
+    samples_begin(s, lookups);
+    for (unsigned k = 0; k < lookups; k++) {
+        const cred_store_cred_t *c = store_cred(xorshift32(&seed) % n, 9, rps);
+        uint32_t c0 = ctaphid_port_cycles();
+        int h = cred_store_find(c->rp_id_hash, c->id, sizeof(c->id));
+        samples_add(s, ctaphid_port_cycles() - c0);
+        if (h >= 0) bad++;
+    }
+    store_emit(b, n, "lookup_miss", s);
+
+    // what a GetAssertion without allowList does: every discoverable
+    // credential of the RP, newest first
+    samples_begin(s, lookups);
+    for (unsigned k = 0; k < lookups; k++) {
+        const cred_store_cred_t *c = store_cred(xorshift32(&seed) % rps, 0, rps);
+        uint8_t rp[CRED_STORE_RP_HASH_LEN];
+        unsigned found = 0;
+        memcpy(rp, c->rp_id_hash, sizeof(rp));
+        uint32_t c0 = ctaphid_port_cycles();
+        for (int h = cred_store_next_resident(rp, -1); h >= 0; h = cred_store_next_resident(rp, h)) {
+            found++;
+        }
+        samples_add(s, ctaphid_port_cycles() - c0);
+        if (found == 0) bad++;
+    }
+    store_emit(b, n, "residents", s);
+
+    samples_begin(s, lookups);
+    for (unsigned k = 0; k < lookups; k++) {
+        int h = store_find(xorshift32(&seed) % n, 0, rps);
+        uint32_t count = 0;
+        uint32_t c0 = ctaphid_port_cycles();
+        int rc = cred_store_bump(h, &count);
+        samples_add(s, ctaphid_port_cycles() - c0);
+        if (rc != 0 || count == 0) bad++;
+    }
+    store_emit(b, n, "bump", s);
+
+    samples_begin(s, n / 2);
+    for (uint32_t i = 0; i < n; i += 2) {
+        int h = store_find(i, 0, rps);
+        uint32_t c0 = ctaphid_port_cycles();
+        int rc = cred_store_delete(h);
+        samples_add(s, ctaphid_port_cycles() - c0);
+        if (rc != 0) bad++;
+    }
+    store_emit(b, n, "delete", s);
+
+    // refill: each pass reclaims the sector with the most dead records
+    samples_begin(s, n / 2);
+    for (uint32_t i = 0; i < n; i += 2) {
+        uint32_t c0 = ctaphid_port_cycles();
+        int rc = cred_store_gc();
+        uint32_t cycles = ctaphid_port_cycles() - c0;
+        if (rc == 1) samples_add(s, cycles);
+        if (rc < 0 || cred_store_insert(store_cred(i, 1, rps)) < 0) bad++;
+    }
+    store_emit(b, n, "gc", s);
+    cred_store_stats_t st;
+    cred_store_get_stats(&st);
+
+    if (cred_store_mount(&ram.flash) != 0 || cred_store_count() != n) bad++;
+    for (uint32_t i = 0; i < n; i++) {
+        bool gone = i % 2 == 0;
+        if ((store_find(i, 0, rps) >= 0) == gone) bad++;
+        if (gone && store_find(i, 1, rps) < 0) bad++;
+    }
+    emit(b,
+         "{\"bench\":\"cred_store\",\"platform\":\"%s\",\"creds\":%u,\"op\":\"summary\","
+         "\"sectors\":%u,\"live\":%u,\"dead\":%u,\"free\":%u,\"gc_runs\":%u,\"gc_moved\":%u,"
+         "\"erase_min\":%u,\"erase_max\":%u,\"bad\":%u}",
+         BENCH_PLATFORM, n, (unsigned)st.sectors, (unsigned)st.live, (unsigned)st.dead,
+         (unsigned)st.free, (unsigned)st.gc_runs, (unsigned)st.gc_moved,
+         (unsigned)st.erase_min, (unsigned)st.erase_max, bad);
+
+    cred_flash_ram_free(&ram);
+    return bad ? 1 : 0;
+}
+
+// Power cut at every 61st byte of a write sequence that inserts (through
+// garbage collection), rolls a signature tally over and deletes. After each
+// cut a fresh mount must find every credential that was complete before
+// the sequence, no deleted one, a counter that never went back, and a
+// store that still takes writes.
+static int store_powerfail(bench_t *b)
+{
+    enum { SECTORS = 6, BASE = 60, NEW = 30, BUMPS = 300 };
+    const uint32_t rps = 8;
+    unsigned cuts = 0, bad = 0;
+    bool complete = false;
+
+    for (long cut = 0; !complete; cut += 61) {
+        cred_flash_ram_t ram;
+        if (cred_flash_ram_init(&ram, SECTORS * CRED_FLASH_SECTOR) != 0) {
+            bad++;
+            break;
+        }
+        uint32_t count = 0;
+        bool setup = cred_store_mount(&ram.flash) == 0;
+        for (uint32_t i = 0; setup && i < BASE; i++) setup = cred_store_insert(store_cred(i, 0, rps)) >= 0;
+        for (uint32_t i = 0; setup && i < BASE; i += 3) setup = cred_store_delete(store_find(i, 0, rps)) == 0;
+        for (int k = 0; setup && k < 5; k++) setup = cred_store_bump(store_find(1, 0, rps), &count) == 0;
+        if (!setup) {
+            bad++;
+            cred_flash_ram_free(&ram);
+            break;
+        }
+
+        ram.cut_after = cut;
+        for (uint32_t j = 0; j < NEW; j++) (void)cred_store_insert(store_cred(j, 1, rps));
+        int h1 = store_find(1, 0, rps);
+        for (int k = 0; k < BUMPS; k++) (void)cred_store_bump(h1, &count);
+        (void)cred_store_delete(store_find(4, 0, rps));
+        complete = !ram.cut;
+        ram.cut = false;
+        ram.cut_after = -1;
+        cuts++;
+
+        unsigned found = 0;
+        cred_store_cred_t c;
+        if (cred_store_mount(&ram.flash) != 0) bad++;
+        for (uint32_t i = 0; i < BASE; i++) {
+            int h = store_find(i, 0, rps);
+            if (h >= 0) found++;
+            if (i % 3 == 0 ? h >= 0 : (h < 0 && i != 4)) bad++;
+            if (h >= 0 && cred_store_read(h, &c) != 0) bad++;
+        }
+        h1 = store_find(1, 0, rps);
+        if (h1 < 0 || cred_store_read(h1, &c) != 0 || c.sign_count < 5 ||
+            (complete && c.sign_count != 5 + BUMPS)) {
+            bad++;
+        }
+        for (uint32_t j = 0; j < NEW; j++) {
+            int h = store_find(j, 1, rps);
+            if (h >= 0) found++;
+            if (h < 0 ? complete : cred_store_read(h, &c) != 0) bad++;
+        }
+        // no phantom or duplicate entries, and the log still moves
+        if (cred_store_count() != found) bad++;
+        if (cred_store_insert(store_cred(0, 2, rps)) < 0) bad++;
+        if (cred_store_mount(&ram.flash) != 0 || store_find(0, 2, rps) < 0) bad++;
+        cred_flash_ram_free(&ram);
+    }
+
+    emit(b, "{\"bench\":\"cred_store\",\"platform\":\"%s\",\"op\":\"powerfail\",\"cuts\":%u,\"bad\":%u}",
+         BENCH_PLATFORM, cuts, bad);
+    return bad ? 1 : 0;
+}
+
+// The store on its own at 50/500/5000 credentials (sizes above
+// CRED_STORE_MAX are skipped), then the power-cut check. Restores whatever
+// store was mounted before.
+static int run_store(bench_t *b, unsigned reps)
+{
+    static const unsigned sizes[] = { 50, 500, 5000 };
+    const cred_flash_t *prev = cred_store_flash();
+    int failed = 0;
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        failed += store_run_size(b, sizes[i], reps);
+    }
+    failed += store_powerfail(b);
+
+    (void)cred_store_mount(prev);
+    return failed;
+}
+
+// ---- allowList scan, timed in the core ----
+
+static uint8_t s_scan_req[CTAPHID_MAX_MSG_SIZE];
+static uint8_t s_scan_resp[512];
+static uint8_t s_scan_id[128];
+
+// GetAssertion for pam://roottap without presence, so nothing waits on the
+// user: `count` IDs of `id_len` bytes led by `lead`, then `ours` if given.
+static uint16_t build_scan_assertion(unsigned count, size_t id_len, uint8_t lead,
+                                     const uint8_t *ours, size_t ours_len)
+{
+    cb_t c = { s_scan_req, 0, sizeof(s_scan_req) };
+    unsigned total = count + (ours ? 1 : 0);
+    cb_byte(&c, CTAP_CMD_GET_ASSERTION);
+    cb_head(&c, 5, 4);
+    cb_int(&c, 1);
+    cb_tstr(&c, "pam://roottap");
+    cb_int(&c, 2);
+    cb_bstr(&c, 3, 32);
+    cb_int(&c, 3);
+    cb_head(&c, 4, total);
+    for (unsigned i = 0; i < total; i++) {
+        bool last = ours && i == count;
+        cb_head(&c, 5, 2);
+        cb_tstr(&c, "id");
+        cb_head(&c, 2, last ? ours_len : id_len);
+        if (last) {
+            for (size_t k = 0; k < ours_len; k++) cb_byte(&c, ours[k]);
+        } else {
+            cb_byte(&c, lead);
+            for (size_t k = 1; k < id_len; k++) cb_byte(&c, pattern_byte(0x200 + i, k));
+        }
+        cb_tstr(&c, "type");
+        cb_tstr(&c, "public-key");
+    }
+    cb_int(&c, 5);
+    cb_head(&c, 5, 1);
+    cb_tstr(&c, "up");
+    cb_head(&c, 7, 20);
+    return c.n <= sizeof(s_scan_req) ? (uint16_t)c.n : 0;
+}
+
+// Mean cycles of `reps` calls into the core; 1 in *bad per wrong status.
+static uint64_t scan_time(bench_t *b, uint16_t len, int expect, unsigned reps,
+                          store_samples_t *s, unsigned *bad)
+{
+    samples_begin(s, reps);
+    for (unsigned i = 0; i < reps; i++) {
+        size_t out = 0;
+        uint32_t c0 = ctaphid_port_cycles();
+        int rc = core_handle_request(b->ctx.core_mem, sizeof(b->ctx.core_mem), s_scan_req, len,
+                                     s_scan_resp, sizeof(s_scan_resp), &out);
+        samples_add(s, ctaphid_port_cycles() - c0);
+        if (rc != expect) (*bad)++;
+    }
+    return s->seen ? s->total / s->seen : 0;
+}
+
+static void scan_emit(bench_t *b, const char *ids, unsigned entries, bool found,
+                      store_samples_t *s, uint64_t base)
+{
+    uint64_t mean = s->seen ? s->total / s->seen : 0;
+    uint64_t us = ctaphid_port_now_us() - s->t0_us;
+    qsort(s->cyc, s->n, sizeof(s->cyc[0]), cmp_u32);
+    emit(b,
+         "{\"bench\":\"allowlist\",\"platform\":\"%s\",\"ids\":\"%s\",\"entries\":%u,"
+         "\"found\":%s,\"calls\":%u,\"total_us\":%llu,\"cycles_per_op\":%llu,"
+         "\"cycles_per_entry\":%llu,\"cycles\":{\"p50\":%u,\"p90\":%u,\"max\":%u}}",
+         BENCH_PLATFORM, ids, entries, found ? "true" : "false", s->seen,
+         (unsigned long long)us, (unsigned long long)mean,
+         (unsigned long long)(entries && mean > base ? (mean - base) / entries : 0),
+         (unsigned)pct(s->cyc, s->n, 50), (unsigned)pct(s->cyc, s->n, 90), (unsigned)s->max);
+}
+
+// What a long pam_u2f allowList costs the core: register one non-resident
+// credential, then time GetAssertion with 1..64 IDs that aren't ours, as
+// other tokens' key handles (64 bytes, rejected on length) and as IDs in
+// our format from another device (rejected by the check MAC), and with ours
+// after the look-alikes (unwrap and sign). cycles_per_entry is over an
+// empty allowList, so request parsing and the rpId hash drop out.
+static int run_allowlist(bench_t *b, unsigned reps)
+{
+    static const unsigned counts[] = { 1, 8, 32, 64 };
+    store_samples_t *s = &s_samples;
+    unsigned bad = 0;
+
+    core_reset(b);
+    uint16_t mc_len = build_make_credential(s_mc_req, sizeof(s_mc_req), "pam://roottap", false, 2);
+    scenario_begin(b);
+    b->up_verdict = CORE_UP_APPROVED;
+    bench_req_t *r = req_add(b, 0x08000001u, CTAPHID_CBOR, mc_len, 0, EXPECT_CBOR_OK, 0);
+    r->data = s_mc_req;
+    pump(b);
+    settle(b);
+    const uint8_t *id = NULL;
+    size_t id_len = mc_cred_id(b->cbor_resp, b->cbor_resp_len, &id);
+    if (b->st.ok != 1 || id_len == 0 || id_len > sizeof(s_scan_id)) {
+        emit(b, "{\"bench\":\"allowlist\",\"platform\":\"%s\",\"registered\":false}",
+             BENCH_PLATFORM);
+        return 1;
+    }
+    memcpy(s_scan_id, id, id_len);
+
+    // no entries: the discoverable-credential path, of which there are none
+    uint16_t len = build_scan_assertion(0, 0, 0, NULL, 0);
+    uint64_t base = scan_time(b, len, CTAP2_ERR_NO_CREDENTIALS, reps, s, &bad);
+    scan_emit(b, "none", 0, false, s, base);
+
+    for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+        len = build_scan_assertion(counts[i], 64, 0x00, NULL, 0);
+        scan_time(b, len, CTAP2_ERR_NO_CREDENTIALS, reps, s, &bad);
+        scan_emit(b, "foreign", counts[i], false, s, base);
+
+        len = build_scan_assertion(counts[i], id_len, s_scan_id[0], NULL, 0);
+        scan_time(b, len, CTAP2_ERR_NO_CREDENTIALS, reps, s, &bad);
+        scan_emit(b, "lookalike", counts[i], false, s, base);
+
+        len = build_scan_assertion(counts[i] - 1, id_len, s_scan_id[0], s_scan_id, id_len);
+        scan_time(b, len, 0, reps, s, &bad);
+        scan_emit(b, "lookalike", counts[i], true, s, base);
+    }
+    emit(b, "{\"bench\":\"allowlist\",\"platform\":\"%s\",\"id_len\":%u,\"bad\":%u}",
+         BENCH_PLATFORM, (unsigned)id_len, bad);
+    return bad ? 1 : 0;
+}
+
+// ---- ClientPIN, timed in the core ----
+
+#define PIN_PROTOCOL  2
+#define PIN_RETRIES   8
+#define PIN_PERM_MC   0x01
+#define PIN_PERM_GA   0x02
+#define PIN_TOKEN_LEN 32
+
+// The platform's half of PIN/UV auth protocol 2.
+typedef struct {
+    uint8_t priv[CRYPTO_P256_PRIV_LEN];
+    uint8_t pub[CRYPTO_P256_PUB_LEN];
+    uint8_t hmac[CRYPTO_HMAC_KEY_LEN];
+    uint8_t aes[CRYPTO_AES_KEY_LEN];
+} pin_platform_t;
+
+static pin_platform_t s_platform;
+static uint8_t s_dev_key[CRYPTO_P256_PUB_LEN];
+static uint8_t s_token[PIN_TOKEN_LEN];
+
+// HKDF-SHA-256, zero salt, one block per key: what the authenticator derives.
+static int pin_agree(pin_platform_t *pp, bool new_key)
+{
+    static const uint8_t zero[CRYPTO_HMAC_KEY_LEN];
+    uint8_t z[CRYPTO_P256_PRIV_LEN], prk[CRYPTO_SHA256_LEN];
+    if (new_key && crypto_p256_keygen(pp->priv, pp->pub) != 0) return -1;
+    if (crypto_p256_ecdh(pp->priv, s_dev_key, z) != 0) return -1;
+    crypto_buf_t part = { z, sizeof(z) };
+    if (crypto_hmac_sha256(zero, &part, 1, prk) != 0) return -1;
+    crypto_buf_t hmac_info[] = { { (const uint8_t *)"CTAP2 HMAC key\x01", 15 } };
+    crypto_buf_t aes_info[] = { { (const uint8_t *)"CTAP2 AES key\x01", 14 } };
+    if (crypto_hmac_sha256(prk, hmac_info, 1, pp->hmac) != 0) return -1;
+    return crypto_hmac_sha256(prk, aes_info, 1, pp->aes);
+}
+
+// IV || AES-256-CBC(data) into `out`, which holds 16 + len bytes.
+static void pin_encrypt(const pin_platform_t *pp, const uint8_t *data, size_t len, uint8_t *out)
+{
+    for (size_t i = 0; i < CRYPTO_AES_BLOCK_LEN; i++) out[i] = pattern_byte(0x500 + (uint32_t)len, i);
+    (void)crypto_aes_cbc_encrypt(pp->aes, out, data, out + CRYPTO_AES_BLOCK_LEN, len);
+}
+
+static void pin_mac(const uint8_t key[32], const uint8_t *a, size_t a_len,
+                    const uint8_t *b2, size_t b_len, uint8_t out[CRYPTO_SHA256_LEN])
+{
+    crypto_buf_t parts[] = { { a, a_len }, { b2, b_len } };
+    (void)crypto_hmac_sha256(key, parts, b2 ? 2 : 1, out);
+}
+
+static void cb_cose_key(cb_t *c, const uint8_t pub[CRYPTO_P256_PUB_LEN])
+{
+    cb_head(c, 5, 5);
+    cb_int(c, 1);
+    cb_int(c, 2);
+    cb_int(c, 3);
+    cb_int(c, -25);
+    cb_int(c, -1);
+    cb_int(c, 1);
+    cb_int(c, -2);
+    cb_bytes(c, pub, 32);
+    cb_int(c, -3);
+    cb_bytes(c, pub + 32, 32);
+}
+
+// ClientPIN request: `sub` with whichever of the key agreement, pinAuth,
+// newPinEnc and pinHashEnc the caller fills in, then permissions and rpId.
+static uint16_t build_client_pin(uint8_t sub, const uint8_t *agreement,
+                                 const uint8_t *pin_auth, const uint8_t *new_pin_enc,
+                                 const uint8_t *pin_hash_enc, uint8_t permissions)
+{
+    cb_t c = { s_scan_req, 0, sizeof(s_scan_req) };
+    unsigned n = 2 + (agreement != NULL) + (pin_auth != NULL) + (new_pin_enc != NULL) +
+                 (pin_hash_enc != NULL) + (permissions ? 2 : 0);
+    cb_byte(&c, CTAP_CMD_CLIENT_PIN);
+    cb_head(&c, 5, n);
+    cb_int(&c, 1);
+    cb_int(&c, PIN_PROTOCOL);
+    cb_int(&c, 2);
+    cb_int(&c, sub);
+    if (agreement) {
+        cb_int(&c, 3);
+        cb_cose_key(&c, agreement);
+    }
+    if (pin_auth) {
+        cb_int(&c, 4);
+        cb_bytes(&c, pin_auth, CRYPTO_SHA256_LEN);
+    }
+    if (new_pin_enc) {
+        cb_int(&c, 5);
+        cb_bytes(&c, new_pin_enc, CRYPTO_AES_BLOCK_LEN + 64);
+    }
+    if (pin_hash_enc) {
+        cb_int(&c, 6);
+        cb_bytes(&c, pin_hash_enc, CRYPTO_AES_BLOCK_LEN + 16);
+    }
+    if (permissions) {
+        cb_int(&c, 9);
+        cb_int(&c, permissions);
+        cb_int(&c, 10);
+        cb_tstr(&c, "pam://roottap");
+    }
+    return c.n <= sizeof(s_scan_req) ? (uint16_t)c.n : 0;
+}
+
+// getPinUvAuthTokenUsingPinWithPermissions (0x09) for pam://roottap.
+static uint16_t build_token_request(const pin_platform_t *pp, const char *pin, uint8_t permissions)
+{
+    uint8_t hash[CRYPTO_SHA256_LEN], enc[CRYPTO_AES_BLOCK_LEN + 16];
+    crypto_buf_t part = { (const uint8_t *)pin, strlen(pin) };
+    (void)crypto_sha256(&part, 1, hash);
+    pin_encrypt(pp, hash, 16, enc);
+    return build_client_pin(0x09, pp->pub, NULL, NULL, enc, permissions);
+}
+
+// sudo's assertion with the token: one allowList entry, without presence
+// (`up` false) the timing is the token check and the signature.
+static uint16_t build_token_assertion(const uint8_t *id, size_t id_len, const uint8_t *token, bool up)
+{
+    uint8_t cdh[CRYPTO_SHA256_LEN], mac[CRYPTO_SHA256_LEN];
+    for (size_t i = 0; i < sizeof(cdh); i++) cdh[i] = pattern_byte(3, i);
+    cb_t c = { s_ga_req, 0, sizeof(s_ga_req) };
+    cb_byte(&c, CTAP_CMD_GET_ASSERTION);
+    cb_head(&c, 5, token ? 6 : 4);
+    cb_int(&c, 1);
+    cb_tstr(&c, "pam://roottap");
+    cb_int(&c, 2);
+    cb_bytes(&c, cdh, sizeof(cdh));
+    cb_int(&c, 3);
+    cb_head(&c, 4, 1);
+    cb_head(&c, 5, 2);
+    cb_tstr(&c, "id");
+    cb_bytes(&c, id, id_len);
+    cb_tstr(&c, "type");
+    cb_tstr(&c, "public-key");
+    cb_int(&c, 5);
+    cb_head(&c, 5, 1);
+    cb_tstr(&c, "up");
+    cb_head(&c, 7, up ? 21 : 20);
+    if (token) {
+        pin_mac(token, cdh, sizeof(cdh), NULL, 0, mac);
+        cb_int(&c, 6);
+        cb_bytes(&c, mac, sizeof(mac));
+        cb_int(&c, 7);
+        cb_int(&c, PIN_PROTOCOL);
+    }
+    return c.n <= sizeof(s_ga_req) ? (uint16_t)c.n : 0;
+}
+
+// One call into the core; the response lands in s_scan_resp.
+static int pin_call(bench_t *b, const uint8_t *req, uint16_t len, size_t *out, uint32_t *cycles)
+{
+    uint32_t c0 = ctaphid_port_cycles();
+    int rc = core_handle_request(b->ctx.core_mem, sizeof(b->ctx.core_mem), req, len,
+                                 s_scan_resp, sizeof(s_scan_resp), out);
+    if (cycles) *cycles = ctaphid_port_cycles() - c0;
+    return rc;
+}
+
+// The authenticator's key from a getKeyAgreement response, by the layout
+// the core emits: {1: {1: 2, 3: -25, -1: 1, -2: x, -3: y}}.
+static bool parse_key_agreement(size_t len)
+{
+    static const uint8_t head[] = {
+        0x00, 0xa1, 0x01, 0xa5, 0x01, 0x02, 0x03, 0x38, 0x18, 0x20, 0x01, 0x21, 0x58, 0x20,
+    };
+    static const uint8_t mid[] = { 0x22, 0x58, 0x20 };
+    if (len != sizeof(head) + 32 + sizeof(mid) + 32 || memcmp(s_scan_resp, head, sizeof(head)) != 0 ||
+        memcmp(s_scan_resp + sizeof(head) + 32, mid, sizeof(mid)) != 0) {
+        return false;
+    }
+    memcpy(s_dev_key, s_scan_resp + sizeof(head), 32);
+    memcpy(s_dev_key + 32, s_scan_resp + sizeof(head) + 32 + sizeof(mid), 32);
+    return true;
+}
+
+// {2: IV || token} decrypted into s_token.
+static bool parse_token(const pin_platform_t *pp, size_t len)
+{
+    static const uint8_t head[] = { 0x00, 0xa1, 0x02, 0x58, CRYPTO_AES_BLOCK_LEN + PIN_TOKEN_LEN };
+    if (len != sizeof(head) + CRYPTO_AES_BLOCK_LEN + PIN_TOKEN_LEN ||
+        memcmp(s_scan_resp, head, sizeof(head)) != 0) {
+        return false;
+    }
+    const uint8_t *iv = s_scan_resp + sizeof(head);
+    return crypto_aes_cbc_decrypt(pp->aes, iv, iv + CRYPTO_AES_BLOCK_LEN, s_token, PIN_TOKEN_LEN) == 0;
+}
+
+// authData flags of a GetAssertion response: the byte after the rpIdHash.
+static int ga_flags(size_t len)
+{
+    static const uint8_t tail[] = { 'p', 'u', 'b', 'l', 'i', 'c', '-', 'k', 'e', 'y', 0x02, 0x58 };
+    for (size_t i = 0; i + sizeof(tail) + 1 + 33 <= len; i++) {
+        if (memcmp(s_scan_resp + i, tail, sizeof(tail)) == 0) return s_scan_resp[i + sizeof(tail) + 1 + 32];
+    }
+    return -1;
+}
+
+static unsigned pin_retries(bench_t *b)
+{
+    size_t out = 0;
+    uint16_t len = build_client_pin(0x01, NULL, NULL, NULL, NULL, 0);
+    if (pin_call(b, s_scan_req, len, &out, NULL) != 0 || out < 4 || s_scan_resp[2] != 0x03) return 0;
+    return s_scan_resp[3];
+}
+
+static void pin_emit(bench_t *b, const char *op, store_samples_t *s)
+{
+    uint64_t us = ctaphid_port_now_us() - s->t0_us;
+    qsort(s->cyc, s->n, sizeof(s->cyc[0]), cmp_u32);
+    emit(b,
+         "{\"bench\":\"pin\",\"platform\":\"%s\",\"op\":\"%s\",\"calls\":%u,\"total_us\":%llu,"
+         "\"cycles_per_op\":%llu,\"cycles\":{\"p50\":%u,\"p90\":%u,\"max\":%u}}",
+         BENCH_PLATFORM, op, s->seen, (unsigned long long)us,
+         (unsigned long long)(s->seen ? s->total / s->seen : 0),
+         (unsigned)pct(s->cyc, s->n, 50), (unsigned)pct(s->cyc, s->n, 90), (unsigned)s->max);
+}
+
+// A deploy script's sudo burst with a PIN set. Times getKeyAgreement, the
+// token request with a new platform key each time (ECDH, two PIN-counter
+// writes) and with the same key again (shared secret from the cache), and
+// GetAssertion with and without the token. Then checks the edges: a wrong
+// PIN costs a retry and a correct one restores them, a replaced token and
+// one without the GetAssertion permission are refused. Closes with the
+// core's counters, token hit rate included.
+static int run_pin(bench_t *b, unsigned reps)
+{
+    store_samples_t *s = &s_samples;
+    pin_platform_t *pp = &s_platform;
+    core_pin_stats_t p0, p1;
+    unsigned bad = 0;
+    size_t out = 0;
+    uint32_t cyc = 0;
+    uint16_t len;
+
+    core_reset(b);
+    core_get_pin_stats(&p0);
+    uint16_t mc_len = build_make_credential(s_mc_req, sizeof(s_mc_req), "pam://roottap", false, 2);
+    scenario_begin(b);
+    b->up_verdict = CORE_UP_APPROVED;
+    bench_req_t *r = req_add(b, 0x0A000001u, CTAPHID_CBOR, mc_len, 0, EXPECT_CBOR_OK, 0);
+    r->data = s_mc_req;
+    pump(b);
+    settle(b);
+    const uint8_t *id = NULL;
+    size_t id_len = mc_cred_id(b->cbor_resp, b->cbor_resp_len, &id);
+    if (b->st.ok != 1 || id_len == 0 || id_len > sizeof(s_scan_id)) {
+        emit(b, "{\"bench\":\"pin\",\"platform\":\"%s\",\"registered\":false}", BENCH_PLATFORM);
+        return 1;
+    }
+    memcpy(s_scan_id, id, id_len);
+
+    len = build_client_pin(0x02, NULL, NULL, NULL, NULL, 0);
+    samples_begin(s, reps);
+    for (unsigned i = 0; i < reps; i++) {
+        if (pin_call(b, s_scan_req, len, &out, &cyc) != 0 || !parse_key_agreement(out)) bad++;
+        samples_add(s, cyc);
+    }
+    pin_emit(b, "get_key_agreement", s);
+
+    // setPIN "123456"
+    uint8_t padded[64] = "123456", new_pin_enc[CRYPTO_AES_BLOCK_LEN + 64], auth[CRYPTO_SHA256_LEN];
+    if (pin_agree(pp, true) != 0) bad++;
+    pin_encrypt(pp, padded, sizeof(padded), new_pin_enc);
+    pin_mac(pp->hmac, new_pin_enc, sizeof(new_pin_enc), NULL, 0, auth);
+    len = build_client_pin(0x03, pp->pub, auth, new_pin_enc, NULL, 0);
+    if (pin_call(b, s_scan_req, len, &out, NULL) != 0) bad++;
+
+    // the platform side (keygen, ECDH) stays out of the timed call
+    samples_begin(s, reps);
+    for (unsigned i = 0; i < reps; i++) {
+        if (pin_agree(pp, true) != 0) bad++;
+        len = build_token_request(pp, "123456", PIN_PERM_MC | PIN_PERM_GA);
+        if (pin_call(b, s_scan_req, len, &out, &cyc) != 0 || !parse_token(pp, out)) bad++;
+        samples_add(s, cyc);
+    }
+    pin_emit(b, "token_new_key", s);
+
+    samples_begin(s, reps);
+    for (unsigned i = 0; i < reps; i++) {
+        if (pin_call(b, s_scan_req, len, &out, &cyc) != 0 || !parse_token(pp, out)) bad++;
+        samples_add(s, cyc);
+    }
+    pin_emit(b, "token_same_key", s);
+
+    len = build_token_assertion(s_scan_id, id_len, NULL, false);
+    samples_begin(s, reps);
+    for (unsigned i = 0; i < reps; i++) {
+        if (pin_call(b, s_ga_req, len, &out, &cyc) != 0 || ga_flags(out) != 0x00) bad++;
+        samples_add(s, cyc);
+    }
+    pin_emit(b, "assert_plain", s);
+
+    len = build_token_assertion(s_scan_id, id_len, s_token, false);
+    samples_begin(s, reps);
+    for (unsigned i = 0; i < reps; i++) {
+        // UV set, UP not asked for
+        if (pin_call(b, s_ga_req, len, &out, &cyc) != 0 || ga_flags(out) != 0x04) bad++;
+        samples_add(s, cyc);
+    }
+    pin_emit(b, "assert_token", s);
+
+    // a new token retires the one above
+    uint16_t stale_len = len;
+    len = build_token_request(pp, "123456", PIN_PERM_MC | PIN_PERM_GA);
+    if (pin_call(b, s_scan_req, len, &out, NULL) != 0 || !parse_token(pp, out)) bad++;
+    if (pin_call(b, s_ga_req, stale_len, &out, NULL) != CTAP2_ERR_PIN_AUTH_INVALID) bad++;
+
+    len = build_token_request(pp, "123456", PIN_PERM_MC);
+    if (pin_call(b, s_scan_req, len, &out, NULL) != 0 || !parse_token(pp, out)) bad++;
+    len = build_token_assertion(s_scan_id, id_len, s_token, false);
+    if (pin_call(b, s_ga_req, len, &out, NULL) != CTAP2_ERR_UNAUTHORIZED_PERMISSION) bad++;
+
+    // a wrong PIN also replaces the key agreement key: agree again after it
+    len = build_token_request(pp, "654321", PIN_PERM_GA);
+    if (pin_call(b, s_scan_req, len, &out, NULL) != CTAP2_ERR_PIN_INVALID) bad++;
+    if (pin_retries(b) != PIN_RETRIES - 1) bad++;
+    len = build_client_pin(0x02, NULL, NULL, NULL, NULL, 0);
+    if (pin_call(b, s_scan_req, len, &out, NULL) != 0 || !parse_key_agreement(out)) bad++;
+    if (pin_agree(pp, true) != 0) bad++;
+    len = build_token_request(pp, "123456", PIN_PERM_GA);
+    if (pin_call(b, s_scan_req, len, &out, NULL) != 0 || !parse_token(pp, out)) bad++;
+    if (pin_retries(b) != PIN_RETRIES) bad++;
+
+    // with presence the request parks and is replayed: one use, not two
+    core_pin_stats_t u0, u1;
+    core_get_pin_stats(&u0);
+    len = build_token_assertion(s_scan_id, id_len, s_token, true);
+    memset(&b->st, 0, sizeof(b->st));
+    b->up_asked = 0;
+    r = req_add(b, 0x0A000002u, CTAPHID_CBOR, len, 0, EXPECT_CBOR_OK, 0);
+    r->data = s_ga_req;
+    pump(b);
+    settle(b);
+    core_get_pin_stats(&u1);
+    memcpy(s_scan_resp, b->cbor_resp, b->cbor_resp_len);
+    if (b->st.ok != 1 || b->up_asked != 1 || ga_flags(b->cbor_resp_len) != 0x05 ||
+        u1.token_hits - u0.token_hits != 1) {
+        bad++;
+    }
+
+    core_get_pin_stats(&p1);
+    uint32_t hits = p1.token_hits - p0.token_hits;
+    uint32_t misses = p1.token_misses - p0.token_misses;
+    emit(b,
+         "{\"bench\":\"pin\",\"platform\":\"%s\",\"op\":\"stats\",\"key_agreements\":%u,"
+         "\"secrets_reused\":%u,\"pin_checks\":%u,\"pin_failures\":%u,\"tokens_issued\":%u,"
+         "\"token_hits\":%u,\"token_misses\":%u,\"token_hit_pct\":%u,\"bad\":%u}",
+         BENCH_PLATFORM, (unsigned)(p1.key_agreements - p0.key_agreements),
+         (unsigned)(p1.secrets_reused - p0.secrets_reused),
+         (unsigned)(p1.pin_checks - p0.pin_checks), (unsigned)(p1.pin_failures - p0.pin_failures),
+         (unsigned)(p1.tokens_issued - p0.tokens_issued), (unsigned)hits, (unsigned)misses,
+         (unsigned)(hits + misses ? 100ull * hits / (hits + misses) : 0), bad);
+    return bad ? 1 : 0;
+}
+
+// The IN queue stops taking reports part way through a response, first for
+// a PING (framed by send_msg) and then for a GetInfo (streamed, may spill).
+// Both are dropped; the pool must come back balanced and the channel must
+// answer normally once the host polls again.
+static int run_stall(bench_t *b, unsigned reps)
+{
+    scenario_begin(b);
+    uint64_t t0 = ctaphid_port_now_us();
+    ctaphid_pool_stats_t p0, p1;
+    ctaphid_get_pool_stats(&b->ctx, &p0);
+
+    for (unsigned i = 0; i < reps; i++) {
+        const uint32_t cid = 0x05000001u;
+        uint32_t dropped = b->ctx.tx_dropped;
+
+        bench_req_t *r = req_add(b, cid, CTAPHID_PING, 1024, i, EXPECT_ECHO, 0);
+        while (r->off + CONT_PAYLOAD_MAX < r->len) feed_next(b, r);
+        b->tx_budget = (int)(i % 6);      // 0 = not even the init frame
+        feed_next(b, r);
+        bus_drain(b);
+        if (b->ctx.tx_dropped == dropped) b->st.bad++;
+        b->rx_active = false;   // the host gives up on the truncated PING
+
+        bench_req_t *g = req_add(b, cid + 1, CTAPHID_CBOR, 1, i, EXPECT_CBOR_OK, 0);
+        g->small[0] = CTAP_CMD_GET_INFO;
+        b->tx_budget = (int)(i % 3);
+        feed_next(b, g);
+        bus_drain(b);
+
+        // neither answer completed
+        r->active = g->active = false;
+        b->st.msgs -= 2;
+        b->rx_active = false;
+        b->tx_budget = -1;
+
+        req_add(b, cid, CTAPHID_PING, 1024, i + reps, EXPECT_ECHO, 0);
+        pump(b);
+        settle(b);
+    }
+
+    ctaphid_get_pool_stats(&b->ctx, &p1);
+    if (p1.in_use != 0 || p1.alloc_fail != p0.alloc_fail) b->st.bad++;
+    return scenario_end(b, "stall", 1024, 2, t0);
+}
+
+typedef int (*scenario_fn)(bench_t *b, unsigned reps);
+
+static const struct {
+    const char *name;
+    scenario_fn fn;
+} s_scenarios[] = {
+    { "init", run_init },
+    { "ping", run_ping },
+    { "getinfo", run_getinfo },
+    { "interleave", run_interleave },
+    { "cancel", run_cancel },
+    { "timeout", run_timeout },
+    { "stall", run_stall },
+    { "cbor", run_cbor },
+    { "fuzz", run_fuzz },
+    { "assert", run_assert },
+    { "next", run_next },
+    { "crypto", run_crypto },
+    { "store", run_store },
+    { "allowlist", run_allowlist },
+    { "pin", run_pin },
+    { "grant", run_grant },
+    { "approval", run_approval },
+};
+
+int ctaphid_bench_run(const ctaphid_bench_cfg_t *cfg)
+{
+    bench_t *b = &s_bench;
+    bool all = !cfg->scenario || strcmp(cfg->scenario, "all") == 0;
+    unsigned reps = cfg->reps ? cfg->reps : DEFAULT_REPS;
+    int failed = 0;
+    bool found = false;
+
+    // Scenarios register credentials and wipe them: give them a scratch
+    // store so the device's own credentials are left alone.
+    const cred_flash_t *prev = cred_store_flash();
+    cred_flash_ram_t scratch;
+    if (cred_flash_ram_init(&scratch, 8 * CRED_FLASH_SECTOR) != 0) return 1;
+    (void)cred_store_mount(&scratch.flash);
+
+    b->cfg = cfg;
+    for (size_t i = 0; i < sizeof(s_scenarios) / sizeof(s_scenarios[0]); i++) {
+        if (!all && strcmp(cfg->scenario, s_scenarios[i].name) != 0) continue;
+        found = true;
+        failed += s_scenarios[i].fn(b, reps);
+    }
+
+    cred_flash_ram_free(&scratch);
+    (void)cred_store_mount(prev);
+    return found ? failed : -1;
+}
@@ -0,0 +1,130 @@
+// CTAPHID diagnostics on the CDC console:
+//   bench [scenario|all] [reps]  same JSON lines as firmware/host's ctaphid-bench
+//   trace [clear]                hex dump of the event ring (tooling/trace)
+//   capture start|stop|dump      record/replay capture (ctaphid_capture.h)
+//   pool                         crypto pool depth and refill counters (JSON)
+//   pin                          ClientPIN key agreement and token counters (JSON)
+//   grants                       presence grant hits, misses and expiries (JSON)
+
+#include "ctaphid_bench_cdc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core_api.h"
+#include "crypto.h"
+#include "ctaphid_bench.h"
+#include "ctaphid_capture.h"
+#include "ctaphid_trace.h"
+#include "usb_cdc_cmd.h"
+
+static void out_line(void *user, const char *line)
+{
+    (void)user;
+    usb_cdc_cmd_write(line);
+    usb_cdc_cmd_write("\r\n");
+}
+
+static void bench_cmd(const char *args)
+{
+    char scenario[24] = "all";
+    unsigned reps = 0;
+    (void)sscanf(args, "%23s %u", scenario, &reps);
+
+    ctaphid_bench_cfg_t cfg = {
+        .scenario = scenario,
+        .reps = reps,
+        .out = out_line,
+    };
+    int failed = ctaphid_bench_run(&cfg);
+    if (failed < 0) {
+        usb_cdc_cmd_write("BENCH ERR scenario\r\n");
+    } else {
+        usb_cdc_cmd_write(failed ? "BENCH FAIL\r\n" : "BENCH OK\r\n");
+    }
+}
+
+static void trace_cmd(const char *args)
+{
+    if (strcmp(args, "clear") == 0) {
+        ctaphid_trace_clear();
+        usb_cdc_cmd_write("TRACE CLEARED\r\n");
+        return;
+    }
+    ctaphid_trace_dump(out_line, NULL);
+}
+
+static void capture_cmd(const char *args)
+{
+    if (!CTAPHID_CAPTURE_ENABLED) {
+        usb_cdc_cmd_write("CAPTURE ERR disabled (CONFIG_CTAPHID_CAPTURE)\r\n");
+    } else if (strcmp(args, "start") == 0) {
+        ctaphid_capture_start(NULL, NULL);
+        usb_cdc_cmd_write("CAPTURE STARTED\r\n");
+    } else if (strcmp(args, "stop") == 0) {
+        ctaphid_capture_stop();
+        usb_cdc_cmd_write("CAPTURE STOPPED\r\n");
+    } else if (strcmp(args, "dump") == 0) {
+        // stopped first: the ring is read in place
+        ctaphid_capture_stop();
+        ctaphid_capture_dump(out_line, NULL);
+    } else {
+        usb_cdc_cmd_write("CAPTURE ERR usage: capture start|stop|dump\r\n");
+    }
+}
+
+static void pool_cmd(const char *args)
+{
+    (void)args;
+    crypto_pool_stats_t st;
+    char line[256];
+    crypto_pool_get_stats(&st);
+    snprintf(line, sizeof(line),
+             "{\"keys\":%u,\"keys_cap\":%u,\"presigs\":%u,\"presigs_cap\":%u,"
+             "\"keys_made\":%u,\"presigs_made\":%u,\"keys_hit\":%u,\"keys_miss\":%u,"
+             "\"presigs_hit\":%u,\"presigs_miss\":%u,\"refill_us\":%llu}",
+             (unsigned)st.keys, (unsigned)CRYPTO_POOL_KEYS,
+             (unsigned)st.presigs, (unsigned)CRYPTO_POOL_PRESIGS,
+             (unsigned)st.keys_made, (unsigned)st.presigs_made,
+             (unsigned)st.keys_hit, (unsigned)st.keys_miss,
+             (unsigned)st.presigs_hit, (unsigned)st.presigs_miss,
+             (unsigned long long)st.refill_us);
+    out_line(NULL, line);
+}
+
+static void pin_cmd(const char *args)
+{
+    (void)args;
+    core_pin_stats_t st;
+    char line[256];
+    core_get_pin_stats(&st);
+    snprintf(line, sizeof(line),
+             "{\"key_agreements\":%u,\"secrets_reused\":%u,\"pin_checks\":%u,"
+             "\"pin_failures\":%u,\"tokens_issued\":%u,\"token_hits\":%u,\"token_misses\":%u}",
+             (unsigned)st.key_agreements, (unsigned)st.secrets_reused,
+             (unsigned)st.pin_checks, (unsigned)st.pin_failures,
+             (unsigned)st.tokens_issued, (unsigned)st.token_hits, (unsigned)st.token_misses);
+    out_line(NULL, line);
+}
+
+static void grants_cmd(const char *args)
+{
+    (void)args;
+    core_grant_stats_t st;
+    char line[128];
+    core_get_grant_stats(&st);
+    snprintf(line, sizeof(line), "{\"granted\":%u,\"hits\":%u,\"misses\":%u,\"expiries\":%u}",
+             (unsigned)st.granted, (unsigned)st.hits, (unsigned)st.misses, (unsigned)st.expiries);
+    out_line(NULL, line);
+}
+
+void ctaphid_bench_cdc_register(void)
+{
+    (void)usb_cdc_cmd_register("bench", bench_cmd);
+    (void)usb_cdc_cmd_register("trace", trace_cmd);
+    (void)usb_cdc_cmd_register("capture", capture_cmd);
+    (void)usb_cdc_cmd_register("pool", pool_cmd);
+    (void)usb_cdc_cmd_register("pin", pin_cmd);
+    (void)usb_cdc_cmd_register("grants", grants_cmd);
+}
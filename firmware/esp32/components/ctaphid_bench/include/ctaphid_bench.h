@@ -0,0 +1,53 @@
+#pragma once
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Scripted-traffic benchmark for the CTAPHID engine. Runs a private
+// ctaphid_ctx_t against a model of the IN endpoint (CTAPHID_BENCH_TXQ_DEPTH
+// slots, one report per 1 ms poll) and reports one JSON object per scenario:
+// frames/s, cycles per frame, per-message latency percentiles (CPU and
+// modelled bus time) and TX queue stalls/drops.
+//
+// Scenarios: init, ping (0..CTAPHID_MAX_MSG_SIZE), getinfo, interleave,
+// cancel, timeout, cbor (realistic MakeCredential/GetAssertion requests),
+// fuzz (seeded mutations of those), assert (register, then sign in with a
+// matching allowList), next (five accounts on one RP listed through
+// GetAssertion and GetNextAssertion) and crypto (SHA-256/keygen/sign timed directly, one
+// {"bench":"crypto"} line per operation, key generation and signing both
+// cold and from the precomputed pool) and store (insert/lookup/bump/delete/
+// mount/GC on a RAM-backed credential store of 50..5000 credentials, one
+// {"bench":"cred_store"} line per operation, then mounts after power cuts at
+// every point of an insert/delete/GC run) and allowlist (GetAssertion timed
+// inside the core against allowLists of 1..64 foreign IDs, with and without
+// ours last, one {"bench":"allowlist"} line each) and pin (ClientPIN key
+// agreement, pinUvAuthToken with a new and a repeated platform key, and
+// GetAssertion with and without the token, one {"bench":"pin"} line each,
+// then the core's PIN counters) and grant (a sudo run with every call
+// asking the phone, then with the first approval granting the rest, then
+// spent and revoked grants; a {"bench":"grant"} line with prompts per run
+// and the core's grant counters) and approval (approval_check() on an
+// authentic phone answer, then the frame rules: the shared test vector,
+// out-of-order answers and each kind of answer that must approve nothing;
+// {"bench":"approval"} lines). Platform-neutral: builds
+// in ESP-IDF and in firmware/host.
+
+// Receives one complete line of JSON (no trailing newline).
+typedef void (*ctaphid_bench_out_fn)(void *user, const char *line);
+
+typedef struct {
+    const char *scenario;   // NULL or "all" runs every scenario
+    unsigned reps;          // messages per scenario step (0 = default)
+    ctaphid_bench_out_fn out;
+    void *out_user;
+} ctaphid_bench_cfg_t;
+
+// Returns the number of scenarios that saw a wrong or missing response
+// (0 = all responses verified), or -1 for an unknown scenario name.
+int ctaphid_bench_run(const ctaphid_bench_cfg_t *cfg);
+
+#ifdef __cplusplus
+}
+#endif
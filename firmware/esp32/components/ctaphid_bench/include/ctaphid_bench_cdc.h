@@ -0,0 +1,12 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Adds the "bench" and "trace" commands to the usb_cdc_cmd console.
+void ctaphid_bench_cdc_register(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,4 +1,5 @@
 #pragma once
+#include <stdbool.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -6,6 +7,16 @@ extern "C" {
 
 void usb_cdc_cmd_start(void);
 
+// Extra console command: called with the text after "<name> " (or "") from
+// the console task. Reply with usb_cdc_cmd_write().
+typedef void (*usb_cdc_cmd_handler_t)(const char *args);
+
+// Register before usb_cdc_cmd_start(). Returns false if the table is full.
+bool usb_cdc_cmd_register(const char *name, usb_cdc_cmd_handler_t handler);
+
+// Write a string to the console and flush it.
+void usb_cdc_cmd_write(const char *s);
+
 #ifdef __cplusplus
 }
 #endif
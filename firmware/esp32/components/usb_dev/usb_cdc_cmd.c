@@ -32,6 +32,44 @@ static void reboot_to_rom_bootloader(void) {
 
 static const char *TAG = "usb_cdc_cmd";
 
+#define MAX_EXTRA_CMDS 8
+
+typedef struct {
+    const char *name;
+    usb_cdc_cmd_handler_t handler;
+} extra_cmd_t;
+
+static extra_cmd_t s_extra_cmds[MAX_EXTRA_CMDS];
+static size_t s_extra_count;
+
+bool usb_cdc_cmd_register(const char *name, usb_cdc_cmd_handler_t handler) {
+    if (s_extra_count >= MAX_EXTRA_CMDS) return false;
+    s_extra_cmds[s_extra_count].name = name;
+    s_extra_cmds[s_extra_count].handler = handler;
+    s_extra_count++;
+    return true;
+}
+
+void usb_cdc_cmd_write(const char *s) {
+    tud_cdc_write_str(s);
+    tud_cdc_write_flush();
+}
+
+// Runs a registered command if the line starts with its name.
+static bool dispatch_extra(const char *line) {
+    while (*line == ' ' || *line == '\t') line++;
+    for (size_t i = 0; i < s_extra_count; i++) {
+        size_t n = strlen(s_extra_cmds[i].name);
+        if (strncmp(line, s_extra_cmds[i].name, n) != 0) continue;
+        if (line[n] != 0 && line[n] != ' ') continue;
+        const char *args = line + n;
+        while (*args == ' ') args++;
+        s_extra_cmds[i].handler(args);
+        return true;
+    }
+    return false;
+}
+
 typedef struct {
     bool active;
     size_t expected;
@@ -154,6 +192,8 @@ void usb_cdc_cmd_task(void *arg) {
                                 tud_cdc_write_str("OTA ERR begin\r\n");
                             }
                             tud_cdc_write_flush();
+                        } else {
+                            (void)dispatch_extra(linebuf);
                         }
                     }
                     idx = 0;
@@ -173,7 +213,7 @@ void usb_cdc_cmd_start(void) {
     xTaskCreate(
         usb_cdc_cmd_task,
         "usb_cdc_cmd",
-        4096,
+        8192,   // registered commands may run the CTAP core on this stack
         NULL,
         5,
         NULL
@@ -19,6 +19,29 @@ int usb_hid_init(usb_hid_out_cb_t cb, void *user);
 /** Send one IN report to host (must be 64 bytes). */
 int usb_hid_send_report(const uint8_t *report, size_t len);
 
+/**
+ * Zero-copy TX: reserve the next free IN queue slot and fill it in place.
+ * Returns the slot's USB_HID_REPORT_LEN-byte buffer. If the queue is full,
+ * blocks up to CONFIG_USB_HID_TX_TIMEOUT_MS for the host to drain it, and
+ * returns NULL (counted as a drop) if it does not. Reserved slots are not
+ * sent until usb_hid_tx_commit(), which publishes all of them in reservation
+ * order; usb_hid_tx_abort() drops them.
+ * Single producer: only one task may reserve at a time.
+ */
+uint8_t *usb_hid_tx_reserve(void);
+int usb_hid_tx_commit(void);
+void usb_hid_tx_abort(void);
+
+typedef struct {
+    uint32_t sent;        // IN reports completed
+    uint32_t stalls;      // reservations that had to wait for a free slot
+    uint32_t drops;       // reservations that gave up (frame not sent)
+    uint8_t  high_water;  // most slots ever in use (committed + reserved)
+    uint8_t  depth;       // configured queue depth
+} usb_hid_tx_stats_t;
+
+void usb_hid_get_tx_stats(usb_hid_tx_stats_t *out);
+
 #ifdef __cplusplus
 }
 #endif
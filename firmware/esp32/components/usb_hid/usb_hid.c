@@ -4,6 +4,7 @@
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 #include <string.h>
 
 #include "tinyusb.h"
@@ -17,19 +18,36 @@ static const char *TAG = "usb_hid";
 static usb_hid_out_cb_t s_out_cb = NULL;
 static void *s_out_user = NULL;
 static volatile bool s_in_busy = false; // true while an IN transfer is in flight
-#define USB_HID_TXQ_DEPTH 4
+#ifdef CONFIG_USB_HID_TXQ_DEPTH
+#define USB_HID_TXQ_DEPTH CONFIG_USB_HID_TXQ_DEPTH
+#else
+// Sized so a full CTAPHID message (1 init + 17 continuation frames for 1024
+// bytes) can be reserved and encoded in place before it is committed.
+#define USB_HID_TXQ_DEPTH 20
+#endif
+#ifdef CONFIG_USB_HID_TX_TIMEOUT_MS
+#define USB_HID_TX_TIMEOUT_MS CONFIG_USB_HID_TX_TIMEOUT_MS
+#else
+#define USB_HID_TX_TIMEOUT_MS 250
+#endif
 static uint8_t s_txq[USB_HID_TXQ_DEPTH][USB_HID_REPORT_LEN];
-static uint8_t s_tx_head = 0;
-static uint8_t s_tx_tail = 0;
-static uint8_t s_tx_count = 0;
+static uint8_t s_tx_head = 0;      // next report to hand to TinyUSB
+static uint8_t s_tx_count = 0;     // committed reports starting at head
+static uint8_t s_tx_reserved = 0;  // reserved behind the committed ones, not yet visible
+// IN reports are queued by the CTAPHID worker and drained from the TinyUSB task.
+static portMUX_TYPE s_tx_lock = portMUX_INITIALIZER_UNLOCKED;
+// Given from the completion callback each time a slot frees up.
+static SemaphoreHandle_t s_tx_space = NULL;
+static usb_hid_tx_stats_t s_tx_stats;
 
-static bool txq_push(const uint8_t *report)
+static uint8_t *txq_reserve(void)
 {
-    if (s_tx_count >= USB_HID_TXQ_DEPTH) return false;
-    memcpy(s_txq[s_tx_tail], report, USB_HID_REPORT_LEN);
-    s_tx_tail = (uint8_t)((s_tx_tail + 1) % USB_HID_TXQ_DEPTH);
-    s_tx_count++;
-    return true;
+    if (s_tx_count + s_tx_reserved >= USB_HID_TXQ_DEPTH) return NULL;
+    uint8_t idx = (uint8_t)((s_tx_head + s_tx_count + s_tx_reserved) % USB_HID_TXQ_DEPTH);
+    s_tx_reserved++;
+    uint8_t used = (uint8_t)(s_tx_count + s_tx_reserved);
+    if (used > s_tx_stats.high_water) s_tx_stats.high_water = used;
+    return s_txq[idx];
 }
 
 static uint8_t *txq_front(void)
@@ -48,11 +66,18 @@ static void txq_pop(void)
 // Kick off sending the front of the queue if idle.
 static int tx_try_send(void)
 {
-    if (s_in_busy) return 0;
-    uint8_t *next = txq_front();
+    uint8_t *next = NULL;
+    portENTER_CRITICAL(&s_tx_lock);
+    if (!s_in_busy) {
+        next = txq_front();
+        if (next) s_in_busy = true;   // claim the endpoint before leaving the lock
+    }
+    portEXIT_CRITICAL(&s_tx_lock);
     if (!next) return 0;
-    if (!tud_hid_ready()) return -2;
-    s_in_busy = true;
+    if (!tud_hid_ready()) {
+        s_in_busy = false;
+        return -2;
+    }
     if (!tud_hid_report(0, next, USB_HID_REPORT_LEN)) {
         s_in_busy = false;
         return -3;
@@ -141,8 +166,12 @@ void tud_hid_report_complete_cb(uint8_t itf, uint8_t const *report, uint16_t len
     (void)itf;
     (void)report;
     (void)len;
+    portENTER_CRITICAL(&s_tx_lock);
     s_in_busy = false;
     txq_pop();
+    s_tx_stats.sent++;
+    portEXIT_CRITICAL(&s_tx_lock);
+    if (s_tx_space) xSemaphoreGive(s_tx_space);
     (void)tx_try_send();
 }
 
@@ -151,6 +180,9 @@ int usb_hid_init(usb_hid_out_cb_t cb, void *user)
     s_out_cb = cb;
     s_out_user = user;
 
+    if (!s_tx_space) s_tx_space = xSemaphoreCreateBinary();
+    if (!s_tx_space) return -1;
+
     const tinyusb_config_t cfg = {
         .device_descriptor = NULL,         // use esp_tinyusb defaults
         .string_descriptor = NULL,         // use default strings
@@ -185,13 +217,75 @@ int usb_hid_init(usb_hid_out_cb_t cb, void *user)
     return 0;
 }
 
+uint8_t *usb_hid_tx_reserve(void)
+{
+    const TickType_t budget = pdMS_TO_TICKS(USB_HID_TX_TIMEOUT_MS);
+    TickType_t start = xTaskGetTickCount();
+    bool stalled = false;
+
+    while (1) {
+        portENTER_CRITICAL(&s_tx_lock);
+        uint8_t *slot = txq_reserve();
+        bool draining = s_tx_count > 0;
+        portEXIT_CRITICAL(&s_tx_lock);
+        if (slot) return slot;
+
+        // Nothing committed means the queue is full of our own uncommitted
+        // reservations: no completion will come, so waiting cannot help.
+        TickType_t waited = xTaskGetTickCount() - start;
+        if (!draining || waited >= budget) break;
+
+        if (!stalled) {
+            stalled = true;
+            portENTER_CRITICAL(&s_tx_lock);
+            s_tx_stats.stalls++;
+            portEXIT_CRITICAL(&s_tx_lock);
+        }
+        // The endpoint may have gone idle without a completion (tud_hid_ready()
+        // was false at commit time); kick it before sleeping on the next one.
+        (void)tx_try_send();
+        xSemaphoreTake(s_tx_space, budget - waited);
+    }
+
+    portENTER_CRITICAL(&s_tx_lock);
+    s_tx_stats.drops++;
+    portEXIT_CRITICAL(&s_tx_lock);
+    return NULL;
+}
+
+int usb_hid_tx_commit(void)
+{
+    portENTER_CRITICAL(&s_tx_lock);
+    s_tx_count = (uint8_t)(s_tx_count + s_tx_reserved);
+    s_tx_reserved = 0;
+    portEXIT_CRITICAL(&s_tx_lock);
+    return tx_try_send();
+}
+
+void usb_hid_tx_abort(void)
+{
+    portENTER_CRITICAL(&s_tx_lock);
+    s_tx_reserved = 0;
+    portEXIT_CRITICAL(&s_tx_lock);
+}
+
+void usb_hid_get_tx_stats(usb_hid_tx_stats_t *out)
+{
+    portENTER_CRITICAL(&s_tx_lock);
+    *out = s_tx_stats;
+    out->depth = USB_HID_TXQ_DEPTH;
+    portEXIT_CRITICAL(&s_tx_lock);
+}
+
 int usb_hid_send_report(const uint8_t *report, size_t len)
 {
     if (len != USB_HID_REPORT_LEN) {
         return -1;
     }
-    if (!txq_push(report)) {
+    uint8_t *slot = usb_hid_tx_reserve();
+    if (!slot) {
         return -4; // queue full
     }
-    return tx_try_send();
+    memcpy(slot, report, USB_HID_REPORT_LEN);
+    return usb_hid_tx_commit();
 }
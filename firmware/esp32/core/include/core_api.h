@@ -6,8 +6,27 @@
 extern "C" {
 #endif
 
+// core_handle_request() return value meaning "needs user presence": nothing
+// was written; keep the request, obtain a verdict, pass it to
+// core_set_user_presence() and call core_handle_request() again with the
+// same request. Vendor-range CTAP status, never sent to the host.
+#define CORE_STATUS_UP_PENDING 0xF0
+
+// core_handle_request() return value for a request that needs user presence
+// while another one is parked: nothing was written or changed, answer
+// ERR_CHANNEL_BUSY. Vendor-range CTAP status, never sent to the host.
+#define CORE_STATUS_UP_BUSY 0xF1
+
+// core_set_user_presence() results
+#define CORE_UP_CLEAR    0
+#define CORE_UP_APPROVED 1
+#define CORE_UP_DENIED   2
+#define CORE_UP_TIMEOUT  3
+
 size_t core_ctx_size(void);
 
+// ctx_mem must be at least core_ctx_size() bytes and aligned for any type;
+// every call fails otherwise.
 int core_init(
     uint8_t *ctx_mem,
     size_t ctx_mem_len
@@ -23,6 +42,112 @@ int core_handle_request(
     size_t *out_resp_len
 );
 
+// Chunked output for core_handle_request_stream(): `next` returns the next
+// writable region and stores its size in *cap, or returns NULL when out of space.
+typedef uint8_t *(*core_chunk_fn)(void *user, size_t *cap);
+
+typedef struct {
+    core_chunk_fn next;
+    void *user;
+} core_sink_t;
+
+// Like core_handle_request(), but encodes the response directly into the
+// chunks handed out by `sink`. On a nonzero return anything already written
+// is garbage and must be discarded.
+int core_handle_request_stream(
+    uint8_t *ctx_mem,
+    size_t ctx_mem_len,
+    const uint8_t *req,
+    size_t req_len,
+    const core_sink_t *sink,
+    size_t *out_resp_len
+);
+
+int core_set_user_presence(
+    uint8_t *ctx_mem,
+    size_t ctx_mem_len,
+    int result
+);
+
+// What a parked request asks presence for, to show on the phone: the CTAP
+// command byte and, for MakeCredential/GetAssertion, the RP. rp_id is not
+// NUL-terminated and is cut at CORE_PROMPT_RP_MAX bytes; rp_id_hash is of
+// the whole ID.
+#define CORE_PROMPT_RP_MAX 64
+
+typedef struct {
+    uint8_t command;
+    uint8_t has_rp;
+    uint8_t rp_id_len;
+    uint8_t rp_id_hash[32];
+    char rp_id[CORE_PROMPT_RP_MAX];
+} core_up_prompt_t;
+
+// Nonzero if no request is parked on presence.
+int core_up_prompt(
+    uint8_t *ctx_mem,
+    size_t ctx_mem_len,
+    core_up_prompt_t *out
+);
+
+// Presence grant the phone sends along with an approval: later
+// GetAssertions it covers pass the presence check without asking again,
+// until ttl_s (capped at an hour) runs out or, if uses is nonzero, after
+// that many. CORE_GRANT_RP covers the RP of the request being approved,
+// CORE_GRANT_HOST every RP. CORE_GRANT_ENROLL instead covers MakeCredential
+// for any RP and needs a nonzero uses, for enrolling a key with many hosts
+// at once. Held in RAM; Reset and a power cycle drop them.
+#define CORE_GRANT_RP     1
+#define CORE_GRANT_HOST   2
+#define CORE_GRANT_ENROLL 3
+
+typedef struct {
+    uint8_t scope;
+    uint16_t uses;
+    uint32_t ttl_s;
+} core_grant_t;
+
+// Call while the request is parked on presence, before
+// core_set_user_presence(CORE_UP_APPROVED): an RP grant takes its RP from it.
+int core_grant_presence(
+    uint8_t *ctx_mem,
+    size_t ctx_mem_len,
+    const core_grant_t *grant
+);
+
+int core_revoke_grants(
+    uint8_t *ctx_mem,
+    size_t ctx_mem_len
+);
+
+// Grant counters since power-up. A hit is a presence check a grant
+// answered, a miss one that went to the phone, an expiry a grant dropped
+// because its time ran out.
+typedef struct {
+    uint32_t granted;
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t expiries;
+} core_grant_stats_t;
+
+void core_get_grant_stats(core_grant_stats_t *out);
+
+// ClientPIN counters since power-up. A token hit is a MakeCredential or
+// GetAssertion that a cached pinUvAuthToken let through without another
+// PIN check; secrets_reused counts getPinUvAuthToken calls that skipped
+// ECDH because the platform kept its key agreement key.
+typedef struct {
+    uint32_t key_agreements;   // ECDH computed
+    uint32_t secrets_reused;   // ... or taken from the cache
+    uint32_t pin_checks;
+    uint32_t pin_failures;
+    uint32_t tokens_issued;
+    uint32_t token_hits;
+    uint32_t token_misses;     // pinUvAuthParam refused: stale, wrong or not permitted
+} core_pin_stats_t;
+
+void core_get_pin_stats(core_pin_stats_t *out);
+
 #ifdef __cplusplus
 }
 #endif
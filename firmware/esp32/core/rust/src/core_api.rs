@@ -1,18 +1,201 @@
-use core::{mem, ptr, slice};
+use core::{ffi::c_void, mem, ptr, slice};
 
-use crate::ctap2::{dispatcher::dispatch, status::CtapStatus};
+use crate::crypto::SHA256_LEN;
+use crate::ctap2::{
+    cbor::{ChunkSink, Writer},
+    commands::get_assertion::NextAssertions,
+    dispatcher::dispatch,
+    grants::{self, Grants},
+    pin::{PinState, COUNTERS},
+    status::CtapStatus,
+};
+
+// Values of `result` in core_set_user_presence (see core_api.h).
+pub const UP_CLEAR: i32 = 0;
+pub const UP_APPROVED: i32 = 1;
+pub const UP_DENIED: i32 = 2;
+pub const UP_TIMEOUT: i32 = 3;
+
+#[derive(Copy, Clone, PartialEq, Eq)]
+pub enum UpState {
+    None,
+    Pending,
+    Approved,
+    Denied,
+    TimedOut,
+}
+
+/// Longest RP ID a presence prompt carries; longer ones are cut.
+pub const PROMPT_RP_MAX: usize = 64;
+
+/// What the request being handled would ask the phone about: the command
+/// and, for MakeCredential/GetAssertion, the RP. core_up_prompt returns it
+/// while the request is parked.
+#[derive(Clone, Copy)]
+#[repr(C)]
+pub struct Prompt {
+    pub command: u8,
+    pub has_rp: u8,
+    pub rp_id_len: u8,
+    pub rp_id_hash: [u8; SHA256_LEN],
+    pub rp_id: [u8; PROMPT_RP_MAX],
+}
+
+impl Prompt {
+    pub const fn new(command: u8) -> Self {
+        Self { command, has_rp: 0, rp_id_len: 0, rp_id_hash: [0; SHA256_LEN], rp_id: [0; PROMPT_RP_MAX] }
+    }
+
+    pub fn set_rp(&mut self, rp_id: &str, rp_id_hash: &[u8; SHA256_LEN]) {
+        let mut n = rp_id.len().min(PROMPT_RP_MAX);
+        while !rp_id.is_char_boundary(n) {
+            n -= 1;
+        }
+        self.rp_id[..n].copy_from_slice(&rp_id.as_bytes()[..n]);
+        self.rp_id_len = n as u8;
+        self.rp_id_hash = *rp_id_hash;
+        self.has_rp = 1;
+    }
+}
 
 pub struct CoreCtx {
-    // TODO(): persistent state, pin retries, uv/permissions, session, etc.
+    // Credentials, the PIN hash and its retries live in the flash store
+    // (ctap2::credentials), not here.
     pub initialized: bool,
+    pub up: UpState,
+    /// What GetNextAssertion hands out; dropped by any other command.
+    pub next_assertions: Option<NextAssertions>,
+    /// ClientPIN key agreement, shared secret and token.
+    pub pin: PinState,
+    /// What the phone approved ahead of time.
+    pub grants: Grants,
+    /// What the current request would ask presence for.
+    pub prompt: Prompt,
+    /// What the parked request asks presence for.
+    pub up_prompt: Prompt,
 }
 
 impl CoreCtx {
     pub const fn new() -> Self {
-        Self { initialized: false }
+        Self {
+            initialized: false,
+            up: UpState::None,
+            next_assertions: None,
+            pin: PinState::new(),
+            grants: Grants::new(),
+            prompt: Prompt::new(0),
+            up_prompt: Prompt::new(0),
+        }
+    }
+
+    /// User-presence gate. The first call parks the request (the HID layer
+    /// keeps the message, sends KEEPALIVE and asks the phone); once a verdict
+    /// is in, the same request is replayed and this consumes it. While one
+    /// request is parked any other that needs presence is turned away
+    /// without touching what the parked one set up.
+    /// Handlers must call it before any side effect.
+    pub fn check_user_presence(&mut self) -> Result<(), CtapStatus> {
+        let verdict = match self.up {
+            UpState::Pending => return Err(CtapStatus::UserPresenceBusy),
+            UpState::None => {
+                self.up = UpState::Pending;
+                self.up_prompt = self.prompt;
+                self.grants.set_pending(None);
+                return Err(CtapStatus::UserPresencePending);
+            }
+            v => v,
+        };
+        self.up = UpState::None;
+        match verdict {
+            UpState::Approved => Ok(()),
+            UpState::TimedOut => Err(CtapStatus::UserActionTimeout),
+            _ => Err(CtapStatus::OperationDenied),
+        }
+    }
+
+    /// `check_user_presence` for a sign-in on one RP: a phone grant that
+    /// covers the RP answers at once, else the phone is asked and may
+    /// grant the RP along with its approval.
+    pub fn check_user_presence_for(&mut self, rp_id_hash: &[u8; SHA256_LEN]) -> Result<(), CtapStatus> {
+        if self.up == UpState::None && self.grants.take(rp_id_hash) {
+            return Ok(());
+        }
+        let r = self.check_user_presence();
+        if matches!(r, Err(CtapStatus::UserPresencePending)) {
+            self.grants.set_pending(Some(rp_id_hash));
+        }
+        r
+    }
+
+    /// `check_user_presence` for registering a credential: an enrollment
+    /// grant answers at once, else the phone is asked.
+    pub fn check_user_presence_enroll(&mut self) -> Result<(), CtapStatus> {
+        if self.up == UpState::None && self.grants.take_enroll() {
+            return Ok(());
+        }
+        self.check_user_presence()
+    }
+}
+
+unsafe extern "C" {
+    // ctaphid_port.h: the core only ever runs under the CTAPHID engine
+    fn ctaphid_port_now_us() -> u64;
+}
+
+/// Monotonic microseconds, for the core's own timeouts.
+pub fn now_us() -> u64 {
+    unsafe { ctaphid_port_now_us() }
+}
+
+/// core_pin_stats_t
+#[repr(C)]
+pub struct PinStats {
+    pub key_agreements: u32,
+    pub secrets_reused: u32,
+    pub pin_checks: u32,
+    pub pin_failures: u32,
+    pub tokens_issued: u32,
+    pub token_hits: u32,
+    pub token_misses: u32,
+}
+
+pub fn pin_stats() -> PinStats {
+    let c = &COUNTERS;
+    let get = |a: &core::sync::atomic::AtomicU32| a.load(core::sync::atomic::Ordering::Relaxed);
+    PinStats {
+        key_agreements: get(&c.key_agreements),
+        secrets_reused: get(&c.secrets_reused),
+        pin_checks: get(&c.pin_checks),
+        pin_failures: get(&c.pin_failures),
+        tokens_issued: get(&c.tokens_issued),
+        token_hits: get(&c.token_hits),
+        token_misses: get(&c.token_misses),
     }
 }
 
+/// core_grant_t
+#[repr(C)]
+pub struct GrantSpec {
+    pub scope: u8,
+    pub uses: u16,
+    pub ttl_s: u32,
+}
+
+/// core_grant_stats_t
+#[repr(C)]
+pub struct GrantStats {
+    pub granted: u32,
+    pub hits: u32,
+    pub misses: u32,
+    pub expiries: u32,
+}
+
+pub fn grant_stats() -> GrantStats {
+    let c = &grants::COUNTERS;
+    let get = |a: &core::sync::atomic::AtomicU32| a.load(core::sync::atomic::Ordering::Relaxed);
+    GrantStats { granted: get(&c.granted), hits: get(&c.hits), misses: get(&c.misses), expiries: get(&c.expiries) }
+}
+
 pub fn ctx_size() -> usize {
     mem::size_of::<CoreCtx>()
 }
@@ -21,6 +204,10 @@ fn ctx_from_mem<'a>(ctx_mem: *mut u8, ctx_mem_len: usize) -> Result<&'a mut Core
     if ctx_mem.is_null() || ctx_mem_len < mem::size_of::<CoreCtx>() {
         return Err(CtapStatus::Other);
     }
+    // a reference to a misaligned CoreCtx is undefined behaviour
+    if ctx_mem.align_offset(mem::align_of::<CoreCtx>()) != 0 {
+        return Err(CtapStatus::Other);
+    }
     let ctx_ptr = ctx_mem as *mut CoreCtx;
     Ok(unsafe { &mut *ctx_ptr })
 }
@@ -36,6 +223,57 @@ pub fn init(ctx_mem: *mut u8, ctx_mem_len: usize) -> i32 {
     0
 }
 
+pub fn set_user_presence(ctx_mem: *mut u8, ctx_mem_len: usize, result: i32) -> i32 {
+    let ctx = match ctx_from_mem(ctx_mem, ctx_mem_len) {
+        Ok(c) if c.initialized => c,
+        _ => return CtapStatus::Other.as_i32(),
+    };
+    ctx.up = match result {
+        UP_CLEAR => UpState::None,
+        UP_APPROVED => UpState::Approved,
+        UP_DENIED => UpState::Denied,
+        UP_TIMEOUT => UpState::TimedOut,
+        _ => return CtapStatus::InvalidParameter.as_i32(),
+    };
+    0
+}
+
+pub fn grant_presence(ctx_mem: *mut u8, ctx_mem_len: usize, grant: *const GrantSpec) -> i32 {
+    let ctx = match ctx_from_mem(ctx_mem, ctx_mem_len) {
+        Ok(c) if c.initialized => c,
+        _ => return CtapStatus::Other.as_i32(),
+    };
+    if grant.is_null() {
+        return CtapStatus::Other.as_i32();
+    }
+    let g = unsafe { &*grant };
+    match ctx.grants.add(g.scope, g.ttl_s, g.uses) {
+        Ok(()) => 0,
+        Err(e) => e.as_i32(),
+    }
+}
+
+pub fn up_prompt(ctx_mem: *mut u8, ctx_mem_len: usize, out: *mut Prompt) -> i32 {
+    let ctx = match ctx_from_mem(ctx_mem, ctx_mem_len) {
+        Ok(c) if c.initialized => c,
+        _ => return CtapStatus::Other.as_i32(),
+    };
+    if out.is_null() || ctx.up != UpState::Pending {
+        return CtapStatus::Other.as_i32();
+    }
+    unsafe { out.write(ctx.up_prompt) };
+    0
+}
+
+pub fn revoke_grants(ctx_mem: *mut u8, ctx_mem_len: usize) -> i32 {
+    let ctx = match ctx_from_mem(ctx_mem, ctx_mem_len) {
+        Ok(c) if c.initialized => c,
+        _ => return CtapStatus::Other.as_i32(),
+    };
+    ctx.grants.clear();
+    0
+}
+
 pub fn handle_request(
     ctx_mem: *mut u8,
     ctx_mem_len: usize,
@@ -56,8 +294,56 @@ pub fn handle_request(
 
     let req = unsafe { slice::from_raw_parts(req, req_len) };
     let resp_buf = unsafe { slice::from_raw_parts_mut(resp, resp_cap) };
+    let mut w = Writer::new(resp_buf);
+
+    match dispatch(ctx, req, &mut w) {
+        Ok(n) => {
+            unsafe { *out_resp_len = n; }
+            0
+        }
+        Err(e) => e.as_i32(),
+    }
+}
+
+/// Chunk provider supplied by C (core_sink_t): each call returns the next
+/// writable region and its size, or NULL when out of space.
+#[repr(C)]
+pub struct CoreSink {
+    pub next: Option<unsafe extern "C" fn(user: *mut c_void, cap: *mut usize) -> *mut u8>,
+    pub user: *mut c_void,
+}
+
+impl ChunkSink for CoreSink {
+    fn next_chunk(&mut self) -> Option<(*mut u8, usize)> {
+        let next = self.next?;
+        let mut cap = 0usize;
+        let p = unsafe { next(self.user, &mut cap) };
+        if p.is_null() { None } else { Some((p, cap)) }
+    }
+}
+
+pub fn handle_request_stream(
+    ctx_mem: *mut u8,
+    ctx_mem_len: usize,
+    req: *const u8,
+    req_len: usize,
+    sink: *const CoreSink,
+    out_resp_len: *mut usize,
+) -> i32 {
+    let ctx = match ctx_from_mem(ctx_mem, ctx_mem_len) {
+        Ok(c) if c.initialized => c,
+        _ => return CtapStatus::Other.as_i32(),
+    };
+
+    if req.is_null() || sink.is_null() || out_resp_len.is_null() {
+        return CtapStatus::Other.as_i32();
+    }
+
+    let req = unsafe { slice::from_raw_parts(req, req_len) };
+    let mut sink = unsafe { CoreSink { next: (*sink).next, user: (*sink).user } };
+    let mut w = Writer::streaming(&mut sink);
 
-    match dispatch(ctx, req, resp_buf) {
+    match dispatch(ctx, req, &mut w) {
         Ok(n) => {
             unsafe { *out_resp_len = n; }
             0
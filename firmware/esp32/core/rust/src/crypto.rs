@@ -0,0 +1,175 @@
+//! P-256, SHA-256, HMAC and AES, implemented in C by the `crypto` component (mbedTLS on
+//! the device, OpenSSL on the host). See components/crypto/include/crypto.h.
+
+use crate::ctap2::status::CtapStatus;
+
+pub const SHA256_LEN: usize = 32;
+pub const PRIV_LEN: usize = 32;
+pub const PUB_LEN: usize = 64;
+pub const HMAC_KEY_LEN: usize = 32;
+pub const AES_KEY_LEN: usize = 32;
+pub const GCM_IV_LEN: usize = 12;
+pub const GCM_TAG_LEN: usize = 16;
+pub const AES_BLOCK_LEN: usize = 16;
+/// DER ECDSA-Sig-Value: two INTEGERs of up to 33 bytes each plus headers.
+pub const DER_SIG_MAX: usize = 72;
+
+#[repr(C)]
+struct CryptoBuf {
+    p: *const u8,
+    len: usize,
+}
+
+unsafe extern "C" {
+    fn crypto_random(out: *mut u8, len: usize) -> i32;
+    fn crypto_sha256(parts: *const CryptoBuf, n: usize, out: *mut u8) -> i32;
+    fn crypto_hmac_sha256(key: *const u8, parts: *const CryptoBuf, n: usize, out: *mut u8) -> i32;
+    fn crypto_aes_gcm_seal(
+        key: *const u8, iv: *const u8, aad: *const u8, aad_len: usize,
+        input: *const u8, out: *mut u8, len: usize, tag: *mut u8,
+    ) -> i32;
+    fn crypto_aes_gcm_open(
+        key: *const u8, iv: *const u8, aad: *const u8, aad_len: usize,
+        input: *const u8, out: *mut u8, len: usize, tag: *const u8,
+    ) -> i32;
+    fn crypto_aes_cbc_encrypt(key: *const u8, iv: *const u8, input: *const u8, out: *mut u8, len: usize) -> i32;
+    fn crypto_aes_cbc_decrypt(key: *const u8, iv: *const u8, input: *const u8, out: *mut u8, len: usize) -> i32;
+    fn crypto_p256_ecdh(private: *const u8, peer: *const u8, out: *mut u8) -> i32;
+    fn crypto_p256_keygen(private: *mut u8, public: *mut u8) -> i32;
+    fn crypto_p256_sign(private: *const u8, digest: *const u8, sig: *mut u8) -> i32;
+}
+
+fn check(rc: i32) -> Result<(), CtapStatus> {
+    if rc == 0 { Ok(()) } else { Err(CtapStatus::Other) }
+}
+
+pub fn random(out: &mut [u8]) -> Result<(), CtapStatus> {
+    check(unsafe { crypto_random(out.as_mut_ptr(), out.len()) })
+}
+
+const MAX_PARTS: usize = 4;
+
+fn bufs(parts: &[&[u8]]) -> Result<[CryptoBuf; MAX_PARTS], CtapStatus> {
+    if parts.len() > MAX_PARTS {
+        return Err(CtapStatus::Other);
+    }
+    let mut bufs: [CryptoBuf; MAX_PARTS] =
+        core::array::from_fn(|_| CryptoBuf { p: core::ptr::null(), len: 0 });
+    for (b, p) in bufs.iter_mut().zip(parts) {
+        *b = CryptoBuf { p: p.as_ptr(), len: p.len() };
+    }
+    Ok(bufs)
+}
+
+/// SHA-256 over the concatenation of `parts`, without copying them together.
+pub fn sha256(parts: &[&[u8]]) -> Result<[u8; SHA256_LEN], CtapStatus> {
+    let bufs = bufs(parts)?;
+    let mut out = [0u8; SHA256_LEN];
+    check(unsafe { crypto_sha256(bufs.as_ptr(), parts.len(), out.as_mut_ptr()) })?;
+    Ok(out)
+}
+
+/// HMAC-SHA256 over the concatenation of `parts`.
+pub fn hmac_sha256(key: &[u8; HMAC_KEY_LEN], parts: &[&[u8]]) -> Result<[u8; SHA256_LEN], CtapStatus> {
+    let bufs = bufs(parts)?;
+    let mut out = [0u8; SHA256_LEN];
+    check(unsafe { crypto_hmac_sha256(key.as_ptr(), bufs.as_ptr(), parts.len(), out.as_mut_ptr()) })?;
+    Ok(out)
+}
+
+/// AES-256-GCM encryption of `data` in place; returns the tag.
+pub fn aes_gcm_seal(
+    key: &[u8; AES_KEY_LEN],
+    iv: &[u8; GCM_IV_LEN],
+    aad: &[u8],
+    data: &mut [u8],
+) -> Result<[u8; GCM_TAG_LEN], CtapStatus> {
+    let mut tag = [0u8; GCM_TAG_LEN];
+    let p = data.as_mut_ptr();
+    check(unsafe {
+        crypto_aes_gcm_seal(key.as_ptr(), iv.as_ptr(), aad.as_ptr(), aad.len(), p, p, data.len(), tag.as_mut_ptr())
+    })?;
+    Ok(tag)
+}
+
+/// Decrypts `data` in place if `tag` authenticates it and `aad`. On
+/// failure `data` is left zeroed.
+pub fn aes_gcm_open(
+    key: &[u8; AES_KEY_LEN],
+    iv: &[u8; GCM_IV_LEN],
+    aad: &[u8],
+    data: &mut [u8],
+    tag: &[u8; GCM_TAG_LEN],
+) -> bool {
+    let p = data.as_mut_ptr();
+    unsafe {
+        crypto_aes_gcm_open(key.as_ptr(), iv.as_ptr(), aad.as_ptr(), aad.len(), p, p, data.len(), tag.as_ptr()) == 0
+    }
+}
+
+/// AES-256-CBC of `data` in place, no padding: the length must be a
+/// multiple of AES_BLOCK_LEN.
+pub fn aes_cbc_encrypt(key: &[u8; AES_KEY_LEN], iv: &[u8; AES_BLOCK_LEN], data: &mut [u8]) -> Result<(), CtapStatus> {
+    let p = data.as_mut_ptr();
+    check(unsafe { crypto_aes_cbc_encrypt(key.as_ptr(), iv.as_ptr(), p, p, data.len()) })
+}
+
+pub fn aes_cbc_decrypt(key: &[u8; AES_KEY_LEN], iv: &[u8; AES_BLOCK_LEN], data: &mut [u8]) -> Result<(), CtapStatus> {
+    let p = data.as_mut_ptr();
+    check(unsafe { crypto_aes_cbc_decrypt(key.as_ptr(), iv.as_ptr(), p, p, data.len()) })
+}
+
+/// ECDH shared point's x coordinate; None if `peer` isn't on the curve.
+pub fn p256_ecdh(private: &[u8; PRIV_LEN], peer: &[u8; PUB_LEN]) -> Option<[u8; PRIV_LEN]> {
+    let mut z = [0u8; PRIV_LEN];
+    (unsafe { crypto_p256_ecdh(private.as_ptr(), peer.as_ptr(), z.as_mut_ptr()) } == 0).then_some(z)
+}
+
+pub struct KeyPair {
+    pub private: [u8; PRIV_LEN],
+    /// x || y
+    pub public: [u8; PUB_LEN],
+}
+
+pub fn p256_keygen() -> Result<KeyPair, CtapStatus> {
+    let mut kp = KeyPair { private: [0; PRIV_LEN], public: [0; PUB_LEN] };
+    check(unsafe { crypto_p256_keygen(kp.private.as_mut_ptr(), kp.public.as_mut_ptr()) })?;
+    Ok(kp)
+}
+
+/// DER-encoded ECDSA signature.
+pub struct Signature {
+    buf: [u8; DER_SIG_MAX],
+    len: usize,
+}
+
+impl Signature {
+    pub fn as_bytes(&self) -> &[u8] {
+        &self.buf[..self.len]
+    }
+}
+
+pub fn p256_sign(private: &[u8; PRIV_LEN], digest: &[u8; SHA256_LEN]) -> Result<Signature, CtapStatus> {
+    let mut rs = [0u8; 64];
+    check(unsafe { crypto_p256_sign(private.as_ptr(), digest.as_ptr(), rs.as_mut_ptr()) })?;
+    Ok(der_signature(&rs))
+}
+
+// SEQUENCE { INTEGER r, INTEGER s } as WebAuthn expects in attStmt/signature.
+fn der_signature(rs: &[u8; 64]) -> Signature {
+    let mut sig = Signature { buf: [0; DER_SIG_MAX], len: 2 };
+    for half in [&rs[..32], &rs[32..]] {
+        let skip = half.iter().take_while(|&&b| b == 0).count().min(31);
+        let v = &half[skip..];
+        let pad = (v[0] & 0x80 != 0) as usize;
+        let at = sig.len;
+        sig.buf[at] = 0x02;
+        sig.buf[at + 1] = (v.len() + pad) as u8;
+        sig.buf[at + 2] = 0;
+        sig.buf[at + 2 + pad..at + 2 + pad + v.len()].copy_from_slice(v);
+        sig.len = at + 2 + pad + v.len();
+    }
+    sig.buf[0] = 0x30;
+    sig.buf[1] = (sig.len - 2) as u8;
+    sig
+}
@@ -0,0 +1,67 @@
+// authenticatorData (WebAuthn §6.1), built in a fixed buffer: it is signed
+// over and then emitted as one byte string, so it can't be streamed.
+use crate::crypto::{PUB_LEN, SHA256_LEN};
+use crate::ctap2::{
+    cbor::Writer,
+    constants::AAGUID,
+    key_wrap::WRAPPED_ID_LEN,
+    status::CtapStatus,
+    types::COSE_ALG_ES256,
+};
+
+pub const FLAG_UP: u8 = 0x01;
+pub const FLAG_UV: u8 = 0x04;
+pub const FLAG_AT: u8 = 0x40;
+
+// rpIdHash, flags, signCount, AAGUID, credentialIdLength, credentialId (a
+// wrapped one is the longest) and a 77-byte EC2 COSE_Key.
+const AUTH_DATA_MAX: usize = 32 + 1 + 4 + 16 + 2 + WRAPPED_ID_LEN + 77;
+
+pub struct AuthData {
+    buf: [u8; AUTH_DATA_MAX],
+    len: usize,
+}
+
+impl AuthData {
+    pub fn new(rp_id_hash: &[u8; SHA256_LEN], flags: u8, sign_count: u32) -> Self {
+        let mut a = Self { buf: [0; AUTH_DATA_MAX], len: 37 };
+        a.buf[..32].copy_from_slice(rp_id_hash);
+        a.buf[32] = flags;
+        a.buf[33..37].copy_from_slice(&sign_count.to_be_bytes());
+        a
+    }
+
+    /// Appends attestedCredentialData for an ES256 key (x || y); the caller
+    /// sets FLAG_AT.
+    pub fn attest(&mut self, cred_id: &[u8], public: &[u8; PUB_LEN]) -> Result<(), CtapStatus> {
+        if cred_id.len() > WRAPPED_ID_LEN {
+            return Err(CtapStatus::Other);
+        }
+        let mut at = self.len;
+        self.buf[at..at + 16].copy_from_slice(&AAGUID);
+        at += 16;
+        self.buf[at..at + 2].copy_from_slice(&(cred_id.len() as u16).to_be_bytes());
+        at += 2;
+        self.buf[at..at + cred_id.len()].copy_from_slice(cred_id);
+        at += cred_id.len();
+
+        let mut w = Writer::new(&mut self.buf[at..]);
+        w.map(5)?;
+        w.int(1)?; // kty: EC2
+        w.int(2)?;
+        w.int(3)?; // alg
+        w.int(COSE_ALG_ES256)?;
+        w.int(-1)?; // crv: P-256
+        w.int(1)?;
+        w.int(-2)?; // x
+        w.bstr(&public[..32])?;
+        w.int(-3)?; // y
+        w.bstr(&public[32..])?;
+        self.len = at + w.len();
+        Ok(())
+    }
+
+    pub fn as_bytes(&self) -> &[u8] {
+        &self.buf[..self.len]
+    }
+}
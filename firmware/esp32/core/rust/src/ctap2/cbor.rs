@@ -1,122 +1,625 @@
+use core::marker::PhantomData;
+
 use crate::ctap2::status::CtapStatus;
 
+/// Source of output chunks for a streaming `Writer`, e.g. the payload areas of
+/// successive CTAPHID IN reports. Returns None when no more space is available.
+pub trait ChunkSink {
+    fn next_chunk(&mut self) -> Option<(*mut u8, usize)>;
+}
+
+/// CBOR encoder writing either into one flat buffer or through a `ChunkSink`,
+/// so responses can be encoded straight into transport frames.
 pub struct Writer<'a> {
-    out: &'a mut [u8],
+    cur: *mut u8,
+    cap: usize,
+    pos: usize,
     n: usize,
+    sink: Option<&'a mut dyn ChunkSink>,
+    _out: PhantomData<&'a mut [u8]>,
 }
 
 impl<'a> Writer<'a> {
     pub fn new(out: &'a mut [u8]) -> Self {
-        Self { out, n: 0 }
+        Self { cur: out.as_mut_ptr(), cap: out.len(), pos: 0, n: 0, sink: None, _out: PhantomData }
     }
+
+    pub fn streaming(sink: &'a mut dyn ChunkSink) -> Self {
+        Self { cur: core::ptr::null_mut(), cap: 0, pos: 0, n: 0, sink: Some(sink), _out: PhantomData }
+    }
+
     pub fn len(&self) -> usize {
         self.n
     }
 
+    fn next_chunk(&mut self) -> Result<(), CtapStatus> {
+        let (p, cap) = match self.sink.as_mut().and_then(|s| s.next_chunk()) {
+            Some(c) if !c.0.is_null() && c.1 > 0 => c,
+            _ => return Err(CtapStatus::InvalidLength),
+        };
+        self.cur = p;
+        self.cap = cap;
+        self.pos = 0;
+        Ok(())
+    }
+
     fn push(&mut self, b: u8) -> Result<(), CtapStatus> {
-        if self.n >= self.out.len() {
-            return Err(CtapStatus::InvalidLength);
+        if self.pos >= self.cap {
+            self.next_chunk()?;
         }
-        self.out[self.n] = b;
+        // SAFETY: pos < cap, and cur/cap describe a writable region valid for 'a.
+        unsafe { *self.cur.add(self.pos) = b; }
+        self.pos += 1;
         self.n += 1;
         Ok(())
     }
 
-    fn bytes(&mut self, data: &[u8]) -> Result<(), CtapStatus> {
-        if self.n + data.len() > self.out.len() {
-            return Err(CtapStatus::InvalidLength);
+    /// Append raw bytes (already-encoded CBOR or the CTAP status byte).
+    pub fn bytes(&mut self, mut data: &[u8]) -> Result<(), CtapStatus> {
+        while !data.is_empty() {
+            if self.pos >= self.cap {
+                self.next_chunk()?;
+            }
+            let k = core::cmp::min(self.cap - self.pos, data.len());
+            // SAFETY: k bytes fit in the current chunk; source and chunk never overlap.
+            unsafe { core::ptr::copy_nonoverlapping(data.as_ptr(), self.cur.add(self.pos), k); }
+            self.pos += k;
+            self.n += k;
+            data = &data[k..];
         }
-        self.out[self.n..self.n + data.len()].copy_from_slice(data);
-        self.n += data.len();
         Ok(())
     }
 
+    // Head with the shortest argument encoding (canonical CBOR).
+    fn head(&mut self, major: u8, v: u64) -> Result<(), CtapStatus> {
+        let mut buf = [0u8; 9];
+        let n = encode_head(&mut buf, major, v);
+        self.bytes(&buf[..n])
+    }
+
     // Major type 5 (map)
-    pub fn map(&mut self, pairs: u8) -> Result<(), CtapStatus> {
-        self.push(0b101_00000 | pairs)
+    pub fn map(&mut self, pairs: usize) -> Result<(), CtapStatus> {
+        self.head(MAJOR_MAP, pairs as u64)
     }
 
     // Major type 4 (array)
-    pub fn array(&mut self, len: u8) -> Result<(), CtapStatus> {
-        self.push(0b100_00000 | len)
+    pub fn array(&mut self, len: usize) -> Result<(), CtapStatus> {
+        self.head(MAJOR_ARRAY, len as u64)
+    }
+
+    // Major type 0 (unsigned int)
+    pub fn u64(&mut self, v: u64) -> Result<(), CtapStatus> {
+        self.head(MAJOR_UINT, v)
     }
 
-    // Major type 0 (unsigned int) small
     pub fn u8(&mut self, v: u8) -> Result<(), CtapStatus> {
-        self.u32(v as u32)
+        self.u64(v as u64)
     }
 
-    // Major type 0 (unsigned int) generic
     pub fn u32(&mut self, v: u32) -> Result<(), CtapStatus> {
-        match v {
-            0..=23 => self.push(0b000_00000 | v as u8),
-            24..=0xff => {
-                self.push(0b000_11000)?; // uint8 follows
-                self.push(v as u8)
-            }
-            0x100..=0xffff => {
-                self.push(0b000_11001)?; // uint16 follows
-                self.push((v >> 8) as u8)?;
-                self.push(v as u8)
-            }
-            _ => {
-                self.push(0b000_11010)?; // uint32 follows
-                self.push((v >> 24) as u8)?;
-                self.push((v >> 16) as u8)?;
-                self.push((v >> 8) as u8)?;
-                self.push(v as u8)
-            }
+        self.u64(v as u64)
+    }
+
+    // Major type 0 or 1 depending on sign
+    pub fn int(&mut self, v: i64) -> Result<(), CtapStatus> {
+        if v >= 0 {
+            self.head(MAJOR_UINT, v as u64)
+        } else {
+            self.head(MAJOR_NINT, (-1 - v) as u64)
         }
     }
 
-    // Major type 1 (negative int) small-ish
-    pub fn nint(&mut self, v: i32) -> Result<(), CtapStatus> {
+    // Major type 1 (negative int)
+    pub fn nint(&mut self, v: i64) -> Result<(), CtapStatus> {
         if v >= 0 {
             return Err(CtapStatus::InvalidParameter);
         }
-        let magnitude = (-1 - v) as u32;
-        match magnitude {
-            0..=23 => self.push(0b001_00000 | magnitude as u8),
-            24..=0xff => {
-                self.push(0b001_11000)?; // uint8 follows
-                self.push(magnitude as u8)
-            }
-            0x100..=0xffff => {
-                self.push(0b001_11001)?; // uint16 follows
-                self.push((magnitude >> 8) as u8)?;
-                self.push(magnitude as u8)
-            }
-            _ => Err(CtapStatus::InvalidParameter),
-        }
+        self.int(v)
     }
 
-    // Major type 3 (text string) small
+    // Major type 3 (text string)
     pub fn tstr(&mut self, s: &str) -> Result<(), CtapStatus> {
-        let b = s.as_bytes();
-        if b.len() < 24 {
-            self.push(0b011_00000 | (b.len() as u8))?;
-        } else {
-            return Err(CtapStatus::InvalidLength); // keep it simple in skeleton
-        }
-        self.bytes(b)
+        self.head(MAJOR_TEXT, s.len() as u64)?;
+        self.bytes(s.as_bytes())
     }
 
-    // Major type 2 (byte string) small
+    // Major type 2 (byte string)
     pub fn bstr(&mut self, data: &[u8]) -> Result<(), CtapStatus> {
-        if data.len() < 24 {
-            self.push(0b010_00000 | (data.len() as u8))?;
-        } else {
-            return Err(CtapStatus::InvalidLength);
-        }
+        self.head(MAJOR_BYTES, data.len() as u64)?;
         self.bytes(data)
     }
 
     // Major type 7 (simple value) booleans
     pub fn bool(&mut self, v: bool) -> Result<(), CtapStatus> {
-        if v {
-            self.push(0b111_10101) // true
+        self.push(if v { 0b111_10101 } else { 0b111_10100 })
+    }
+}
+
+// Shortest head for `v`; returns the number of bytes used in `out`.
+const fn encode_head(out: &mut [u8; 9], major: u8, v: u64) -> usize {
+    let mt = major << 5;
+    let n = if v < 24 {
+        out[0] = mt | v as u8;
+        return 1;
+    } else if v <= 0xff {
+        out[0] = mt | 24;
+        1
+    } else if v <= 0xffff {
+        out[0] = mt | 25;
+        2
+    } else if v <= 0xffff_ffff {
+        out[0] = mt | 26;
+        4
+    } else {
+        out[0] = mt | 27;
+        8
+    };
+    let mut i = 0;
+    while i < n {
+        out[1 + i] = (v >> (8 * (n - 1 - i))) as u8;
+        i += 1;
+    }
+    1 + n
+}
+
+/// Compile-time CBOR encoder for responses that never change. Build it as a
+/// const builder chain, then cut it to size with `to_array`:
+///
+/// ```ignore
+/// const ENC: ConstWriter<64> = ConstWriter::new().map(1).u64(1).tstr("x");
+/// static OUT: [u8; ENC.len()] = ENC.to_array();
+/// ```
+///
+/// Overflowing `N` or a wrong output size fails const evaluation, so a
+/// mistake is a build error rather than a runtime one.
+pub struct ConstWriter<const N: usize> {
+    buf: [u8; N],
+    len: usize,
+}
+
+impl<const N: usize> ConstWriter<N> {
+    pub const fn new() -> Self {
+        Self { buf: [0; N], len: 0 }
+    }
+
+    pub const fn len(&self) -> usize {
+        self.len
+    }
+
+    pub const fn is_empty(&self) -> bool {
+        self.len == 0
+    }
+
+    const fn raw(mut self, data: &[u8]) -> Self {
+        assert!(self.len + data.len() <= N, "ConstWriter buffer too small");
+        let mut i = 0;
+        while i < data.len() {
+            self.buf[self.len + i] = data[i];
+            i += 1;
+        }
+        self.len += data.len();
+        self
+    }
+
+    const fn head(self, major: u8, v: u64) -> Self {
+        let mut h = [0u8; 9];
+        let n = encode_head(&mut h, major, v);
+        let (h, _) = h.split_at(n);
+        self.raw(h)
+    }
+
+    pub const fn map(self, pairs: usize) -> Self {
+        self.head(MAJOR_MAP, pairs as u64)
+    }
+
+    pub const fn array(self, len: usize) -> Self {
+        self.head(MAJOR_ARRAY, len as u64)
+    }
+
+    pub const fn u64(self, v: u64) -> Self {
+        self.head(MAJOR_UINT, v)
+    }
+
+    pub const fn int(self, v: i64) -> Self {
+        if v >= 0 {
+            self.head(MAJOR_UINT, v as u64)
         } else {
-            self.push(0b111_10100) // false
+            self.head(MAJOR_NINT, (-1 - v) as u64)
         }
     }
+
+    pub const fn tstr(self, s: &str) -> Self {
+        self.head(MAJOR_TEXT, s.len() as u64).raw(s.as_bytes())
+    }
+
+    pub const fn bstr(self, data: &[u8]) -> Self {
+        self.head(MAJOR_BYTES, data.len() as u64).raw(data)
+    }
+
+    pub const fn bool(self, v: bool) -> Self {
+        self.raw(if v { &[0b111_10101] } else { &[0b111_10100] })
+    }
+
+    /// The encoded bytes; `M` must equal `len()`.
+    pub const fn to_array<const M: usize>(&self) -> [u8; M] {
+        assert!(M == self.len, "ConstWriter::to_array size mismatch");
+        let mut out = [0u8; M];
+        let mut i = 0;
+        while i < M {
+            out[i] = self.buf[i];
+            i += 1;
+        }
+        out
+    }
+}
+
+// ---- decoding ----
+
+/// Nesting limit for requests: the deepest CTAP2 request (MakeCredential
+/// excludeList -> descriptor -> transports) nests four levels.
+pub const MAX_DEPTH: u8 = 4;
+
+// Hard cap on `Reader::with_max_depth`; skip() recurses once per level.
+const DEPTH_CAP: u8 = 8;
+
+const MAJOR_UINT: u8 = 0;
+const MAJOR_NINT: u8 = 1;
+const MAJOR_BYTES: u8 = 2;
+const MAJOR_TEXT: u8 = 3;
+const MAJOR_ARRAY: u8 = 4;
+const MAJOR_MAP: u8 = 5;
+const MAJOR_TAG: u8 = 6;
+const MAJOR_SIMPLE: u8 = 7;
+
+const SIMPLE_FALSE: u64 = 20;
+const SIMPLE_TRUE: u64 = 21;
+const SIMPLE_NULL: u64 = 22;
+const SIMPLE_UNDEFINED: u64 = 23;
+
+/// Map key as used by CTAP2: integer keys at the top level, text keys inside
+/// entities and options.
+#[derive(Copy, Clone, Debug, PartialEq, Eq)]
+pub enum Key<'a> {
+    Int(i64),
+    Text(&'a str),
+}
+
+/// Pull-style CBOR decoder over a borrowed request. Strings are returned as
+/// slices of the input, nothing is copied or allocated. Only CTAP2 canonical
+/// encoding is accepted: definite lengths, shortest-form heads, map keys in
+/// canonical order without duplicates, no floats, nesting up to `max_depth`.
+#[derive(Clone)]
+pub struct Reader<'a> {
+    buf: &'a [u8],
+    pos: usize,
+    depth: u8,
+    max_depth: u8,
+}
+
+impl<'a> Reader<'a> {
+    pub fn new(buf: &'a [u8]) -> Self {
+        Self::with_max_depth(buf, MAX_DEPTH)
+    }
+
+    pub fn with_max_depth(buf: &'a [u8], max_depth: u8) -> Self {
+        Self { buf, pos: 0, depth: 0, max_depth: core::cmp::min(max_depth, DEPTH_CAP) }
+    }
+
+    pub fn position(&self) -> usize {
+        self.pos
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.pos >= self.buf.len()
+    }
+
+    /// Input consumed since `start` (an earlier `position()`).
+    pub fn since(&self, start: usize) -> &'a [u8] {
+        &self.buf[start..self.pos]
+    }
+
+    /// The whole input must have been consumed.
+    pub fn finish(&self) -> Result<(), CtapStatus> {
+        if self.is_empty() { Ok(()) } else { Err(CtapStatus::InvalidCbor) }
+    }
+
+    fn take(&mut self, n: usize) -> Result<&'a [u8], CtapStatus> {
+        if n > self.buf.len() - self.pos {
+            return Err(CtapStatus::InvalidCbor);
+        }
+        let s = &self.buf[self.pos..self.pos + n];
+        self.pos += n;
+        Ok(s)
+    }
+
+    fn be(bytes: &[u8]) -> u64 {
+        bytes.iter().fold(0u64, |acc, &b| (acc << 8) | b as u64)
+    }
+
+    // Initial byte plus argument, rejecting indefinite lengths, reserved
+    // additional-info values, floats and non-shortest encodings.
+    fn head(&mut self) -> Result<(u8, u64), CtapStatus> {
+        let ib = self.take(1)?[0];
+        let major = ib >> 5;
+        let ai = ib & 0x1f;
+        if major == MAJOR_SIMPLE && ai >= 24 {
+            return Err(CtapStatus::InvalidCbor);
+        }
+        let (v, min) = match ai {
+            0..=23 => return Ok((major, ai as u64)),
+            24 => (Self::be(self.take(1)?), 24),
+            25 => (Self::be(self.take(2)?), 0x100),
+            26 => (Self::be(self.take(4)?), 0x1_0000),
+            27 => (Self::be(self.take(8)?), 0x1_0000_0000),
+            _ => return Err(CtapStatus::InvalidCbor),
+        };
+        if v < min {
+            return Err(CtapStatus::InvalidCbor);
+        }
+        Ok((major, v))
+    }
+
+    fn peek_head(&self) -> Result<(u8, u64), CtapStatus> {
+        self.clone().head()
+    }
+
+    /// Major type of the next item without consuming it.
+    pub fn peek_major(&self) -> Result<u8, CtapStatus> {
+        Ok(self.peek_head()?.0)
+    }
+
+    // Head of the expected major type; leaves the input untouched otherwise.
+    fn expect(&mut self, major: u8) -> Result<u64, CtapStatus> {
+        let (m, v) = self.peek_head()?;
+        if m != major {
+            return Err(CtapStatus::CborUnexpectedType);
+        }
+        self.head()?;
+        Ok(v)
+    }
+
+    fn len_arg(&self, v: u64) -> Result<usize, CtapStatus> {
+        // Every string byte or container item needs at least one input byte.
+        if v > (self.buf.len() - self.pos) as u64 {
+            return Err(CtapStatus::InvalidCbor);
+        }
+        Ok(v as usize)
+    }
+
+    pub fn u64(&mut self) -> Result<u64, CtapStatus> {
+        self.expect(MAJOR_UINT)
+    }
+
+    pub fn u32(&mut self) -> Result<u32, CtapStatus> {
+        u32::try_from(self.u64()?).map_err(|_| CtapStatus::CborUnexpectedType)
+    }
+
+    pub fn u8(&mut self) -> Result<u8, CtapStatus> {
+        u8::try_from(self.u64()?).map_err(|_| CtapStatus::CborUnexpectedType)
+    }
+
+    /// Unsigned or negative integer.
+    pub fn int(&mut self) -> Result<i64, CtapStatus> {
+        let (m, v) = self.peek_head()?;
+        let v = i64::try_from(v).map_err(|_| CtapStatus::CborUnexpectedType)?;
+        let out = match m {
+            MAJOR_UINT => v,
+            MAJOR_NINT => -1 - v,
+            _ => return Err(CtapStatus::CborUnexpectedType),
+        };
+        self.head()?;
+        Ok(out)
+    }
+
+    pub fn bytes(&mut self) -> Result<&'a [u8], CtapStatus> {
+        let n = self.expect(MAJOR_BYTES)?;
+        let n = self.len_arg(n)?;
+        self.take(n)
+    }
+
+    pub fn text(&mut self) -> Result<&'a str, CtapStatus> {
+        let n = self.expect(MAJOR_TEXT)?;
+        let n = self.len_arg(n)?;
+        core::str::from_utf8(self.take(n)?).map_err(|_| CtapStatus::InvalidCbor)
+    }
+
+    pub fn bool(&mut self) -> Result<bool, CtapStatus> {
+        match self.peek_head()? {
+            (MAJOR_SIMPLE, SIMPLE_FALSE) => { self.head()?; Ok(false) }
+            (MAJOR_SIMPLE, SIMPLE_TRUE) => { self.head()?; Ok(true) }
+            _ => Err(CtapStatus::CborUnexpectedType),
+        }
+    }
+
+    fn enter(&mut self) -> Result<(), CtapStatus> {
+        if self.depth >= self.max_depth {
+            return Err(CtapStatus::InvalidCbor);
+        }
+        self.depth += 1;
+        Ok(())
+    }
+
+    /// Opens an array. Read exactly one value per `Array::next` item.
+    pub fn array(&mut self) -> Result<Array<'_, 'a>, CtapStatus> {
+        let n = self.expect(MAJOR_ARRAY)?;
+        let left = self.len_arg(n)?;
+        self.enter()?;
+        Ok(Array { r: self, left })
+    }
+
+    /// Consumes an array head and returns the item count, without opening a
+    /// nesting level. For iterators over input that was already validated
+    /// with `array()`, which can't keep an `Array` borrow alive.
+    pub fn array_head(&mut self) -> Result<usize, CtapStatus> {
+        let n = self.expect(MAJOR_ARRAY)?;
+        self.len_arg(n)
+    }
+
+    /// Opens a map. Alternate `Map::next_key` with reading (or skipping) the value.
+    pub fn map(&mut self) -> Result<Map<'_, 'a>, CtapStatus> {
+        let n = self.expect(MAJOR_MAP)?;
+        let left = self.len_arg(n)?;
+        // each pair needs at least two bytes
+        if left > (self.buf.len() - self.pos) / 2 {
+            return Err(CtapStatus::InvalidCbor);
+        }
+        self.enter()?;
+        Ok(Map { r: self, left, prev_key: None })
+    }
+
+    /// Skips one complete value, checking it the same way as the typed reads.
+    pub fn skip(&mut self) -> Result<(), CtapStatus> {
+        let (major, v) = self.head()?;
+        match major {
+            MAJOR_UINT | MAJOR_NINT => Ok(()),
+            MAJOR_BYTES => {
+                let n = self.len_arg(v)?;
+                self.take(n).map(|_| ())
+            }
+            MAJOR_TEXT => {
+                let n = self.len_arg(v)?;
+                core::str::from_utf8(self.take(n)?).map(|_| ()).map_err(|_| CtapStatus::InvalidCbor)
+            }
+            MAJOR_ARRAY => {
+                let n = self.len_arg(v)?;
+                self.enter()?;
+                for _ in 0..n {
+                    self.skip()?;
+                }
+                self.depth -= 1;
+                Ok(())
+            }
+            MAJOR_MAP => {
+                let n = self.len_arg(v)?;
+                self.enter()?;
+                let mut prev: Option<&'a [u8]> = None;
+                for _ in 0..n {
+                    let start = self.pos;
+                    self.skip()?;
+                    let key = &self.buf[start..self.pos];
+                    check_key_order(prev, key)?;
+                    prev = Some(key);
+                    self.skip()?;
+                }
+                self.depth -= 1;
+                Ok(())
+            }
+            MAJOR_TAG => {
+                self.enter()?;
+                self.skip()?;
+                self.depth -= 1;
+                Ok(())
+            }
+            _ => match v {
+                SIMPLE_FALSE | SIMPLE_TRUE | SIMPLE_NULL | SIMPLE_UNDEFINED => Ok(()),
+                _ => Err(CtapStatus::InvalidCbor),
+            },
+        }
+    }
+
+    /// Encoded bytes of the next value, skipped and checked; re-read it later
+    /// with `Reader::new` (e.g. allow/exclude lists walked per credential).
+    pub fn raw_value(&mut self) -> Result<&'a [u8], CtapStatus> {
+        let start = self.pos;
+        self.skip()?;
+        Ok(&self.buf[start..self.pos])
+    }
+}
+
+// Canonical CBOR: shorter encoded keys first, equal lengths bytewise.
+fn check_key_order(prev: Option<&[u8]>, key: &[u8]) -> Result<(), CtapStatus> {
+    match prev {
+        Some(p) if (p.len(), p) >= (key.len(), key) => Err(CtapStatus::InvalidCbor),
+        _ => Ok(()),
+    }
+}
+
+/// Open array on a `Reader`; closes its nesting level when dropped.
+pub struct Array<'r, 'a> {
+    r: &'r mut Reader<'a>,
+    left: usize,
+}
+
+impl<'r, 'a> Array<'r, 'a> {
+    pub fn len(&self) -> usize {
+        self.left
+    }
+
+    /// Reader positioned at the next item, or None at the end.
+    pub fn next(&mut self) -> Option<&mut Reader<'a>> {
+        if self.left == 0 {
+            return None;
+        }
+        self.left -= 1;
+        Some(self.r)
+    }
+
+    /// Skips the remaining items.
+    pub fn finish(mut self) -> Result<(), CtapStatus> {
+        while let Some(r) = self.next() {
+            r.skip()?;
+        }
+        Ok(())
+    }
+}
+
+impl Drop for Array<'_, '_> {
+    fn drop(&mut self) {
+        self.r.depth -= 1;
+    }
+}
+
+/// Open map on a `Reader`; closes its nesting level when dropped.
+pub struct Map<'r, 'a> {
+    r: &'r mut Reader<'a>,
+    left: usize,
+    prev_key: Option<&'a [u8]>,
+}
+
+impl<'r, 'a> Map<'r, 'a> {
+    pub fn len(&self) -> usize {
+        self.left
+    }
+
+    /// Next key (checked for canonical order), or None when the map is done.
+    /// The value must be read or skipped before asking for the next key.
+    pub fn next_key(&mut self) -> Result<Option<Key<'a>>, CtapStatus> {
+        if self.left == 0 {
+            return Ok(None);
+        }
+        let start = self.r.pos;
+        let key = match self.r.peek_major()? {
+            MAJOR_UINT | MAJOR_NINT => Key::Int(self.r.int()?),
+            MAJOR_TEXT => Key::Text(self.r.text()?),
+            _ => return Err(CtapStatus::InvalidCbor),
+        };
+        let raw = &self.r.buf[start..self.r.pos];
+        check_key_order(self.prev_key, raw)?;
+        self.prev_key = Some(raw);
+        self.left -= 1;
+        Ok(Some(key))
+    }
+
+    /// Reader positioned at the value of the key just returned.
+    pub fn value(&mut self) -> &mut Reader<'a> {
+        self.r
+    }
+
+    pub fn skip_value(&mut self) -> Result<(), CtapStatus> {
+        self.r.skip()
+    }
+
+    /// Skips the remaining pairs.
+    pub fn finish(mut self) -> Result<(), CtapStatus> {
+        while self.next_key()?.is_some() {
+            self.skip_value()?;
+        }
+        Ok(())
+    }
+}
+
+impl Drop for Map<'_, '_> {
+    fn drop(&mut self) {
+        self.r.depth -= 1;
+    }
 }
@@ -1,7 +1,207 @@
-// TODO()
 use crate::core_api::CoreCtx;
-use crate::ctap2::status::CtapStatus;
+use crate::crypto::{self, SHA256_LEN};
+use crate::ctap2::{
+    cbor::{Key, Reader, Writer},
+    credentials::{self, PIN_HASH_LEN},
+    pin::{self, SharedSecret, MAX_RETRIES, PERM_GA, PERM_MC, PROTOCOL},
+    status::CtapStatus,
+};
 
-pub fn handle(_ctx: &mut CoreCtx, _cbor_req: &[u8], _out: &mut [u8]) -> Result<usize, CtapStatus> {
-    Err(CtapStatus::InvalidCommand)
+const GET_PIN_RETRIES: u8 = 0x01;
+const GET_KEY_AGREEMENT: u8 = 0x02;
+const SET_PIN: u8 = 0x03;
+const CHANGE_PIN: u8 = 0x04;
+const GET_PIN_TOKEN: u8 = 0x05;
+const GET_PIN_UV_AUTH_TOKEN_USING_PIN_WITH_PERMISSIONS: u8 = 0x09;
+
+/// newPinEnc's plaintext: the PIN, zero padded.
+const PADDED_PIN_LEN: usize = 64;
+const PIN_MIN_CODE_POINTS: usize = 4;
+
+/// authenticatorClientPIN (0x06) parameters, borrowed from the request.
+pub struct Request<'a> {
+    pub pin_protocol: Option<u8>,
+    pub sub_command: u8,
+    /// COSE_Key map, still encoded.
+    pub key_agreement: Option<&'a [u8]>,
+    pub pin_auth: Option<&'a [u8]>,
+    pub new_pin_enc: Option<&'a [u8]>,
+    pub pin_hash_enc: Option<&'a [u8]>,
+    pub permissions: Option<u32>,
+    pub rp_id: Option<&'a str>,
+}
+
+impl<'a> Request<'a> {
+    pub fn parse(cbor: &'a [u8]) -> Result<Self, CtapStatus> {
+        let mut r = Reader::new(cbor);
+        let mut req = Self {
+            pin_protocol: None,
+            sub_command: 0,
+            key_agreement: None,
+            pin_auth: None,
+            new_pin_enc: None,
+            pin_hash_enc: None,
+            permissions: None,
+            rp_id: None,
+        };
+        let mut sub_command = None;
+
+        let mut m = r.map()?;
+        while let Some(k) = m.next_key()? {
+            let v = m.value();
+            match k {
+                Key::Int(1) => req.pin_protocol = Some(v.u8()?),
+                Key::Int(2) => sub_command = Some(v.u8()?),
+                Key::Int(3) => req.key_agreement = Some(v.raw_value()?),
+                Key::Int(4) => req.pin_auth = Some(v.bytes()?),
+                Key::Int(5) => req.new_pin_enc = Some(v.bytes()?),
+                Key::Int(6) => req.pin_hash_enc = Some(v.bytes()?),
+                Key::Int(9) => req.permissions = Some(v.u32()?),
+                Key::Int(10) => req.rp_id = Some(v.text()?),
+                _ => v.skip()?,
+            }
+        }
+        drop(m);
+        r.finish()?;
+
+        req.sub_command = sub_command.ok_or(CtapStatus::MissingParameter)?;
+        Ok(req)
+    }
+}
+
+/// authenticatorClientPIN with PIN/UV auth protocol 2 only.
+pub fn handle(ctx: &mut CoreCtx, cbor_req: &[u8], w: &mut Writer) -> Result<(), CtapStatus> {
+    let req = Request::parse(cbor_req)?;
+    if req.sub_command != GET_PIN_RETRIES {
+        match req.pin_protocol {
+            None => return Err(CtapStatus::MissingParameter),
+            Some(PROTOCOL) => {}
+            Some(_) => return Err(CtapStatus::InvalidParameter),
+        }
+    }
+
+    match req.sub_command {
+        GET_PIN_RETRIES => {
+            let failures = credentials::pin().map_or(0, |(_, f)| f);
+            w.map(2)?;
+            w.u8(3)?; // pinRetries
+            w.u32(MAX_RETRIES.saturating_sub(failures))?;
+            w.u8(4)?; // powerCycleState
+            w.bool(ctx.pin.auth_blocked())
+        }
+        GET_KEY_AGREEMENT => {
+            let public = ctx.pin.agreement_public()?;
+            w.map(1)?;
+            w.u8(1)?; // keyAgreement
+            w.map(5)?;
+            w.int(1)?; // kty: EC2
+            w.int(2)?;
+            w.int(3)?; // alg: ECDH-ES+HKDF-256, as CTAP asks for either protocol
+            w.int(-25)?;
+            w.int(-1)?; // crv: P-256
+            w.int(1)?;
+            w.int(-2)?;
+            w.bstr(&public[..32])?;
+            w.int(-3)?;
+            w.bstr(&public[32..])
+        }
+        SET_PIN => set_pin(ctx, &req),
+        CHANGE_PIN => change_pin(ctx, &req),
+        GET_PIN_TOKEN => {
+            // the pre-2.1 form: MakeCredential and GetAssertion, any RP
+            if req.permissions.is_some() || req.rp_id.is_some() {
+                return Err(CtapStatus::InvalidParameter);
+            }
+            get_token(ctx, &req, PERM_MC | PERM_GA, w)
+        }
+        GET_PIN_UV_AUTH_TOKEN_USING_PIN_WITH_PERMISSIONS => {
+            let permissions = req.permissions.ok_or(CtapStatus::MissingParameter)?;
+            if permissions == 0 {
+                return Err(CtapStatus::InvalidParameter);
+            }
+            if permissions & !u32::from(PERM_MC | PERM_GA) != 0 {
+                return Err(CtapStatus::UnauthorizedPermission);
+            }
+            get_token(ctx, &req, permissions as u8, w)
+        }
+        _ => Err(CtapStatus::InvalidSubcommand),
+    }
+}
+
+fn shared_secret(ctx: &mut CoreCtx, req: &Request<'_>) -> Result<SharedSecret, CtapStatus> {
+    let raw = req.key_agreement.ok_or(CtapStatus::MissingParameter)?;
+    ctx.pin.shared_secret(&pin::parse_cose_key(raw)?)
+}
+
+/// Retries left and the power-cycle block, before any PIN is looked at.
+fn check_retries() -> Result<(), CtapStatus> {
+    let (_, failures) = credentials::pin().ok_or(CtapStatus::PinNotSet)?;
+    if failures >= MAX_RETRIES {
+        return Err(CtapStatus::PinBlocked);
+    }
+    Ok(())
+}
+
+/// LEFT(SHA-256(PIN), 16) of newPinEnc, after the length policy.
+fn new_pin_hash(secret: &SharedSecret, new_pin_enc: &[u8]) -> Result<[u8; PIN_HASH_LEN], CtapStatus> {
+    let mut padded = [0u8; PADDED_PIN_LEN];
+    let rc = secret.decrypt(new_pin_enc, &mut padded).and_then(|_| {
+        let len = padded.iter().position(|&b| b == 0).ok_or(CtapStatus::PinPolicyViolation)?;
+        let pin = &padded[..len];
+        // code points, not bytes: a UTF-8 continuation byte doesn't count
+        if pin.iter().filter(|&&b| b & 0xC0 != 0x80).count() < PIN_MIN_CODE_POINTS {
+            return Err(CtapStatus::PinPolicyViolation);
+        }
+        crypto::sha256(&[pin])
+    });
+    padded.iter_mut().for_each(|b| unsafe { core::ptr::write_volatile(b, 0) });
+    let digest = rc?;
+    Ok(digest[..PIN_HASH_LEN].try_into().unwrap())
+}
+
+fn set_pin(ctx: &mut CoreCtx, req: &Request<'_>) -> Result<(), CtapStatus> {
+    let new_pin_enc = req.new_pin_enc.ok_or(CtapStatus::MissingParameter)?;
+    let pin_auth = req.pin_auth.ok_or(CtapStatus::MissingParameter)?;
+    if credentials::pin().is_some() {
+        return Err(CtapStatus::NotAllowed);
+    }
+    let secret = shared_secret(ctx, req)?;
+    secret.verify(&[new_pin_enc], pin_auth)?;
+    credentials::set_pin(&new_pin_hash(&secret, new_pin_enc)?)
+}
+
+fn change_pin(ctx: &mut CoreCtx, req: &Request<'_>) -> Result<(), CtapStatus> {
+    let new_pin_enc = req.new_pin_enc.ok_or(CtapStatus::MissingParameter)?;
+    let pin_hash_enc = req.pin_hash_enc.ok_or(CtapStatus::MissingParameter)?;
+    let pin_auth = req.pin_auth.ok_or(CtapStatus::MissingParameter)?;
+    check_retries()?;
+    if ctx.pin.auth_blocked() {
+        return Err(CtapStatus::PinAuthBlocked);
+    }
+    let secret = shared_secret(ctx, req)?;
+    secret.verify(&[new_pin_enc, pin_hash_enc], pin_auth)?;
+    ctx.pin.check_pin(&secret, pin_hash_enc)?;
+    let hash = new_pin_hash(&secret, new_pin_enc)?;
+    credentials::set_pin(&hash)?;
+    // tokens got with the old PIN go with it
+    ctx.pin.regenerate();
+    Ok(())
+}
+
+fn get_token(ctx: &mut CoreCtx, req: &Request<'_>, permissions: u8, w: &mut Writer) -> Result<(), CtapStatus> {
+    let pin_hash_enc = req.pin_hash_enc.ok_or(CtapStatus::MissingParameter)?;
+    check_retries()?;
+    if ctx.pin.auth_blocked() {
+        return Err(CtapStatus::PinAuthBlocked);
+    }
+    let secret = shared_secret(ctx, req)?;
+    ctx.pin.check_pin(&secret, pin_hash_enc)?;
+
+    let rp_id_hash: Option<[u8; SHA256_LEN]> = match req.rp_id {
+        Some(rp_id) => Some(crypto::sha256(&[rp_id.as_bytes()])?),
+        None => None,
+    };
+    w.map(1)?;
+    w.u8(2)?; // pinUvAuthToken
+    ctx.pin.issue_token(&secret, permissions, rp_id_hash, w)
 }
@@ -1,7 +1,228 @@
-// TODO()
-use crate::core_api::CoreCtx;
-use crate::ctap2::status::CtapStatus;
+use crate::core_api::{self, CoreCtx};
+use crate::crypto::{self, SHA256_LEN};
+use crate::ctap2::{
+    auth_data::{AuthData, FLAG_UP, FLAG_UV},
+    cbor::{Key, Reader, Writer},
+    credentials::{self, Handle},
+    key_wrap::{PrivateKey, WrapKeys},
+    pin::{self, PERM_GA},
+    status::CtapStatus,
+    types::{CredList, Options},
+};
 
-pub fn handle(_ctx: &mut CoreCtx, _cbor_req: &[u8], _out: &mut [u8]) -> Result<usize, CtapStatus> {
-    Err(CtapStatus::NoCredentials)
+/// authenticatorGetAssertion (0x02) parameters, borrowed from the request.
+pub struct Request<'a> {
+    pub rp_id: &'a str,
+    pub client_data_hash: &'a [u8],
+    pub allow_list: Option<CredList<'a>>,
+    pub extensions: Option<&'a [u8]>,
+    pub options: Options,
+    pub pin_auth: Option<&'a [u8]>,
+    pub pin_protocol: Option<u8>,
+}
+
+impl<'a> Request<'a> {
+    pub fn parse(cbor: &'a [u8]) -> Result<Self, CtapStatus> {
+        let mut r = Reader::new(cbor);
+        let mut rp_id = None;
+        let mut client_data_hash = None;
+        let mut allow_list = None;
+        let mut extensions = None;
+        let mut options = Options::default();
+        let mut pin_auth = None;
+        let mut pin_protocol = None;
+
+        let mut m = r.map()?;
+        while let Some(k) = m.next_key()? {
+            let v = m.value();
+            match k {
+                Key::Int(1) => rp_id = Some(v.text()?),
+                Key::Int(2) => client_data_hash = Some(v.bytes()?),
+                Key::Int(3) => allow_list = Some(CredList::parse(v)?),
+                Key::Int(4) => extensions = Some(v.raw_value()?),
+                Key::Int(5) => options = Options::parse(v)?,
+                Key::Int(6) => pin_auth = Some(v.bytes()?),
+                Key::Int(7) => pin_protocol = Some(v.u8()?),
+                _ => v.skip()?,
+            }
+        }
+        drop(m);
+        r.finish()?;
+
+        Ok(Self {
+            rp_id: rp_id.ok_or(CtapStatus::MissingParameter)?,
+            client_data_hash: client_data_hash.ok_or(CtapStatus::MissingParameter)?,
+            allow_list,
+            extensions,
+            options,
+            pin_auth,
+            pin_protocol,
+        })
+    }
+}
+
+/// Where the signing key comes from.
+enum Found<'a> {
+    Stored(Handle),
+    /// unwrapped from this allowList entry
+    Wrapped(&'a [u8], PrivateKey),
+}
+
+/// Discoverable credentials GetNextAssertion still has to return, newest
+/// first, with what the GetAssertion that found them was asked to sign.
+/// Only handles are kept, so the store isn't scanned again and presence
+/// and the PIN token, checked once for the batch, aren't asked again.
+pub struct NextAssertions {
+    rp_id_hash: [u8; SHA256_LEN],
+    client_data_hash: [u8; SHA256_LEN],
+    flags: u8,
+    handles: [Option<Handle>; NEXT_MAX],
+    len: usize,
+    next: usize,
+    deadline_us: u64,
+}
+
+/// Most credentials one GetAssertion offers after the first; the RP's
+/// older ones are left out.
+pub const NEXT_MAX: usize = 15;
+/// CTAP's limit between GetNextAssertion calls.
+const NEXT_TIMEOUT_US: u64 = 30_000_000;
+
+pub fn handle(ctx: &mut CoreCtx, cbor_req: &[u8], w: &mut Writer) -> Result<(), CtapStatus> {
+    let req = Request::parse(cbor_req)?;
+    if req.client_data_hash.len() != SHA256_LEN {
+        return Err(CtapStatus::InvalidLength);
+    }
+    if req.options.rk.is_some() {
+        return Err(CtapStatus::InvalidOption);
+    }
+    if req.options.uv == Some(true) {
+        return Err(CtapStatus::UnsupportedOption);
+    }
+
+    // With an allowList the first of ours wins, as CTAP allows: a wrapped ID
+    // is opened in RAM, anything else is looked up in the store. Without one
+    // the RP's newest discoverable credential answers and GetNextAssertion
+    // offers the others.
+    let rp_id_hash = crypto::sha256(&[req.rp_id.as_bytes()])?;
+    ctx.prompt.set_rp(req.rp_id, &rp_id_hash);
+    let uv = pin::verify_request(ctx, req.pin_auth, req.pin_protocol, PERM_GA, &rp_id_hash, req.client_data_hash)?;
+    let discover = req.allow_list.as_ref().is_none_or(|l| l.is_empty());
+    let found = match req.allow_list.filter(|l| !l.is_empty()) {
+        Some(list) => {
+            let keys = WrapKeys::load()?;
+            list.ids().find_map(|id| match keys.as_ref().and_then(|k| k.unwrap(&rp_id_hash, id)) {
+                Some(key) => Some(Found::Wrapped(id, key)),
+                None => credentials::find(&rp_id_hash, id).map(Found::Stored),
+            })
+        }
+        None => credentials::residents(&rp_id_hash).next().map(Found::Stored),
+    }
+    .ok_or(CtapStatus::NoCredentials)?;
+
+    let up = req.options.up.unwrap_or(true);
+    if up {
+        ctx.check_user_presence_for(&rp_id_hash)?;
+    }
+    pin::commit_request(ctx, uv, &rp_id_hash);
+    let flags = if up { FLAG_UP } else { 0 } | if uv { FLAG_UV } else { 0 };
+
+    // The rest of the RP's discoverable credentials wait for
+    // GetNextAssertion; an allowList answer is always a single one.
+    let mut batch = None;
+    if let (Found::Stored(first), true) = (&found, discover) {
+        let mut next = NextAssertions {
+            rp_id_hash,
+            client_data_hash: req.client_data_hash.try_into().unwrap(),
+            flags,
+            handles: [None; NEXT_MAX],
+            len: 0,
+            next: 0,
+            deadline_us: 0,
+        };
+        for (slot, h) in next.handles.iter_mut().zip(credentials::residents(&rp_id_hash).filter(|h| h != first)) {
+            *slot = Some(h);
+            next.len += 1;
+        }
+        if next.len > 0 {
+            batch = Some(next);
+        }
+    }
+
+    let count = batch.as_ref().map(|b| 1 + b.len);
+    respond(w, &rp_id_hash, req.client_data_hash, flags, found, count)?;
+    if let Some(mut b) = batch {
+        b.deadline_us = core_api::now_us() + NEXT_TIMEOUT_US;
+        ctx.next_assertions = Some(b);
+    }
+    Ok(())
+}
+
+/// authenticatorGetNextAssertion (0x08): the next credential of the batch
+/// the last GetAssertion found, signed over the same clientDataHash.
+pub fn handle_next(ctx: &mut CoreCtx, _cbor_req: &[u8], w: &mut Writer) -> Result<(), CtapStatus> {
+    let mut batch = ctx.next_assertions.take().ok_or(CtapStatus::NotAllowed)?;
+    let now = core_api::now_us();
+    if now > batch.deadline_us || batch.next >= batch.len {
+        return Err(CtapStatus::NotAllowed);
+    }
+    let h = batch.handles[batch.next].ok_or(CtapStatus::Other)?;
+    batch.next += 1;
+    respond(w, &batch.rp_id_hash, &batch.client_data_hash, batch.flags, Found::Stored(h), None)?;
+    if batch.next < batch.len {
+        batch.deadline_us = now + NEXT_TIMEOUT_US;
+        ctx.next_assertions = Some(batch);
+    }
+    Ok(())
+}
+
+/// Counts the signature, signs and writes the response map.
+/// `number_of_credentials` goes in the first response of a batch.
+fn respond(
+    w: &mut Writer,
+    rp_id_hash: &[u8; SHA256_LEN],
+    client_data_hash: &[u8],
+    flags: u8,
+    found: Found<'_>,
+    number_of_credentials: Option<usize>,
+) -> Result<(), CtapStatus> {
+    let cred;
+    let (id, private_key, user_id, sign_count) = match &found {
+        Found::Stored(h) => {
+            let count = credentials::bump(*h)?;
+            cred = credentials::read(*h)?;
+            (&cred.id[..], &cred.private_key, cred.is_resident().then(|| cred.user_id()), count)
+        }
+        // wrapped credentials share the device's counter
+        Found::Wrapped(id, key) => (*id, &key.0, None, credentials::bump_device()?),
+    };
+
+    let auth = AuthData::new(rp_id_hash, flags, sign_count);
+    let digest = crypto::sha256(&[auth.as_bytes(), client_data_hash])?;
+    let sig = crypto::p256_sign(private_key, &digest)?;
+
+    let entries = 3 + user_id.is_some() as usize + number_of_credentials.is_some() as usize;
+    w.map(entries)?;
+    w.u8(1)?; // credential
+    w.map(2)?;
+    w.tstr("id")?;
+    w.bstr(id)?;
+    w.tstr("type")?;
+    w.tstr("public-key")?;
+    w.u8(2)?; // authData
+    w.bstr(auth.as_bytes())?;
+    w.u8(3)?; // signature
+    w.bstr(sig.as_bytes())?;
+    if let Some(user_id) = user_id {
+        // the platform needs the user handle to tell accounts apart
+        w.u8(4)?; // user
+        w.map(1)?;
+        w.tstr("id")?;
+        w.bstr(user_id)?;
+    }
+    if let Some(n) = number_of_credentials {
+        w.u8(5)?; // numberOfCredentials
+        w.u64(n as u64)?;
+    }
+    Ok(())
 }
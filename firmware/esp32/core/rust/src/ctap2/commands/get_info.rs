@@ -1,50 +1,73 @@
 use crate::core_api::CoreCtx;
-use crate::ctap2::{cbor, constants, status::CtapStatus};
+use crate::ctap2::{
+    cbor::{ConstWriter, Writer},
+    constants,
+    credentials,
+    pin,
+    status::CtapStatus,
+    types::COSE_ALG_ES256,
+};
 
-const AAGUID: [u8; 16] = [
-    0x52, 0x4f, 0x4f, 0x54, 0x54, 0x41, 0x50, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
-];
+// 135 bytes today; outgrowing it fails const evaluation.
+const ENCODE_CAP: usize = 144;
 
-pub fn handle(_ctx: &mut CoreCtx, _cbor_req: &[u8], out: &mut [u8]) -> Result<usize, CtapStatus> {
-    let mut w = cbor::Writer::new(out);
-
-    w.map(5)?;
-
-    // versions
-    w.u8(1)?;
-    w.array(1)?;
-    w.tstr("FIDO_2_0")?;
-
-    // aaguid
-    w.u8(3)?;
-    w.bstr(&AAGUID)?;
-
-    // options
-    w.u8(4)?;
-    w.map(4)?;
-    w.tstr("rk")?;
-    w.bool(false)?;
-    w.tstr("up")?;
-    w.bool(true)?;
-    w.tstr("uv")?;
-    w.bool(false)?;
-    w.tstr("plat")?;
-    w.bool(false)?;
-
-    // maxMsgSize
-    w.u8(5)?;
-    w.u32(constants::MAX_MSG_SIZE as u32)?;
+// The response only changes with whether a PIN is set, so both forms are
+// encoded at compile time; GetInfo is the first command of every
+// transaction and costs a copy.
+const fn encode(client_pin: bool) -> ConstWriter<ENCODE_CAP> {
+    ConstWriter::new()
+        .map(6)
+        // versions
+        .u64(1)
+        .array(2)
+        .tstr("FIDO_2_0")
+        .tstr("FIDO_2_1")
+        // aaguid
+        .u64(3)
+        .bstr(&constants::AAGUID)
+        // options
+        .u64(4)
+        .map(7)
+        .tstr("rk")
+        .bool(true)
+        .tstr("up")
+        .bool(true)
+        .tstr("uv")
+        .bool(false)
+        .tstr("plat")
+        .bool(false)
+        .tstr("clientPin")
+        .bool(client_pin)
+        .tstr("pinUvAuthToken")
+        .bool(true)
+        // discoverable credentials still need the PIN once one is set
+        .tstr("makeCredUvNotRqd")
+        .bool(true)
+        // maxMsgSize
+        .u64(5)
+        .u64(constants::MAX_MSG_SIZE as u64)
+        // pinUvAuthProtocols
+        .u64(6)
+        .array(1)
+        .u64(pin::PROTOCOL as u64)
+        // algorithms
+        .u64(0x0A)
+        .array(1)
+        .map(2)
+        // Shorter key first for canonical CBOR.
+        .tstr("alg")
+        .int(COSE_ALG_ES256)
+        .tstr("type")
+        .tstr("public-key")
+}
 
-    // algorithms
-    w.u8(0x0A)?;
-    w.array(1)?;
-    w.map(2)?;
-    // Shorter key first for canonical CBOR.
-    w.tstr("alg")?;
-    w.nint(-7)?;
-    w.tstr("type")?;
-    w.tstr("public-key")?;
+const NO_PIN: ConstWriter<ENCODE_CAP> = encode(false);
+const WITH_PIN: ConstWriter<ENCODE_CAP> = encode(true);
 
+pub static RESPONSE_NO_PIN: [u8; NO_PIN.len()] = NO_PIN.to_array();
+pub static RESPONSE_WITH_PIN: [u8; WITH_PIN.len()] = WITH_PIN.to_array();
 
-    Ok(w.len())
+pub fn handle(_ctx: &mut CoreCtx, _cbor_req: &[u8], w: &mut Writer) -> Result<(), CtapStatus> {
+    // the store keeps the PIN in RAM: no flash read here
+    w.bytes(if credentials::pin().is_some() { &RESPONSE_WITH_PIN } else { &RESPONSE_NO_PIN })
 }
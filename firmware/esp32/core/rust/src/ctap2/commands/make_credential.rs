@@ -1,8 +1,158 @@
 use crate::core_api::CoreCtx;
-use crate::ctap2::status::CtapStatus;
+use crate::crypto::{self, SHA256_LEN};
+use crate::ctap2::{
+    auth_data::{AuthData, FLAG_AT, FLAG_UP, FLAG_UV},
+    cbor::{Key, Reader, Writer},
+    credentials::{self, Credential, CRED_ID_LEN},
+    key_wrap::{WrapKeys, WRAPPED_ID_LEN},
+    pin::{self, PERM_MC},
+    status::CtapStatus,
+    types::{cred_params_offer, CredList, Options, RpEntity, UserEntity, COSE_ALG_ES256},
+};
 
-// TODO()
-pub fn handle(_ctx: &mut CoreCtx, _cbor_req: &[u8], _out: &mut [u8]) -> Result<usize, CtapStatus> {
-    // Until implemented, deny.
-    Err(CtapStatus::OperationDenied)
+/// authenticatorMakeCredential (0x01) parameters, borrowed from the request.
+pub struct Request<'a> {
+    pub client_data_hash: &'a [u8],
+    pub rp: RpEntity<'a>,
+    pub user: UserEntity<'a>,
+    pub es256: bool,
+    pub exclude_list: Option<CredList<'a>>,
+    pub extensions: Option<&'a [u8]>,
+    pub options: Options,
+    pub pin_auth: Option<&'a [u8]>,
+    pub pin_protocol: Option<u8>,
+}
+
+impl<'a> Request<'a> {
+    pub fn parse(cbor: &'a [u8]) -> Result<Self, CtapStatus> {
+        let mut r = Reader::new(cbor);
+        let mut client_data_hash = None;
+        let mut rp = None;
+        let mut user = None;
+        let mut es256 = None;
+        let mut exclude_list = None;
+        let mut extensions = None;
+        let mut options = Options::default();
+        let mut pin_auth = None;
+        let mut pin_protocol = None;
+
+        let mut m = r.map()?;
+        while let Some(k) = m.next_key()? {
+            let v = m.value();
+            match k {
+                Key::Int(1) => client_data_hash = Some(v.bytes()?),
+                Key::Int(2) => rp = Some(RpEntity::parse(v)?),
+                Key::Int(3) => user = Some(UserEntity::parse(v)?),
+                Key::Int(4) => es256 = Some(cred_params_offer(v, COSE_ALG_ES256)?),
+                Key::Int(5) => exclude_list = Some(CredList::parse(v)?),
+                Key::Int(6) => extensions = Some(v.raw_value()?),
+                Key::Int(7) => options = Options::parse(v)?,
+                Key::Int(8) => pin_auth = Some(v.bytes()?),
+                Key::Int(9) => pin_protocol = Some(v.u8()?),
+                _ => v.skip()?,
+            }
+        }
+        drop(m);
+        r.finish()?;
+
+        Ok(Self {
+            client_data_hash: client_data_hash.ok_or(CtapStatus::MissingParameter)?,
+            rp: rp.ok_or(CtapStatus::MissingParameter)?,
+            user: user.ok_or(CtapStatus::MissingParameter)?,
+            es256: es256.ok_or(CtapStatus::MissingParameter)?,
+            exclude_list,
+            extensions,
+            options,
+            pin_auth,
+            pin_protocol,
+        })
+    }
+}
+
+/// New ES256 credential with packed self-attestation (signed by the
+/// credential key itself, no attestation certificate).
+pub fn handle(ctx: &mut CoreCtx, cbor_req: &[u8], w: &mut Writer) -> Result<(), CtapStatus> {
+    let req = Request::parse(cbor_req)?;
+    if !req.es256 {
+        return Err(CtapStatus::UnsupportedAlgorithm);
+    }
+    if req.client_data_hash.len() != SHA256_LEN {
+        return Err(CtapStatus::InvalidLength);
+    }
+    if req.options.up == Some(false) {
+        return Err(CtapStatus::InvalidOption);
+    }
+    if req.options.uv == Some(true) {
+        return Err(CtapStatus::UnsupportedOption);
+    }
+    let resident = req.options.rk == Some(true);
+
+    let rp_id_hash = crypto::sha256(&[req.rp.id.as_bytes()])?;
+    ctx.prompt.set_rp(req.rp.id, &rp_id_hash);
+    let uv = pin::verify_request(ctx, req.pin_auth, req.pin_protocol, PERM_MC, &rp_id_hash, req.client_data_hash)?;
+    // makeCredUvNotRqd: only discoverable credentials insist on the PIN
+    if !uv && resident && credentials::pin().is_some() {
+        return Err(CtapStatus::PinRequired);
+    }
+    if let Some(list) = req.exclude_list {
+        let keys = WrapKeys::load()?;
+        let ours = |id: &[u8]| {
+            keys.as_ref().is_some_and(|k| k.unwrap(&rp_id_hash, id).is_some())
+                || credentials::find(&rp_id_hash, id).is_some()
+        };
+        if list.ids().any(ours) {
+            // the user confirms before learning the authenticator is known
+            ctx.check_user_presence()?;
+            return Err(CtapStatus::CredentialExcluded);
+        }
+    }
+    if resident && credentials::is_full() {
+        return Err(CtapStatus::KeyStoreFull);
+    }
+
+    ctx.check_user_presence_enroll()?;
+    pin::commit_request(ctx, uv, &rp_id_hash);
+
+    let kp = crypto::p256_keygen()?;
+    // Discoverable credentials are stored under a random ID; the others
+    // are not stored at all, their ID carries the key.
+    let mut id = [0u8; WRAPPED_ID_LEN];
+    let id_len = if resident {
+        crypto::random(&mut id[..CRED_ID_LEN])?;
+        CRED_ID_LEN
+    } else {
+        id = WrapKeys::load_or_create()?.wrap(&rp_id_hash, &kp.private)?;
+        WRAPPED_ID_LEN
+    };
+    let id = &id[..id_len];
+
+    let flags = FLAG_UP | FLAG_AT | if uv { FLAG_UV } else { 0 };
+    let mut auth = AuthData::new(&rp_id_hash, flags, 0);
+    auth.attest(id, &kp.public)?;
+    let digest = crypto::sha256(&[auth.as_bytes(), req.client_data_hash])?;
+    let sig = crypto::p256_sign(&kp.private, &digest)?;
+
+    if resident {
+        let cred = Credential::new(id.try_into().unwrap(), rp_id_hash, kp.private, req.user.id, true)?;
+        let new = credentials::insert(&cred)?;
+        // one discoverable credential per account: the new one replaces it
+        while let Some(old) = credentials::residents(&rp_id_hash)
+            .filter(|&h| h != new)
+            .find(|&h| credentials::read(h).is_ok_and(|c| c.user_id() == req.user.id))
+        {
+            credentials::delete(old)?;
+        }
+    }
+
+    w.map(3)?;
+    w.u8(1)?; // fmt
+    w.tstr("packed")?;
+    w.u8(2)?; // authData
+    w.bstr(auth.as_bytes())?;
+    w.u8(3)?; // attStmt
+    w.map(2)?;
+    w.tstr("alg")?;
+    w.int(COSE_ALG_ES256)?;
+    w.tstr("sig")?;
+    w.bstr(sig.as_bytes())
 }
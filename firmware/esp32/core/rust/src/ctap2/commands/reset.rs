@@ -1,7 +1,12 @@
-// TODO()
 use crate::core_api::CoreCtx;
-use crate::ctap2::status::CtapStatus;
+use crate::ctap2::{cbor::Writer, credentials, pin::PinState, status::CtapStatus};
 
-pub fn handle(_ctx: &mut CoreCtx, _cbor_req: &[u8], _out: &mut [u8]) -> Result<usize, CtapStatus> {
-    Err(CtapStatus::OperationDenied)
+pub fn handle(ctx: &mut CoreCtx, _cbor_req: &[u8], _w: &mut Writer) -> Result<(), CtapStatus> {
+    // Insist on presence so a host can't wipe credentials silently.
+    ctx.check_user_presence()?;
+    // the PIN goes with the store, its key agreement and token with it,
+    // and nothing the phone approved before outlives the credentials
+    ctx.pin = PinState::new();
+    ctx.grants.clear();
+    credentials::wipe()
 }
@@ -1,7 +1,7 @@
-// TODO()
 use crate::core_api::CoreCtx;
-use crate::ctap2::status::CtapStatus;
+use crate::ctap2::{cbor::Writer, status::CtapStatus};
 
-pub fn handle(_ctx: &mut CoreCtx, _cbor_req: &[u8], _out: &mut [u8]) -> Result<usize, CtapStatus> {
-    Err(CtapStatus::InvalidCommand)
+pub fn handle(ctx: &mut CoreCtx, _cbor_req: &[u8], _w: &mut Writer) -> Result<(), CtapStatus> {
+    ctx.check_user_presence()?;
+    Ok(())
 }
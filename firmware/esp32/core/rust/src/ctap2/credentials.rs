@@ -0,0 +1,204 @@
+// Discoverable credentials made by MakeCredential, kept by the `cred_store`
+// component: a log on the "creds" flash partition with a RAM index by
+// rpIdHash (see components/cred_store/include/cred_store.h). Handles are
+// valid until the next insert or delete. Non-resident credentials are not
+// stored; their IDs carry the key (ctap2::key_wrap) and only the device
+// secret and their shared counter live here, next to the ClientPIN hash and
+// its failed attempts (ctap2::pin).
+use crate::crypto::{PRIV_LEN, SHA256_LEN};
+use crate::ctap2::status::CtapStatus;
+
+pub const CRED_ID_LEN: usize = 16;
+pub const USER_ID_MAX: usize = 64;
+
+/// cred_store_cred_t
+#[repr(C)]
+pub struct Credential {
+    pub id: [u8; CRED_ID_LEN],
+    pub rp_id_hash: [u8; SHA256_LEN],
+    pub private_key: [u8; PRIV_LEN],
+    user_id: [u8; USER_ID_MAX],
+    user_id_len: u8,
+    resident: u8,
+    pub sign_count: u32,
+}
+
+impl Credential {
+    pub fn new(
+        id: [u8; CRED_ID_LEN],
+        rp_id_hash: [u8; SHA256_LEN],
+        private_key: [u8; PRIV_LEN],
+        user_id: &[u8],
+        resident: bool,
+    ) -> Result<Self, CtapStatus> {
+        if user_id.len() > USER_ID_MAX {
+            return Err(CtapStatus::InvalidLength);
+        }
+        let mut c = Self::empty();
+        c.id = id;
+        c.rp_id_hash = rp_id_hash;
+        c.private_key = private_key;
+        c.user_id[..user_id.len()].copy_from_slice(user_id);
+        c.user_id_len = user_id.len() as u8;
+        c.resident = resident as u8;
+        Ok(c)
+    }
+
+    const fn empty() -> Self {
+        Self {
+            id: [0; CRED_ID_LEN],
+            rp_id_hash: [0; SHA256_LEN],
+            private_key: [0; PRIV_LEN],
+            user_id: [0; USER_ID_MAX],
+            user_id_len: 0,
+            resident: 0,
+            sign_count: 0,
+        }
+    }
+
+    pub fn user_id(&self) -> &[u8] {
+        &self.user_id[..self.user_id_len as usize]
+    }
+
+    pub fn is_resident(&self) -> bool {
+        self.resident != 0
+    }
+}
+
+impl Drop for Credential {
+    fn drop(&mut self) {
+        self.private_key.iter_mut().for_each(|b| unsafe { core::ptr::write_volatile(b, 0) });
+    }
+}
+
+#[derive(Copy, Clone, PartialEq, Eq)]
+pub struct Handle(i32);
+
+unsafe extern "C" {
+    fn cred_store_find(rp_id_hash: *const u8, id: *const u8, id_len: usize) -> i32;
+    fn cred_store_next_resident(rp_id_hash: *const u8, after: i32) -> i32;
+    fn cred_store_read(handle: i32, out: *mut Credential) -> i32;
+    fn cred_store_insert(cred: *const Credential) -> i32;
+    fn cred_store_delete(handle: i32) -> i32;
+    fn cred_store_bump(handle: i32, count: *mut u32) -> i32;
+    fn cred_store_wipe() -> i32;
+    fn cred_store_full() -> bool;
+    fn cred_store_device_secret(out: *mut u8) -> i32;
+    fn cred_store_set_device_secret(secret: *const u8) -> i32;
+    fn cred_store_bump_device(count: *mut u32) -> i32;
+    fn cred_store_pin(hash: *mut u8, failures: *mut u32) -> i32;
+    fn cred_store_set_pin(hash: *const u8) -> i32;
+    fn cred_store_pin_attempt(failures: *mut u32) -> i32;
+}
+
+// cred_store.h error returns
+const ERR_FULL: i32 = -2;
+
+fn check(rc: i32) -> Result<i32, CtapStatus> {
+    match rc {
+        0.. => Ok(rc),
+        ERR_FULL => Err(CtapStatus::KeyStoreFull),
+        _ => Err(CtapStatus::Other),
+    }
+}
+
+pub fn is_full() -> bool {
+    unsafe { cred_store_full() }
+}
+
+/// The credential `id` if it was made for `rp_id_hash`.
+pub fn find(rp_id_hash: &[u8; SHA256_LEN], id: &[u8]) -> Option<Handle> {
+    let h = unsafe { cred_store_find(rp_id_hash.as_ptr(), id.as_ptr(), id.len()) };
+    (h >= 0).then_some(Handle(h))
+}
+
+/// Discoverable credentials of an RP, newest first.
+pub fn residents(rp_id_hash: &[u8; SHA256_LEN]) -> Residents<'_> {
+    Residents { rp_id_hash, last: -1 }
+}
+
+pub struct Residents<'a> {
+    rp_id_hash: &'a [u8; SHA256_LEN],
+    last: i32,
+}
+
+impl Iterator for Residents<'_> {
+    type Item = Handle;
+
+    fn next(&mut self) -> Option<Handle> {
+        let h = unsafe { cred_store_next_resident(self.rp_id_hash.as_ptr(), self.last) };
+        if h < 0 {
+            return None;
+        }
+        self.last = h;
+        Some(Handle(h))
+    }
+}
+
+pub fn read(h: Handle) -> Result<Credential, CtapStatus> {
+    let mut c = Credential::empty();
+    check(unsafe { cred_store_read(h.0, &mut c) })?;
+    Ok(c)
+}
+
+pub fn insert(cred: &Credential) -> Result<Handle, CtapStatus> {
+    check(unsafe { cred_store_insert(cred) }).map(Handle)
+}
+
+pub fn delete(h: Handle) -> Result<(), CtapStatus> {
+    check(unsafe { cred_store_delete(h.0) }).map(drop)
+}
+
+/// Advances the signature counter and returns the new value.
+pub fn bump(h: Handle) -> Result<u32, CtapStatus> {
+    let mut count = 0u32;
+    check(unsafe { cred_store_bump(h.0, &mut count) })?;
+    Ok(count)
+}
+
+pub const DEVICE_SECRET_LEN: usize = PRIV_LEN;
+
+/// The secret non-resident credential IDs are wrapped under, from RAM; None
+/// until the first one is made (and again after a reset).
+pub fn device_secret() -> Option<[u8; DEVICE_SECRET_LEN]> {
+    let mut s = [0u8; DEVICE_SECRET_LEN];
+    (unsafe { cred_store_device_secret(s.as_mut_ptr()) } == 0).then_some(s)
+}
+
+pub fn set_device_secret(secret: &[u8; DEVICE_SECRET_LEN]) -> Result<(), CtapStatus> {
+    check(unsafe { cred_store_set_device_secret(secret.as_ptr()) }).map(drop)
+}
+
+/// Advances the counter shared by the wrapped credentials.
+pub fn bump_device() -> Result<u32, CtapStatus> {
+    let mut count = 0u32;
+    check(unsafe { cred_store_bump_device(&mut count) })?;
+    Ok(count)
+}
+
+pub const PIN_HASH_LEN: usize = 16;
+
+/// The PIN hash and the attempts counted as failed since it was stored;
+/// None while no PIN is set.
+pub fn pin() -> Option<([u8; PIN_HASH_LEN], u32)> {
+    let mut hash = [0u8; PIN_HASH_LEN];
+    let mut failures = 0u32;
+    (unsafe { cred_store_pin(hash.as_mut_ptr(), &mut failures) } == 0).then_some((hash, failures))
+}
+
+/// Stores the PIN hash with no failed attempts.
+pub fn set_pin(hash: &[u8; PIN_HASH_LEN]) -> Result<(), CtapStatus> {
+    check(unsafe { cred_store_set_pin(hash.as_ptr()) }).map(drop)
+}
+
+/// Counts one more failed attempt, before the PIN is checked; returns the
+/// new total.
+pub fn pin_attempt() -> Result<u32, CtapStatus> {
+    let mut failures = 0u32;
+    check(unsafe { cred_store_pin_attempt(&mut failures) })?;
+    Ok(failures)
+}
+
+pub fn wipe() -> Result<(), CtapStatus> {
+    check(unsafe { cred_store_wipe() }).map(drop)
+}
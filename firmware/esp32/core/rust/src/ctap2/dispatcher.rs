@@ -1,9 +1,9 @@
-use crate::core_api::CoreCtx;
-use super::{constants::*, status::CtapStatus};
+use crate::core_api::{CoreCtx, Prompt};
+use super::{cbor::Writer, constants::*, status::CtapStatus};
 
 use super::commands;
 
-pub fn dispatch(ctx: &mut CoreCtx, req: &[u8], resp: &mut [u8]) -> Result<usize, CtapStatus> {
+pub fn dispatch(ctx: &mut CoreCtx, req: &[u8], w: &mut Writer) -> Result<usize, CtapStatus> {
     if req.is_empty() {
         return Err(CtapStatus::InvalidLength);
     }
@@ -11,19 +11,27 @@ pub fn dispatch(ctx: &mut CoreCtx, req: &[u8], resp: &mut [u8]) -> Result<usize,
     let cmd = req[0];
     let cbor = &req[1..];
 
-    // CTAP2 over CBOR response format: first byte = status, then CBOR map (optional)
-    // TODO(): write status later; handlers write CBOR payload into resp[1..]
-    resp[0] = CtapStatus::Ok as u8;
+    // CTAP2 over CBOR response format: first byte = status, then CBOR map (optional).
+    // Errors are reported by the caller as a lone status byte; whatever was
+    // already written is discarded.
+    w.bytes(&[CtapStatus::Ok as u8])?;
 
-    let out_len = match cmd {
-        CTAP2_GET_INFO        => commands::get_info::handle(ctx, cbor, &mut resp[1..])?,
-        CTAP2_MAKE_CREDENTIAL => commands::make_credential::handle(ctx, cbor, &mut resp[1..])?,
-        CTAP2_GET_ASSERTION   => commands::get_assertion::handle(ctx, cbor, &mut resp[1..])?,
-        CTAP2_CLIENT_PIN      => commands::client_pin::handle(ctx, cbor, &mut resp[1..])?,
-        CTAP2_RESET           => commands::reset::handle(ctx, cbor, &mut resp[1..])?,
-        CTAP2_SELECTION       => commands::selection::handle(ctx, cbor, &mut resp[1..])?,
+    // GetNextAssertion only continues the GetAssertion right before it
+    if cmd != CTAP2_GET_NEXT_ASSERTION {
+        ctx.next_assertions = None;
+    }
+    ctx.prompt = Prompt::new(cmd);
+
+    match cmd {
+        CTAP2_GET_INFO        => commands::get_info::handle(ctx, cbor, w)?,
+        CTAP2_MAKE_CREDENTIAL => commands::make_credential::handle(ctx, cbor, w)?,
+        CTAP2_GET_ASSERTION   => commands::get_assertion::handle(ctx, cbor, w)?,
+        CTAP2_GET_NEXT_ASSERTION => commands::get_assertion::handle_next(ctx, cbor, w)?,
+        CTAP2_CLIENT_PIN      => commands::client_pin::handle(ctx, cbor, w)?,
+        CTAP2_RESET           => commands::reset::handle(ctx, cbor, w)?,
+        CTAP2_SELECTION       => commands::selection::handle(ctx, cbor, w)?,
         _ => return Err(CtapStatus::InvalidCommand),
-    };
+    }
 
-    Ok(1 + out_len)
+    Ok(w.len())
 }
@@ -0,0 +1,151 @@
+// Presence grants: when the phone approves a request it can also approve
+// what follows, for the request's RP or for any RP on this host, for a
+// number of minutes and optionally a number of uses. A runbook of sudo
+// commands then waits for the phone once; the GetAssertions after it find
+// a grant here and pass the presence check without leaving the core.
+//
+// An enrollment grant is the other kind: it lets MakeCredential for any RP
+// pass the presence check, a fixed number of times, so registering one key
+// with a fleet of hosts waits for the phone once.
+//
+// Grants are RAM only and die with a power cycle, a Reset or a revoke from
+// the phone. Resetting and the ClientPIN presence check always ask.
+use core::sync::atomic::{AtomicU32, Ordering};
+
+use crate::core_api;
+use crate::crypto::SHA256_LEN;
+use crate::ctap2::status::CtapStatus;
+
+/// core_grant_t scopes (see core_api.h).
+pub const SCOPE_RP: u8 = 1;
+pub const SCOPE_HOST: u8 = 2;
+pub const SCOPE_ENROLL: u8 = 3;
+
+/// Grants held at once; a new one replaces the one closest to expiry.
+const GRANT_MAX: usize = 4;
+/// Longest grant the phone can give, however long it asks for.
+const GRANT_MAX_S: u32 = 60 * 60;
+
+/// Since power-up, for core_get_grant_stats.
+pub struct Counters {
+    pub granted: AtomicU32,
+    pub hits: AtomicU32,
+    pub misses: AtomicU32,
+    pub expiries: AtomicU32,
+}
+
+pub static COUNTERS: Counters = Counters {
+    granted: AtomicU32::new(0),
+    hits: AtomicU32::new(0),
+    misses: AtomicU32::new(0),
+    expiries: AtomicU32::new(0),
+};
+
+fn count(c: &AtomicU32) {
+    c.fetch_add(1, Ordering::Relaxed);
+}
+
+#[derive(Clone, Copy)]
+struct Grant {
+    /// MakeCredential rather than GetAssertion
+    enroll: bool,
+    /// None: any RP
+    rp_id_hash: Option<[u8; SHA256_LEN]>,
+    expires_us: u64,
+    /// presence checks left; None: until it expires
+    uses_left: Option<u16>,
+}
+
+pub struct Grants {
+    slots: [Option<Grant>; GRANT_MAX],
+    /// RP of the request parked on the phone, which an RP grant is for.
+    pending_rp: Option<[u8; SHA256_LEN]>,
+}
+
+impl Grants {
+    pub const fn new() -> Self {
+        Self { slots: [None; GRANT_MAX], pending_rp: None }
+    }
+
+    /// Remembers whose request waits for the phone; None for one no grant
+    /// may come from.
+    pub fn set_pending(&mut self, rp_id_hash: Option<&[u8; SHA256_LEN]>) {
+        self.pending_rp = rp_id_hash.copied();
+    }
+
+    /// Uses up a sign-in grant covering the RP, if there is one. Expired
+    /// grants found on the way are dropped.
+    pub fn take(&mut self, rp_id_hash: &[u8; SHA256_LEN]) -> bool {
+        self.take_where(|g| !g.enroll && g.rp_id_hash.as_ref().is_none_or(|h| h == rp_id_hash))
+    }
+
+    /// Uses up an enrollment grant, if there is one.
+    pub fn take_enroll(&mut self) -> bool {
+        self.take_where(|g| g.enroll)
+    }
+
+    fn take_where(&mut self, covers: impl Fn(&Grant) -> bool) -> bool {
+        let now = core_api::now_us();
+        let mut hit = None;
+        for (i, slot) in self.slots.iter_mut().enumerate() {
+            let Some(g) = slot else { continue };
+            if now >= g.expires_us {
+                *slot = None;
+                count(&COUNTERS.expiries);
+            } else if hit.is_none() && covers(g) {
+                hit = Some(i);
+            }
+        }
+        let Some(i) = hit else {
+            count(&COUNTERS.misses);
+            return false;
+        };
+        let slot = &mut self.slots[i];
+        if let Some(Grant { uses_left: Some(n), .. }) = slot {
+            *n -= 1;
+            if *n == 0 {
+                *slot = None;
+            }
+        }
+        count(&COUNTERS.hits);
+        true
+    }
+
+    /// Adds the grant the phone sent with its approval. `uses` 0 means
+    /// only the time limit applies; an enrollment grant must count its uses.
+    pub fn add(&mut self, scope: u8, ttl_s: u32, uses: u16) -> Result<(), CtapStatus> {
+        let rp_id_hash = match scope {
+            SCOPE_RP => Some(self.pending_rp.ok_or(CtapStatus::NotAllowed)?),
+            SCOPE_HOST | SCOPE_ENROLL => None,
+            _ => return Err(CtapStatus::InvalidParameter),
+        };
+        let enroll = scope == SCOPE_ENROLL;
+        if ttl_s == 0 || (enroll && uses == 0) {
+            return Err(CtapStatus::InvalidParameter);
+        }
+        let grant = Grant {
+            enroll,
+            rp_id_hash,
+            expires_us: core_api::now_us() + u64::from(ttl_s.min(GRANT_MAX_S)) * 1_000_000,
+            uses_left: (uses > 0).then_some(uses),
+        };
+
+        // same scope again replaces the old grant, else a free slot, else
+        // the one that would have expired first
+        let same = |g: Grant| g.enroll == enroll && g.rp_id_hash == rp_id_hash;
+        let slot = match self.slots.iter().position(|s| s.is_some_and(same)) {
+            Some(i) => i,
+            None => match self.slots.iter().position(Option::is_none) {
+                Some(i) => i,
+                None => (0..GRANT_MAX).min_by_key(|&i| self.slots[i].map_or(0, |g| g.expires_us)).unwrap_or(0),
+            },
+        };
+        self.slots[slot] = Some(grant);
+        count(&COUNTERS.granted);
+        Ok(())
+    }
+
+    pub fn clear(&mut self) {
+        self.slots = [None; GRANT_MAX];
+    }
+}
@@ -0,0 +1,129 @@
+// Non-resident credentials keep nothing on the device: the credential ID is
+// the private key sealed with AES-256-GCM under a key derived from the
+// device secret, with the rpIdHash as associated data. GetAssertion gets
+// the key back from the allowList in RAM and MakeCredential writes no flash.
+//
+// ID layout (WRAPPED_ID_LEN bytes):
+//   0       VERSION
+//   1..13   nonce, the GCM IV
+//   13..21  check: HMAC-SHA256(mac key, rpIdHash || id[0..13])[..8]
+//   21..53  private key, encrypted
+//   53..69  GCM tag, rpIdHash || VERSION as associated data
+//
+// The check is the fast reject: pam_u2f sends the key handles of every
+// token the user enrolled, and a foreign or other-RP ID then costs the
+// length and version test or one short HMAC instead of a GCM key schedule
+// and decrypt. GCM still decides; the check only has to be cheap and
+// unlikely (2^-64) to pass by chance.
+use crate::crypto::{self, AES_KEY_LEN, GCM_IV_LEN, GCM_TAG_LEN, HMAC_KEY_LEN, PRIV_LEN, SHA256_LEN};
+use crate::ctap2::{credentials, status::CtapStatus};
+
+const VERSION: u8 = 0x01;
+const CHECK_LEN: usize = 8;
+
+const NONCE_AT: usize = 1;
+const CHECK_AT: usize = NONCE_AT + GCM_IV_LEN;
+const KEY_AT: usize = CHECK_AT + CHECK_LEN;
+const TAG_AT: usize = KEY_AT + PRIV_LEN;
+pub const WRAPPED_ID_LEN: usize = TAG_AT + GCM_TAG_LEN;
+
+// labels for the two keys derived from the device secret
+const ENC_LABEL: &[u8] = b"roottap cred-id enc";
+const MAC_LABEL: &[u8] = b"roottap cred-id mac";
+
+fn aad(rp_id_hash: &[u8; SHA256_LEN]) -> [u8; SHA256_LEN + 1] {
+    let mut a = [VERSION; SHA256_LEN + 1];
+    a[..SHA256_LEN].copy_from_slice(rp_id_hash);
+    a
+}
+
+/// A private key out of a credential ID; wiped on drop.
+pub struct PrivateKey(pub [u8; PRIV_LEN]);
+
+impl Drop for PrivateKey {
+    fn drop(&mut self) {
+        self.0.iter_mut().for_each(|b| unsafe { core::ptr::write_volatile(b, 0) });
+    }
+}
+
+pub struct WrapKeys {
+    enc: [u8; AES_KEY_LEN],
+    mac: [u8; HMAC_KEY_LEN],
+}
+
+impl Drop for WrapKeys {
+    fn drop(&mut self) {
+        for k in [&mut self.enc, &mut self.mac] {
+            k.iter_mut().for_each(|b| unsafe { core::ptr::write_volatile(b, 0) });
+        }
+    }
+}
+
+impl WrapKeys {
+    /// Keys under the current device secret; None before the first
+    /// non-resident credential, when no ID can be ours.
+    pub fn load() -> Result<Option<Self>, CtapStatus> {
+        match credentials::device_secret() {
+            Some(secret) => Self::derive(PrivateKey(secret)).map(Some),
+            None => Ok(None),
+        }
+    }
+
+    /// As `load`, making the device secret first if there is none. Writes
+    /// flash then, so only after user presence.
+    pub fn load_or_create() -> Result<Self, CtapStatus> {
+        if let Some(keys) = Self::load()? {
+            return Ok(keys);
+        }
+        let mut secret = PrivateKey([0; PRIV_LEN]);
+        crypto::random(&mut secret.0)?;
+        credentials::set_device_secret(&secret.0)?;
+        Self::derive(secret)
+    }
+
+    fn derive(secret: PrivateKey) -> Result<Self, CtapStatus> {
+        Ok(Self {
+            enc: crypto::hmac_sha256(&secret.0, &[ENC_LABEL])?,
+            mac: crypto::hmac_sha256(&secret.0, &[MAC_LABEL])?,
+        })
+    }
+
+    fn check(&self, rp_id_hash: &[u8; SHA256_LEN], id: &[u8]) -> Result<[u8; SHA256_LEN], CtapStatus> {
+        crypto::hmac_sha256(&self.mac, &[rp_id_hash, &id[..CHECK_AT]])
+    }
+
+    /// Credential ID for a new key pair of the RP.
+    pub fn wrap(&self, rp_id_hash: &[u8; SHA256_LEN], private: &[u8; PRIV_LEN]) -> Result<[u8; WRAPPED_ID_LEN], CtapStatus> {
+        let mut id = [0u8; WRAPPED_ID_LEN];
+        id[0] = VERSION;
+        crypto::random(&mut id[NONCE_AT..CHECK_AT])?;
+        let check = self.check(rp_id_hash, &id)?;
+        id[CHECK_AT..KEY_AT].copy_from_slice(&check[..CHECK_LEN]);
+
+        let iv: [u8; GCM_IV_LEN] = id[NONCE_AT..CHECK_AT].try_into().unwrap();
+        let (body, tag) = id[KEY_AT..].split_at_mut(PRIV_LEN);
+        body.copy_from_slice(private);
+        let t = crypto::aes_gcm_seal(&self.enc, &iv, &aad(rp_id_hash), body)?;
+        tag.copy_from_slice(&t);
+        Ok(id)
+    }
+
+    /// The private key in `id` if this device wrapped it for this RP.
+    pub fn unwrap(&self, rp_id_hash: &[u8; SHA256_LEN], id: &[u8]) -> Option<PrivateKey> {
+        if id.len() != WRAPPED_ID_LEN || id[0] != VERSION {
+            return None;
+        }
+        let check = self.check(rp_id_hash, id).ok()?;
+        // constant time, though GCM would catch a forged check anyway
+        let diff = check[..CHECK_LEN].iter().zip(&id[CHECK_AT..KEY_AT]).fold(0u8, |d, (a, b)| d | (a ^ b));
+        if diff != 0 {
+            return None;
+        }
+
+        let iv: [u8; GCM_IV_LEN] = id[NONCE_AT..CHECK_AT].try_into().unwrap();
+        let tag: [u8; GCM_TAG_LEN] = id[TAG_AT..].try_into().unwrap();
+        let mut key = PrivateKey([0; PRIV_LEN]);
+        key.0.copy_from_slice(&id[KEY_AT..TAG_AT]);
+        crypto::aes_gcm_open(&self.enc, &iv, &aad(rp_id_hash), &mut key.0, &tag).then_some(key)
+    }
+}
@@ -3,5 +3,10 @@ pub mod types;
 pub mod status;
 pub mod dispatcher;
 
+pub mod auth_data;
 pub mod cbor;
+pub mod credentials;
+pub mod grants;
+pub mod key_wrap;
+pub mod pin;
 pub mod commands;
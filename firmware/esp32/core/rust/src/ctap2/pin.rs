@@ -0,0 +1,373 @@
+// PIN/UV auth protocol 2 (CTAP 2.1 §6.5.7) and what ClientPIN keeps between
+// requests: the key agreement key, the last shared secret and the
+// pinUvAuthToken. The PIN hash and its retries live in the credential
+// store (ctap2::credentials), so a power cycle doesn't reset them.
+//
+// A deploy script that runs sudo over and over pays for one PIN check: the
+// token stays valid while it keeps being used, TOKEN_IDLE_US between uses
+// and TOKEN_MAX_US in all. A platform that keeps its own key agreement key
+// (a broker rather than one process per login) gets the shared secret from
+// the cache on its next getPinUvAuthToken instead of another ECDH; the
+// result is the one ECDH would give, so the cache changes cost, not what
+// the protocol accepts.
+use core::sync::atomic::{AtomicU32, Ordering};
+
+use crate::core_api::{self, CoreCtx};
+use crate::crypto::{self, AES_BLOCK_LEN, AES_KEY_LEN, HMAC_KEY_LEN, PRIV_LEN, PUB_LEN, SHA256_LEN};
+use crate::ctap2::{
+    cbor::{Key, Reader, Writer},
+    credentials::{self, PIN_HASH_LEN},
+    status::CtapStatus,
+};
+
+pub const PROTOCOL: u8 = 2;
+pub const TOKEN_LEN: usize = 32;
+
+/// pinUvAuthToken permissions this authenticator grants; the others are
+/// for commands it doesn't have.
+pub const PERM_MC: u8 = 0x01;
+pub const PERM_GA: u8 = 0x02;
+
+/// Wrong PINs before the PIN is blocked for good (a reset clears it).
+pub const MAX_RETRIES: u32 = 8;
+/// Wrong PINs in a row before a power cycle is needed to try again.
+const MAX_MISMATCHES: u8 = 3;
+
+/// A token not used for this long is dropped...
+const TOKEN_IDLE_US: u64 = 30_000_000;
+/// ...and none outlives this, however busy.
+const TOKEN_MAX_US: u64 = 600_000_000;
+
+const HMAC_LABEL: &[u8] = b"CTAP2 HMAC key";
+const AES_LABEL: &[u8] = b"CTAP2 AES key";
+
+/// Since power-up, for core_get_pin_stats.
+pub struct Counters {
+    pub key_agreements: AtomicU32,
+    pub secrets_reused: AtomicU32,
+    pub pin_checks: AtomicU32,
+    pub pin_failures: AtomicU32,
+    pub tokens_issued: AtomicU32,
+    pub token_hits: AtomicU32,
+    pub token_misses: AtomicU32,
+}
+
+pub static COUNTERS: Counters = Counters {
+    key_agreements: AtomicU32::new(0),
+    secrets_reused: AtomicU32::new(0),
+    pin_checks: AtomicU32::new(0),
+    pin_failures: AtomicU32::new(0),
+    tokens_issued: AtomicU32::new(0),
+    token_hits: AtomicU32::new(0),
+    token_misses: AtomicU32::new(0),
+};
+
+fn count(c: &AtomicU32) {
+    c.fetch_add(1, Ordering::Relaxed);
+}
+
+fn wipe(b: &mut [u8]) {
+    b.iter_mut().for_each(|b| unsafe { core::ptr::write_volatile(b, 0) });
+}
+
+fn ct_eq(a: &[u8], b: &[u8]) -> bool {
+    a.len() == b.len() && a.iter().zip(b).fold(0u8, |d, (x, y)| d | (x ^ y)) == 0
+}
+
+/// The two keys protocol 2 derives from the ECDH result.
+#[derive(Clone)]
+pub struct SharedSecret {
+    hmac: [u8; HMAC_KEY_LEN],
+    aes: [u8; AES_KEY_LEN],
+}
+
+impl Drop for SharedSecret {
+    fn drop(&mut self) {
+        wipe(&mut self.hmac);
+        wipe(&mut self.aes);
+    }
+}
+
+impl SharedSecret {
+    /// HKDF-SHA-256 with an all-zero salt, one output block per key.
+    fn derive(z: &[u8; PRIV_LEN]) -> Result<Self, CtapStatus> {
+        let mut prk = crypto::hmac_sha256(&[0; HMAC_KEY_LEN], &[z])?;
+        let keys = Self {
+            hmac: crypto::hmac_sha256(&prk, &[HMAC_LABEL, &[1]])?,
+            aes: crypto::hmac_sha256(&prk, &[AES_LABEL, &[1]])?,
+        };
+        wipe(&mut prk);
+        Ok(keys)
+    }
+
+    /// pinUvAuthParam over the concatenation of `parts`.
+    pub fn verify(&self, parts: &[&[u8]], param: &[u8]) -> Result<(), CtapStatus> {
+        let mac = crypto::hmac_sha256(&self.hmac, parts)?;
+        if ct_eq(&mac, param) { Ok(()) } else { Err(CtapStatus::PinAuthInvalid) }
+    }
+
+    /// IV || ciphertext into `out`, which must be exactly as long as the
+    /// plaintext.
+    pub fn decrypt(&self, data: &[u8], out: &mut [u8]) -> Result<(), CtapStatus> {
+        if data.len() != AES_BLOCK_LEN + out.len() || out.len() % AES_BLOCK_LEN != 0 {
+            return Err(CtapStatus::InvalidParameter);
+        }
+        let (iv, body) = data.split_at(AES_BLOCK_LEN);
+        out.copy_from_slice(body);
+        crypto::aes_cbc_decrypt(&self.aes, iv.try_into().unwrap(), out)
+    }
+
+    /// Writes the token encrypted under a fresh IV, as a byte string.
+    fn write_encrypted(&self, token: &[u8; TOKEN_LEN], w: &mut Writer) -> Result<(), CtapStatus> {
+        let mut out = [0u8; AES_BLOCK_LEN + TOKEN_LEN];
+        let (iv, body) = out.split_at_mut(AES_BLOCK_LEN);
+        crypto::random(iv)?;
+        body.copy_from_slice(token);
+        let iv: [u8; AES_BLOCK_LEN] = (*iv).try_into().unwrap();
+        let rc = crypto::aes_cbc_encrypt(&self.aes, &iv, body).and_then(|_| w.bstr(&out));
+        wipe(&mut out);
+        rc
+    }
+}
+
+/// The platform's key agreement key: a COSE_Key with kty EC2 on P-256.
+pub fn parse_cose_key(raw: &[u8]) -> Result<[u8; PUB_LEN], CtapStatus> {
+    let mut r = Reader::new(raw);
+    let mut kty = None;
+    let mut crv = None;
+    let mut x = None;
+    let mut y = None;
+    let mut m = r.map()?;
+    while let Some(k) = m.next_key()? {
+        let v = m.value();
+        match k {
+            Key::Int(1) => kty = Some(v.int()?),
+            Key::Int(-1) => crv = Some(v.int()?),
+            Key::Int(-2) => x = Some(v.bytes()?),
+            Key::Int(-3) => y = Some(v.bytes()?),
+            _ => v.skip()?,
+        }
+    }
+    drop(m);
+    let (x, y) = (x.ok_or(CtapStatus::MissingParameter)?, y.ok_or(CtapStatus::MissingParameter)?);
+    if kty != Some(2) || crv != Some(1) || x.len() != 32 || y.len() != 32 {
+        return Err(CtapStatus::InvalidParameter);
+    }
+    let mut public = [0u8; PUB_LEN];
+    public[..32].copy_from_slice(x);
+    public[32..].copy_from_slice(y);
+    Ok(public)
+}
+
+struct Token {
+    key: [u8; TOKEN_LEN],
+    permissions: u8,
+    /// set by getPinUvAuthToken's rpId, else by the first use
+    rp_id_hash: Option<[u8; SHA256_LEN]>,
+    idle_deadline_us: u64,
+    end_us: u64,
+}
+
+impl Drop for Token {
+    fn drop(&mut self) {
+        wipe(&mut self.key);
+    }
+}
+
+struct AgreementKey {
+    private: [u8; PRIV_LEN],
+    public: [u8; PUB_LEN],
+}
+
+impl Drop for AgreementKey {
+    fn drop(&mut self) {
+        wipe(&mut self.private);
+    }
+}
+
+/// ClientPIN state in RAM; all of it goes with a power cycle or a reset.
+pub struct PinState {
+    /// made on first use, so boot doesn't wait for a key pair
+    agreement: Option<AgreementKey>,
+    /// the last platform key and what it agreed on
+    shared: Option<([u8; PUB_LEN], SharedSecret)>,
+    token: Option<Token>,
+    /// wrong PINs in a row since power-up
+    mismatches: u8,
+}
+
+impl PinState {
+    pub const fn new() -> Self {
+        Self { agreement: None, shared: None, token: None, mismatches: 0 }
+    }
+
+    /// x || y of the authenticator's key agreement key.
+    pub fn agreement_public(&mut self) -> Result<[u8; PUB_LEN], CtapStatus> {
+        if self.agreement.is_none() {
+            let mut kp = crypto::p256_keygen()?;
+            self.agreement = Some(AgreementKey { private: kp.private, public: kp.public });
+            wipe(&mut kp.private);
+        }
+        Ok(self.agreement.as_ref().unwrap().public)
+    }
+
+    /// Protocol 2 keys shared with `peer`, from the cache when the platform
+    /// reuses its key.
+    pub fn shared_secret(&mut self, peer: &[u8; PUB_LEN]) -> Result<SharedSecret, CtapStatus> {
+        if let Some((key, secret)) = &self.shared {
+            if key == peer {
+                count(&COUNTERS.secrets_reused);
+                return Ok(secret.clone());
+            }
+        }
+        // the platform can't have agreed on a key we haven't handed out yet
+        let agreement = self.agreement.as_ref().ok_or(CtapStatus::PinAuthInvalid)?;
+        let mut z = crypto::p256_ecdh(&agreement.private, peer).ok_or(CtapStatus::InvalidParameter)?;
+        count(&COUNTERS.key_agreements);
+        let secret = SharedSecret::derive(&z);
+        wipe(&mut z);
+        let secret = secret?;
+        self.shared = Some((*peer, secret.clone()));
+        Ok(secret)
+    }
+
+    /// What CTAP asks for after a wrong PIN, and on a PIN change or reset:
+    /// a new key agreement key (so the platform must agree afresh) and no
+    /// token.
+    pub fn regenerate(&mut self) {
+        self.agreement = None;
+        self.shared = None;
+        self.token = None;
+    }
+
+    pub fn auth_blocked(&self) -> bool {
+        self.mismatches >= MAX_MISMATCHES
+    }
+
+    /// Checks the PIN hash the platform sent against the stored one. The
+    /// attempt is counted in flash first and cleared again on success.
+    pub fn check_pin(&mut self, secret: &SharedSecret, pin_hash_enc: &[u8]) -> Result<(), CtapStatus> {
+        let (stored, _) = credentials::pin().ok_or(CtapStatus::PinNotSet)?;
+        let mut sent = [0u8; PIN_HASH_LEN];
+        secret.decrypt(pin_hash_enc, &mut sent)?;
+        let failures = credentials::pin_attempt()?;
+        count(&COUNTERS.pin_checks);
+        let ok = ct_eq(&sent, &stored);
+        wipe(&mut sent);
+        if !ok {
+            count(&COUNTERS.pin_failures);
+            self.regenerate();
+            self.mismatches = self.mismatches.saturating_add(1);
+            return Err(if failures >= MAX_RETRIES {
+                CtapStatus::PinBlocked
+            } else if self.auth_blocked() {
+                CtapStatus::PinAuthBlocked
+            } else {
+                CtapStatus::PinInvalid
+            });
+        }
+        self.mismatches = 0;
+        credentials::set_pin(&stored)
+    }
+
+    /// A new pinUvAuthToken, replacing any other, written encrypted.
+    pub fn issue_token(
+        &mut self,
+        secret: &SharedSecret,
+        permissions: u8,
+        rp_id_hash: Option<[u8; SHA256_LEN]>,
+        w: &mut Writer,
+    ) -> Result<(), CtapStatus> {
+        let now = core_api::now_us();
+        let mut t = Token {
+            key: [0; TOKEN_LEN],
+            permissions,
+            rp_id_hash,
+            idle_deadline_us: now + TOKEN_IDLE_US,
+            end_us: now + TOKEN_MAX_US,
+        };
+        crypto::random(&mut t.key)?;
+        secret.write_encrypted(&t.key, w)?;
+        self.token = Some(t);
+        count(&COUNTERS.tokens_issued);
+        Ok(())
+    }
+
+    /// Verifies pinUvAuthParam over `client_data_hash` with the token and
+    /// checks it may do `permission` for the RP. Changes nothing but
+    /// dropping an expired token: a request parked on presence runs this
+    /// again when it is replayed.
+    fn check_token(
+        &mut self,
+        permission: u8,
+        rp_id_hash: &[u8; SHA256_LEN],
+        client_data_hash: &[u8],
+        param: &[u8],
+    ) -> Result<(), CtapStatus> {
+        let now = core_api::now_us();
+        if self.token.as_ref().is_some_and(|t| now >= t.idle_deadline_us.min(t.end_us)) {
+            self.token = None;
+        }
+        let t = self.token.as_ref().ok_or(CtapStatus::PinAuthInvalid)?;
+        let mac = crypto::hmac_sha256(&t.key, &[client_data_hash])?;
+        if !ct_eq(&mac, param) {
+            return Err(CtapStatus::PinAuthInvalid);
+        }
+        if t.permissions & permission == 0 || t.rp_id_hash.is_some_and(|h| &h != rp_id_hash) {
+            return Err(CtapStatus::UnauthorizedPermission);
+        }
+        Ok(())
+    }
+
+    /// Records a use check_token passed: binds the token to the RP and
+    /// keeps it alive for another TOKEN_IDLE_US.
+    fn commit_token(&mut self, rp_id_hash: &[u8; SHA256_LEN]) {
+        if let Some(t) = self.token.as_mut() {
+            t.rp_id_hash = Some(*rp_id_hash);
+            t.idle_deadline_us = core_api::now_us() + TOKEN_IDLE_US;
+        }
+    }
+}
+
+/// pinUvAuthParam handling shared by MakeCredential and GetAssertion.
+/// Ok(true) when the token verified and the response may set UV, Ok(false)
+/// when there was none. Call before user presence so a bad token costs no
+/// touch; it leaves the token as it was, so once presence is settled call
+/// commit_request to count the use.
+pub fn verify_request(
+    ctx: &mut CoreCtx,
+    param: Option<&[u8]>,
+    protocol: Option<u8>,
+    permission: u8,
+    rp_id_hash: &[u8; SHA256_LEN],
+    client_data_hash: &[u8],
+) -> Result<bool, CtapStatus> {
+    let Some(param) = param else {
+        return Ok(false);
+    };
+    // An empty one asks which authenticator the user means and whether it
+    // has a PIN; platforms send it before collecting the PIN.
+    if param.is_empty() {
+        ctx.check_user_presence()?;
+        return Err(if credentials::pin().is_some() { CtapStatus::PinInvalid } else { CtapStatus::PinNotSet });
+    }
+    match protocol {
+        None => return Err(CtapStatus::MissingParameter),
+        Some(PROTOCOL) => {}
+        Some(_) => return Err(CtapStatus::InvalidParameter),
+    }
+    ctx.pin.check_token(permission, rp_id_hash, client_data_hash, param).inspect_err(|_| {
+        // a miss ends the request, so it is never replayed
+        count(&COUNTERS.token_misses);
+    })?;
+    Ok(true)
+}
+
+/// The second half of verify_request, for the pass that completes the
+/// request (not one parked on presence): `uv` as verify_request returned.
+pub fn commit_request(ctx: &mut CoreCtx, uv: bool, rp_id_hash: &[u8; SHA256_LEN]) {
+    if uv {
+        ctx.pin.commit_token(rp_id_hash);
+        count(&COUNTERS.token_hits);
+    }
+}
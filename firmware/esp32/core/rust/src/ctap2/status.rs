@@ -16,12 +16,35 @@ pub enum CtapStatus {
     CborUnexpectedType = 0x11,
     InvalidCbor = 0x12,
     MissingParameter = 0x14,
+    CredentialExcluded = 0x19,
 
+    UnsupportedAlgorithm = 0x26,
     OperationDenied = 0x27,
     KeyStoreFull = 0x28,
+    UnsupportedOption = 0x2B,
+    InvalidOption = 0x2C,
+    KeepaliveCancel = 0x2D,
     NoCredentials = 0x2E,
+    UserActionTimeout = 0x2F,
+    NotAllowed = 0x30,
+
+    PinInvalid = 0x31,
+    PinBlocked = 0x32,
+    PinAuthInvalid = 0x33,
+    PinAuthBlocked = 0x34,
+    PinNotSet = 0x35,
+    PinRequired = 0x36,
+    PinPolicyViolation = 0x37,
+    InvalidSubcommand = 0x3E,
+    UnauthorizedPermission = 0x40,
 
     Other = 0x7F,
+
+    // Vendor range, never sent on the wire: the request is parked until the
+    // HID layer reports a user-presence verdict and calls us again.
+    UserPresencePending = 0xF0,
+    // Another request is parked on presence; nothing was changed.
+    UserPresenceBusy = 0xF1,
 }
 
 impl CtapStatus {
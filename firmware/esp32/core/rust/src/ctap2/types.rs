@@ -1 +1,187 @@
-// TODO(): CTAP2 shared request/response structs.
+// CTAP2 request building blocks shared by the command parsers. Everything
+// borrows from the request buffer; lists stay encoded and are walked lazily.
+use crate::ctap2::{
+    cbor::{Key, Reader},
+    status::CtapStatus,
+};
+
+/// COSE algorithm identifier for ES256 (ECDSA P-256 with SHA-256).
+pub const COSE_ALG_ES256: i64 = -7;
+
+pub struct RpEntity<'a> {
+    pub id: &'a str,
+    pub name: Option<&'a str>,
+}
+
+impl<'a> RpEntity<'a> {
+    pub fn parse(r: &mut Reader<'a>) -> Result<Self, CtapStatus> {
+        let mut id = None;
+        let mut name = None;
+        let mut m = r.map()?;
+        while let Some(k) = m.next_key()? {
+            match k {
+                Key::Text("id") => id = Some(m.value().text()?),
+                Key::Text("name") => name = Some(m.value().text()?),
+                _ => m.skip_value()?,
+            }
+        }
+        Ok(Self { id: id.ok_or(CtapStatus::MissingParameter)?, name })
+    }
+}
+
+pub struct UserEntity<'a> {
+    pub id: &'a [u8],
+    pub name: Option<&'a str>,
+    pub display_name: Option<&'a str>,
+}
+
+impl<'a> UserEntity<'a> {
+    pub fn parse(r: &mut Reader<'a>) -> Result<Self, CtapStatus> {
+        let mut id = None;
+        let mut name = None;
+        let mut display_name = None;
+        let mut m = r.map()?;
+        while let Some(k) = m.next_key()? {
+            match k {
+                Key::Text("id") => id = Some(m.value().bytes()?),
+                Key::Text("name") => name = Some(m.value().text()?),
+                Key::Text("displayName") => display_name = Some(m.value().text()?),
+                _ => m.skip_value()?,
+            }
+        }
+        let id = id.ok_or(CtapStatus::MissingParameter)?;
+        if id.len() > 64 {
+            return Err(CtapStatus::InvalidLength);
+        }
+        Ok(Self { id, name, display_name })
+    }
+}
+
+/// Whether pubKeyCredParams offers a public-key credential with `alg`.
+pub fn cred_params_offer(r: &mut Reader<'_>, alg: i64) -> Result<bool, CtapStatus> {
+    let mut found = false;
+    let mut a = r.array()?;
+    while let Some(item) = a.next() {
+        let mut alg_v = None;
+        let mut public_key = false;
+        let mut m = item.map()?;
+        while let Some(k) = m.next_key()? {
+            match k {
+                Key::Text("alg") => alg_v = Some(m.value().int()?),
+                Key::Text("type") => public_key = m.value().text()? == "public-key",
+                _ => m.skip_value()?,
+            }
+        }
+        let alg_v = alg_v.ok_or(CtapStatus::MissingParameter)?;
+        found |= public_key && alg_v == alg;
+    }
+    Ok(found)
+}
+
+/// allowList / excludeList: validated once while parsing the request, kept
+/// encoded and decoded again per lookup.
+#[derive(Copy, Clone)]
+pub struct CredList<'a> {
+    raw: &'a [u8],
+    len: usize,
+}
+
+impl<'a> CredList<'a> {
+    pub fn parse(r: &mut Reader<'a>) -> Result<Self, CtapStatus> {
+        // shape check now so iteration can't fail later
+        let start = r.position();
+        let mut a = r.array()?;
+        let len = a.len();
+        while let Some(item) = a.next() {
+            CredDescriptor::parse(item)?;
+        }
+        drop(a);
+        Ok(Self { raw: r.since(start), len })
+    }
+
+    pub fn len(&self) -> usize {
+        self.len
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.len == 0
+    }
+
+    /// Credential IDs of public-key descriptors, in list order.
+    pub fn ids(&self) -> CredIds<'a> {
+        let mut r = Reader::new(self.raw);
+        // parse() already checked the whole list
+        let left = r.array_head().unwrap_or(0);
+        CredIds { r, left }
+    }
+}
+
+pub struct CredIds<'a> {
+    r: Reader<'a>,
+    left: usize,
+}
+
+impl<'a> Iterator for CredIds<'a> {
+    type Item = &'a [u8];
+
+    fn next(&mut self) -> Option<&'a [u8]> {
+        while self.left > 0 {
+            self.left -= 1;
+            let d = CredDescriptor::parse(&mut self.r).ok()?;
+            if d.public_key {
+                return Some(d.id);
+            }
+        }
+        None
+    }
+}
+
+pub struct CredDescriptor<'a> {
+    pub id: &'a [u8],
+    pub public_key: bool,
+}
+
+impl<'a> CredDescriptor<'a> {
+    pub fn parse(r: &mut Reader<'a>) -> Result<Self, CtapStatus> {
+        let mut id = None;
+        let mut ty = None;
+        let mut m = r.map()?;
+        while let Some(k) = m.next_key()? {
+            match k {
+                Key::Text("id") => id = Some(m.value().bytes()?),
+                Key::Text("type") => ty = Some(m.value().text()?),
+                _ => m.skip_value()?,
+            }
+        }
+        Ok(Self {
+            id: id.ok_or(CtapStatus::MissingParameter)?,
+            public_key: ty.ok_or(CtapStatus::MissingParameter)? == "public-key",
+        })
+    }
+}
+
+/// Request options map; absent keys stay None so handlers apply their own
+/// defaults.
+#[derive(Copy, Clone, Default)]
+pub struct Options {
+    pub rk: Option<bool>,
+    pub up: Option<bool>,
+    pub uv: Option<bool>,
+}
+
+impl Options {
+    pub fn parse(r: &mut Reader<'_>) -> Result<Self, CtapStatus> {
+        let mut o = Self::default();
+        let mut m = r.map()?;
+        while let Some(k) = m.next_key()? {
+            let v = m.value().bool()?;
+            match k {
+                Key::Text("rk") => o.rk = Some(v),
+                Key::Text("up") => o.up = Some(v),
+                Key::Text("uv") => o.uv = Some(v),
+                _ => {}
+            }
+        }
+        Ok(o)
+    }
+}
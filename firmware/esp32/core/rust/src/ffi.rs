@@ -3,7 +3,7 @@
 use core::panic::PanicInfo;
 use core::ffi::c_uchar;
 
-use crate::core_api;
+use crate::core_api::{self, CoreSink, GrantSpec, GrantStats, PinStats, Prompt};
 
 #[panic_handler]
 fn panic(_: &PanicInfo) -> ! { loop {} }
@@ -38,3 +38,57 @@ pub extern "C" fn core_handle_request(
 ) -> i32 {
     core_api::handle_request(ctx_mem, ctx_mem_len, req, req_len, resp, resp_cap, out_resp_len)
 }
+
+/// Same as core_handle_request, but the response is encoded straight into
+/// the chunks handed out by `sink` (e.g. CTAPHID IN report payloads).
+#[unsafe(no_mangle)]
+pub extern "C" fn core_handle_request_stream(
+    ctx_mem: *mut u8,
+    ctx_mem_len: usize,
+    req: *const c_uchar,
+    req_len: usize,
+    sink: *const CoreSink,
+    out_resp_len: *mut usize,
+) -> i32 {
+    core_api::handle_request_stream(ctx_mem, ctx_mem_len, req, req_len, sink, out_resp_len)
+}
+
+/// Hand the user-presence verdict for a parked request to the core.
+#[unsafe(no_mangle)]
+pub extern "C" fn core_set_user_presence(ctx_mem: *mut u8, ctx_mem_len: usize, result: i32) -> i32 {
+    core_api::set_user_presence(ctx_mem, ctx_mem_len, result)
+}
+
+/// ClientPIN counters since power-up; safe from any task.
+#[unsafe(no_mangle)]
+pub extern "C" fn core_get_pin_stats(out: *mut PinStats) {
+    if !out.is_null() {
+        unsafe { out.write(core_api::pin_stats()) };
+    }
+}
+
+/// Add a presence grant along with the approval of the parked request.
+#[unsafe(no_mangle)]
+pub extern "C" fn core_grant_presence(ctx_mem: *mut u8, ctx_mem_len: usize, grant: *const GrantSpec) -> i32 {
+    core_api::grant_presence(ctx_mem, ctx_mem_len, grant)
+}
+
+/// What the parked request asks presence for.
+#[unsafe(no_mangle)]
+pub extern "C" fn core_up_prompt(ctx_mem: *mut u8, ctx_mem_len: usize, out: *mut Prompt) -> i32 {
+    core_api::up_prompt(ctx_mem, ctx_mem_len, out)
+}
+
+/// Drop every presence grant.
+#[unsafe(no_mangle)]
+pub extern "C" fn core_revoke_grants(ctx_mem: *mut u8, ctx_mem_len: usize) -> i32 {
+    core_api::revoke_grants(ctx_mem, ctx_mem_len)
+}
+
+/// Grant counters since power-up; safe from any task.
+#[unsafe(no_mangle)]
+pub extern "C" fn core_get_grant_stats(out: *mut GrantStats) {
+    if !out.is_null() {
+        unsafe { out.write(core_api::grant_stats()) };
+    }
+}
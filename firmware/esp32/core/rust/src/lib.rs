@@ -1,5 +1,6 @@
 #![no_std]
 
 pub mod core_api;
+pub mod crypto;
 pub mod ctap2;
 mod ffi;
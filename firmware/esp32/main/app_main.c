@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <string.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 
@@ -9,9 +10,16 @@
 #include "esp_log.h"
 
 #include "core_api.h"
+#include "crypto.h"
+#include "cred_store.h"
 #include "usb_hid.h"
 #include "ctaphid.h"
+#include "ctaphid_task.h"
 // #include "usb_cdc_cmd.h"
+#if CONFIG_CTAPHID_BENCH_CDC
+#include "usb_cdc_cmd.h"
+#include "ctaphid_bench_cdc.h"
+#endif
 
 static const char *TAG = "main";
 
@@ -33,14 +41,57 @@ static void init_nvs(void)
 
 static ctaphid_ctx_t s_ctap;
 
-static int send_report(void *user, const uint8_t *r64) {
+static uint8_t *tx_reserve(void *user) {
     (void)user;
-    return usb_hid_send_report(r64, USB_HID_REPORT_LEN);
+    return usb_hid_tx_reserve();
 }
 
+static int tx_commit(void *user) {
+    (void)user;
+    return usb_hid_tx_commit();
+}
+
+static void tx_abort(void *user) {
+    (void)user;
+    usb_hid_tx_abort();
+}
+
+// What the parked request wants, for the phone to show. Written by the
+// CTAPHID worker before EV_REQUEST, read by the approval loop after it;
+// only one request parks at a time.
+static approval_ctx_t s_prompt;
+
+// Called from the CTAPHID worker when a request parks on the presence gate;
+// the approval loop in app_main picks it up like a button press.
+static void request_user_presence(void *user, uint32_t cid) {
+    (void)user;
+    ESP_LOGI(TAG, "UP needed cid=%08x", (unsigned)cid);
+    core_up_prompt_t p;
+    memset(&s_prompt, 0, sizeof(s_prompt));
+    if (ctaphid_up_prompt(&s_ctap, &p) == 0) {
+        s_prompt.command = p.command;
+        s_prompt.has_rp = p.has_rp != 0;
+        memcpy(s_prompt.rp_id_hash, p.rp_id_hash, sizeof(s_prompt.rp_id_hash));
+        s_prompt.rp_id_len = p.rp_id_len < APPROVAL_RP_MAX ? p.rp_id_len : APPROVAL_RP_MAX;
+        memcpy(s_prompt.rp_id, p.rp_id, s_prompt.rp_id_len);
+    }
+    uint32_t park = ctaphid_up_park_id(&s_ctap);
+    if (!button_publish((button_event_t){ .type = EV_REQUEST, .park = park })) {
+        ctaphid_task_post_up(park, false);
+    }
+}
+
+// Called from the CTAPHID worker when the parked request ends, answered or
+// not: the phone must not be left with a request that can still approve.
+static void presence_done(void *user, uint32_t park) {
+    (void)user;
+    button_ble_approval_done(park);
+}
+
+// Runs in the TinyUSB task: hand the frame to the CTAPHID worker and return.
 static void on_usb_out(void *user, const uint8_t *report, size_t len) {
     (void)user;
-    ctaphid_on_report(&s_ctap, report, len);
+    (void)ctaphid_task_post_report(report, len);
 }
 
 
@@ -50,12 +101,30 @@ void app_main(void)
     // IMPORTANT: don’t require BOOT during startup (GPIO0 is a strapping pin)
     vTaskDelay(pdMS_TO_TICKS(1500));
     init_nvs();
+    if (cred_store_init() != 0) {
+        ESP_LOGE(TAG, "credential store init failed");
+    }
+    button_init();
 
     ctaphid_io_t io = {
-        .send_report = send_report,
-        .send_user = NULL,
+        .tx_reserve = tx_reserve,
+        .tx_commit = tx_commit,
+        .tx_abort = tx_abort,
+        .tx_user = NULL,
+        .up_request = request_user_presence,
+        .up_done = presence_done,
+        .up_user = NULL,
     };
+    // curve tables now rather than on the first MakeCredential, then keep
+    // key pairs and signing nonces precomputed while idle
+    if (crypto_init() != 0 || crypto_pool_task_start() != 0) {
+        ESP_LOGE(TAG, "crypto init failed");
+    }
     ctaphid_init(&s_ctap, &io);
+    if (ctaphid_task_start(&s_ctap) != 0) {
+        ESP_LOGE(TAG, "ctaphid_task_start failed");
+        return;
+    }
 
                 ESP_LOGI(TAG, "before hid");
     // ESP_ERROR_CHECK(usb_hid_init(on_usb_out, NULL));
@@ -66,64 +135,66 @@ void app_main(void)
         ESP_LOGE(TAG, "usb_hid_init failed");
         return;
     }
+#if CONFIG_CTAPHID_BENCH_CDC
+    ctaphid_bench_cdc_register();
+    usb_cdc_cmd_start();
+#else
     // usb_cdc_cmd_start();
+#endif
 
 
 
-    button_init();
     ESP_ERROR_CHECK(button_gpio_init());
 
-
-    // led_t led;
-    // led_init(&led, LED_GPIO, true);
-
-    // vTaskDelay(pdMS_TO_TICKS(500));
-    // ESP_ERROR_CHECK(button_ble_init());
-
-    // QueueHandle_t q = button_get_event_queue();
-    // button_event_t ev;
-
-    // const TickType_t pending_timeout_ticks = pdMS_TO_TICKS(20000);  // timeout for awaiting approval
-    // bool pending = false;
-    // TickType_t pending_since = 0;
-
-
-    // while (1) {
-    //     TickType_t wait_ticks = portMAX_DELAY;
-    //     if (pending) {
-    //         TickType_t elapsed = xTaskGetTickCount() - pending_since;
-    //         wait_ticks = (elapsed < pending_timeout_ticks)
-    //                          ? (pending_timeout_ticks - elapsed)
-    //                          : 0;
-    //     }
-
-    //     if (xQueueReceive(q, &ev, wait_ticks)) {
-
-    //         if (ev.type == EV_REQUEST && !pending) {
-    //             pending = true;
-    //             pending_since = xTaskGetTickCount();
-    //             ESP_LOGI(TAG, "Request -> notify phone");
-    //             esp_err_t err = button_ble_request_approval();   // notify phone
-    //             if (err != ESP_OK) {
-    //                 pending = false;  // <-- critical: don’t get stuck
-    //                 ESP_LOGI(TAG, "Request canceled: %s", esp_err_to_name(err));
-    //                 // optional: blink LED / buzz to show “no phone”
-    //             }
-    //         }
-
-    //         if (ev.type == EV_APPROVE && pending) {
-    //             pending = false;
-    //             led_toggle(&led);                // toggle ONLY here
-    //         }
-
-    //         if (ev.type == EV_DENY && pending) {
-    //             pending = false;
-    //             ESP_LOGI(TAG, "Request -> denied");
-    //             // optional: indicate deny
-    //         }
-    //     } else if (pending) {
-    //         pending = false;
-    //         ESP_LOGI(TAG, "Request -> timeout, no response");
-    //     }
-    // }
+    led_t led;
+    led_init(&led, LED_GPIO, true);
+
+    vTaskDelay(pdMS_TO_TICKS(500));
+    ESP_ERROR_CHECK(button_ble_init());
+
+    QueueHandle_t q = button_get_event_queue();
+    button_event_t ev;
+
+    // Approval loop. Timeouts, KEEPALIVE and dropping a verdict for a park
+    // that has ended live in ctaphid; this only bridges button/BLE events.
+    while (1) {
+        if (!xQueueReceive(q, &ev, portMAX_DELAY)) continue;
+
+        if (ev.type == EV_REQUEST) {
+            ESP_LOGI(TAG, "Request -> notify phone");
+            esp_err_t err = button_ble_request_approval(&s_prompt, ev.park);   // notify phone
+            if (err != ESP_OK) {
+                // BLE not up: fail the request now instead of letting it time
+                // out (a phone that isn't connected yet is waited for)
+                ESP_LOGI(TAG, "Request canceled: %s", esp_err_to_name(err));
+                ctaphid_task_post_up(ev.park, false);
+            }
+        }
+
+        if (ev.type == EV_APPROVE) {
+            led_toggle(&led);
+            if (ev.grant != GRANT_NONE && ev.grant_minutes > 0) {
+                ESP_LOGI(TAG, "Request -> approved, grant scope=%d for %u min / %u uses",
+                         (int)ev.grant, (unsigned)ev.grant_minutes, (unsigned)ev.grant_uses);
+                core_grant_t grant = {
+                    .scope = (uint8_t)ev.grant,
+                    .uses = ev.grant_uses,
+                    .ttl_s = (uint32_t)ev.grant_minutes * 60u,
+                };
+                ctaphid_task_post_grant(ev.park, &grant);
+            } else {
+                ctaphid_task_post_up(ev.park, true);
+            }
+        }
+
+        if (ev.type == EV_DENY) {
+            ESP_LOGI(TAG, "Request -> denied");
+            ctaphid_task_post_up(ev.park, false);
+        }
+
+        if (ev.type == EV_REVOKE) {
+            ESP_LOGI(TAG, "Grants revoked");
+            ctaphid_task_post_revoke();
+        }
+    }
 }
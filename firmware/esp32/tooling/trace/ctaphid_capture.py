@@ -0,0 +1,116 @@
+#!/usr/bin/env python3
+"""Turn a device capture dump (the "capture dump" console command) into a
+capture file for firmware/host's ctaphid-replay.
+
+    ctaphid_capture.py dump.txt -o session.cap             # captured console text
+    ctaphid_capture.py --port /dev/ttyACM0 -o session.cap  # ask the device (needs pyserial)
+
+Record with "capture start" on the console, run the session, then dump.
+Anything outside the CAPTURE BEGIN / CAPTURE END block is ignored, as with
+ctaphid_trace.py.
+
+A device capture has no RNG seed and starts with whatever the key already
+holds, so ctaphid-replay checks it with --check frames by default: headers
+and CTAP status bytes, not signatures.
+"""
+import argparse
+import struct
+import sys
+
+# Must match include/ctaphid_capture.h (CTAPHID_CAPTURE_VERSION 1).
+MAGIC = b"RTCAP\r\n\x1a"
+VERSION = 1
+REC_SIZE = 80
+F_DEVICE = 0x2
+
+
+def parse(lines):
+    """(header dict, [record bytes]) of the last dump block in `lines`."""
+    block = None
+    header = None
+    recs = []
+    for raw in lines:
+        line = raw.strip()
+        if line.startswith("CAPTURE BEGIN"):
+            header = {"version": 0}
+            for tok in line.split()[2:]:
+                if tok.startswith("v"):
+                    header["version"] = int(tok[1:])
+                elif "=" in tok:
+                    k, v = tok.split("=", 1)
+                    header[k] = int(v)
+            recs = []
+            continue
+        if header is None:
+            continue
+        if line == "CAPTURE END":
+            block = (header, recs)
+            header = None
+            continue
+        if len(line) != 2 * REC_SIZE:
+            continue
+        try:
+            recs.append(bytes.fromhex(line))
+        except ValueError:
+            continue
+    return block
+
+
+def read_from_port(port, timeout):
+    import serial  # pyserial, only needed for --port
+
+    with serial.Serial(port, 115200, timeout=timeout) as s:
+        s.reset_input_buffer()
+        s.write(b"capture dump\r\n")
+        lines = []
+        while True:
+            raw = s.readline()
+            if not raw:
+                break
+            line = raw.decode("ascii", "replace")
+            lines.append(line)
+            if line.strip() == "CAPTURE END":
+                break
+        return lines
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__,
+                                 formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("input", nargs="?", help="dump text (default: stdin)")
+    ap.add_argument("-o", "--output", required=True, help="capture file to write")
+    ap.add_argument("--port", help="serial port of the device console")
+    ap.add_argument("--timeout", type=float, default=2.0)
+    args = ap.parse_args()
+
+    if args.port:
+        lines = read_from_port(args.port, args.timeout)
+    elif args.input:
+        with open(args.input, encoding="ascii", errors="replace") as f:
+            lines = f.readlines()
+    else:
+        lines = sys.stdin.readlines()
+
+    block = parse(lines)
+    if block is None:
+        sys.stderr.write("no CAPTURE BEGIN/END block found\n")
+        return 1
+    header, recs = block
+    if header["version"] != VERSION:
+        sys.stderr.write("capture format v%d, this converter writes v%d\n" % (header["version"], VERSION))
+        return 1
+    lost = header.get("lost", 0)
+    if lost:
+        sys.stderr.write("warning: %d records did not fit the ring (CONFIG_CTAPHID_CAPTURE_DEPTH=%s)\n"
+                         % (lost, header.get("depth", "?")))
+
+    with open(args.output, "wb") as f:
+        f.write(struct.pack("<8sIIQII", MAGIC, VERSION, F_DEVICE, 0, REC_SIZE, lost))
+        for r in recs:
+            f.write(r)
+    sys.stderr.write("%d records -> %s\n" % (len(recs), args.output))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
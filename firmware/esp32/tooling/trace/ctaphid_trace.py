@@ -0,0 +1,204 @@
+#!/usr/bin/env python3
+"""Decode a CTAPHID trace dump (the "trace" console command, or
+ctaphid-bench --trace FILE).
+
+    ctaphid_trace.py dump.txt            # captured console text
+    ctaphid_trace.py --port /dev/ttyACM0  # ask the device (needs pyserial)
+    ctaphid_trace.py dump.txt --summary  # per-channel counts only
+
+Anything outside the TRACE BEGIN / TRACE END block (log lines, "OK") is
+ignored, so a raw console capture works as input.
+"""
+import argparse
+import collections
+import sys
+
+# Must match include/ctaphid_trace.h (CTAPHID_TRACE_VERSION 1).
+EVENTS = {
+    1: "RX",
+    2: "TX",
+    3: "ERR",
+    4: "CBOR",
+    5: "UP_PARK",
+    6: "UP_DONE",
+    7: "CANCEL",
+    8: "EXPIRE",
+    9: "EVICT",
+}
+
+HID_CMDS = {
+    0x01: "PING",
+    0x06: "INIT",
+    0x10: "CBOR",
+    0x11: "CANCEL",
+    0x3B: "KEEPALIVE",
+    0x3F: "ERROR",
+}
+
+HID_ERRORS = {
+    0x01: "INVALID_CMD",
+    0x02: "INVALID_PAR",
+    0x03: "INVALID_LEN",
+    0x04: "INVALID_SEQ",
+    0x05: "MSG_TIMEOUT",
+    0x06: "CHANNEL_BUSY",
+    0x0B: "INVALID_CHANNEL",
+}
+
+CTAP_CMDS = {
+    0x01: "makeCredential",
+    0x02: "getAssertion",
+    0x04: "getInfo",
+    0x06: "clientPIN",
+    0x07: "reset",
+    0x08: "getNextAssertion",
+    0x0B: "selection",
+}
+
+UP_VERDICTS = {0: "CLEAR", 1: "APPROVED", 2: "DENIED", 3: "TIMEOUT"}
+
+Record = collections.namedtuple("Record", "ts cid ev cmd seq rc")
+
+
+def parse(lines):
+    """Yield (header dict, [Record]) for every dump block in `lines`."""
+    header = None
+    recs = []
+    for raw in lines:
+        line = raw.strip()
+        if line.startswith("TRACE BEGIN"):
+            header = {"version": 0}
+            for tok in line.split()[2:]:
+                if tok.startswith("v"):
+                    header["version"] = int(tok[1:])
+                elif "=" in tok:
+                    k, v = tok.split("=", 1)
+                    header[k] = int(v)
+            recs = []
+            continue
+        if header is None:
+            continue
+        if line == "TRACE END":
+            yield header, recs
+            header = None
+            continue
+        if len(line) != 24:
+            continue
+        try:
+            recs.append(Record(
+                ts=int(line[0:8], 16),
+                cid=int(line[8:16], 16),
+                ev=int(line[16:18], 16),
+                cmd=int(line[18:20], 16),
+                seq=int(line[20:22], 16),
+                rc=int(line[22:24], 16),
+            ))
+        except ValueError:
+            continue
+
+
+def describe(r):
+    ev = EVENTS.get(r.ev, "ev%02x" % r.ev)
+    if r.ev == 1:
+        if r.cmd & 0x80:
+            c = r.cmd & 0x7F
+            return ev, "init %s" % HID_CMDS.get(c, "0x%02x" % c)
+        return ev, "cont seq=%d" % r.seq
+    if r.ev == 2:
+        what = HID_CMDS.get(r.cmd, "0x%02x" % r.cmd)
+        return ev, "%s frames=%d%s" % (what, r.seq, " DROPPED" if r.rc else "")
+    if r.ev == 3:
+        return ev, HID_ERRORS.get(r.rc, "0x%02x" % r.rc)
+    if r.ev == 4:
+        return ev, "%s status=0x%02x" % (CTAP_CMDS.get(r.seq, "0x%02x" % r.seq), r.rc)
+    if r.ev == 5:
+        return ev, CTAP_CMDS.get(r.seq, "0x%02x" % r.seq)
+    if r.ev == 6:
+        return ev, UP_VERDICTS.get(r.rc, str(r.rc))
+    if r.ev == 7:
+        return ev, {0: "idle channel", 1: "parked request", 2: "reassembly dropped"}.get(r.rc, str(r.rc))
+    if r.ev == 8:
+        return ev, "%s after seq=%d" % (HID_CMDS.get(r.cmd, "0x%02x" % r.cmd), r.seq)
+    return ev, "cmd=0x%02x seq=%d rc=0x%02x" % (r.cmd, r.seq, r.rc)
+
+
+def print_records(header, recs, out):
+    total = header.get("total", len(recs))
+    lost = max(0, total - len(recs))
+    out.write("# v%d depth=%s total=%d shown=%d lost=%d\n" % (
+        header["version"], header.get("depth", "?"), total, len(recs), lost))
+    if not recs:
+        return
+    t0 = recs[0].ts
+    prev = t0
+    for r in recs:
+        rel = (r.ts - t0) & 0xFFFFFFFF
+        gap = (r.ts - prev) & 0xFFFFFFFF
+        prev = r.ts
+        ev, detail = describe(r)
+        out.write("%12.3f ms  +%7d us  %08x  %-8s %s\n" % (rel / 1000.0, gap, r.cid, ev, detail))
+
+
+def print_summary(recs, out):
+    per = collections.OrderedDict()
+    for r in recs:
+        c = per.setdefault(r.cid, collections.Counter())
+        c[EVENTS.get(r.ev, "ev%02x" % r.ev)] += 1
+        if r.ev == 3:
+            c["err:" + HID_ERRORS.get(r.rc, "0x%02x" % r.rc)] += 1
+    for cid, c in per.items():
+        out.write("%08x  %s\n" % (cid, "  ".join("%s=%d" % kv for kv in sorted(c.items()))))
+
+
+def read_from_port(port, timeout):
+    import serial  # pyserial, only needed for --port
+
+    with serial.Serial(port, 115200, timeout=timeout) as s:
+        s.reset_input_buffer()
+        s.write(b"trace\r\n")
+        lines = []
+        while True:
+            raw = s.readline()
+            if not raw:
+                break
+            line = raw.decode("ascii", "replace")
+            lines.append(line)
+            if line.strip() == "TRACE END":
+                break
+        return lines
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__,
+                                 formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("input", nargs="?", help="dump text (default: stdin)")
+    ap.add_argument("--port", help="serial port of the device console")
+    ap.add_argument("--timeout", type=float, default=2.0)
+    ap.add_argument("--summary", action="store_true", help="per-channel counts only")
+    args = ap.parse_args()
+
+    if args.port:
+        lines = read_from_port(args.port, args.timeout)
+    elif args.input:
+        with open(args.input, encoding="ascii", errors="replace") as f:
+            lines = f.readlines()
+    else:
+        lines = sys.stdin.readlines()
+
+    found = False
+    for header, recs in parse(lines):
+        found = True
+        if header["version"] != 1:
+            sys.stderr.write("warning: trace format v%d, decoder knows v1\n" % header["version"])
+        if args.summary:
+            print_summary(recs, sys.stdout)
+        else:
+            print_records(header, recs, sys.stdout)
+    if not found:
+        sys.stderr.write("no TRACE BEGIN/END block found\n")
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,73 @@
+// ctaphid-bench: runs the ctaphid_bench scenarios on the host and prints one
+// JSON object per line to stdout. Exit status is non-zero if any response
+// was wrong or missing. --trace FILE writes the event ring afterwards in the
+// same text format as the device's "trace" command.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ctaphid_bench.h"
+#include "ctaphid_trace.h"
+
+static void out_line(void *user, const char *line)
+{
+    (void)user;
+    fputs(line, stdout);
+    fputc('\n', stdout);
+}
+
+static void trace_line(void *user, const char *line)
+{
+    FILE *f = user;
+    fputs(line, f);
+    fputc('\n', f);
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr, "usage: %s [--scenario NAME|all] [--reps N] [--trace FILE]\n", argv0);
+}
+
+int main(int argc, char **argv)
+{
+    const char *trace_path = NULL;
+    ctaphid_bench_cfg_t cfg = {
+        .scenario = "all",
+        .out = out_line,
+    };
+
+    for (int i = 1; i < argc; i++) {
+        const char *val = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (strcmp(argv[i], "--scenario") == 0 && val) {
+            cfg.scenario = val;
+            i++;
+        } else if (strcmp(argv[i], "--reps") == 0 && val) {
+            cfg.reps = (unsigned)strtoul(val, NULL, 0);
+            i++;
+        } else if (strcmp(argv[i], "--trace") == 0 && val) {
+            trace_path = val;
+            i++;
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    int failed = ctaphid_bench_run(&cfg);
+    if (failed < 0) {
+        fprintf(stderr, "unknown scenario '%s'\n", cfg.scenario);
+        return 2;
+    }
+
+    if (trace_path) {
+        FILE *f = fopen(trace_path, "w");
+        if (!f) {
+            perror(trace_path);
+            return 2;
+        }
+        ctaphid_trace_dump(trace_line, f);
+        fclose(f);
+    }
+    return failed ? 1 : 0;
+}
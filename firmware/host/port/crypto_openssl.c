@@ -0,0 +1,409 @@
+// OpenSSL implementation of crypto.h / crypto_impl.h for the host build.
+// OpenSSL's P-256 code is constant time, so host timings are representative
+// of the algorithm rather than of a shortcut.
+
+// RAND_set_rand_method is deprecated in 3.0 but still routes every draw of
+// the default library context, provider keygen and ECDSA included
+#define OPENSSL_SUPPRESS_DEPRECATED
+
+#include "crypto.h"
+#include "crypto_impl.h"
+#include "port_host.h"
+
+#include <pthread.h>
+#include <time.h>
+
+#include <openssl/core_names.h>
+#include <openssl/ec.h>
+#include <openssl/ecdsa.h>
+#include <openssl/evp.h>
+#include <openssl/obj_mac.h>
+#include <openssl/param_build.h>
+#include <openssl/rand.h>
+
+// for the presignature arithmetic; EVP covers everything else
+static EC_GROUP *s_grp;
+// fetched once: a fetch per call would cost more than the MAC
+static EVP_MAC *s_hmac;
+static pthread_once_t s_once = PTHREAD_ONCE_INIT;
+
+static void load_group(void)
+{
+    s_grp = EC_GROUP_new_by_curve_name(NID_X9_62_prime256v1);
+    s_hmac = EVP_MAC_fetch(NULL, "HMAC", NULL);
+}
+
+int crypto_init(void)
+{
+    pthread_once(&s_once, load_group);
+    return s_grp ? 0 : -1;
+}
+
+// ---- seeded RNG for deterministic runs (port_host.h) ----
+static pthread_mutex_t s_seed_mu = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t s_seed_state;
+
+static int seeded_bytes(unsigned char *out, int num)
+{
+    pthread_mutex_lock(&s_seed_mu);
+    for (int i = 0; i < num; i += 8) {
+        uint64_t v = port_host_mix(&s_seed_state);
+        for (int b = 0; b < 8 && i + b < num; b++) out[i + b] = (unsigned char)(v >> (8 * b));
+    }
+    pthread_mutex_unlock(&s_seed_mu);
+    return 1;
+}
+
+static int seeded_status(void)
+{
+    return 1;
+}
+
+static const RAND_METHOD s_seeded_rand = {
+    .bytes = seeded_bytes,
+    .pseudorand = seeded_bytes,
+    .status = seeded_status,
+};
+
+void crypto_host_seed(uint64_t seed)
+{
+    pthread_mutex_lock(&s_seed_mu);
+    s_seed_state = seed;
+    pthread_mutex_unlock(&s_seed_mu);
+    RAND_set_rand_method(&s_seeded_rand);
+}
+
+int crypto_random(uint8_t *out, size_t len)
+{
+    return RAND_bytes(out, (int)len) == 1 ? 0 : -1;
+}
+
+int crypto_sha256(const crypto_buf_t *parts, size_t n, uint8_t out[CRYPTO_SHA256_LEN])
+{
+    EVP_MD_CTX *md = EVP_MD_CTX_new();
+    int ok = md && EVP_DigestInit_ex(md, EVP_sha256(), NULL);
+    for (size_t i = 0; ok && i < n; i++) {
+        ok = EVP_DigestUpdate(md, parts[i].p, parts[i].len);
+    }
+    ok = ok && EVP_DigestFinal_ex(md, out, NULL);
+    EVP_MD_CTX_free(md);
+    return ok ? 0 : -1;
+}
+
+int crypto_hmac_sha256(const uint8_t key[CRYPTO_HMAC_KEY_LEN],
+                       const crypto_buf_t *parts, size_t n,
+                       uint8_t out[CRYPTO_SHA256_LEN])
+{
+    pthread_once(&s_once, load_group);
+    EVP_MAC_CTX *mac = s_hmac ? EVP_MAC_CTX_new(s_hmac) : NULL;
+    OSSL_PARAM params[] = {
+        OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, (char *)"SHA256", 0),
+        OSSL_PARAM_construct_end(),
+    };
+    size_t olen = 0;
+
+    int ok = mac && EVP_MAC_init(mac, key, CRYPTO_HMAC_KEY_LEN, params);
+    for (size_t i = 0; ok && i < n; i++) {
+        ok = EVP_MAC_update(mac, parts[i].p, parts[i].len);
+    }
+    ok = ok && EVP_MAC_final(mac, out, &olen, CRYPTO_SHA256_LEN) && olen == CRYPTO_SHA256_LEN;
+    EVP_MAC_CTX_free(mac);
+    return ok ? 0 : -1;
+}
+
+static EVP_CIPHER_CTX *gcm_start(const uint8_t *key, const uint8_t *iv, bool enc,
+                                 const uint8_t *aad, size_t aad_len)
+{
+    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+    int olen = 0;
+    int ok = ctx
+          && EVP_CipherInit_ex(ctx, EVP_aes_256_gcm(), NULL, NULL, NULL, enc)
+          && EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_IVLEN, CRYPTO_GCM_IV_LEN, NULL)
+          && EVP_CipherInit_ex(ctx, NULL, NULL, key, iv, enc)
+          && (aad_len == 0 || EVP_CipherUpdate(ctx, NULL, &olen, aad, (int)aad_len));
+    if (!ok) {
+        EVP_CIPHER_CTX_free(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+int crypto_aes_gcm_seal(const uint8_t key[CRYPTO_AES_KEY_LEN],
+                        const uint8_t iv[CRYPTO_GCM_IV_LEN],
+                        const uint8_t *aad, size_t aad_len,
+                        const uint8_t *in, uint8_t *out, size_t len,
+                        uint8_t tag[CRYPTO_GCM_TAG_LEN])
+{
+    EVP_CIPHER_CTX *ctx = gcm_start(key, iv, true, aad, aad_len);
+    uint8_t end[16];
+    int olen = 0, flen = 0;
+    int ok = ctx
+          && EVP_CipherUpdate(ctx, out, &olen, in, (int)len)
+          && EVP_CipherFinal_ex(ctx, end, &flen)
+          && EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, CRYPTO_GCM_TAG_LEN, tag);
+    EVP_CIPHER_CTX_free(ctx);
+    return ok ? 0 : -1;
+}
+
+int crypto_aes_gcm_open(const uint8_t key[CRYPTO_AES_KEY_LEN],
+                        const uint8_t iv[CRYPTO_GCM_IV_LEN],
+                        const uint8_t *aad, size_t aad_len,
+                        const uint8_t *in, uint8_t *out, size_t len,
+                        const uint8_t tag[CRYPTO_GCM_TAG_LEN])
+{
+    EVP_CIPHER_CTX *ctx = gcm_start(key, iv, false, aad, aad_len);
+    uint8_t end[16];
+    int olen = 0, flen = 0;
+    int ok = ctx
+          && EVP_CipherUpdate(ctx, out, &olen, in, (int)len)
+          && EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, CRYPTO_GCM_TAG_LEN, (void *)tag)
+          && EVP_CipherFinal_ex(ctx, end, &flen) > 0;
+    EVP_CIPHER_CTX_free(ctx);
+    // OpenSSL decrypts before it checks: don't hand out an unauthenticated key
+    if (!ok) crypto_wipe(out, len);
+    return ok ? 0 : -1;
+}
+
+static int aes_cbc(const uint8_t *key, const uint8_t *iv, int enc,
+                   const uint8_t *in, uint8_t *out, size_t len)
+{
+    if (len % CRYPTO_AES_BLOCK_LEN) return -1;
+    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+    int olen = 0, flen = 0;
+    int ok = ctx
+          && EVP_CipherInit_ex(ctx, EVP_aes_256_cbc(), NULL, key, iv, enc)
+          && EVP_CIPHER_CTX_set_padding(ctx, 0)
+          && EVP_CipherUpdate(ctx, out, &olen, in, (int)len)
+          && EVP_CipherFinal_ex(ctx, out + olen, &flen);
+    EVP_CIPHER_CTX_free(ctx);
+    return ok ? 0 : -1;
+}
+
+int crypto_aes_cbc_encrypt(const uint8_t key[CRYPTO_AES_KEY_LEN],
+                           const uint8_t iv[CRYPTO_AES_BLOCK_LEN],
+                           const uint8_t *in, uint8_t *out, size_t len)
+{
+    return aes_cbc(key, iv, 1, in, out, len);
+}
+
+int crypto_aes_cbc_decrypt(const uint8_t key[CRYPTO_AES_KEY_LEN],
+                           const uint8_t iv[CRYPTO_AES_BLOCK_LEN],
+                           const uint8_t *in, uint8_t *out, size_t len)
+{
+    return aes_cbc(key, iv, 0, in, out, len);
+}
+
+int crypto_impl_keygen(uint8_t priv[CRYPTO_P256_PRIV_LEN], uint8_t pub[CRYPTO_P256_PUB_LEN])
+{
+    EVP_PKEY *pkey = EVP_PKEY_Q_keygen(NULL, NULL, "EC", "P-256");
+    BIGNUM *d = NULL;
+    uint8_t point[1 + CRYPTO_P256_PUB_LEN];
+    size_t olen = 0;
+
+    int ok = pkey != NULL
+          && EVP_PKEY_get_bn_param(pkey, OSSL_PKEY_PARAM_PRIV_KEY, &d)
+          && BN_bn2binpad(d, priv, CRYPTO_P256_PRIV_LEN) == CRYPTO_P256_PRIV_LEN
+          && EVP_PKEY_get_octet_string_param(pkey, OSSL_PKEY_PARAM_PUB_KEY,
+                                             point, sizeof(point), &olen)
+          && olen == sizeof(point) && point[0] == 0x04;
+    if (ok) {
+        for (size_t i = 0; i < CRYPTO_P256_PUB_LEN; i++) pub[i] = point[1 + i];
+    }
+
+    BN_clear_free(d);
+    EVP_PKEY_free(pkey);
+    return ok ? 0 : -1;
+}
+
+static EVP_PKEY *load_private(const uint8_t priv[CRYPTO_P256_PRIV_LEN])
+{
+    EVP_PKEY *pkey = NULL;
+    OSSL_PARAM *params = NULL;
+    OSSL_PARAM_BLD *bld = OSSL_PARAM_BLD_new();
+    BIGNUM *d = BN_secure_new();
+    EVP_PKEY_CTX *ctx = EVP_PKEY_CTX_new_from_name(NULL, "EC", NULL);
+
+    int ok = bld && d && ctx
+          && BN_bin2bn(priv, CRYPTO_P256_PRIV_LEN, d)
+          && OSSL_PARAM_BLD_push_utf8_string(bld, OSSL_PKEY_PARAM_GROUP_NAME, "P-256", 0)
+          && OSSL_PARAM_BLD_push_BN(bld, OSSL_PKEY_PARAM_PRIV_KEY, d)
+          && (params = OSSL_PARAM_BLD_to_param(bld)) != NULL
+          && EVP_PKEY_fromdata_init(ctx) > 0
+          && EVP_PKEY_fromdata(ctx, &pkey, EVP_PKEY_KEYPAIR, params) > 0;
+    if (!ok) {
+        EVP_PKEY_free(pkey);
+        pkey = NULL;
+    }
+
+    EVP_PKEY_CTX_free(ctx);
+    OSSL_PARAM_free(params);
+    OSSL_PARAM_BLD_free(bld);
+    BN_clear_free(d);
+    return pkey;
+}
+
+static EVP_PKEY *load_public(const uint8_t pub[CRYPTO_P256_PUB_LEN])
+{
+    EVP_PKEY *pkey = NULL;
+    uint8_t point[1 + CRYPTO_P256_PUB_LEN];
+    point[0] = 0x04;
+    for (size_t i = 0; i < CRYPTO_P256_PUB_LEN; i++) point[1 + i] = pub[i];
+    OSSL_PARAM params[] = {
+        OSSL_PARAM_construct_utf8_string(OSSL_PKEY_PARAM_GROUP_NAME, (char *)"P-256", 0),
+        OSSL_PARAM_construct_octet_string(OSSL_PKEY_PARAM_PUB_KEY, point, sizeof(point)),
+        OSSL_PARAM_construct_end(),
+    };
+    EVP_PKEY_CTX *ctx = EVP_PKEY_CTX_new_from_name(NULL, "EC", NULL);
+    // decoding the point checks that it is on the curve
+    int ok = ctx
+          && EVP_PKEY_fromdata_init(ctx) > 0
+          && EVP_PKEY_fromdata(ctx, &pkey, EVP_PKEY_PUBLIC_KEY, params) > 0;
+    if (!ok) {
+        EVP_PKEY_free(pkey);
+        pkey = NULL;
+    }
+    EVP_PKEY_CTX_free(ctx);
+    return pkey;
+}
+
+int crypto_p256_ecdh(const uint8_t priv[CRYPTO_P256_PRIV_LEN],
+                     const uint8_t peer[CRYPTO_P256_PUB_LEN],
+                     uint8_t out[CRYPTO_P256_PRIV_LEN])
+{
+    EVP_PKEY *ours = load_private(priv);
+    EVP_PKEY *theirs = load_public(peer);
+    EVP_PKEY_CTX *ctx = ours && theirs ? EVP_PKEY_CTX_new_from_pkey(NULL, ours, NULL) : NULL;
+    size_t olen = CRYPTO_P256_PRIV_LEN;
+
+    int ok = ctx != NULL
+          && EVP_PKEY_derive_init(ctx) > 0
+          && EVP_PKEY_derive_set_peer(ctx, theirs) > 0
+          && EVP_PKEY_derive(ctx, out, &olen) > 0
+          && olen == CRYPTO_P256_PRIV_LEN;
+
+    EVP_PKEY_CTX_free(ctx);
+    EVP_PKEY_free(theirs);
+    EVP_PKEY_free(ours);
+    return ok ? 0 : -1;
+}
+
+int crypto_impl_sign(const uint8_t priv[CRYPTO_P256_PRIV_LEN],
+                     const uint8_t digest[CRYPTO_SHA256_LEN],
+                     uint8_t sig[CRYPTO_P256_SIG_LEN])
+{
+    EVP_PKEY *pkey = load_private(priv);
+    EVP_PKEY_CTX *ctx = pkey ? EVP_PKEY_CTX_new_from_pkey(NULL, pkey, NULL) : NULL;
+    uint8_t der[80];
+    size_t der_len = sizeof(der);
+    const unsigned char *p = der;
+    ECDSA_SIG *es = NULL;
+
+    int ok = ctx != NULL
+          && EVP_PKEY_sign_init(ctx) > 0
+          && EVP_PKEY_sign(ctx, der, &der_len, digest, CRYPTO_SHA256_LEN) > 0
+          && (es = d2i_ECDSA_SIG(NULL, &p, (long)der_len)) != NULL
+          && BN_bn2binpad(ECDSA_SIG_get0_r(es), sig, 32) == 32
+          && BN_bn2binpad(ECDSA_SIG_get0_s(es), sig + 32, 32) == 32;
+
+    ECDSA_SIG_free(es);
+    EVP_PKEY_CTX_free(ctx);
+    EVP_PKEY_free(pkey);
+    return ok ? 0 : -1;
+}
+
+static BIGNUM *secret_bn(BN_CTX *ctx)
+{
+    BIGNUM *b = BN_CTX_get(ctx);
+    if (b) BN_set_flags(b, BN_FLG_CONSTTIME);
+    return b;
+}
+
+static int random_scalar(BIGNUM *out, const BIGNUM *order)
+{
+    do {
+        if (!BN_priv_rand_range(out, order)) return 0;
+    } while (BN_is_zero(out));
+    return 1;
+}
+
+int crypto_impl_presign(crypto_presig_t *ps)
+{
+    if (crypto_init() != 0) return -1;
+    const BIGNUM *n = EC_GROUP_get0_order(s_grp);
+    BN_CTX *ctx = BN_CTX_secure_new();
+    EC_POINT *kg = EC_POINT_new(s_grp);
+    if (ctx) BN_CTX_start(ctx);
+    BIGNUM *k = ctx ? secret_bn(ctx) : NULL;
+    BIGNUM *t = ctx ? secret_bn(ctx) : NULL;
+    BIGNUM *r = ctx ? BN_CTX_get(ctx) : NULL;
+    BIGNUM *tr = ctx ? secret_bn(ctx) : NULL;
+    BIGNUM *u = ctx ? secret_bn(ctx) : NULL;
+
+    int ok = kg && u
+          && random_scalar(k, n)
+          && EC_POINT_mul(s_grp, kg, k, NULL, NULL, ctx)
+          && EC_POINT_get_affine_coordinates(s_grp, kg, r, NULL, ctx)
+          && BN_nnmod(r, r, n, ctx)
+          && !BN_is_zero(r)
+          && random_scalar(t, n)
+          && BN_mod_mul(tr, t, r, n, ctx)
+          && BN_mod_mul(u, k, t, n, ctx)
+          && BN_mod_inverse(u, u, n, ctx)
+          && BN_bn2binpad(r, ps->r, sizeof(ps->r)) == (int)sizeof(ps->r)
+          && BN_bn2binpad(t, ps->t, sizeof(ps->t)) == (int)sizeof(ps->t)
+          && BN_bn2binpad(tr, ps->tr, sizeof(ps->tr)) == (int)sizeof(ps->tr)
+          && BN_bn2binpad(u, ps->u, sizeof(ps->u)) == (int)sizeof(ps->u);
+    if (!ok) crypto_wipe(ps, sizeof(*ps));
+
+    if (ctx) BN_CTX_end(ctx);
+    BN_CTX_free(ctx);
+    EC_POINT_free(kg);
+    return ok ? 0 : -1;
+}
+
+int crypto_impl_sign_presig(const uint8_t priv[CRYPTO_P256_PRIV_LEN],
+                            const uint8_t digest[CRYPTO_SHA256_LEN],
+                            const crypto_presig_t *ps,
+                            uint8_t sig[CRYPTO_P256_SIG_LEN])
+{
+    if (crypto_init() != 0) return -1;
+    const BIGNUM *n = EC_GROUP_get0_order(s_grp);
+    BN_CTX *ctx = BN_CTX_secure_new();
+    if (!ctx) return -1;
+    BN_CTX_start(ctx);
+    BIGNUM *d = secret_bn(ctx);
+    BIGNUM *e = BN_CTX_get(ctx);
+    BIGNUM *t = secret_bn(ctx);
+    BIGNUM *tr = secret_bn(ctx);
+    BIGNUM *u = secret_bn(ctx);
+    BIGNUM *s = secret_bn(ctx);
+    BIGNUM *tmp = secret_bn(ctx);
+
+    // s = u * (t*e + tr*d) mod n
+    int ok = tmp
+          && BN_bin2bn(priv, CRYPTO_P256_PRIV_LEN, d)
+          && BN_bin2bn(digest, CRYPTO_SHA256_LEN, e)
+          && BN_bin2bn(ps->t, sizeof(ps->t), t)
+          && BN_bin2bn(ps->tr, sizeof(ps->tr), tr)
+          && BN_bin2bn(ps->u, sizeof(ps->u), u)
+          && BN_mod_mul(s, t, e, n, ctx)
+          && BN_mod_mul(tmp, tr, d, n, ctx)
+          && BN_mod_add(s, s, tmp, n, ctx)
+          && BN_mod_mul(s, s, u, n, ctx)
+          && !BN_is_zero(s)
+          && BN_bn2binpad(s, sig + 32, 32) == 32;
+    if (ok) {
+        for (size_t i = 0; i < 32; i++) sig[i] = ps->r[i];
+    }
+
+    BN_CTX_end(ctx);
+    BN_CTX_free(ctx);
+    return ok ? 0 : -1;
+}
+
+uint64_t crypto_impl_now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
@@ -0,0 +1,60 @@
+// Linux implementation of ctaphid_port.h.
+
+#include "ctaphid_port.h"
+#include "port_host.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/random.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+static uint64_t (*s_clock)(void);
+static bool s_seeded;
+static uint64_t s_rng;   // splitmix64 state once seeded
+
+void ctaphid_port_host_seed(uint64_t seed)
+{
+    s_rng = seed;
+    s_seeded = true;
+    // a stream of its own, so CIDs don't shift when the core draws more
+    crypto_host_seed(seed ^ 0x726f6f74746170ULL);
+}
+
+void ctaphid_port_host_set_clock(uint64_t (*now_us)(void))
+{
+    s_clock = now_us;
+}
+
+uint64_t ctaphid_port_now_us(void)
+{
+    if (s_clock) return s_clock();
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+uint32_t ctaphid_port_random(void)
+{
+    if (s_seeded) return (uint32_t)port_host_mix(&s_rng);
+    uint32_t v = 0;
+    if (getrandom(&v, sizeof(v), 0) != (ssize_t)sizeof(v)) {
+        // getrandom only fails before the pool is seeded; fall back to time
+        v = (uint32_t)ctaphid_port_now_us() * 2654435761u;
+    }
+    return v;
+}
+
+uint32_t ctaphid_port_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return (uint32_t)__rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec);
+#endif
+}
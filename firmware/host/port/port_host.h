@@ -0,0 +1,36 @@
+#pragma once
+// Host-only controls over the port layer, for runs that have to come out the
+// same every time: roottap-sim --record and ctaphid-replay.
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Replaces getrandom and OpenSSL's DRBG - channel IDs, crypto_random and the
+ * keys and nonces OpenSSL draws for keygen and signing - with generators
+ * seeded from `seed`, so the same inputs give byte-identical outputs.
+ * Nothing they produce is secret; never use this for a real key.
+ */
+void ctaphid_port_host_seed(uint64_t seed);
+
+/** The crypto half of ctaphid_port_host_seed (crypto_openssl.c). */
+void crypto_host_seed(uint64_t seed);
+
+/** ctaphid_port_now_us() returns now_us() instead of CLOCK_MONOTONIC (the
+ *  engine and the core both read it); NULL restores the real clock. */
+void ctaphid_port_host_set_clock(uint64_t (*now_us)(void));
+
+/** splitmix64 step, the generator behind both seeded streams. */
+static inline uint64_t port_host_mix(uint64_t *state)
+{
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+#ifdef __cplusplus
+}
+#endif
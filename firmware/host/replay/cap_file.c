@@ -0,0 +1,81 @@
+#include "cap_file.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+int cap_file_create(cap_file_t *cf, const char *path, uint32_t flags, uint64_t seed)
+{
+    memset(cf, 0, sizeof(*cf));
+    cf->f = fopen(path, "wb");
+    if (!cf->f) return -errno;
+    memcpy(cf->hdr.magic, CTAPHID_CAP_MAGIC, sizeof(cf->hdr.magic));
+    cf->hdr.version = CTAPHID_CAPTURE_VERSION;
+    cf->hdr.flags = flags;
+    cf->hdr.seed = seed;
+    cf->hdr.rec_size = sizeof(ctaphid_cap_rec_t);
+    if (fwrite(&cf->hdr, sizeof(cf->hdr), 1, cf->f) != 1) {
+        int err = -errno;
+        fclose(cf->f);
+        cf->f = NULL;
+        return err;
+    }
+    return 0;
+}
+
+void cap_file_write(void *user, const ctaphid_cap_rec_t *rec)
+{
+    cap_file_t *cf = user;
+    if (cf->err == 0 && fwrite(rec, sizeof(*rec), 1, cf->f) != 1) cf->err = errno ? -errno : -EIO;
+}
+
+int cap_file_close(cap_file_t *cf, uint32_t lost)
+{
+    if (!cf->f) return cf->err;
+    cf->hdr.lost = lost;
+    if (cf->err == 0 && (fseek(cf->f, 0, SEEK_SET) != 0 || fwrite(&cf->hdr, sizeof(cf->hdr), 1, cf->f) != 1)) {
+        cf->err = -errno;
+    }
+    if (fclose(cf->f) != 0 && cf->err == 0) cf->err = -errno;
+    cf->f = NULL;
+    return cf->err;
+}
+
+int cap_file_load(const char *path, ctaphid_cap_file_hdr_t *hdr, ctaphid_cap_rec_t **recs, size_t *n)
+{
+    *recs = NULL;
+    *n = 0;
+    FILE *f = fopen(path, "rb");
+    if (!f) return -errno;
+
+    int rc = 0;
+    if (fread(hdr, sizeof(*hdr), 1, f) != 1 ||
+        memcmp(hdr->magic, CTAPHID_CAP_MAGIC, sizeof(hdr->magic)) != 0 ||
+        hdr->version != CTAPHID_CAPTURE_VERSION || hdr->rec_size != sizeof(ctaphid_cap_rec_t)) {
+        fclose(f);
+        return -EINVAL;
+    }
+
+    size_t cap = 0;
+    ctaphid_cap_rec_t rec;
+    while (fread(&rec, sizeof(rec), 1, f) == 1) {
+        if (*n == cap) {
+            cap = cap ? 2 * cap : 256;
+            ctaphid_cap_rec_t *grown = realloc(*recs, cap * sizeof(rec));
+            if (!grown) {
+                rc = -ENOMEM;
+                break;
+            }
+            *recs = grown;
+        }
+        (*recs)[(*n)++] = rec;
+    }
+    if (rc == 0 && ferror(f)) rc = -EIO;
+    fclose(f);
+    if (rc != 0) {
+        free(*recs);
+        *recs = NULL;
+        *n = 0;
+    }
+    return rc;
+}
@@ -0,0 +1,29 @@
+#pragma once
+// Capture files (ctaphid_capture.h): written by roottap-sim --record and
+// tooling/trace/ctaphid_capture.py, read by ctaphid-replay. Header and
+// records are stored as the little-endian structs; the host build only
+// targets little-endian machines.
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "ctaphid_capture.h"
+
+typedef struct {
+    FILE *f;
+    ctaphid_cap_file_hdr_t hdr;
+    int err;   // first write error, -errno
+} cap_file_t;
+
+/** Creates `path` and writes the header. 0 or -errno. */
+int cap_file_create(cap_file_t *cf, const char *path, uint32_t flags, uint64_t seed);
+
+/** ctaphid_capture_sink_fn: appends one record; `user` is the cap_file_t. */
+void cap_file_write(void *user, const ctaphid_cap_rec_t *rec);
+
+/** Stores the lost count in the header and closes. 0 or the first -errno. */
+int cap_file_close(cap_file_t *cf, uint32_t lost);
+
+/** Reads a whole capture; free(*recs) afterwards. 0, -errno, or -EINVAL for
+ *  a file that isn't a capture of this version. */
+int cap_file_load(const char *path, ctaphid_cap_file_hdr_t *hdr, ctaphid_cap_rec_t **recs, size_t *n);
@@ -0,0 +1,188 @@
+#include "compare.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LINE_MAX_LEN 512
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+typedef struct {
+    double mean;
+    double p50;
+    double p99;
+} stats_t;
+
+// over msgs[i].us for every i whose op is `op`; returns how many
+static size_t op_stats(const replay_msg_t *msgs, size_t n, const char *op, stats_t *st)
+{
+    double *us = malloc((n ? n : 1) * sizeof(*us));
+    size_t k = 0;
+    double sum = 0;
+    for (size_t i = 0; us && i < n; i++) {
+        if (strcmp(msgs[i].op, op) != 0) continue;
+        us[k++] = msgs[i].us;
+        sum += msgs[i].us;
+    }
+    memset(st, 0, sizeof(*st));
+    if (k) {
+        qsort(us, k, sizeof(*us), cmp_double);
+        st->mean = sum / (double)k;
+        st->p50 = us[k / 2];
+        st->p99 = us[(size_t)(0.99 * (double)(k - 1))];
+    }
+    free(us);
+    return k;
+}
+
+// first message of each operation, so every one is listed once
+static bool first_of_op(const replay_msg_t *msgs, size_t i)
+{
+    for (size_t j = 0; j < i; j++) {
+        if (strcmp(msgs[j].op, msgs[i].op) == 0) return false;
+    }
+    return true;
+}
+
+void replay_print_summaries(FILE *out, const replay_msg_t *msgs, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        if (!first_of_op(msgs, i)) continue;
+        stats_t st;
+        size_t k = op_stats(msgs, n, msgs[i].op, &st);
+        fprintf(out, "{\"summary\":\"%s\",\"n\":%zu,\"mean_us\":%.3f,\"p50_us\":%.3f,\"p99_us\":%.3f}\n",
+                msgs[i].op, k, st.mean, st.p50, st.p99);
+    }
+}
+
+// The "msg" lines of a result file, in order. -errno, or -EINVAL if one is
+// missing (a --quiet run).
+static int load_result(const char *path, replay_msg_t **out, size_t *n, size_t *mismatches, double *speed)
+{
+    FILE *f = fopen(path, "r");
+    if (!f) return -errno;
+    *out = NULL;
+    *n = 0;
+    *mismatches = 0;
+    size_t cap = 0, msgs_total = 0;
+    bool have_total = false;
+    char line[LINE_MAX_LEN];
+    int rc = 0;
+    while (rc == 0 && fgets(line, sizeof(line), f)) {
+        size_t idx, bad;
+        replay_msg_t m;
+        char match[8];
+        unsigned cid;
+        if (sscanf(line, "{\"replay\":\"%*[^\"]\",\"records\":%*u,\"seeded\":%*[a-z],\"check\":\"%*[^\"]\",\"speed\":%lf",
+                   speed) == 1) {
+            continue;
+        }
+        if (sscanf(line, "{\"total\":\"%*[^\"]\",\"inputs\":%*u,\"messages\":%zu,\"mismatches\":%zu",
+                   &msgs_total, &bad) == 2) {
+            *mismatches = bad;
+            have_total = true;
+            continue;
+        }
+        if (sscanf(line, "{\"msg\":%zu,\"rec\":%zu,\"op\":\"%31[^\"]\",\"cid\":\"%x\",\"frames\":%u,\"us\":%lf,\"match\":%7[a-z]",
+                   &idx, &m.rec, m.op, &cid, &m.frames, &m.us, match) != 7) {
+            continue;
+        }
+        if (idx != *n) {
+            rc = -EINVAL;
+            break;
+        }
+        m.cid = cid;
+        m.match = strcmp(match, "true") == 0;
+        if (*n == cap) {
+            cap = cap ? 2 * cap : 256;
+            replay_msg_t *grown = realloc(*out, cap * sizeof(m));
+            if (!grown) {
+                rc = -ENOMEM;
+                break;
+            }
+            *out = grown;
+        }
+        (*out)[(*n)++] = m;
+    }
+    fclose(f);
+    if (rc == 0 && (!have_total || msgs_total != *n)) rc = -EINVAL;
+    if (rc != 0) {
+        free(*out);
+        *out = NULL;
+    }
+    return rc;
+}
+
+static double pct(double base, double now)
+{
+    return base > 0 ? 100.0 * (now - base) / base : 0.0;
+}
+
+int replay_compare(const char *base_path, const char *new_path, double max_regress_pct)
+{
+    replay_msg_t *base = NULL, *cur = NULL;
+    size_t nbase = 0, ncur = 0, bad_base = 0, bad_cur = 0;
+    double speed_base = -1, speed_cur = -1;
+    const char *path = base_path;
+    int rc = load_result(base_path, &base, &nbase, &bad_base, &speed_base);
+    if (rc == 0) {
+        path = new_path;
+        rc = load_result(new_path, &cur, &ncur, &bad_cur, &speed_cur);
+    }
+    if (rc != 0) {
+        fprintf(stderr, "%s: %s\n", path, rc == -EINVAL ? "not a complete ctaphid-replay result (--quiet?)" : strerror(-rc));
+        free(base);
+        return 2;
+    }
+    // same capture, same message boundaries
+    bool aligned = nbase == ncur;
+    for (size_t i = 0; aligned && i < nbase; i++) {
+        aligned = base[i].rec == cur[i].rec && strcmp(base[i].op, cur[i].op) == 0;
+    }
+    if (!aligned) {
+        fprintf(stderr, "%s and %s are not results of the same capture\n", base_path, new_path);
+        free(base);
+        free(cur);
+        return 2;
+    }
+
+    // paced inputs find colder caches than back-to-back ones
+    if (speed_base != speed_cur) {
+        fprintf(stderr, "warning: %s ran at --speed %g, %s at %g; timings are not comparable\n",
+                base_path, speed_base, new_path, speed_cur);
+    }
+
+    double sum_base = 0, sum_cur = 0;
+    for (size_t i = 0; i < nbase; i++) {
+        sum_base += base[i].us;
+        sum_cur += cur[i].us;
+        printf("{\"msg\":%zu,\"op\":\"%s\",\"base_us\":%.3f,\"new_us\":%.3f,\"delta_us\":%.3f,\"delta_pct\":%.1f}\n",
+               i, base[i].op, base[i].us, cur[i].us, cur[i].us - base[i].us, pct(base[i].us, cur[i].us));
+    }
+
+    unsigned regressions = 0;
+    for (size_t i = 0; i < nbase; i++) {
+        if (!first_of_op(base, i)) continue;
+        stats_t sb, sc;
+        size_t k = op_stats(base, nbase, base[i].op, &sb);
+        (void)op_stats(cur, ncur, base[i].op, &sc);
+        double d = pct(sb.p50, sc.p50);
+        bool regressed = max_regress_pct >= 0 && d > max_regress_pct;
+        if (regressed) regressions++;
+        printf("{\"compare\":\"%s\",\"n\":%zu,\"base_p50_us\":%.3f,\"new_p50_us\":%.3f,\"delta_pct\":%.1f,"
+               "\"base_p99_us\":%.3f,\"new_p99_us\":%.3f,\"regressed\":%s}\n",
+               base[i].op, k, sb.p50, sc.p50, d, sb.p99, sc.p99, regressed ? "true" : "false");
+    }
+    printf("{\"compare\":\"total\",\"messages\":%zu,\"base_us\":%.1f,\"new_us\":%.1f,\"delta_pct\":%.1f,"
+           "\"base_mismatches\":%zu,\"new_mismatches\":%zu,\"regressions\":%u}\n",
+           nbase, sum_base, sum_cur, pct(sum_base, sum_cur), bad_base, bad_cur, regressions);
+
+    free(base);
+    free(cur);
+    return bad_base || bad_cur || regressions ? 1 : 0;
+}
@@ -0,0 +1,27 @@
+#pragma once
+// ctaphid-replay's results: per-operation summaries and --compare, which
+// lines up two builds' results for the same capture message by message.
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+typedef struct {
+    size_t rec;        // capture record that completed the message
+    char op[32];       // "cbor/getAssertion", "ping", "up", ...
+    uint32_t cid;
+    unsigned frames;   // IN reports produced
+    double us;         // time this build spent on the record
+    bool match;
+} replay_msg_t;
+
+/** One {"summary":OP,...} line per operation: n, mean, p50, p99. */
+void replay_print_summaries(FILE *out, const replay_msg_t *msgs, size_t n);
+
+/**
+ * Reads two --result files and prints per-message and per-operation deltas
+ * of NEW against BASE. Returns 0, 1 if either run had mismatches or an
+ * operation's median got slower than `max_regress_pct` (ignored if < 0),
+ * 2 if the files can't be compared.
+ */
+int replay_compare(const char *base_path, const char *new_path, double max_regress_pct);
@@ -0,0 +1,470 @@
+// ctaphid-replay: runs a capture (ctaphid_capture.h) back through this
+// build's CTAPHID engine and core and checks that it answers the same.
+//
+//   ctaphid-replay CAPTURE [--speed X|max] [--check strict|frames|none]
+//                  [--result FILE] [--quiet]
+//   ctaphid-replay --compare BASE NEW [--max-regress-pct P]
+//
+// Every record that is an input - an OUT report, a presence verdict or
+// grant, a revocation, a tick, a pool refill - is applied at its recorded
+// time: the engine and the core read the capture's clock, not the host's,
+// and a seeded capture (roottap-sim --record) gets its RNG seed back, so
+// channel IDs, keys and signatures come out byte for byte as recorded.
+// --speed only paces the inputs against the wall clock: 1 is the original
+// timing, 10 ten times faster, max back to back.
+//
+// The IN reports an input produces are compared with the ones recorded
+// after it. --check frames compares CTAPHID headers and CTAP status bytes
+// only, for device captures whose keys the host doesn't have; it is the
+// default for captures without a seed. Channel IDs the replay allocates
+// differently are mapped onto the recorded ones.
+//
+// One JSON line per input that produced output (a "message": its response
+// or a KEEPALIVE/error) with the time this build spent on it, per-operation
+// summaries and a total. Run two builds on the same capture with --result
+// and compare them with --compare for per-message deltas.
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cap_file.h"
+#include "compare.h"
+#include "core_api.h"
+#include "cred_store.h"
+#include "crypto.h"
+#include "ctaphid.h"
+#include "ctaphid_capture.h"
+#include "ctaphid_port.h"
+#include "port_host.h"
+
+#define REPLAY_TXQ_DEPTH 20              // roottap-sim's, so spills happen alike
+#define REPLAY_CREDS_SIZE (64u * 1024u)  // roottap-sim's RAM store
+#define REPLAY_MAX_OUT 256               // IN reports one input may produce
+#define REPLAY_MAX_CIDS 64
+#define REPLAY_MAX_DIFFS 10              // mismatches described on stderr
+
+typedef enum {
+    CHECK_STRICT,
+    CHECK_FRAMES,
+    CHECK_NONE,
+} check_mode_t;
+
+static ctaphid_ctx_t s_ctx;
+static uint64_t s_now_us;   // the capture's clock
+
+static uint8_t s_txq[REPLAY_TXQ_DEPTH][CTAPHID_REPORT_LEN];
+static unsigned s_tx_reserved;
+static uint8_t s_out[REPLAY_MAX_OUT][CTAPHID_REPORT_LEN];
+static unsigned s_out_n;
+static unsigned s_out_dropped;
+
+// recorded channel ID -> the one this replay got for it
+static struct {
+    uint32_t rec;
+    uint32_t ours;
+} s_cids[REPLAY_MAX_CIDS];
+static unsigned s_ncids;
+
+// what each recorded channel last asked for, to name its messages
+static struct {
+    uint32_t cid;
+    uint8_t cmd;
+    uint8_t ctap;
+} s_req[REPLAY_MAX_CIDS];
+static unsigned s_nreq;
+
+static uint64_t capture_now_us(void)
+{
+    return s_now_us;
+}
+
+static uint8_t *replay_tx_reserve(void *user)
+{
+    (void)user;
+    if (s_tx_reserved >= REPLAY_TXQ_DEPTH) return NULL;
+    uint8_t *slot = s_txq[s_tx_reserved++];
+    memset(slot, 0, CTAPHID_REPORT_LEN);
+    return slot;
+}
+
+static int replay_tx_commit(void *user)
+{
+    (void)user;
+    for (unsigned i = 0; i < s_tx_reserved; i++) {
+        if (s_out_n < REPLAY_MAX_OUT) memcpy(s_out[s_out_n++], s_txq[i], CTAPHID_REPORT_LEN);
+        else s_out_dropped++;
+    }
+    s_tx_reserved = 0;
+    return 0;
+}
+
+static void replay_tx_abort(void *user)
+{
+    (void)user;
+    s_tx_reserved = 0;
+}
+
+// verdicts come from the capture
+static void replay_up_request(void *user, uint32_t cid)
+{
+    (void)user;
+    (void)cid;
+}
+
+static uint32_t be32(const uint8_t *p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static void put_be32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+static uint32_t cid_ours(uint32_t rec)
+{
+    for (unsigned i = 0; i < s_ncids; i++) {
+        if (s_cids[i].rec == rec) return s_cids[i].ours;
+    }
+    return rec;
+}
+
+static uint32_t cid_recorded(uint32_t ours)
+{
+    for (unsigned i = 0; i < s_ncids; i++) {
+        if (s_cids[i].ours == ours) return s_cids[i].rec;
+    }
+    return ours;
+}
+
+static void cid_map(uint32_t rec, uint32_t ours)
+{
+    if (rec == ours) return;
+    for (unsigned i = 0; i < s_ncids; i++) {
+        if (s_cids[i].rec == rec) {
+            s_cids[i].ours = ours;
+            return;
+        }
+    }
+    if (s_ncids < REPLAY_MAX_CIDS) {
+        s_cids[s_ncids].rec = rec;
+        s_cids[s_ncids].ours = ours;
+        s_ncids++;
+    }
+}
+
+static void note_request(const uint8_t *report)
+{
+    if (!(report[4] & 0x80)) return;
+    uint32_t cid = be32(report);
+    unsigned i = 0;
+    while (i < s_nreq && s_req[i].cid != cid) i++;
+    if (i == s_nreq) {
+        if (s_nreq == REPLAY_MAX_CIDS) return;
+        s_nreq++;
+    }
+    s_req[i].cid = cid;
+    s_req[i].cmd = report[4] & 0x7F;
+    s_req[i].ctap = report[7];
+}
+
+static const char *ctap_name(uint8_t cmd)
+{
+    switch (cmd) {
+    case 0x01: return "makeCredential";
+    case 0x02: return "getAssertion";
+    case 0x04: return "getInfo";
+    case 0x06: return "clientPIN";
+    case 0x07: return "reset";
+    case 0x08: return "getNextAssertion";
+    case 0x0B: return "selection";
+    default: return NULL;
+    }
+}
+
+// "cbor/getAssertion", "ping", "up", ... for the message an input completed
+static void op_name(const ctaphid_cap_rec_t *in, char *out, size_t len)
+{
+    switch (in->type) {
+    case CTAPHID_CAP_UP: snprintf(out, len, "up"); return;
+    case CTAPHID_CAP_GRANT: snprintf(out, len, "grant"); return;
+    case CTAPHID_CAP_REVOKE: snprintf(out, len, "revoke"); return;
+    case CTAPHID_CAP_TICK: snprintf(out, len, "tick"); return;
+    case CTAPHID_CAP_REFILL: snprintf(out, len, "refill"); return;
+    default: break;
+    }
+    uint32_t cid = be32(in->data);
+    for (unsigned i = 0; i < s_nreq; i++) {
+        if (s_req[i].cid != cid) continue;
+        switch (s_req[i].cmd) {
+        case CTAPHID_INIT: snprintf(out, len, "init"); return;
+        case CTAPHID_PING: snprintf(out, len, "ping"); return;
+        case CTAPHID_CANCEL: snprintf(out, len, "cancel"); return;
+        case CTAPHID_CBOR: {
+            const char *name = ctap_name(s_req[i].ctap);
+            if (name) snprintf(out, len, "cbor/%s", name);
+            else snprintf(out, len, "cbor/0x%02x", s_req[i].ctap);
+            return;
+        }
+        default: snprintf(out, len, "hid/0x%02x", s_req[i].cmd); return;
+        }
+    }
+    snprintf(out, len, "frame");
+}
+
+// Puts the recorded channel IDs into a report of ours; an INIT response
+// teaches which of ours stands for which recorded one.
+static void translate(const uint8_t *rec, uint8_t *ours)
+{
+    put_be32(ours, cid_recorded(be32(ours)));
+    if (rec[4] == (0x80 | CTAPHID_INIT) && ours[4] == rec[4]) {
+        cid_map(be32(&rec[15]), be32(&ours[15]));
+        memcpy(&ours[15], &rec[15], 4);
+    }
+}
+
+// Offset of the first byte `ours` differs from `rec` in, or -1.
+static int frame_diff(const uint8_t *rec, const uint8_t *ours, check_mode_t mode)
+{
+    size_t n = CTAPHID_REPORT_LEN;
+    if (mode == CHECK_FRAMES) {
+        // who and what, not how long: DER signatures vary in length
+        n = 5;
+        if (rec[4] == (0x80 | CTAPHID_CBOR) || rec[4] == (0x80 | CTAPHID_ERROR) ||
+            rec[4] == (0x80 | CTAPHID_KEEPALIVE)) {
+            if (rec[7] != ours[7]) return 7;
+        }
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (rec[i] != ours[i]) return (int)i;
+    }
+    return -1;
+}
+
+static void sleep_until_ns(uint64_t due_ns)
+{
+    struct timespec ts = { .tv_sec = (time_t)(due_ns / 1000000000ULL), .tv_nsec = (long)(due_ns % 1000000000ULL) };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+    }
+}
+
+static uint64_t mono_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// Applies one input record; false if the engine couldn't take it the way
+// the recording did.
+static bool apply(const ctaphid_cap_rec_t *r)
+{
+    switch (r->type) {
+    case CTAPHID_CAP_OUT: {
+        uint8_t report[CTAPHID_REPORT_LEN];
+        memcpy(report, r->data, sizeof(report));
+        uint32_t cid = cid_ours(be32(report));
+        put_be32(report, cid);
+        // the order sim_on_output and ctaphid_task_post_report use
+        if (report[4] == (0x80 | CTAPHID_CANCEL)) ctaphid_request_cancel(&s_ctx, cid);
+        ctaphid_on_report(&s_ctx, report, sizeof(report));
+        return true;
+    }
+    case CTAPHID_CAP_UP:
+        ctaphid_up_resolve(&s_ctx, r->arg);
+        return true;
+    case CTAPHID_CAP_GRANT: {
+        core_grant_t g = { .scope = r->arg, .uses = r->uses, .ttl_s = r->ttl_s };
+        ctaphid_up_grant(&s_ctx, &g);
+        return true;
+    }
+    case CTAPHID_CAP_REVOKE:
+        ctaphid_up_revoke(&s_ctx);
+        return true;
+    case CTAPHID_CAP_TICK:
+        ctaphid_tick(&s_ctx);
+        return true;
+    case CTAPHID_CAP_REFILL:
+        return crypto_pool_refill(r->arg) == r->arg;
+    default:
+        return false;
+    }
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s CAPTURE [--speed X|max] [--check strict|frames|none] [--result FILE] [--quiet]\n"
+            "       %s --compare BASE NEW [--max-regress-pct P]\n",
+            argv0, argv0);
+}
+
+int main(int argc, char **argv)
+{
+    const char *cap_path = NULL;
+    const char *result_path = NULL;
+    const char *base_path = NULL, *new_path = NULL;
+    double speed = 1.0;
+    double max_regress_pct = -1;
+    int check = -1;
+    bool quiet = false;
+
+    for (int i = 1; i < argc; i++) {
+        const char *val = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (strcmp(argv[i], "--speed") == 0 && val) {
+            speed = strcmp(val, "max") == 0 ? 0 : strtod(val, NULL);
+            if (speed < 0) {
+                usage(argv[0]);
+                return 2;
+            }
+            i++;
+        } else if (strcmp(argv[i], "--check") == 0 && val) {
+            if (strcmp(val, "strict") == 0) check = CHECK_STRICT;
+            else if (strcmp(val, "frames") == 0) check = CHECK_FRAMES;
+            else if (strcmp(val, "none") == 0) check = CHECK_NONE;
+            else {
+                usage(argv[0]);
+                return 2;
+            }
+            i++;
+        } else if (strcmp(argv[i], "--result") == 0 && val) {
+            result_path = val;
+            i++;
+        } else if (strcmp(argv[i], "--quiet") == 0) {
+            quiet = true;
+        } else if (strcmp(argv[i], "--compare") == 0 && val && i + 2 < argc) {
+            base_path = val;
+            new_path = argv[i + 2];
+            i += 2;
+        } else if (strcmp(argv[i], "--max-regress-pct") == 0 && val) {
+            max_regress_pct = strtod(val, NULL);
+            i++;
+        } else if (argv[i][0] != '-' && !cap_path) {
+            cap_path = argv[i];
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (base_path) return replay_compare(base_path, new_path, max_regress_pct);
+    if (!cap_path) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    ctaphid_cap_file_hdr_t hdr;
+    ctaphid_cap_rec_t *recs;
+    size_t nrecs;
+    int rc = cap_file_load(cap_path, &hdr, &recs, &nrecs);
+    if (rc != 0) {
+        fprintf(stderr, "%s: %s\n", cap_path, rc == -EINVAL ? "not a capture of this version" : strerror(-rc));
+        return 2;
+    }
+    bool seeded = hdr.flags & CTAPHID_CAP_F_SEEDED;
+    if (check < 0) check = seeded ? CHECK_STRICT : CHECK_FRAMES;
+    if (hdr.lost) fprintf(stderr, "%s: %u records were lost while recording\n", cap_path, (unsigned)hdr.lost);
+
+    FILE *res = stdout;
+    if (result_path && !(res = fopen(result_path, "w"))) {
+        fprintf(stderr, "%s: %s\n", result_path, strerror(errno));
+        return 2;
+    }
+
+    // the sim's start-up order: seed, store, engine
+    if (seeded) ctaphid_port_host_seed(hdr.seed);
+    s_now_us = nrecs ? recs[0].ts_us : 0;
+    ctaphid_port_host_set_clock(capture_now_us);
+    cred_flash_ram_t creds;
+    if (cred_flash_ram_init(&creds, REPLAY_CREDS_SIZE) != 0 || cred_store_mount(&creds.flash) != 0) {
+        fprintf(stderr, "credential store unusable\n");
+        return 1;
+    }
+    ctaphid_io_t io = {
+        .tx_reserve = replay_tx_reserve,
+        .tx_commit = replay_tx_commit,
+        .tx_abort = replay_tx_abort,
+        .up_request = replay_up_request,
+    };
+    ctaphid_init(&s_ctx, &io);
+
+    fprintf(res, "{\"replay\":\"%s\",\"records\":%zu,\"seeded\":%s,\"check\":\"%s\",\"speed\":%.3g}\n",
+            cap_path, nrecs, seeded ? "true" : "false",
+            check == CHECK_STRICT ? "strict" : check == CHECK_FRAMES ? "frames" : "none", speed);
+
+    replay_msg_t *msgs = calloc(nrecs ? nrecs : 1, sizeof(*msgs));
+    size_t nmsgs = 0, inputs = 0, mismatches = 0, diffs = 0;
+    uint64_t busy_ns = 0;
+    uint64_t wall0 = mono_ns();
+    uint64_t ts0 = s_now_us;
+
+    for (size_t i = 0; i < nrecs; i++) {
+        const ctaphid_cap_rec_t *r = &recs[i];
+        if (r->type == CTAPHID_CAP_IN) continue;   // only ones before the first input
+        size_t exp_from = i + 1, exp_to = exp_from;
+        while (exp_to < nrecs && recs[exp_to].type == CTAPHID_CAP_IN) exp_to++;
+
+        if (speed > 0 && r->ts_us > ts0) sleep_until_ns(wall0 + (uint64_t)((double)(r->ts_us - ts0) * 1000.0 / speed));
+        s_now_us = r->ts_us;
+        if (r->type == CTAPHID_CAP_OUT) note_request(r->data);
+
+        s_out_n = 0;
+        s_out_dropped = 0;
+        uint64_t t0 = mono_ns();
+        bool ok = apply(r);
+        uint64_t dt = mono_ns() - t0;
+        busy_ns += dt;
+        inputs++;
+
+        size_t expected = exp_to - exp_from;
+        for (size_t k = 0; k < s_out_n && k < expected; k++) translate(recs[exp_from + k].data, s_out[k]);
+        if (!ok && diffs++ < REPLAY_MAX_DIFFS) fprintf(stderr, "record %zu: input not taken as recorded\n", i);
+        if (check != CHECK_NONE && (s_out_dropped || s_out_n != expected)) {
+            if (diffs++ < REPLAY_MAX_DIFFS) {
+                fprintf(stderr, "record %zu: %u IN reports, %zu recorded\n", i, s_out_n + s_out_dropped, expected);
+            }
+            ok = false;
+        }
+        for (size_t k = 0; ok && check != CHECK_NONE && k < s_out_n; k++) {
+            int at = frame_diff(recs[exp_from + k].data, s_out[k], (check_mode_t)check);
+            if (at < 0) continue;
+            if (diffs++ < REPLAY_MAX_DIFFS) {
+                fprintf(stderr, "record %zu: IN report %zu differs at byte %d (recorded %02x, replayed %02x)\n",
+                        i, k, at, recs[exp_from + k].data[at], s_out[k][at]);
+            }
+            ok = false;
+        }
+        if (!ok) mismatches++;
+        if (s_out_n == 0 && expected == 0 && ok) continue;
+
+        replay_msg_t *m = &msgs[nmsgs];
+        m->rec = i;
+        op_name(r, m->op, sizeof(m->op));
+        m->cid = r->type == CTAPHID_CAP_OUT ? be32(r->data) : 0;
+        m->frames = s_out_n;
+        m->us = (double)dt / 1000.0;
+        m->match = ok;
+        if (!quiet || !ok) {
+            fprintf(res, "{\"msg\":%zu,\"rec\":%zu,\"op\":\"%s\",\"cid\":\"%08x\",\"frames\":%u,\"us\":%.3f,\"match\":%s}\n",
+                    nmsgs, m->rec, m->op, (unsigned)m->cid, m->frames, m->us, ok ? "true" : "false");
+        }
+        nmsgs++;
+    }
+
+    replay_print_summaries(res, msgs, nmsgs);
+    fprintf(res, "{\"total\":\"%s\",\"inputs\":%zu,\"messages\":%zu,\"mismatches\":%zu,\"busy_us\":%.1f,\"wall_ms\":%.1f}\n",
+            cap_path, inputs, nmsgs, mismatches, (double)busy_ns / 1000.0, (double)(mono_ns() - wall0) / 1e6);
+    if (res != stdout) fclose(res);
+
+    free(msgs);
+    free(recs);
+    cred_flash_ram_free(&creds);
+    return mismatches ? 1 : 0;
+}
@@ -0,0 +1,100 @@
+// Write-through file image for the credential store: reads come from RAM,
+// every write or erase is applied to RAM first and then copied to the file.
+
+#include "cred_file.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static int sync_range(const cred_file_t *cf, uint32_t addr, size_t len)
+{
+    const uint8_t *p = cf->ram.mem + addr;
+    while (len > 0) {
+        ssize_t n = pwrite(cf->fd, p, len, (off_t)addr);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        addr += (uint32_t)n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int file_read(const cred_flash_t *f, uint32_t addr, void *dst, size_t len)
+{
+    const cred_file_t *cf = f->user;
+    return cf->ram.flash.read(&cf->ram.flash, addr, dst, len);
+}
+
+static int file_write(const cred_flash_t *f, uint32_t addr, const void *src, size_t len)
+{
+    const cred_file_t *cf = f->user;
+    if (cf->ram.flash.write(&cf->ram.flash, addr, src, len) != 0) return -1;
+    return sync_range(cf, addr, len);
+}
+
+static int file_erase(const cred_flash_t *f, uint32_t addr)
+{
+    const cred_file_t *cf = f->user;
+    if (cf->ram.flash.erase(&cf->ram.flash, addr) != 0) return -1;
+    return sync_range(cf, addr, CRED_FLASH_SECTOR);
+}
+
+int cred_file_open(cred_file_t *cf, const char *path, uint32_t size)
+{
+    struct stat sb;
+    int err;
+
+    memset(cf, 0, sizeof(*cf));
+    if (cred_flash_ram_init(&cf->ram, size) != 0) return -ENOMEM;
+    size = cf->ram.flash.size;
+
+    cf->fd = open(path, O_RDWR | O_CREAT, 0600);
+    if (cf->fd < 0) {
+        err = -errno;
+        goto fail;
+    }
+    if (fstat(cf->fd, &sb) != 0) {
+        err = -errno;
+        goto fail;
+    }
+    if (sb.st_size == 0) {
+        // new image: erased flash
+        if (sync_range(cf, 0, size) != 0) {
+            err = -errno;
+            goto fail;
+        }
+    } else if (sb.st_size != (off_t)size) {
+        err = -EINVAL;   // made with a different size
+        goto fail;
+    } else if (pread(cf->fd, cf->ram.mem, size, 0) != (ssize_t)size) {
+        err = -EIO;
+        goto fail;
+    }
+
+    cf->flash = (cred_flash_t){
+        .read = file_read,
+        .write = file_write,
+        .erase = file_erase,
+        .size = size,
+        .user = cf,
+    };
+    return 0;
+
+fail:
+    if (cf->fd >= 0) close(cf->fd);
+    cred_flash_ram_free(&cf->ram);
+    return err;
+}
+
+void cred_file_close(cred_file_t *cf)
+{
+    if (cred_store_flash() == &cf->flash) (void)cred_store_mount(NULL);
+    if (cf->fd >= 0) close(cf->fd);
+    cred_flash_ram_free(&cf->ram);
+}
@@ -0,0 +1,17 @@
+#pragma once
+// Credential store image in a regular file, so roottap-sim remembers its
+// credentials across restarts like the device does.
+#include <stdint.h>
+
+#include "cred_store.h"
+
+typedef struct {
+    cred_flash_ram_t ram;   // working copy, NOR rules enforced here
+    cred_flash_t flash;     // what the store mounts: ram, then the file
+    int fd;
+} cred_file_t;
+
+/** Opens or creates `path` as an image of `size` bytes. 0 or -errno. */
+int cred_file_open(cred_file_t *cf, const char *path, uint32_t size);
+
+void cred_file_close(cred_file_t *cf);
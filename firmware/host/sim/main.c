@@ -0,0 +1,378 @@
+// roottap-sim: runs the device's CTAPHID engine and Rust core on Linux and
+// exposes them as a FIDO HID device through /dev/uhid. Any hidraw client
+// (libfido2, pam_u2f, a browser) can then talk to it without hardware.
+//
+// User presence is answered by policy instead of the phone:
+//   --up approve|deny   fixed verdict after --up-delay-ms (default approve, 0)
+//   --up prompt         ask on the terminal (y/n)
+//   --up-grant rp|host:SECONDS[:USES]
+//                       approve like a phone that also grants the RP (or
+//                       every RP) for a while, so later sign-ins skip it
+//   --up-grant enroll:SECONDS:USES
+//                       likewise for the next USES MakeCredentials
+//
+// --socket PATH serves the device on a Unix socket instead of /dev/uhid, for
+// machines without it; host/linux's tools open it as "unix:PATH".
+//
+// --record FILE captures the session for ctaphid-replay (ctaphid_capture.h):
+// every report, presence verdict and pool refill, with the RNG seeded
+// (--seed N, or a random seed stored in the file) so a replay draws the
+// same channel IDs, keys and nonces. A seeded sim's keys are not secret.
+//
+// Credentials go to a 64 KiB flash image like the device's "creds"
+// partition: in RAM by default, or in the file given with --creds so they
+// survive a restart.
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "core_api.h"
+#include "cred_file.h"
+#include "cred_store.h"
+#include "crypto.h"
+#include "ctaphid.h"
+#include "cap_file.h"
+#include "ctaphid_capture.h"
+#include "ctaphid_port.h"
+#include "port_host.h"
+#include "sock_dev.h"
+#include "uhid_dev.h"
+
+#define SIM_TXQ_DEPTH 20   // matches CONFIG_USB_HID_TXQ_DEPTH
+#define SIM_CREDS_SIZE (64u * 1024u)   // docs/setup/OTA/partitions.csv
+
+typedef enum {
+    UP_MODE_APPROVE,
+    UP_MODE_DENY,
+    UP_MODE_PROMPT,
+} up_mode_t;
+
+static const char *TAG = "sim";
+
+static uhid_dev_t s_dev;
+static sock_dev_t s_sock;
+static bool s_use_sock;
+static ctaphid_ctx_t s_ctx;
+
+// IN reports reserved by the engine but not committed yet
+static uint8_t s_txq[SIM_TXQ_DEPTH][UHID_DEV_REPORT_LEN];
+static unsigned s_tx_reserved;
+
+static up_mode_t s_up_mode = UP_MODE_APPROVE;
+static unsigned s_up_delay_ms;
+static bool s_up_pending;
+static uint64_t s_up_due_us;
+static core_grant_t s_up_grant;   // scope 0: approvals grant nothing
+
+static volatile sig_atomic_t s_stop;
+
+static cred_file_t s_creds_file;
+static cred_flash_ram_t s_creds_ram;
+
+static cap_file_t s_cap;
+
+static uint8_t *sim_tx_reserve(void *user)
+{
+    (void)user;
+    if (s_tx_reserved >= SIM_TXQ_DEPTH) return NULL;
+    uint8_t *slot = s_txq[s_tx_reserved++];
+    memset(slot, 0, UHID_DEV_REPORT_LEN);
+    return slot;
+}
+
+static int sim_tx_commit(void *user)
+{
+    (void)user;
+    int rc = 0;
+    for (unsigned i = 0; i < s_tx_reserved; i++) {
+        int err = s_use_sock ? sock_dev_send(&s_sock, s_txq[i]) : uhid_dev_send(&s_dev, s_txq[i]);
+        if (err != 0 && rc == 0) rc = err;
+    }
+    s_tx_reserved = 0;
+    return rc;
+}
+
+static void sim_tx_abort(void *user)
+{
+    (void)user;
+    s_tx_reserved = 0;
+}
+
+static void sim_up_request(void *user, uint32_t cid)
+{
+    (void)user;
+    s_up_pending = true;
+    s_up_due_us = ctaphid_port_now_us() + (uint64_t)s_up_delay_ms * 1000ULL;
+    if (s_up_mode == UP_MODE_PROMPT) {
+        fprintf(stderr, "user presence requested (cid %08x) - approve? [y/n] ", (unsigned)cid);
+        fflush(stderr);
+    }
+}
+
+static void sim_on_output(void *user, const uint8_t *report, size_t len)
+{
+    (void)user;
+    if (len != UHID_DEV_REPORT_LEN) {
+        CTAPHID_LOGW(TAG, "dropping %u-byte output report", (unsigned)len);
+        return;
+    }
+    // Same ordering as ctaphid_task_post_report: flag CANCEL before the frame
+    if (report[4] == (0x80 | CTAPHID_CANCEL)) {
+        uint32_t cid = (uint32_t)report[0] << 24 | (uint32_t)report[1] << 16 |
+                       (uint32_t)report[2] << 8 | report[3];
+        ctaphid_request_cancel(&s_ctx, cid);
+    }
+    ctaphid_on_report(&s_ctx, report, len);
+}
+
+static void up_resolve(int verdict)
+{
+    s_up_pending = false;
+    if (verdict == CORE_UP_APPROVED && s_up_grant.scope) {
+        ctaphid_up_grant(&s_ctx, &s_up_grant);
+    } else {
+        ctaphid_up_resolve(&s_ctx, verdict);
+    }
+}
+
+// rp|host:SECONDS[:USES] or enroll:SECONDS:USES
+static bool parse_grant(const char *val, core_grant_t *g)
+{
+    char scope[8];
+    unsigned secs = 0, uses = 0;
+    if (sscanf(val, "%7[a-z]:%u:%u", scope, &secs, &uses) < 2 || secs == 0 || uses > UINT16_MAX) {
+        return false;
+    }
+    if (strcmp(scope, "rp") == 0) g->scope = CORE_GRANT_RP;
+    else if (strcmp(scope, "host") == 0) g->scope = CORE_GRANT_HOST;
+    else if (strcmp(scope, "enroll") == 0 && uses > 0) g->scope = CORE_GRANT_ENROLL;
+    else return false;
+    g->ttl_s = secs;
+    g->uses = (uint16_t)uses;
+    return true;
+}
+
+static void read_prompt_answer(void)
+{
+    char line[32];
+    if (!fgets(line, sizeof(line), stdin)) {
+        s_stop = 1;
+        return;
+    }
+    if (!s_up_pending) return;
+    up_resolve(line[0] == 'y' || line[0] == 'Y' ? CORE_UP_APPROVED : CORE_UP_DENIED);
+}
+
+static int poll_timeout_ms(void)
+{
+    int timeout = -1;
+    if (!ctaphid_idle(&s_ctx)) timeout = CTAPHID_KEEPALIVE_MS;
+    if (s_up_pending && s_up_mode != UP_MODE_PROMPT) {
+        uint64_t now = ctaphid_port_now_us();
+        int due = s_up_due_us > now ? (int)((s_up_due_us - now + 999) / 1000) : 0;
+        if (timeout < 0 || due < timeout) timeout = due;
+    }
+    // idle with room in the crypto pool: come back right away to refill
+    if (timeout < 0 && crypto_pool_needs_refill()) timeout = 0;
+    return timeout;
+}
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    s_stop = 1;
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s [--name NAME] [--up approve|deny|prompt] [--up-delay-ms N]"
+            " [--up-grant rp|host|enroll:SECONDS[:USES]] [--creds FILE] [--socket PATH]"
+            " [--record FILE] [--seed N]\n",
+            argv0);
+}
+
+int main(int argc, char **argv)
+{
+    int rc;
+    const char *name = "roottap-sim";
+    const char *creds_path = NULL;
+    const char *sock_path = NULL;
+    const char *record_path = NULL;
+    bool seeded = false;
+    uint64_t seed = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *val = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (strcmp(arg, "--name") == 0 && val) {
+            name = val;
+            i++;
+        } else if (strcmp(arg, "--up") == 0 && val) {
+            if (strcmp(val, "approve") == 0) s_up_mode = UP_MODE_APPROVE;
+            else if (strcmp(val, "deny") == 0) s_up_mode = UP_MODE_DENY;
+            else if (strcmp(val, "prompt") == 0) s_up_mode = UP_MODE_PROMPT;
+            else {
+                usage(argv[0]);
+                return 2;
+            }
+            i++;
+        } else if (strcmp(arg, "--up-delay-ms") == 0 && val) {
+            s_up_delay_ms = (unsigned)strtoul(val, NULL, 0);
+            i++;
+        } else if (strcmp(arg, "--up-grant") == 0 && val) {
+            if (!parse_grant(val, &s_up_grant)) {
+                usage(argv[0]);
+                return 2;
+            }
+            i++;
+        } else if (strcmp(arg, "--creds") == 0 && val) {
+            creds_path = val;
+            i++;
+        } else if (strcmp(arg, "--socket") == 0 && val) {
+            sock_path = val;
+            i++;
+        } else if (strcmp(arg, "--record") == 0 && val) {
+            record_path = val;
+            i++;
+        } else if (strcmp(arg, "--seed") == 0 && val) {
+            seed = strtoull(val, NULL, 0);
+            seeded = true;
+            i++;
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    // before anything draws from the RNG: the store and the core included
+    if (record_path && !seeded) {
+        seed = (uint64_t)ctaphid_port_random() << 32 | ctaphid_port_random();
+        seeded = true;
+    }
+    if (seeded) {
+        ctaphid_port_host_seed(seed);
+        CTAPHID_LOGW(TAG, "seeded RNG (%llu): keys are not secret", (unsigned long long)seed);
+    }
+
+    const cred_flash_t *flash = NULL;
+    if (creds_path) {
+        rc = cred_file_open(&s_creds_file, creds_path, SIM_CREDS_SIZE);
+        if (rc != 0) {
+            CTAPHID_LOGE(TAG, "%s: %s", creds_path, strerror(-rc));
+            return 1;
+        }
+        flash = &s_creds_file.flash;
+    } else if (cred_flash_ram_init(&s_creds_ram, SIM_CREDS_SIZE) == 0) {
+        flash = &s_creds_ram.flash;
+    }
+    if (!flash || cred_store_mount(flash) != 0) {
+        CTAPHID_LOGE(TAG, "credential store unusable");
+        return 1;
+    }
+    CTAPHID_LOGI(TAG, "%u credentials in %s", (unsigned)cred_store_count(),
+                 creds_path ? creds_path : "RAM");
+
+    if (record_path) {
+        rc = cap_file_create(&s_cap, record_path, CTAPHID_CAP_F_SEEDED, seed);
+        if (rc != 0) {
+            CTAPHID_LOGE(TAG, "%s: %s", record_path, strerror(-rc));
+            return 1;
+        }
+        // a replay starts from an empty store
+        if (creds_path) CTAPHID_LOGW(TAG, "recording with --creds: replays won't see its credentials");
+        ctaphid_capture_start(cap_file_write, &s_cap);
+    }
+
+    ctaphid_io_t io = {
+        .tx_reserve = sim_tx_reserve,
+        .tx_commit = sim_tx_commit,
+        .tx_abort = sim_tx_abort,
+        .up_request = sim_up_request,
+    };
+    ctaphid_init(&s_ctx, &io);
+
+    s_use_sock = sock_path != NULL;
+    rc = s_use_sock ? sock_dev_open(&s_sock, sock_path, sim_on_output, NULL)
+                    : uhid_dev_open(&s_dev, name, sim_on_output, NULL);
+    if (rc != 0) {
+        CTAPHID_LOGE(TAG, "%s: %s", s_use_sock ? sock_path : "/dev/uhid", strerror(-rc));
+        return 1;
+    }
+    CTAPHID_LOGI(TAG, "FIDO HID device '%s' created on %s (up=%s)", name,
+                 s_use_sock ? sock_path : "uhid",
+                 s_up_mode == UP_MODE_PROMPT ? "prompt" :
+                 s_up_mode == UP_MODE_DENY ? "deny" : "approve");
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    while (!s_stop) {
+        // device fds first, then stdin for --up prompt
+        struct pollfd fds[2 + SOCK_DEV_MAX_CLIENTS];
+        size_t ndev = 1;
+        if (s_use_sock) ndev = sock_dev_pollfds(&s_sock, fds, SOCK_DEV_MAX_CLIENTS + 1);
+        else fds[0] = (struct pollfd){ .fd = s_dev.fd, .events = POLLIN };
+        nfds_t nfds = ndev;
+        if (s_up_mode == UP_MODE_PROMPT) fds[nfds++] = (struct pollfd){ .fd = STDIN_FILENO, .events = POLLIN };
+
+        int n = poll(fds, nfds, poll_timeout_ms());
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            CTAPHID_LOGE(TAG, "poll: %s", strerror(errno));
+            break;
+        }
+
+        if (s_use_sock) {
+            sock_dev_dispatch(&s_sock, fds, ndev);
+        } else if (fds[0].revents & POLLIN) {
+            rc = uhid_dev_dispatch(&s_dev);
+            if (rc != 0) {
+                CTAPHID_LOGE(TAG, "uhid: %s", strerror(-rc));
+                break;
+            }
+        }
+        if (nfds > ndev && (fds[ndev].revents & (POLLIN | POLLHUP))) {
+            read_prompt_answer();
+        }
+
+        if (s_up_pending && s_up_mode != UP_MODE_PROMPT &&
+            ctaphid_port_now_us() >= s_up_due_us) {
+            up_resolve(s_up_mode == UP_MODE_DENY ? CORE_UP_DENIED : CORE_UP_APPROVED);
+        }
+
+        ctaphid_tick(&s_ctx);
+        // the engine drops a parked request on CANCEL or its own timeout
+        if (s_up_pending && ctaphid_idle(&s_ctx)) s_up_pending = false;
+
+        // the device does this from a low-priority task; one entry per
+        // pass keeps the loop responsive
+        if (n == 0 && ctaphid_idle(&s_ctx)) {
+            unsigned made = crypto_pool_refill(1);
+            // part of the session: it decides which draws keygen and signing see
+            if (made && record_path) ctaphid_capture_event(CTAPHID_CAP_REFILL, ctaphid_port_now_us(), (uint8_t)made, 0, 0);
+        }
+    }
+
+    if (record_path) {
+        ctaphid_capture_stop();
+        rc = cap_file_close(&s_cap, ctaphid_capture_lost());
+        if (rc != 0) CTAPHID_LOGE(TAG, "%s: %s", record_path, strerror(-rc));
+        else CTAPHID_LOGI(TAG, "%u records in %s", (unsigned)ctaphid_capture_total(), record_path);
+    }
+    if (s_use_sock) sock_dev_close(&s_sock);
+    else uhid_dev_close(&s_dev);
+    if (creds_path) cred_file_close(&s_creds_file);
+    else cred_flash_ram_free(&s_creds_ram);
+    return 0;
+}
@@ -0,0 +1,120 @@
+// The FIDO HID device on a Unix socket, for machines without /dev/uhid
+// (containers, CI). Behaves like a hidraw node: any number of clients, each
+// packet one report, every IN report goes to every client. host/linux's
+// client library opens it as "unix:PATH".
+
+#define _GNU_SOURCE   // accept4
+#include "sock_dev.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "ctaphid_port.h"
+
+static const char *TAG = "sock_dev";
+
+int sock_dev_open(sock_dev_t *dev, const char *path, sock_dev_out_cb_t cb, void *user)
+{
+    memset(dev, 0, sizeof(*dev));
+    for (size_t i = 0; i < SOCK_DEV_MAX_CLIENTS; i++) dev->client_fd[i] = -1;
+    dev->out_cb = cb;
+    dev->out_user = user;
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) return -ENAMETOOLONG;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+    snprintf(dev->path, sizeof(dev->path), "%s", path);
+
+    dev->listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (dev->listen_fd < 0) return -errno;
+    (void)unlink(path);
+    if (bind(dev->listen_fd, (const struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(dev->listen_fd, SOCK_DEV_MAX_CLIENTS) != 0) {
+        int err = -errno;
+        close(dev->listen_fd);
+        dev->listen_fd = -1;
+        return err;
+    }
+    return 0;
+}
+
+size_t sock_dev_pollfds(const sock_dev_t *dev, struct pollfd *fds, size_t max)
+{
+    size_t n = 0;
+    if (n < max) fds[n++] = (struct pollfd){ .fd = dev->listen_fd, .events = POLLIN };
+    for (size_t i = 0; i < SOCK_DEV_MAX_CLIENTS && n < max; i++) {
+        if (dev->client_fd[i] >= 0) fds[n++] = (struct pollfd){ .fd = dev->client_fd[i], .events = POLLIN };
+    }
+    return n;
+}
+
+static void drop_client(sock_dev_t *dev, int fd)
+{
+    for (size_t i = 0; i < SOCK_DEV_MAX_CLIENTS; i++) {
+        if (dev->client_fd[i] == fd) dev->client_fd[i] = -1;
+    }
+    close(fd);
+}
+
+static void accept_client(sock_dev_t *dev)
+{
+    int fd = accept4(dev->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (fd < 0) return;
+    for (size_t i = 0; i < SOCK_DEV_MAX_CLIENTS; i++) {
+        if (dev->client_fd[i] < 0) {
+            dev->client_fd[i] = fd;
+            return;
+        }
+    }
+    CTAPHID_LOGW(TAG, "%d clients already, refusing one", SOCK_DEV_MAX_CLIENTS);
+    close(fd);
+}
+
+void sock_dev_dispatch(sock_dev_t *dev, const struct pollfd *fds, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        if (!fds[i].revents) continue;
+        if (fds[i].fd == dev->listen_fd) {
+            accept_client(dev);
+            continue;
+        }
+        uint8_t report[SOCK_DEV_REPORT_LEN + 1];
+        ssize_t len = recv(fds[i].fd, report, sizeof(report), MSG_DONTWAIT);
+        if (len == 0 || (len < 0 && errno != EAGAIN && errno != EINTR)) {
+            drop_client(dev, fds[i].fd);
+        } else if (len > 0) {
+            dev->out_cb(dev->out_user, report, (size_t)len);
+        }
+    }
+}
+
+int sock_dev_send(sock_dev_t *dev, const uint8_t *report)
+{
+    for (size_t i = 0; i < SOCK_DEV_MAX_CLIENTS; i++) {
+        int fd = dev->client_fd[i];
+        if (fd < 0) continue;
+        // a client that stopped reading loses reports, like a slow hidraw reader
+        if (send(fd, report, SOCK_DEV_REPORT_LEN, MSG_DONTWAIT | MSG_NOSIGNAL) < 0 &&
+            errno != EAGAIN && errno != EWOULDBLOCK) {
+            drop_client(dev, fd);
+        }
+    }
+    return 0;
+}
+
+void sock_dev_close(sock_dev_t *dev)
+{
+    for (size_t i = 0; i < SOCK_DEV_MAX_CLIENTS; i++) {
+        if (dev->client_fd[i] >= 0) close(dev->client_fd[i]);
+        dev->client_fd[i] = -1;
+    }
+    if (dev->listen_fd >= 0) {
+        close(dev->listen_fd);
+        (void)unlink(dev->path);
+    }
+    dev->listen_fd = -1;
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <poll.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SOCK_DEV_REPORT_LEN 64
+#define SOCK_DEV_MAX_CLIENTS 16
+
+typedef void (*sock_dev_out_cb_t)(void *user, const uint8_t *report, size_t len);
+
+typedef struct {
+    int listen_fd;
+    int client_fd[SOCK_DEV_MAX_CLIENTS];   // -1: free
+    char path[108];
+    sock_dev_out_cb_t out_cb;
+    void *out_user;
+} sock_dev_t;
+
+/**
+ * Listen on a SOCK_SEQPACKET Unix socket at `path`, one 64-byte report per
+ * packet. Returns 0 or -errno.
+ */
+int sock_dev_open(sock_dev_t *dev, const char *path, sock_dev_out_cb_t cb, void *user);
+
+/** Fills up to `max` pollfds (listener first); returns how many. */
+size_t sock_dev_pollfds(const sock_dev_t *dev, struct pollfd *fds, size_t max);
+
+/** Accepts clients and reads their reports for every readable fd in `fds`. */
+void sock_dev_dispatch(sock_dev_t *dev, const struct pollfd *fds, size_t n);
+
+/** Send one 64-byte IN report to every client. */
+int sock_dev_send(sock_dev_t *dev, const uint8_t *report);
+
+void sock_dev_close(sock_dev_t *dev);
@@ -0,0 +1,128 @@
+// FIDO HID device on top of Linux UHID. The kernel exposes it as
+// /dev/hidrawN, so libfido2, pam_u2f and browsers see a regular security key.
+
+#include "uhid_dev.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/uhid.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+// Same descriptor as s_hid_report_desc in components/usb_hid/usb_hid.c.
+static const uint8_t s_report_desc[] = {
+    0x06, 0xD0, 0xF1,          // Usage Page (FIDO Alliance)
+    0x09, 0x01,                // Usage (U2F HID Authenticator Device)
+    0xA1, 0x01,                // Collection (Application)
+    0x09, 0x20,                //   Usage (Input Report Data)
+    0x15, 0x00,                //   Logical Min (0)
+    0x26, 0xFF, 0x00,          //   Logical Max (255)
+    0x75, 0x08,                //   Report Size (8)
+    0x95, UHID_DEV_REPORT_LEN, //   Report Count (64)
+    0x81, 0x02,                //   Input (Data,Var,Abs)
+    0x09, 0x21,                //   Usage (Output Report Data)
+    0x95, UHID_DEV_REPORT_LEN, //   Report Count (64)
+    0x91, 0x02,                //   Output (Data,Var,Abs)
+    0xC0                       // End Collection
+};
+
+static int uhid_write(int fd, const struct uhid_event *ev)
+{
+    ssize_t n = write(fd, ev, sizeof(*ev));
+    if (n < 0) return -errno;
+    return n == (ssize_t)sizeof(*ev) ? 0 : -EIO;
+}
+
+int uhid_dev_open(uhid_dev_t *dev, const char *name, uhid_dev_out_cb_t cb, void *user)
+{
+    memset(dev, 0, sizeof(*dev));
+    dev->out_cb = cb;
+    dev->out_user = user;
+    dev->fd = open("/dev/uhid", O_RDWR | O_CLOEXEC);
+    if (dev->fd < 0) return -errno;
+
+    struct uhid_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.type = UHID_CREATE2;
+    snprintf((char *)ev.u.create2.name, sizeof(ev.u.create2.name), "%s", name);
+    snprintf((char *)ev.u.create2.uniq, sizeof(ev.u.create2.uniq), "%s-%d", name, (int)getpid());
+    memcpy(ev.u.create2.rd_data, s_report_desc, sizeof(s_report_desc));
+    ev.u.create2.rd_size = sizeof(s_report_desc);
+    ev.u.create2.bus = BUS_USB;
+    ev.u.create2.vendor = 0x303A;   // Espressif VID, as on the device
+    ev.u.create2.product = 0x4004;
+    ev.u.create2.version = 0x0100;
+
+    int rc = uhid_write(dev->fd, &ev);
+    if (rc != 0) {
+        close(dev->fd);
+        dev->fd = -1;
+    }
+    return rc;
+}
+
+int uhid_dev_dispatch(uhid_dev_t *dev)
+{
+    struct uhid_event ev;
+    ssize_t n = read(dev->fd, &ev, sizeof(ev));
+    if (n < 0) return -errno;
+    if (n == 0) return -EIO;
+
+    switch (ev.type) {
+    case UHID_OUTPUT: {
+        // hidraw writers prepend the report number (0 here); some kernels
+        // pass it through, so accept 65-byte outputs too.
+        const uint8_t *data = ev.u.output.data;
+        size_t len = ev.u.output.size;
+        if (len == UHID_DEV_REPORT_LEN + 1) {
+            data++;
+            len--;
+        }
+        if (dev->out_cb) dev->out_cb(dev->out_user, data, len);
+        break;
+    }
+    case UHID_GET_REPORT: {
+        // No feature reports, same as tud_hid_get_report_cb.
+        struct uhid_event r;
+        memset(&r, 0, sizeof(r));
+        r.type = UHID_GET_REPORT_REPLY;
+        r.u.get_report_reply.id = ev.u.get_report.id;
+        r.u.get_report_reply.err = EIO;
+        return uhid_write(dev->fd, &r);
+    }
+    case UHID_SET_REPORT: {
+        struct uhid_event r;
+        memset(&r, 0, sizeof(r));
+        r.type = UHID_SET_REPORT_REPLY;
+        r.u.set_report_reply.id = ev.u.set_report.id;
+        r.u.set_report_reply.err = EIO;
+        return uhid_write(dev->fd, &r);
+    }
+    default:
+        // START/STOP/OPEN/CLOSE need no action
+        break;
+    }
+    return 0;
+}
+
+int uhid_dev_send(uhid_dev_t *dev, const uint8_t *report)
+{
+    struct uhid_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.type = UHID_INPUT2;
+    ev.u.input2.size = UHID_DEV_REPORT_LEN;
+    memcpy(ev.u.input2.data, report, UHID_DEV_REPORT_LEN);
+    return uhid_write(dev->fd, &ev);
+}
+
+void uhid_dev_close(uhid_dev_t *dev)
+{
+    if (dev->fd < 0) return;
+    struct uhid_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.type = UHID_DESTROY;
+    (void)uhid_write(dev->fd, &ev);
+    close(dev->fd);
+    dev->fd = -1;
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#define UHID_DEV_REPORT_LEN 64
+
+typedef void (*uhid_dev_out_cb_t)(void *user, const uint8_t *report, size_t len);
+
+typedef struct {
+    int fd;
+    uhid_dev_out_cb_t out_cb;
+    void *out_user;
+} uhid_dev_t;
+
+/** Create a FIDO HID device through /dev/uhid. Returns 0 or -errno. */
+int uhid_dev_open(uhid_dev_t *dev, const char *name, uhid_dev_out_cb_t cb, void *user);
+
+/** Handle one pending event from the kernel (call when dev->fd is readable). */
+int uhid_dev_dispatch(uhid_dev_t *dev);
+
+/** Send one 64-byte IN report to the host. */
+int uhid_dev_send(uhid_dev_t *dev, const uint8_t *report);
+
+void uhid_dev_close(uhid_dev_t *dev);
@@ -0,0 +1,279 @@
+#include "broker.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <future>
+#include <poll.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+#include "roottap/broker_proto.hpp"
+#include "roottap/ctap2.hpp"
+#include "roottap/session.hpp"
+
+namespace roottap {
+
+namespace {
+
+constexpr int kOpenTimeoutMs = 1000;     // INIT and GetInfo when (re)opening
+constexpr int kMaxTimeoutMs = 120000;
+constexpr int kAcceptPollMs = 500;       // how often serve() notices stop
+constexpr int kHangupPollMs = 50;        // how often a waiting request checks its client
+
+std::vector<uint8_t> response(uint8_t status, uint8_t cmd = 0, const std::vector<uint8_t> &data = {})
+{
+    std::vector<uint8_t> r(broker::kResponseHead + data.size());
+    r[0] = broker::kVersion;
+    r[1] = status;
+    r[2] = cmd;
+    std::copy(data.begin(), data.end(), r.begin() + broker::kResponseHead);
+    return r;
+}
+
+// what a client may send on a lent channel; INIT, LOCK and the like would
+// disturb the broker's own channel state
+bool forwardable(uint8_t cmd)
+{
+    return cmd == ctaphid::kPing || cmd == ctaphid::kMsg || cmd == ctaphid::kWink || cmd == ctaphid::kCbor;
+}
+
+bool hung_up(int fd)
+{
+    struct pollfd p = { fd, POLLRDHUP, 0 };
+    return poll(&p, 1, 0) > 0 && (p.revents & (POLLRDHUP | POLLHUP | POLLERR));
+}
+
+}  // namespace
+
+Broker::Broker(std::string device, size_t max_channels) : path_(std::move(device)), max_channels_(max_channels) {}
+
+BrokerStats Broker::stats()
+{
+    std::lock_guard<std::mutex> lock(mu_);
+    return stats_;
+}
+
+std::shared_ptr<Device> Broker::device()
+{
+    std::lock_guard<std::mutex> lock(mu_);
+    if (dev_ && dev_->alive()) return dev_;
+
+    // requests still running on a dead device hold their own reference
+    dev_.reset();
+    idle_.clear();
+    channels_ = 0;
+    info_.clear();
+    cv_.notify_all();
+
+    std::string node = path_;
+    std::vector<uint8_t> info;
+    if (path_ == "auto" || path_.compare(0, 7, "serial:") == 0) {
+        std::optional<KeyInfo> k = registry_.find(path_);
+        if (!k) throw IoError(path_ == "auto" ? "no FIDO device found" : path_ + ": not plugged in");
+        node = k->node;
+        // only trusted while uevents would have dropped it on unplug
+        if (registry_.fd() >= 0) info = std::move(k->info);
+    }
+
+    auto dev = std::make_shared<Device>(open_transport(node));
+    uint32_t cid = dev->init(kOpenTimeoutMs).cid;
+    if (info.empty()) {
+        Message m = dev->transact(cid, ctaphid::kCbor, { ctap2::kGetInfo }, kOpenTimeoutMs);
+        if (m.cmd != ctaphid::kCbor || m.data.empty() || m.data[0] != ctap2::kOk) {
+            throw IoError(dev->path() + ": GetInfo failed");
+        }
+        info = std::move(m.data);
+        registry_.set_info(node, info);
+    }
+    std::fprintf(stderr, "roottapd: %s open\n", dev->path().c_str());
+    info_ = std::move(info);
+    idle_.push_back(cid);
+    channels_ = 1;
+    stats_.channels++;
+    stats_.reopens++;
+    dev_ = std::move(dev);
+    return dev_;
+}
+
+void Broker::remember_info(const std::shared_ptr<Device> &dev, const Message &m)
+{
+    if (m.cmd != ctaphid::kCbor || m.data.empty() || m.data[0] != ctap2::kOk) return;
+    std::lock_guard<std::mutex> lock(mu_);
+    if (dev != dev_) return;
+    info_ = m.data;
+    registry_.set_info(dev->path(), m.data);
+}
+
+void Broker::forget_info(const std::shared_ptr<Device> &dev)
+{
+    std::lock_guard<std::mutex> lock(mu_);
+    if (dev == dev_) info_.clear();
+    registry_.invalidate_info(dev->path());
+}
+
+uint32_t Broker::acquire(const std::shared_ptr<Device> &dev)
+{
+    std::unique_lock<std::mutex> lock(mu_);
+    for (;;) {
+        if (dev != dev_ || !dev->alive()) throw IoError(dev->path() + ": device gone");
+        if (!idle_.empty()) {
+            uint32_t cid = idle_.back();
+            idle_.pop_back();
+            return cid;
+        }
+        if (channels_ < max_channels_) break;
+        cv_.wait_for(lock, std::chrono::milliseconds(kHangupPollMs));
+    }
+
+    channels_++;
+    lock.unlock();
+    try {
+        uint32_t cid = dev->init(kOpenTimeoutMs).cid;
+        lock.lock();
+        stats_.channels++;
+        return cid;
+    } catch (...) {
+        lock.lock();
+        if (dev == dev_) channels_--;
+        cv_.notify_one();
+        throw;
+    }
+}
+
+void Broker::release(const std::shared_ptr<Device> &dev, uint32_t cid)
+{
+    std::lock_guard<std::mutex> lock(mu_);
+    if (dev != dev_) return;
+    idle_.push_back(cid);
+    cv_.notify_one();
+}
+
+std::vector<uint8_t> Broker::answer(int client_fd, const uint8_t *req, size_t len)
+{
+    if (len < broker::kRequestHead || req[0] != broker::kVersion) return response(broker::kBadRequest);
+    uint8_t cmd = req[1];
+    uint32_t timeout = static_cast<uint32_t>(req[2]) << 24 | static_cast<uint32_t>(req[3]) << 16 |
+                       static_cast<uint32_t>(req[4]) << 8 | req[5];
+    int timeout_ms = timeout == 0 || timeout > kMaxTimeoutMs ? kMaxTimeoutMs : static_cast<int>(timeout);
+    std::vector<uint8_t> data(req + broker::kRequestHead, req + len);
+    if (!forwardable(cmd) || data.size() > ctaphid::kMaxMessage) return response(broker::kBadRequest);
+
+    std::shared_ptr<Device> dev;
+    try {
+        dev = device();
+    } catch (const std::exception &e) {
+        std::fprintf(stderr, "roottapd: %s\n", e.what());
+        return response(broker::kNoDevice);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        stats_.requests++;
+        if (cmd == ctaphid::kCbor && data.size() == 1 && data[0] == ctap2::kGetInfo && dev == dev_ &&
+            !info_.empty()) {
+            stats_.info_hits++;
+            return response(broker::kOk, ctaphid::kCbor, info_);
+        }
+    }
+
+    uint32_t cid;
+    try {
+        cid = acquire(dev);
+    } catch (const std::exception &) {
+        return response(broker::kNoDevice);
+    }
+
+    // a sudo that is interrupted closes the socket; cancel so the key stops
+    // waiting for a presence nobody will use
+    auto result = std::async(std::launch::async, [&] { return dev->transact(cid, cmd, data, timeout_ms); });
+    bool cancelled = false;
+    while (result.wait_for(std::chrono::milliseconds(kHangupPollMs)) != std::future_status::ready) {
+        if (!cancelled && hung_up(client_fd)) {
+            cancelled = true;
+            try {
+                dev->cancel(cid);
+            } catch (const IoError &) {
+            }
+            std::lock_guard<std::mutex> lock(mu_);
+            stats_.cancels++;
+        }
+    }
+
+    // a PIN set or changed, or a reset, shows in GetInfo's options
+    bool stale = cmd == ctaphid::kCbor && !data.empty() &&
+                 (data[0] == ctap2::kClientPin || data[0] == ctap2::kReset);
+    if (stale) forget_info(dev);
+
+    try {
+        Message m = result.get();
+        release(dev, cid);
+        if (cmd == ctaphid::kCbor && data.size() == 1 && data[0] == ctap2::kGetInfo) remember_info(dev, m);
+        return response(broker::kOk, m.cmd, m.data);
+    } catch (const IoError &) {
+        if (!dev->alive()) return response(broker::kNoDevice);
+        // the channel may still be busy with the request; free it first
+        try {
+            dev->cancel(cid);
+        } catch (const IoError &) {
+        }
+        release(dev, cid);
+        return response(broker::kTimeout);
+    }
+}
+
+void Broker::client_loop(int fd)
+{
+    std::vector<uint8_t> buf(broker::kRequestHead + ctaphid::kMaxMessage + 1);
+    for (;;) {
+        ssize_t n = recv(fd, buf.data(), buf.size(), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        std::vector<uint8_t> resp = answer(fd, buf.data(), static_cast<size_t>(n));
+        if (send(fd, resp.data(), resp.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(resp.size())) break;
+    }
+    std::lock_guard<std::mutex> lock(mu_);
+    clients_.erase(fd);
+    close(fd);
+    cv_.notify_all();
+}
+
+void Broker::serve(int listen_fd, const volatile std::sig_atomic_t &stop)
+{
+    if (!registry_.watch()) std::fprintf(stderr, "roottapd: no uevents, rescanning sysfs on a miss\n");
+
+    // open the key now so the first authentication finds it ready
+    try {
+        device();
+    } catch (const std::exception &e) {
+        std::fprintf(stderr, "roottapd: %s (will retry on the first request)\n", e.what());
+    }
+
+    while (!stop) {
+        struct pollfd p[2] = { { listen_fd, POLLIN, 0 }, { registry_.fd(), POLLIN, 0 } };
+        if (poll(p, registry_.fd() >= 0 ? 2 : 1, kAcceptPollMs) <= 0) continue;
+        if ((p[1].revents & POLLIN) && registry_.dispatch()) {
+            // a key came or went: open it now rather than on the next login
+            try {
+                device();
+            } catch (const std::exception &) {
+            }
+        }
+        if (!(p[0].revents & POLLIN)) continue;
+        int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) continue;
+        std::lock_guard<std::mutex> lock(mu_);
+        clients_.insert(fd);
+        std::thread(&Broker::client_loop, this, fd).detach();
+    }
+
+    // wake every client thread (a waiting request sees the hangup and
+    // cancels) and wait for them to finish
+    std::unique_lock<std::mutex> lock(mu_);
+    for (int fd : clients_) shutdown(fd, SHUT_RDWR);
+    cv_.wait(lock, [this] { return clients_.empty(); });
+}
+
+}  // namespace roottap
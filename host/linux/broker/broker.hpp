@@ -0,0 +1,67 @@
+#pragma once
+// roottapd: owns the key, keeps channels allocated on it and GetInfo cached,
+// and forwards requests from its socket (broker_proto.hpp) so a PAM
+// authentication skips device discovery and CTAPHID_INIT.
+
+#include <condition_variable>
+#include <csignal>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "roottap/ctaphid.hpp"
+#include "roottap/registry.hpp"
+
+namespace roottap {
+
+struct BrokerStats {
+    uint64_t requests = 0;
+    uint64_t info_hits = 0;       // GetInfo answered from the cache
+    uint64_t channels = 0;        // CTAPHID_INITs sent
+    uint64_t reopens = 0;         // device (re)opened
+    uint64_t cancels = 0;         // clients gone mid-request
+};
+
+class Broker {
+  public:
+    // `device` as for open_transport, "auto" or "serial:S" (found through a
+    // Registry). At most `max_channels` requests run on the key at once; the
+    // rest wait for a channel.
+    Broker(std::string device, size_t max_channels);
+
+    // Accepts clients on `listen_fd` until `stop` is set, one thread each;
+    // returns once they have all finished.
+    void serve(int listen_fd, const volatile std::sig_atomic_t &stop);
+
+    BrokerStats stats();
+    RegistryStats registry_stats() { return registry_.stats(); }
+
+  private:
+    void client_loop(int fd);
+    std::vector<uint8_t> answer(int client_fd, const uint8_t *req, size_t len);
+    // the open device, opening it (and filling the cache) if needed
+    std::shared_ptr<Device> device();
+    // refill / drop the GetInfo cache for `dev` if it is still the open device
+    void remember_info(const std::shared_ptr<Device> &dev, const Message &m);
+    void forget_info(const std::shared_ptr<Device> &dev);
+    uint32_t acquire(const std::shared_ptr<Device> &dev);
+    void release(const std::shared_ptr<Device> &dev, uint32_t cid);
+
+    std::string path_;
+    size_t max_channels_;
+    Registry registry_;
+
+    std::mutex mu_;
+    std::condition_variable cv_;
+    std::shared_ptr<Device> dev_;
+    std::vector<uint8_t> info_;        // CTAPHID_CBOR answer to GetInfo, empty if stale
+    std::vector<uint32_t> idle_;       // allocated channels not in use
+    size_t channels_ = 0;              // allocated on dev_
+    std::set<int> clients_;            // connected client sockets
+    BrokerStats stats_;
+};
+
+}  // namespace roottap
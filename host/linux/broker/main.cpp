@@ -0,0 +1,114 @@
+// roottapd: the broker daemon. Listens on --socket (root only) and lends
+// channels on the key to pam_roottap; see broker.hpp.
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "broker.hpp"
+#include "roottap/broker_proto.hpp"
+
+namespace {
+
+volatile std::sig_atomic_t s_stop = 0;
+
+void on_signal(int)
+{
+    s_stop = 1;
+}
+
+void usage(const char *argv0)
+{
+    std::fprintf(stderr, "usage: %s [--device PATH|auto|serial:S] [--socket PATH] [--channels N]\n", argv0);
+}
+
+int listen_on(const std::string &path)
+{
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    (void)unlink(path.c_str());
+    // only root (sudo, sshd) may ask the key for an assertion
+    mode_t old = umask(0077);
+    int rc = bind(fd, reinterpret_cast<const struct sockaddr *>(&addr), sizeof(addr));
+    umask(old);
+    if (rc != 0 || listen(fd, 16) != 0) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    return fd;
+}
+
+}  // namespace
+
+int main(int argc, char **argv)
+{
+    std::string device = "auto";
+    std::string sock = roottap::broker::kDefaultSocket;
+    size_t channels = 8;
+
+    for (int i = 1; i < argc; i++) {
+        const char *val = (i + 1 < argc) ? argv[i + 1] : nullptr;
+        if (std::strcmp(argv[i], "--device") == 0 && val) {
+            device = val;
+            i++;
+        } else if (std::strcmp(argv[i], "--socket") == 0 && val) {
+            sock = val;
+            i++;
+        } else if (std::strcmp(argv[i], "--channels") == 0 && val) {
+            channels = std::strtoul(val, nullptr, 0);
+            i++;
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (channels == 0) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    int fd = listen_on(sock);
+    if (fd < 0) {
+        std::fprintf(stderr, "roottapd: %s: %s\n", sock.c_str(), std::strerror(errno));
+        return 1;
+    }
+
+    struct sigaction sa = {};
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+
+    roottap::Broker broker(device, channels);
+    broker.serve(fd, s_stop);
+
+    close(fd);
+    (void)unlink(sock.c_str());
+    roottap::BrokerStats st = broker.stats();
+    std::fprintf(stderr,
+                 "roottapd: %llu requests, %llu GetInfo from cache, %llu channels, %llu opens, %llu cancels\n",
+                 static_cast<unsigned long long>(st.requests), static_cast<unsigned long long>(st.info_hits),
+                 static_cast<unsigned long long>(st.channels), static_cast<unsigned long long>(st.reopens),
+                 static_cast<unsigned long long>(st.cancels));
+    roottap::RegistryStats rs = broker.registry_stats();
+    std::fprintf(stderr, "roottapd: %llu hidraw events, %llu descriptors read, %llu sysfs scans\n",
+                 static_cast<unsigned long long>(rs.events), static_cast<unsigned long long>(rs.probes),
+                 static_cast<unsigned long long>(rs.rescans));
+    return 0;
+}
@@ -0,0 +1,52 @@
+#include "roottap/auth.hpp"
+
+#include <algorithm>
+#include <map>
+
+#include "roottap/ctap2.hpp"
+
+namespace roottap {
+
+namespace {
+
+constexpr int kInfoTimeoutMs = 1000;
+
+}  // namespace
+
+AuthResult authenticate(Session &s, const std::vector<KeyEntry> &keys, int timeout_ms)
+{
+    ctap2::Info info = ctap2::parse_info(s.cbor(ctap2::kGetInfo, {}, kInfoTimeoutMs));
+    if (std::find(info.versions.begin(), info.versions.end(), "FIDO_2_0") == info.versions.end()) {
+        throw IoError("key does not speak CTAP2");
+    }
+
+    std::map<std::string, std::vector<const KeyEntry *>> by_rp;
+    for (const KeyEntry &k : keys) by_rp[k.rp_id].push_back(&k);
+
+    for (const auto &[rp_id, entries] : by_rp) {
+        std::vector<std::vector<uint8_t>> allow;
+        for (const KeyEntry *k : entries) allow.push_back(k->credential_id);
+        std::vector<uint8_t> challenge = ctap2::random_bytes(ctap2::kHashLen);
+        std::vector<uint8_t> cdh = ctap2::sha256(challenge.data(), challenge.size());
+
+        ctap2::Assertion a;
+        try {
+            a = ctap2::parse_get_assertion(s.cbor(ctap2::kGetAssertion, ctap2::get_assertion(rp_id, cdh, allow),
+                                                  timeout_ms));
+        } catch (const ctap2::Error &e) {
+            if (e.status == ctap2::kErrNoCredentials) continue;
+            return AuthResult::Denied;
+        }
+        // with one entry in the allowList the key may leave the ID out
+        if (a.credential_id.empty() && entries.size() == 1) a.credential_id = entries[0]->credential_id;
+        for (const KeyEntry *k : entries) {
+            if (k->credential_id == a.credential_id) {
+                return ctap2::verify(a, rp_id, cdh, k->public_key) ? AuthResult::Ok : AuthResult::Denied;
+            }
+        }
+        return AuthResult::Denied;
+    }
+    return AuthResult::NoMatch;
+}
+
+}  // namespace roottap
@@ -0,0 +1,149 @@
+#include "roottap/cbor.hpp"
+
+namespace roottap::cbor {
+
+Writer &Writer::head(uint8_t major, uint64_t v)
+{
+    uint8_t m = static_cast<uint8_t>(major << 5);
+    if (v < 24) {
+        out_.push_back(static_cast<uint8_t>(m | v));
+        return *this;
+    }
+    int len = v <= 0xFF ? 1 : v <= 0xFFFF ? 2 : v <= 0xFFFFFFFFu ? 4 : 8;
+    out_.push_back(static_cast<uint8_t>(m | (len == 1 ? 24 : len == 2 ? 25 : len == 4 ? 26 : 27)));
+    for (int i = len - 1; i >= 0; i--) out_.push_back(static_cast<uint8_t>(v >> (8 * i)));
+    return *this;
+}
+
+Writer &Writer::integer(int64_t v)
+{
+    return v >= 0 ? head(0, static_cast<uint64_t>(v)) : head(1, static_cast<uint64_t>(-1 - v));
+}
+
+Writer &Writer::bytes(const uint8_t *p, size_t n)
+{
+    head(2, n);
+    out_.insert(out_.end(), p, p + n);
+    return *this;
+}
+
+Writer &Writer::text(const std::string &s)
+{
+    head(3, s.size());
+    out_.insert(out_.end(), s.begin(), s.end());
+    return *this;
+}
+
+Writer &Writer::boolean(bool b)
+{
+    out_.push_back(b ? 0xF5 : 0xF4);
+    return *this;
+}
+
+const uint8_t *Reader::take(size_t n)
+{
+    if (n > n_ - pos_) throw Error("cbor: truncated");
+    const uint8_t *p = p_ + pos_;
+    pos_ += n;
+    return p;
+}
+
+uint8_t Reader::peek() const
+{
+    if (pos_ >= n_) throw Error("cbor: truncated");
+    return p_[pos_] >> 5;
+}
+
+uint64_t Reader::head(uint8_t major)
+{
+    uint8_t ib = *take(1);
+    if ((ib >> 5) != major) throw Error("cbor: unexpected type");
+    uint8_t ai = ib & 0x1F;
+    if (ai < 24) return ai;
+    if (ai > 27) throw Error("cbor: indefinite or reserved length");
+    size_t len = static_cast<size_t>(1) << (ai - 24);
+    const uint8_t *p = take(len);
+    uint64_t v = 0;
+    for (size_t i = 0; i < len; i++) v = v << 8 | p[i];
+    return v;
+}
+
+uint64_t Reader::uint()
+{
+    return head(0);
+}
+
+int64_t Reader::integer()
+{
+    if (peek() == 1) return -1 - static_cast<int64_t>(head(1));
+    return static_cast<int64_t>(head(0));
+}
+
+std::vector<uint8_t> Reader::bytes()
+{
+    size_t n = head(2);
+    const uint8_t *p = take(n);
+    return std::vector<uint8_t>(p, p + n);
+}
+
+std::string Reader::text()
+{
+    size_t n = head(3);
+    const uint8_t *p = take(n);
+    return std::string(reinterpret_cast<const char *>(p), n);
+}
+
+size_t Reader::array()
+{
+    return head(4);
+}
+
+size_t Reader::map()
+{
+    return head(5);
+}
+
+bool Reader::boolean()
+{
+    uint8_t ib = *take(1);
+    if (ib != 0xF4 && ib != 0xF5) throw Error("cbor: not a boolean");
+    return ib == 0xF5;
+}
+
+void Reader::skip()
+{
+    uint8_t major = peek();
+    switch (major) {
+    case 0:
+    case 1:
+        head(major);
+        break;
+    case 2:
+    case 3:
+        take(head(major));
+        break;
+    case 4:
+        for (size_t i = head(4); i > 0; i--) skip();
+        break;
+    case 5:
+        for (size_t i = head(5); i > 0; i--) {
+            skip();
+            skip();
+        }
+        break;
+    case 6:
+        head(6);
+        skip();
+        break;
+    default: {
+        uint8_t ai = *take(1) & 0x1F;
+        if (ai == 24) take(1);
+        else if (ai == 25) take(2);
+        else if (ai == 26) take(4);
+        else if (ai == 27) take(8);
+        break;
+    }
+    }
+}
+
+}  // namespace roottap::cbor
@@ -0,0 +1,175 @@
+#include "roottap/ctap2.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <openssl/core_names.h>
+#include <openssl/evp.h>
+#include <openssl/param_build.h>
+#include <openssl/rand.h>
+#include <openssl/sha.h>
+
+#include "roottap/cbor.hpp"
+
+namespace roottap::ctap2 {
+
+namespace {
+
+std::string status_name(uint8_t status)
+{
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "CTAP2 status 0x%02x", status);
+    return buf;
+}
+
+// authData: rpIdHash(32) flags(1) signCount(4) [aaguid(16) len(2) credId key]
+constexpr size_t kAuthDataHead = 37;
+
+}  // namespace
+
+Error::Error(uint8_t s) : std::runtime_error(status_name(s)), status(s) {}
+
+std::vector<uint8_t> make_credential(const MakeCredentialParams &p)
+{
+    cbor::Writer w;
+    w.map(5);
+    w.uint(1).bytes(p.client_data_hash);
+    w.uint(2).map(1).text("id").text(p.rp_id);
+    w.uint(3).map(2).text("id").bytes(p.user_id).text("name").text(p.user_name);
+    w.uint(4).array(1).map(2).text("alg").integer(-7).text("type").text("public-key");
+    w.uint(7).map(1).text("rk").boolean(p.rk);
+    return w.take();
+}
+
+std::vector<uint8_t> get_assertion(const std::string &rp_id, const std::vector<uint8_t> &client_data_hash,
+                                   const std::vector<std::vector<uint8_t>> &allow_list, bool up)
+{
+    cbor::Writer w;
+    w.map(allow_list.empty() ? 3 : 4);
+    w.uint(1).text(rp_id);
+    w.uint(2).bytes(client_data_hash);
+    if (!allow_list.empty()) {
+        w.uint(3).array(allow_list.size());
+        for (const auto &id : allow_list) w.map(2).text("id").bytes(id).text("type").text("public-key");
+    }
+    w.uint(5).map(1).text("up").boolean(up);
+    return w.take();
+}
+
+Info parse_info(const std::vector<uint8_t> &body)
+{
+    Info info;
+    cbor::Reader r(body.data(), body.size());
+    for (size_t n = r.map(); n > 0; n--) {
+        uint64_t k = r.uint();
+        if (k == 1) {
+            for (size_t i = r.array(); i > 0; i--) info.versions.push_back(r.text());
+        } else if (k == 3) {
+            info.aaguid = r.bytes();
+        } else if (k == 5) {
+            info.max_msg_size = r.uint();
+        } else {
+            r.skip();
+        }
+    }
+    return info;
+}
+
+Credential parse_make_credential(const std::vector<uint8_t> &body)
+{
+    std::vector<uint8_t> auth;
+    cbor::Reader r(body.data(), body.size());
+    for (size_t n = r.map(); n > 0; n--) {
+        if (r.uint() == 2) auth = r.bytes();
+        else r.skip();
+    }
+    if (auth.size() < kAuthDataHead + 18) throw cbor::Error("authData without attested credential");
+    size_t id_len = static_cast<size_t>(auth[kAuthDataHead + 16]) << 8 | auth[kAuthDataHead + 17];
+    size_t off = kAuthDataHead + 18;
+    if (auth.size() < off + id_len) throw cbor::Error("authData: short credential ID");
+
+    Credential c;
+    c.id.assign(auth.begin() + off, auth.begin() + off + id_len);
+    cbor::Reader key(auth.data() + off + id_len, auth.size() - off - id_len);
+    std::vector<uint8_t> x, y;
+    for (size_t n = key.map(); n > 0; n--) {
+        int64_t k = key.integer();
+        if (k == -2) x = key.bytes();
+        else if (k == -3) y = key.bytes();
+        else key.skip();
+    }
+    if (x.size() != 32 || y.size() != 32) throw cbor::Error("COSE key: not P-256");
+    c.public_key.push_back(0x04);
+    c.public_key.insert(c.public_key.end(), x.begin(), x.end());
+    c.public_key.insert(c.public_key.end(), y.begin(), y.end());
+    return c;
+}
+
+Assertion parse_get_assertion(const std::vector<uint8_t> &body)
+{
+    Assertion a;
+    cbor::Reader r(body.data(), body.size());
+    for (size_t n = r.map(); n > 0; n--) {
+        uint64_t k = r.uint();
+        if (k == 1) {
+            for (size_t m = r.map(); m > 0; m--) {
+                if (r.text() == "id") a.credential_id = r.bytes();
+                else r.skip();
+            }
+        } else if (k == 2) {
+            a.auth_data = r.bytes();
+        } else if (k == 3) {
+            a.signature = r.bytes();
+        } else {
+            r.skip();
+        }
+    }
+    if (a.auth_data.size() < kAuthDataHead || a.signature.empty()) throw cbor::Error("assertion incomplete");
+    return a;
+}
+
+std::vector<uint8_t> sha256(const void *data, size_t len)
+{
+    std::vector<uint8_t> h(kHashLen);
+    SHA256(static_cast<const unsigned char *>(data), len, h.data());
+    return h;
+}
+
+std::vector<uint8_t> random_bytes(size_t n)
+{
+    std::vector<uint8_t> b(n);
+    if (RAND_bytes(b.data(), static_cast<int>(n)) != 1) throw std::runtime_error("no randomness");
+    return b;
+}
+
+bool verify(const Assertion &a, const std::string &rp_id, const std::vector<uint8_t> &client_data_hash,
+            const std::vector<uint8_t> &public_key)
+{
+    std::vector<uint8_t> rp_hash = sha256(rp_id.data(), rp_id.size());
+    if (a.auth_data.size() < kAuthDataHead || !std::equal(rp_hash.begin(), rp_hash.end(), a.auth_data.begin()) ||
+        !(a.auth_data[32] & kFlagUp)) {
+        return false;
+    }
+
+    EVP_PKEY *key = nullptr;
+    OSSL_PARAM_BLD *bld = OSSL_PARAM_BLD_new();
+    OSSL_PARAM *params = nullptr;
+    EVP_PKEY_CTX *kctx = EVP_PKEY_CTX_new_from_name(nullptr, "EC", nullptr);
+    EVP_MD_CTX *md = EVP_MD_CTX_new();
+    bool ok = bld && kctx && md &&
+              OSSL_PARAM_BLD_push_utf8_string(bld, OSSL_PKEY_PARAM_GROUP_NAME, "prime256v1", 0) &&
+              OSSL_PARAM_BLD_push_octet_string(bld, OSSL_PKEY_PARAM_PUB_KEY, public_key.data(), public_key.size()) &&
+              (params = OSSL_PARAM_BLD_to_param(bld)) != nullptr && EVP_PKEY_fromdata_init(kctx) == 1 &&
+              EVP_PKEY_fromdata(kctx, &key, EVP_PKEY_PUBLIC_KEY, params) == 1 &&
+              EVP_DigestVerifyInit(md, nullptr, EVP_sha256(), nullptr, key) == 1 &&
+              EVP_DigestVerifyUpdate(md, a.auth_data.data(), a.auth_data.size()) == 1 &&
+              EVP_DigestVerifyUpdate(md, client_data_hash.data(), client_data_hash.size()) == 1 &&
+              EVP_DigestVerifyFinal(md, a.signature.data(), a.signature.size()) == 1;
+    EVP_MD_CTX_free(md);
+    EVP_PKEY_CTX_free(kctx);
+    OSSL_PARAM_free(params);
+    OSSL_PARAM_BLD_free(bld);
+    EVP_PKEY_free(key);
+    return ok;
+}
+
+}  // namespace roottap::ctap2
@@ -0,0 +1,186 @@
+#include "roottap/ctaphid.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <openssl/rand.h>
+
+namespace roottap {
+
+namespace {
+
+constexpr int kReadPollMs = 100;
+constexpr int kBusyRetryMs = 5;    // back-off after CTAPHID_ERR_CHANNEL_BUSY
+
+uint32_t be32(const uint8_t *p)
+{
+    return static_cast<uint32_t>(p[0]) << 24 | static_cast<uint32_t>(p[1]) << 16 |
+           static_cast<uint32_t>(p[2]) << 8 | p[3];
+}
+
+void put_be32(uint8_t *p, uint32_t v)
+{
+    p[0] = static_cast<uint8_t>(v >> 24);
+    p[1] = static_cast<uint8_t>(v >> 16);
+    p[2] = static_cast<uint8_t>(v >> 8);
+    p[3] = static_cast<uint8_t>(v);
+}
+
+}  // namespace
+
+Device::Device(std::unique_ptr<Transport> t) : t_(std::move(t))
+{
+    reader_ = std::thread([this] { read_loop(); });
+}
+
+Device::~Device()
+{
+    stop_ = true;
+    t_->wake();
+    reader_.join();
+}
+
+void Device::send_message(uint32_t cid, uint8_t cmd, const std::vector<uint8_t> &data)
+{
+    if (data.size() > ctaphid::kMaxMessage) throw IoError("message too long");
+    std::lock_guard<std::mutex> lock(send_mu_);
+    Report r{};
+    put_be32(r.data(), cid);
+    r[4] = static_cast<uint8_t>(0x80 | cmd);
+    r[5] = static_cast<uint8_t>(data.size() >> 8);
+    r[6] = static_cast<uint8_t>(data.size());
+    size_t n = std::min(data.size(), ctaphid::kInitPayload);
+    std::memcpy(r.data() + 7, data.data(), n);
+    t_->send(r);
+    for (uint8_t seq = 0; n < data.size(); seq++) {
+        r.fill(0);
+        put_be32(r.data(), cid);
+        r[4] = seq;
+        size_t k = std::min(data.size() - n, ctaphid::kContPayload);
+        std::memcpy(r.data() + 5, data.data() + n, k);
+        t_->send(r);
+        n += k;
+    }
+}
+
+void Device::on_report(const Report &r)
+{
+    uint32_t cid = be32(r.data());
+    std::lock_guard<std::mutex> lock(mu_);
+    auto it = inboxes_.find(cid);
+    if (it == inboxes_.end()) return;   // another client's channel, or stale
+    Inbox &in = it->second;
+
+    if (r[4] & 0x80) {
+        in.cmd = r[4] & 0x7F;
+        in.total = static_cast<size_t>(r[5]) << 8 | r[6];
+        in.buf.assign(r.begin() + 7, r.begin() + 7 + std::min(in.total, ctaphid::kInitPayload));
+        in.next_seq = 0;
+        in.partial = true;
+    } else {
+        if (!in.partial || r[4] != in.next_seq) {
+            in.partial = false;
+            return;
+        }
+        in.next_seq++;
+        size_t k = std::min(in.total - in.buf.size(), ctaphid::kContPayload);
+        in.buf.insert(in.buf.end(), r.begin() + 5, r.begin() + 5 + k);
+    }
+    if (in.buf.size() >= in.total) {
+        in.partial = false;
+        in.done.push_back(Message{ in.cmd, std::move(in.buf) });
+        in.buf.clear();
+        cv_.notify_all();
+    }
+}
+
+void Device::read_loop()
+{
+    Report r;
+    while (!stop_) {
+        try {
+            if (t_->recv(r, kReadPollMs)) on_report(r);
+        } catch (const IoError &) {
+            dead_ = true;
+            break;
+        }
+    }
+    std::lock_guard<std::mutex> lock(mu_);
+    cv_.notify_all();
+}
+
+Message Device::transact(uint32_t cid, uint8_t cmd, const std::vector<uint8_t> &data, int timeout_ms,
+                         bool retry_busy)
+{
+    using clock = std::chrono::steady_clock;
+    if (dead_) throw IoError(path() + ": device gone");
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        inboxes_[cid] = Inbox{};
+    }
+    struct Close {
+        Device *d;
+        uint32_t cid;
+        ~Close()
+        {
+            std::lock_guard<std::mutex> lock(d->mu_);
+            d->inboxes_.erase(cid);
+        }
+    } close_inbox{ this, cid };
+
+    send_message(cid, cmd, data);
+
+    std::unique_lock<std::mutex> lock(mu_);
+    Inbox &in = inboxes_[cid];
+    auto deadline = clock::now() + std::chrono::milliseconds(timeout_ms);
+    for (;;) {
+        if (!cv_.wait_until(lock, deadline, [&] { return !in.done.empty() || dead_; })) {
+            throw IoError(path() + ": timeout");
+        }
+        if (in.done.empty()) throw IoError(path() + ": device gone");
+        Message m = std::move(in.done.front());
+        in.done.pop_front();
+        if (m.cmd == ctaphid::kKeepalive) {
+            deadline = clock::now() + std::chrono::milliseconds(timeout_ms);
+            continue;
+        }
+        // INIT answers on the broadcast channel carry the nonce they answer
+        if (cid == ctaphid::kBroadcastCid && cmd == ctaphid::kInit &&
+            (m.cmd != ctaphid::kInit || m.data.size() < 8 || std::memcmp(m.data.data(), data.data(), 8) != 0)) {
+            continue;
+        }
+        // another channel has the key; ask again until the deadline
+        if (retry_busy && m.cmd == ctaphid::kError && m.data.size() == 1 && m.data[0] == ctaphid::kErrChannelBusy &&
+            clock::now() + std::chrono::milliseconds(kBusyRetryMs) < deadline) {
+            lock.unlock();
+            std::this_thread::sleep_for(std::chrono::milliseconds(kBusyRetryMs));
+            send_message(cid, cmd, data);
+            lock.lock();
+            continue;
+        }
+        return m;
+    }
+}
+
+InitInfo Device::init(int timeout_ms)
+{
+    std::lock_guard<std::mutex> lock(init_mu_);
+    std::vector<uint8_t> nonce(8);
+    if (RAND_bytes(nonce.data(), static_cast<int>(nonce.size())) != 1) throw IoError("no randomness");
+    Message m = transact(ctaphid::kBroadcastCid, ctaphid::kInit, nonce, timeout_ms);
+    if (m.data.size() < 17) throw IoError(path() + ": short INIT response");
+    InitInfo info;
+    info.cid = be32(m.data.data() + 8);
+    info.version = m.data[12];
+    info.major = m.data[13];
+    info.minor = m.data[14];
+    info.build = m.data[15];
+    info.caps = m.data[16];
+    return info;
+}
+
+void Device::cancel(uint32_t cid)
+{
+    send_message(cid, ctaphid::kCancel, {});
+}
+
+}  // namespace roottap
@@ -0,0 +1,22 @@
+#pragma once
+// What pam_roottap does per pam_authenticate once it has a session: GetInfo,
+// then a GetAssertion per RP the user has keys for, checked against the
+// stored public key.
+
+#include <vector>
+
+#include "roottap/keys.hpp"
+#include "roottap/session.hpp"
+
+namespace roottap {
+
+enum class AuthResult {
+    Ok,
+    Denied,     // presence refused or timed out, or a bad signature
+    NoMatch,    // the key holds none of the user's credentials
+};
+
+// Throws IoError or HidError if the key can't be used.
+AuthResult authenticate(Session &s, const std::vector<KeyEntry> &keys, int timeout_ms);
+
+}  // namespace roottap
@@ -0,0 +1,28 @@
+#pragma once
+// roottapd's socket (SOCK_SEQPACKET, one message per packet):
+//
+//   request:  version(1) cmd(1) timeout_ms(4, big-endian) data
+//   response: version(1) status(1) cmd(1) data
+//
+// cmd/data are a CTAPHID command and payload, forwarded on one of the
+// broker's channels; the response carries the device's answer, which may be
+// a CTAPHID_ERROR. A status other than kOk means there is no answer.
+
+#include <cstddef>
+#include <cstdint>
+
+namespace roottap::broker {
+
+constexpr const char *kDefaultSocket = "/run/roottap/broker.sock";
+
+constexpr uint8_t kVersion = 1;
+constexpr size_t kRequestHead = 6;
+constexpr size_t kResponseHead = 3;
+
+// response status
+constexpr uint8_t kOk = 0;
+constexpr uint8_t kNoDevice = 1;    // no key, or it went away
+constexpr uint8_t kTimeout = 2;     // the key didn't answer in time
+constexpr uint8_t kBadRequest = 3;
+
+}  // namespace roottap::broker
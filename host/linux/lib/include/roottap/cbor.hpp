@@ -0,0 +1,64 @@
+#pragma once
+// Just enough CBOR for CTAP2 requests and responses: definite lengths,
+// integers, byte and text strings, arrays, maps, booleans.
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace roottap::cbor {
+
+class Error : public std::runtime_error {
+  public:
+    using std::runtime_error::runtime_error;
+};
+
+class Writer {
+  public:
+    Writer &uint(uint64_t v) { return head(0, v); }
+    Writer &integer(int64_t v);
+    Writer &bytes(const uint8_t *p, size_t n);
+    Writer &bytes(const std::vector<uint8_t> &v) { return bytes(v.data(), v.size()); }
+    Writer &text(const std::string &s);
+    Writer &array(size_t n) { return head(4, n); }
+    Writer &map(size_t n) { return head(5, n); }
+    Writer &boolean(bool b);
+
+    const std::vector<uint8_t> &out() const { return out_; }
+    std::vector<uint8_t> take() { return std::move(out_); }
+
+  private:
+    Writer &head(uint8_t major, uint64_t v);
+    std::vector<uint8_t> out_;
+};
+
+class Reader {
+  public:
+    Reader(const uint8_t *p, size_t n) : p_(p), n_(n) {}
+
+    uint64_t uint();
+    int64_t integer();
+    std::vector<uint8_t> bytes();
+    std::string text();
+    size_t array();
+    size_t map();
+    bool boolean();
+    void skip();
+
+    // major type of the next item
+    uint8_t peek() const;
+    bool done() const { return pos_ == n_; }
+    size_t pos() const { return pos_; }
+
+  private:
+    uint64_t head(uint8_t major);
+    const uint8_t *take(size_t n);
+
+    const uint8_t *p_;
+    size_t n_;
+    size_t pos_ = 0;
+};
+
+}  // namespace roottap::cbor
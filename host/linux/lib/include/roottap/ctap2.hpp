@@ -0,0 +1,80 @@
+#pragma once
+// CTAP2 requests and responses for what the host tools need: GetInfo,
+// MakeCredential, GetAssertion, and checking an assertion's signature.
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace roottap::ctap2 {
+
+constexpr uint8_t kMakeCredential = 0x01;
+constexpr uint8_t kGetAssertion = 0x02;
+constexpr uint8_t kGetInfo = 0x04;
+constexpr uint8_t kClientPin = 0x06;
+constexpr uint8_t kReset = 0x07;
+constexpr uint8_t kGetNextAssertion = 0x08;
+
+constexpr uint8_t kOk = 0x00;
+constexpr uint8_t kErrOperationDenied = 0x27;
+constexpr uint8_t kErrKeepaliveCancel = 0x2D;
+constexpr uint8_t kErrNoCredentials = 0x2E;
+constexpr uint8_t kErrUserActionTimeout = 0x2F;
+constexpr uint8_t kErrNotAllowed = 0x30;
+
+// A non-zero CTAP2 status.
+class Error : public std::runtime_error {
+  public:
+    explicit Error(uint8_t status);
+    uint8_t status;
+};
+
+constexpr size_t kHashLen = 32;
+constexpr uint8_t kFlagUp = 0x01;
+constexpr uint8_t kFlagUv = 0x04;
+
+struct Info {
+    std::vector<std::string> versions;
+    std::vector<uint8_t> aaguid;
+    uint64_t max_msg_size = 0;
+};
+
+struct MakeCredentialParams {
+    std::string rp_id;
+    std::vector<uint8_t> client_data_hash;
+    std::vector<uint8_t> user_id;
+    std::string user_name;
+    bool rk = false;
+};
+
+struct Credential {
+    std::vector<uint8_t> id;
+    std::vector<uint8_t> public_key;   // uncompressed P-256 point, 65 bytes
+};
+
+struct Assertion {
+    std::vector<uint8_t> credential_id;
+    std::vector<uint8_t> auth_data;
+    std::vector<uint8_t> signature;   // DER ECDSA
+};
+
+// Request parameters (the CBOR after the command byte).
+std::vector<uint8_t> make_credential(const MakeCredentialParams &p);
+std::vector<uint8_t> get_assertion(const std::string &rp_id, const std::vector<uint8_t> &client_data_hash,
+                                   const std::vector<std::vector<uint8_t>> &allow_list, bool up = true);
+
+// Response bodies (the CBOR after a zero status). Throw cbor::Error.
+Info parse_info(const std::vector<uint8_t> &cbor);
+Credential parse_make_credential(const std::vector<uint8_t> &cbor);
+Assertion parse_get_assertion(const std::vector<uint8_t> &cbor);
+
+std::vector<uint8_t> sha256(const void *data, size_t len);
+std::vector<uint8_t> random_bytes(size_t n);
+
+// Whether `a` is for `rp_id`, carries UP and is signed by `public_key`
+// over its authData and `client_data_hash`.
+bool verify(const Assertion &a, const std::string &rp_id, const std::vector<uint8_t> &client_data_hash,
+            const std::vector<uint8_t> &public_key);
+
+}  // namespace roottap::ctap2
@@ -0,0 +1,117 @@
+#pragma once
+// CTAPHID client: channels on one device, the host side of
+// firmware/esp32/components/ctaphid. A reader thread reassembles incoming
+// messages by channel, so several threads can each run a transaction on
+// their own channel at once.
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "roottap/transport.hpp"
+
+namespace roottap {
+
+namespace ctaphid {
+constexpr uint32_t kBroadcastCid = 0xFFFFFFFFu;
+
+constexpr uint8_t kPing = 0x01;
+constexpr uint8_t kMsg = 0x03;
+constexpr uint8_t kInit = 0x06;
+constexpr uint8_t kWink = 0x08;
+constexpr uint8_t kCbor = 0x10;
+constexpr uint8_t kCancel = 0x11;
+constexpr uint8_t kKeepalive = 0x3B;
+constexpr uint8_t kError = 0x3F;
+
+// kError payloads
+constexpr uint8_t kErrInvalidCmd = 0x01;
+constexpr uint8_t kErrInvalidSeq = 0x04;
+constexpr uint8_t kErrMsgTimeout = 0x05;
+constexpr uint8_t kErrChannelBusy = 0x06;
+constexpr uint8_t kErrInvalidChannel = 0x0B;
+
+constexpr size_t kInitPayload = kReportLen - 7;
+constexpr size_t kContPayload = kReportLen - 5;
+constexpr size_t kMaxMessage = kInitPayload + 128 * kContPayload;   // 7609
+}  // namespace ctaphid
+
+// A CTAPHID_ERROR answer.
+class HidError : public std::runtime_error {
+  public:
+    explicit HidError(uint8_t c) : std::runtime_error("CTAPHID error " + std::to_string(c)), code(c) {}
+    uint8_t code;
+};
+
+struct Message {
+    uint8_t cmd = 0;
+    std::vector<uint8_t> data;
+};
+
+// CTAPHID_INIT response
+struct InitInfo {
+    uint32_t cid = 0;
+    uint8_t version = 0;
+    uint8_t major = 0;
+    uint8_t minor = 0;
+    uint8_t build = 0;
+    uint8_t caps = 0;
+};
+
+class Device {
+  public:
+    explicit Device(std::unique_ptr<Transport> t);
+    ~Device();
+    Device(const Device &) = delete;
+    Device &operator=(const Device &) = delete;
+
+    // Allocates a channel (CTAPHID_INIT on the broadcast channel).
+    InitInfo init(int timeout_ms = 1000);
+
+    // Sends cmd/data on `cid` and waits for its answer; KEEPALIVEs restart
+    // the timeout and CHANNEL_BUSY is retried until it unless `retry_busy`
+    // is false. Any other CTAPHID error comes back as a kError message.
+    // Throws IoError on timeout or if the device is gone.
+    Message transact(uint32_t cid, uint8_t cmd, const std::vector<uint8_t> &data, int timeout_ms,
+                     bool retry_busy = true);
+
+    // CTAPHID_CANCEL for whatever runs on `cid`; no answer is expected.
+    void cancel(uint32_t cid);
+
+    bool alive() const { return !dead_; }
+    const std::string &path() const { return t_->path(); }
+
+  private:
+    struct Inbox {
+        std::deque<Message> done;
+        // the message being reassembled
+        uint8_t cmd = 0;
+        size_t total = 0;
+        uint8_t next_seq = 0;
+        std::vector<uint8_t> buf;
+        bool partial = false;
+    };
+
+    void send_message(uint32_t cid, uint8_t cmd, const std::vector<uint8_t> &data);
+    void on_report(const Report &r);
+    void read_loop();
+
+    std::unique_ptr<Transport> t_;
+    std::mutex send_mu_;
+    std::mutex init_mu_;
+    std::mutex mu_;
+    std::condition_variable cv_;
+    std::map<uint32_t, Inbox> inboxes_;   // channels with a transaction waiting
+    std::atomic<bool> stop_{ false };
+    std::atomic<bool> dead_{ false };
+    std::thread reader_;
+};
+
+}  // namespace roottap
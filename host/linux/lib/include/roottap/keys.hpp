@@ -0,0 +1,34 @@
+#pragma once
+// The keys a user may authenticate with, one per line:
+//
+//   USER RP CREDENTIAL_ID_HEX PUBLIC_KEY_HEX
+//
+// '#' starts a comment. The public key is the uncompressed P-256 point.
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace roottap {
+
+constexpr const char *kDefaultKeysFile = "/etc/roottap/keys";
+
+struct KeyEntry {
+    std::string user;
+    std::string rp_id;
+    std::vector<uint8_t> credential_id;
+    std::vector<uint8_t> public_key;
+};
+
+// `user`'s entries in `path`; malformed lines are skipped. Throws
+// std::runtime_error if the file can't be read.
+std::vector<KeyEntry> load_keys(const std::string &path, const std::string &user);
+
+// One line in the format above, without the newline.
+std::string format_key(const KeyEntry &k);
+
+std::string to_hex(const std::vector<uint8_t> &b);
+// false on odd length or a non-hex digit
+bool from_hex(const std::string &s, std::vector<uint8_t> &out);
+
+}  // namespace roottap
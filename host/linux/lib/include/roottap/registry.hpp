@@ -0,0 +1,87 @@
+#pragma once
+// The FIDO keys plugged in, kept up to date from kernel uevents instead of
+// rescanning /sys/class/hidraw for every lookup. Keys are found by serial
+// (HID_UNIQ, else HID_PHYS) in O(1); every hidraw node's verdict is cached,
+// so a plug or unplug reads at most the one node it concerns.
+
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace roottap {
+
+struct KeyInfo {
+    std::string node;                 // "/dev/hidrawN"
+    std::string serial;
+    std::string name;                 // HID_NAME
+    std::vector<uint8_t> descriptor;  // HID report descriptor
+    std::vector<uint8_t> info;        // GetInfo answer, once someone has asked
+};
+
+struct RegistryStats {
+    uint64_t probes = 0;      // report descriptors read
+    uint64_t events = 0;      // hidraw uevents handled
+    uint64_t rescans = 0;     // full sysfs scans
+};
+
+class Registry {
+  public:
+    explicit Registry(std::string sysfs = "/sys/class/hidraw", std::string dev_dir = "/dev");
+    ~Registry();
+    Registry(const Registry &) = delete;
+    Registry &operator=(const Registry &) = delete;
+
+    // Subscribes to kernel uevents; call before the first lookup. false if
+    // not allowed (no netlink in a container), in which case lookups that
+    // miss rescan.
+    bool watch();
+    // the uevent socket to poll for POLLIN, or -1
+    int fd() const { return nl_fd_; }
+    // Handles pending uevents without blocking; true if keys came or went.
+    bool dispatch();
+    // One uevent as the kernel sends it (NUL-separated "KEY=value"s).
+    bool on_uevent(const char *buf, size_t len);
+
+    // Reads every hidraw node's descriptor again.
+    void rescan();
+
+    // "auto" (the first key), "serial:S", or a node path.
+    std::optional<KeyInfo> find(const std::string &spec);
+    std::vector<KeyInfo> keys();
+
+    // Remembers a key's GetInfo answer until it is unplugged or
+    // invalidate_info drops it.
+    void set_info(const std::string &node, std::vector<uint8_t> info);
+    // Forgets it; call after anything that changes what GetInfo reports
+    // (ClientPIN setting a PIN, Reset).
+    void invalidate_info(const std::string &node);
+
+    RegistryStats stats();
+
+  private:
+    struct Node {
+        bool fido = false;
+        KeyInfo key;
+    };
+
+    void scan_locked();
+    bool probe(const std::string &name);
+    bool drop(const std::string &name);
+    const Node *lookup(const std::string &spec) const;
+
+    std::string sysfs_;
+    std::string dev_dir_;
+    int nl_fd_ = -1;
+    bool scanned_ = false;
+
+    std::mutex mu_;
+    std::unordered_map<std::string, Node> nodes_;             // by "hidrawN", FIDO or not
+    std::unordered_map<std::string, std::string> by_serial_;  // serial -> "hidrawN"
+    std::string first_;                                        // a FIDO node, "" if none
+    RegistryStats stats_;
+};
+
+}  // namespace roottap
@@ -0,0 +1,61 @@
+#pragma once
+// Somewhere to send CTAPHID commands: a channel of our own on the device,
+// or roottapd, which owns the device and lends out its channels.
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "roottap/ctaphid.hpp"
+
+namespace roottap {
+
+class Session {
+  public:
+    virtual ~Session() = default;
+    virtual Message transact(uint8_t cmd, const std::vector<uint8_t> &data, int timeout_ms) = 0;
+
+    // CTAP2 command over CTAPHID_CBOR; the CBOR after a zero status.
+    // Throws ctap2::Error, HidError or IoError.
+    std::vector<uint8_t> cbor(uint8_t command, const std::vector<uint8_t> &params, int timeout_ms);
+};
+
+// A channel on a device this process opens, as a PAM module without the
+// broker does on every authentication.
+class DeviceSession : public Session {
+  public:
+    // Opens `path` (see resolve_device and open_transport) and allocates a
+    // channel.
+    explicit DeviceSession(const std::string &path, int timeout_ms = 1000);
+    // A new channel on a device already open.
+    explicit DeviceSession(std::shared_ptr<Device> dev, int timeout_ms = 1000);
+
+    Message transact(uint8_t cmd, const std::vector<uint8_t> &data, int timeout_ms) override;
+    uint32_t cid() const { return info_.cid; }
+    Device &device() { return *dev_; }
+
+  private:
+    std::shared_ptr<Device> dev_;
+    InitInfo info_;
+};
+
+// The broker's socket.
+class BrokerSession : public Session {
+  public:
+    explicit BrokerSession(const std::string &socket_path);
+    ~BrokerSession() override;
+    BrokerSession(const BrokerSession &) = delete;
+    BrokerSession &operator=(const BrokerSession &) = delete;
+
+    Message transact(uint8_t cmd, const std::vector<uint8_t> &data, int timeout_ms) override;
+
+  private:
+    int fd_;
+};
+
+// "auto": the first FIDO hidraw node; "serial:S": the key with that serial;
+// anything else as is. Scans sysfs once; roottapd keeps a Registry instead.
+std::string resolve_device(const std::string &path);
+
+}  // namespace roottap
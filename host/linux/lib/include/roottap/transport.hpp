@@ -0,0 +1,45 @@
+#pragma once
+// A FIDO HID device as 64-byte reports: a hidraw node, or roottap-sim's
+// Unix socket ("unix:PATH", see firmware/host/sim/sock_dev.c).
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace roottap {
+
+constexpr size_t kReportLen = 64;
+using Report = std::array<uint8_t, kReportLen>;
+
+// The device (or the broker) can't be reached, went away or timed out.
+class IoError : public std::runtime_error {
+  public:
+    using std::runtime_error::runtime_error;
+};
+
+class Transport {
+  public:
+    virtual ~Transport() = default;
+    virtual void send(const Report &r) = 0;
+    // false if nothing arrived within timeout_ms, or wake() was called
+    virtual bool recv(Report &r, int timeout_ms) = 0;
+    // makes a recv() blocked in another thread return now
+    virtual void wake() = 0;
+    virtual const std::string &path() const = 0;
+};
+
+// "/dev/hidrawN" or "unix:PATH". Throws IoError.
+std::unique_ptr<Transport> open_transport(const std::string &path);
+
+// Whether a HID report descriptor declares the FIDO usage page (0xF1D0).
+bool is_fido_descriptor(const uint8_t *desc, size_t len);
+
+// hidraw nodes with a FIDO report descriptor, by scanning sysfs. Every
+// call reads every node's descriptor.
+std::vector<std::string> find_fido_devices(const std::string &sysfs = "/sys/class/hidraw");
+
+}  // namespace roottap
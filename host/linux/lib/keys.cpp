@@ -0,0 +1,70 @@
+#include "roottap/keys.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace roottap {
+
+namespace {
+
+int hex_digit(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+}  // namespace
+
+std::string to_hex(const std::vector<uint8_t> &b)
+{
+    static const char digits[] = "0123456789abcdef";
+    std::string s;
+    s.reserve(b.size() * 2);
+    for (uint8_t v : b) {
+        s.push_back(digits[v >> 4]);
+        s.push_back(digits[v & 0x0F]);
+    }
+    return s;
+}
+
+bool from_hex(const std::string &s, std::vector<uint8_t> &out)
+{
+    if (s.size() % 2) return false;
+    out.clear();
+    out.reserve(s.size() / 2);
+    for (size_t i = 0; i < s.size(); i += 2) {
+        int hi = hex_digit(s[i]), lo = hex_digit(s[i + 1]);
+        if (hi < 0 || lo < 0) return false;
+        out.push_back(static_cast<uint8_t>(hi << 4 | lo));
+    }
+    return true;
+}
+
+std::vector<KeyEntry> load_keys(const std::string &path, const std::string &user)
+{
+    std::ifstream f(path);
+    if (!f) throw std::runtime_error(path + ": cannot read");
+    std::vector<KeyEntry> keys;
+    std::string line;
+    while (std::getline(f, line)) {
+        size_t hash = line.find('#');
+        if (hash != std::string::npos) line.erase(hash);
+        std::istringstream in(line);
+        KeyEntry k;
+        std::string id, pub;
+        if (!(in >> k.user >> k.rp_id >> id >> pub) || k.user != user) continue;
+        if (!from_hex(id, k.credential_id) || !from_hex(pub, k.public_key) || k.public_key.size() != 65) continue;
+        keys.push_back(std::move(k));
+    }
+    return keys;
+}
+
+std::string format_key(const KeyEntry &k)
+{
+    return k.user + " " + k.rp_id + " " + to_hex(k.credential_id) + " " + to_hex(k.public_key);
+}
+
+}  // namespace roottap
@@ -0,0 +1,229 @@
+#include "roottap/registry.hpp"
+
+#include <cstring>
+#include <dirent.h>
+#include <fstream>
+#include <iterator>
+#include <linux/netlink.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "roottap/transport.hpp"
+
+namespace roottap {
+
+namespace {
+
+constexpr size_t kUeventMax = 8192;
+
+std::vector<uint8_t> read_file(const std::string &path)
+{
+    std::ifstream f(path, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+}
+
+// KEY=value lines of a sysfs uevent file
+std::unordered_map<std::string, std::string> read_uevent(const std::string &path)
+{
+    std::unordered_map<std::string, std::string> vars;
+    std::ifstream f(path);
+    std::string line;
+    while (std::getline(f, line)) {
+        size_t eq = line.find('=');
+        if (eq != std::string::npos) vars[line.substr(0, eq)] = line.substr(eq + 1);
+    }
+    return vars;
+}
+
+std::string basename_of(const std::string &path)
+{
+    size_t slash = path.rfind('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+}  // namespace
+
+Registry::Registry(std::string sysfs, std::string dev_dir) : sysfs_(std::move(sysfs)), dev_dir_(std::move(dev_dir)) {}
+
+Registry::~Registry()
+{
+    if (nl_fd_ >= 0) close(nl_fd_);
+}
+
+bool Registry::watch()
+{
+    if (nl_fd_ >= 0) return true;
+    int fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_KOBJECT_UEVENT);
+    if (fd < 0) return false;
+    struct sockaddr_nl addr = {};
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = 1;   // the kernel's own events, not udev's rebroadcast
+    if (bind(fd, reinterpret_cast<const struct sockaddr *>(&addr), sizeof(addr)) != 0) {
+        close(fd);
+        return false;
+    }
+    nl_fd_ = fd;
+    return true;
+}
+
+bool Registry::dispatch()
+{
+    bool changed = false;
+    if (nl_fd_ < 0) return false;
+    char buf[kUeventMax];
+    for (;;) {
+        struct sockaddr_nl src = {};
+        socklen_t src_len = sizeof(src);
+        ssize_t n = recvfrom(nl_fd_, buf, sizeof(buf) - 1, 0, reinterpret_cast<struct sockaddr *>(&src), &src_len);
+        if (n <= 0) break;
+        if (src.nl_pid != 0) continue;   // only the kernel speaks on this group
+        buf[n] = '\0';
+        changed |= on_uevent(buf, static_cast<size_t>(n));
+    }
+    return changed;
+}
+
+bool Registry::on_uevent(const char *buf, size_t len)
+{
+    std::string action, subsystem, devname;
+    // "action@devpath" first, then KEY=value, each NUL-terminated
+    for (size_t i = 0; i < len;) {
+        const char *s = buf + i;
+        size_t n = strnlen(s, len - i);
+        if (std::strncmp(s, "ACTION=", 7) == 0) action.assign(s + 7, n - 7);
+        else if (std::strncmp(s, "SUBSYSTEM=", 10) == 0) subsystem.assign(s + 10, n - 10);
+        else if (std::strncmp(s, "DEVNAME=", 8) == 0) devname.assign(s + 8, n - 8);
+        i += n + 1;
+    }
+    if (subsystem != "hidraw" || devname.empty()) return false;
+    std::string name = basename_of(devname);
+
+    std::lock_guard<std::mutex> lock(mu_);
+    stats_.events++;
+    if (action == "add" || action == "change") {
+        bool was = drop(name);
+        return probe(name) || was;
+    }
+    if (action == "remove") return drop(name);
+    return false;
+}
+
+bool Registry::probe(const std::string &name)
+{
+    const std::string dir = sysfs_ + "/" + name + "/device/";
+    stats_.probes++;
+    Node n;
+    n.key.descriptor = read_file(dir + "report_descriptor");
+    n.fido = is_fido_descriptor(n.key.descriptor.data(), n.key.descriptor.size());
+    if (!n.fido) {
+        n.key.descriptor.clear();
+        nodes_[name] = std::move(n);
+        return false;
+    }
+
+    auto vars = read_uevent(dir + "uevent");
+    n.key.node = dev_dir_ + "/" + name;
+    n.key.name = vars["HID_NAME"];
+    n.key.serial = !vars["HID_UNIQ"].empty() ? vars["HID_UNIQ"] : !vars["HID_PHYS"].empty() ? vars["HID_PHYS"] : name;
+    by_serial_[n.key.serial] = name;
+    if (first_.empty()) first_ = name;
+    nodes_[name] = std::move(n);
+    return true;
+}
+
+bool Registry::drop(const std::string &name)
+{
+    auto it = nodes_.find(name);
+    if (it == nodes_.end()) return false;
+    bool fido = it->second.fido;
+    if (fido) {
+        auto s = by_serial_.find(it->second.key.serial);
+        if (s != by_serial_.end() && s->second == name) by_serial_.erase(s);
+    }
+    nodes_.erase(it);
+    if (first_ == name) first_ = by_serial_.empty() ? "" : by_serial_.begin()->second;
+    return fido;
+}
+
+void Registry::rescan()
+{
+    std::lock_guard<std::mutex> lock(mu_);
+    scan_locked();
+}
+
+void Registry::scan_locked()
+{
+    nodes_.clear();
+    by_serial_.clear();
+    first_.clear();
+    stats_.rescans++;
+    scanned_ = true;
+    DIR *d = opendir(sysfs_.c_str());
+    if (!d) return;
+    while (struct dirent *e = readdir(d)) {
+        if (std::strncmp(e->d_name, "hidraw", 6) == 0) probe(e->d_name);
+    }
+    closedir(d);
+}
+
+const Registry::Node *Registry::lookup(const std::string &spec) const
+{
+    std::string name;
+    if (spec == "auto") {
+        name = first_;
+    } else if (spec.compare(0, 7, "serial:") == 0) {
+        auto s = by_serial_.find(spec.substr(7));
+        if (s != by_serial_.end()) name = s->second;
+    } else if (spec.compare(0, dev_dir_.size() + 1, dev_dir_ + "/") == 0) {
+        name = spec.substr(dev_dir_.size() + 1);
+    }
+    auto it = nodes_.find(name);
+    return it != nodes_.end() && it->second.fido ? &it->second : nullptr;
+}
+
+std::optional<KeyInfo> Registry::find(const std::string &spec)
+{
+    std::lock_guard<std::mutex> lock(mu_);
+    if (!scanned_) scan_locked();
+    const Node *n = lookup(spec);
+    // with uevents a miss is a miss; without, the key may be new
+    if (!n && nl_fd_ < 0) {
+        scan_locked();
+        n = lookup(spec);
+    }
+    if (!n) return std::nullopt;
+    return n->key;
+}
+
+std::vector<KeyInfo> Registry::keys()
+{
+    std::lock_guard<std::mutex> lock(mu_);
+    if (!scanned_) scan_locked();
+    std::vector<KeyInfo> out;
+    for (const auto &[name, n] : nodes_) {
+        if (n.fido) out.push_back(n.key);
+    }
+    return out;
+}
+
+void Registry::set_info(const std::string &node, std::vector<uint8_t> info)
+{
+    std::lock_guard<std::mutex> lock(mu_);
+    auto it = nodes_.find(basename_of(node));
+    if (it != nodes_.end() && it->second.fido && it->second.key.node == node) it->second.key.info = std::move(info);
+}
+
+void Registry::invalidate_info(const std::string &node)
+{
+    std::lock_guard<std::mutex> lock(mu_);
+    auto it = nodes_.find(basename_of(node));
+    if (it != nodes_.end() && it->second.key.node == node) it->second.key.info.clear();
+}
+
+RegistryStats Registry::stats()
+{
+    std::lock_guard<std::mutex> lock(mu_);
+    return stats_;
+}
+
+}  // namespace roottap
@@ -0,0 +1,102 @@
+#include "roottap/session.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "roottap/broker_proto.hpp"
+#include "roottap/ctap2.hpp"
+#include "roottap/registry.hpp"
+
+namespace roottap {
+
+std::vector<uint8_t> Session::cbor(uint8_t command, const std::vector<uint8_t> &params, int timeout_ms)
+{
+    std::vector<uint8_t> req;
+    req.reserve(1 + params.size());
+    req.push_back(command);
+    req.insert(req.end(), params.begin(), params.end());
+    Message m = transact(ctaphid::kCbor, req, timeout_ms);
+    if (m.cmd == ctaphid::kError) throw HidError(m.data.empty() ? 0 : m.data[0]);
+    if (m.cmd != ctaphid::kCbor || m.data.empty()) throw IoError("unexpected CTAPHID answer");
+    if (m.data[0] != ctap2::kOk) throw ctap2::Error(m.data[0]);
+    return std::vector<uint8_t>(m.data.begin() + 1, m.data.end());
+}
+
+std::string resolve_device(const std::string &path)
+{
+    if (path != "auto" && path.compare(0, 7, "serial:") != 0) return path;
+    std::optional<KeyInfo> k = Registry().find(path);
+    if (!k) throw IoError(path == "auto" ? "no FIDO device found" : path + ": not plugged in");
+    return k->node;
+}
+
+DeviceSession::DeviceSession(const std::string &path, int timeout_ms)
+    : DeviceSession(std::make_shared<Device>(open_transport(resolve_device(path))), timeout_ms)
+{
+}
+
+DeviceSession::DeviceSession(std::shared_ptr<Device> dev, int timeout_ms) : dev_(std::move(dev))
+{
+    info_ = dev_->init(timeout_ms);
+}
+
+Message DeviceSession::transact(uint8_t cmd, const std::vector<uint8_t> &data, int timeout_ms)
+{
+    return dev_->transact(info_.cid, cmd, data, timeout_ms);
+}
+
+BrokerSession::BrokerSession(const std::string &socket_path)
+{
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(addr.sun_path)) throw IoError(socket_path + ": path too long");
+    std::memcpy(addr.sun_path, socket_path.c_str(), socket_path.size() + 1);
+    fd_ = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd_ < 0) throw IoError(std::string("socket: ") + std::strerror(errno));
+    if (connect(fd_, reinterpret_cast<const struct sockaddr *>(&addr), sizeof(addr)) != 0) {
+        std::string msg = socket_path + ": " + std::strerror(errno);
+        close(fd_);
+        throw IoError(msg);
+    }
+}
+
+BrokerSession::~BrokerSession()
+{
+    close(fd_);
+}
+
+Message BrokerSession::transact(uint8_t cmd, const std::vector<uint8_t> &data, int timeout_ms)
+{
+    std::vector<uint8_t> req(broker::kRequestHead);
+    req[0] = broker::kVersion;
+    req[1] = cmd;
+    for (int i = 0; i < 4; i++) req[2 + i] = static_cast<uint8_t>(static_cast<uint32_t>(timeout_ms) >> (24 - 8 * i));
+    req.insert(req.end(), data.begin(), data.end());
+    if (send(fd_, req.data(), req.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(req.size())) {
+        throw IoError(std::string("broker: ") + std::strerror(errno));
+    }
+
+    // the broker answers within timeout_ms; allow for its own overhead
+    struct pollfd p = { fd_, POLLIN, 0 };
+    int n;
+    do {
+        n = poll(&p, 1, timeout_ms + 1000);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) throw IoError("broker: no answer");
+
+    std::vector<uint8_t> resp(broker::kResponseHead + ctaphid::kMaxMessage);
+    ssize_t len = recv(fd_, resp.data(), resp.size(), 0);
+    if (len < static_cast<ssize_t>(broker::kResponseHead) || resp[0] != broker::kVersion) {
+        throw IoError("broker: bad answer");
+    }
+    if (resp[1] == broker::kNoDevice) throw IoError("broker: no device");
+    if (resp[1] == broker::kTimeout) throw IoError("broker: timeout");
+    if (resp[1] != broker::kOk) throw IoError("broker: request refused");
+    return Message{ resp[2], std::vector<uint8_t>(resp.begin() + broker::kResponseHead, resp.begin() + len) };
+}
+
+}  // namespace roottap
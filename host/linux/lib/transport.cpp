@@ -0,0 +1,171 @@
+#include "roottap/transport.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fstream>
+#include <iterator>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace roottap {
+
+namespace {
+
+std::string errno_msg(const std::string &what)
+{
+    return what + ": " + std::strerror(errno);
+}
+
+// false on timeout or when `wake_fd` is signalled
+bool wait_readable(int fd, int wake_fd, int timeout_ms)
+{
+    struct pollfd p[2] = { { fd, POLLIN, 0 }, { wake_fd, POLLIN, 0 } };
+    int n;
+    do {
+        n = poll(p, 2, timeout_ms);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) throw IoError(errno_msg("poll"));
+    if (p[1].revents & POLLIN) {
+        uint64_t v;
+        (void)!read(wake_fd, &v, sizeof(v));
+        return false;
+    }
+    if (n > 0 && (p[0].revents & (POLLERR | POLLHUP | POLLNVAL)) && !(p[0].revents & POLLIN)) {
+        throw IoError("device closed");
+    }
+    return n > 0;
+}
+
+class FdTransport : public Transport {
+  public:
+    FdTransport(int fd, std::string path, bool report_id)
+        : fd_(fd), wake_fd_(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)), path_(std::move(path)), report_id_(report_id)
+    {
+        if (wake_fd_ < 0) {
+            close(fd_);
+            throw IoError(errno_msg("eventfd"));
+        }
+    }
+    ~FdTransport() override
+    {
+        close(wake_fd_);
+        close(fd_);
+    }
+    FdTransport(const FdTransport &) = delete;
+    FdTransport &operator=(const FdTransport &) = delete;
+
+    void send(const Report &r) override
+    {
+        // hidraw takes the report ID first, 0 for a device without IDs
+        uint8_t buf[kReportLen + 1] = { 0 };
+        size_t off = report_id_ ? 1 : 0;
+        std::memcpy(buf + off, r.data(), kReportLen);
+        ssize_t n = write(fd_, buf, kReportLen + off);
+        if (n != static_cast<ssize_t>(kReportLen + off)) throw IoError(errno_msg("write " + path_));
+    }
+
+    bool recv(Report &r, int timeout_ms) override
+    {
+        if (!wait_readable(fd_, wake_fd_, timeout_ms)) return false;
+        ssize_t n = read(fd_, r.data(), kReportLen);
+        if (n == 0) throw IoError(path_ + ": closed");
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EINTR) return false;
+            throw IoError(errno_msg("read " + path_));
+        }
+        if (static_cast<size_t>(n) < kReportLen) std::memset(r.data() + n, 0, kReportLen - n);
+        return true;
+    }
+
+    void wake() override
+    {
+        uint64_t one = 1;
+        (void)!write(wake_fd_, &one, sizeof(one));
+    }
+
+    const std::string &path() const override { return path_; }
+
+  private:
+    int fd_;
+    int wake_fd_;
+    std::string path_;
+    bool report_id_;
+};
+
+std::vector<uint8_t> read_file(const std::string &path)
+{
+    std::ifstream f(path, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+}
+
+}  // namespace
+
+std::unique_ptr<Transport> open_transport(const std::string &path)
+{
+    const std::string unix_prefix = "unix:";
+    if (path.compare(0, unix_prefix.size(), unix_prefix) == 0) {
+        std::string sock = path.substr(unix_prefix.size());
+        struct sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        if (sock.size() >= sizeof(addr.sun_path)) throw IoError(sock + ": path too long");
+        std::memcpy(addr.sun_path, sock.c_str(), sock.size() + 1);
+        int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+        if (fd < 0) throw IoError(errno_msg("socket"));
+        if (connect(fd, reinterpret_cast<const struct sockaddr *>(&addr), sizeof(addr)) != 0) {
+            int err = errno;
+            close(fd);
+            errno = err;
+            throw IoError(errno_msg(sock));
+        }
+        return std::make_unique<FdTransport>(fd, path, false);
+    }
+    int fd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0) throw IoError(errno_msg(path));
+    return std::make_unique<FdTransport>(fd, path, true);
+}
+
+bool is_fido_descriptor(const uint8_t *desc, size_t len)
+{
+    // walk the short items; a Usage Page item (0x05 1 byte, 0x06 2 bytes)
+    // of 0xF1D0 is enough
+    size_t i = 0;
+    while (i < len) {
+        uint8_t prefix = desc[i];
+        if (prefix == 0xFE) {   // long item
+            if (i + 2 >= len) break;
+            i += 3 + desc[i + 1];
+            continue;
+        }
+        size_t size = prefix & 0x03;
+        if (size == 3) size = 4;
+        if (i + 1 + size > len) break;
+        if ((prefix & 0xFC) == 0x04) {   // global Usage Page
+            uint32_t page = 0;
+            for (size_t k = 0; k < size; k++) page |= static_cast<uint32_t>(desc[i + 1 + k]) << (8 * k);
+            if (page == 0xF1D0) return true;
+        }
+        i += 1 + size;
+    }
+    return false;
+}
+
+std::vector<std::string> find_fido_devices(const std::string &sysfs)
+{
+    std::vector<std::string> found;
+    DIR *d = opendir(sysfs.c_str());
+    if (!d) return found;
+    while (struct dirent *e = readdir(d)) {
+        if (std::strncmp(e->d_name, "hidraw", 6) != 0) continue;
+        std::vector<uint8_t> desc = read_file(sysfs + "/" + e->d_name + "/device/report_descriptor");
+        if (is_fido_descriptor(desc.data(), desc.size())) found.push_back(std::string("/dev/") + e->d_name);
+    }
+    closedir(d);
+    return found;
+}
+
+}  // namespace roottap
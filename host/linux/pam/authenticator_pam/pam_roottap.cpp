@@ -0,0 +1,98 @@
+// pam_roottap: authenticates with the roottap key. Goes through roottapd
+// when its socket is there, else opens the key itself.
+//
+//   auth sufficient pam_roottap.so [keys=FILE] [broker=SOCK] [nobroker]
+//                                  [device=PATH|auto] [timeout=MS] [debug]
+
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <syslog.h>
+
+#include <security/pam_ext.h>
+#include <security/pam_modules.h>
+
+#include "roottap/auth.hpp"
+#include "roottap/broker_proto.hpp"
+#include "roottap/keys.hpp"
+#include "roottap/session.hpp"
+
+namespace {
+
+struct Options {
+    std::string keys = roottap::kDefaultKeysFile;
+    std::string broker = roottap::broker::kDefaultSocket;
+    std::string device = "auto";
+    bool use_broker = true;
+    int timeout_ms = 30000;
+    bool debug = false;
+};
+
+Options parse_args(int argc, const char **argv)
+{
+    Options o;
+    for (int i = 0; i < argc; i++) {
+        const char *a = argv[i];
+        if (std::strncmp(a, "keys=", 5) == 0) o.keys = a + 5;
+        else if (std::strncmp(a, "broker=", 7) == 0) o.broker = a + 7;
+        else if (std::strcmp(a, "nobroker") == 0) o.use_broker = false;
+        else if (std::strncmp(a, "device=", 7) == 0) o.device = a + 7;
+        else if (std::strncmp(a, "timeout=", 8) == 0) o.timeout_ms = std::atoi(a + 8);
+        else if (std::strcmp(a, "debug") == 0) o.debug = true;
+    }
+    return o;
+}
+
+std::unique_ptr<roottap::Session> open_session(pam_handle_t *pamh, const Options &o)
+{
+    if (o.use_broker) {
+        try {
+            return std::make_unique<roottap::BrokerSession>(o.broker);
+        } catch (const roottap::IoError &e) {
+            if (o.debug) pam_syslog(pamh, LOG_DEBUG, "no broker (%s), opening the key", e.what());
+        }
+    }
+    return std::make_unique<roottap::DeviceSession>(o.device);
+}
+
+}  // namespace
+
+extern "C" PAM_EXTERN int pam_sm_authenticate(pam_handle_t *pamh, int flags, int argc, const char **argv)
+{
+    (void)flags;
+    Options o = parse_args(argc, argv);
+    const char *user = nullptr;
+    if (pam_get_user(pamh, &user, nullptr) != PAM_SUCCESS || !user) return PAM_USER_UNKNOWN;
+
+    try {
+        std::vector<roottap::KeyEntry> keys = roottap::load_keys(o.keys, user);
+        if (keys.empty()) {
+            if (o.debug) pam_syslog(pamh, LOG_DEBUG, "no keys for %s in %s", user, o.keys.c_str());
+            return PAM_AUTHINFO_UNAVAIL;
+        }
+        std::unique_ptr<roottap::Session> s = open_session(pamh, o);
+        pam_info(pamh, "roottap: approve on your phone");
+        switch (roottap::authenticate(*s, keys, o.timeout_ms)) {
+        case roottap::AuthResult::Ok:
+            return PAM_SUCCESS;
+        case roottap::AuthResult::NoMatch:
+            pam_syslog(pamh, LOG_NOTICE, "key holds none of %s's credentials", user);
+            return PAM_AUTH_ERR;
+        case roottap::AuthResult::Denied:
+            return PAM_AUTH_ERR;
+        }
+    } catch (const std::exception &e) {
+        pam_syslog(pamh, LOG_ERR, "%s", e.what());
+    }
+    return PAM_AUTHINFO_UNAVAIL;
+}
+
+extern "C" PAM_EXTERN int pam_sm_setcred(pam_handle_t *pamh, int flags, int argc, const char **argv)
+{
+    (void)pamh;
+    (void)flags;
+    (void)argc;
+    (void)argv;
+    return PAM_SUCCESS;
+}
@@ -0,0 +1,149 @@
+// roottap-auth-bench: what pam_roottap adds to a pam_authenticate, with and
+// without roottapd. Each rep is the module's work from opening a session to
+// the verdict; --clients runs that many at once, like parallel sudo/sshd.
+// Prints one JSON line per path to stdout.
+//
+// Registers a throwaway credential first, so run it against roottap-sim
+// with --up approve (or a key with a grant), not a key waiting for a touch.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "roottap/auth.hpp"
+#include "roottap/ctap2.hpp"
+#include "roottap/session.hpp"
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+constexpr int kTimeoutMs = 5000;
+
+struct Result {
+    std::vector<double> lat_us;
+    unsigned failed = 0;
+};
+
+template <typename Open>
+Result run(Open open, const std::vector<roottap::KeyEntry> &keys, unsigned reps, unsigned clients)
+{
+    std::vector<Result> per(clients);
+    std::vector<std::thread> threads;
+    for (unsigned c = 0; c < clients; c++) {
+        threads.emplace_back([&, c] {
+            for (unsigned i = c; i < reps; i += clients) {
+                auto t0 = clock_type::now();
+                bool ok = false;
+                try {
+                    std::unique_ptr<roottap::Session> s = open();
+                    ok = roottap::authenticate(*s, keys, kTimeoutMs) == roottap::AuthResult::Ok;
+                } catch (const std::exception &e) {
+                    std::fprintf(stderr, "%s\n", e.what());
+                }
+                auto us = std::chrono::duration<double, std::micro>(clock_type::now() - t0).count();
+                if (ok) per[c].lat_us.push_back(us);
+                else per[c].failed++;
+            }
+        });
+    }
+    for (auto &t : threads) t.join();
+
+    Result all;
+    for (auto &r : per) {
+        all.lat_us.insert(all.lat_us.end(), r.lat_us.begin(), r.lat_us.end());
+        all.failed += r.failed;
+    }
+    std::sort(all.lat_us.begin(), all.lat_us.end());
+    return all;
+}
+
+double pct(const std::vector<double> &v, double p)
+{
+    if (v.empty()) return 0;
+    return v[std::min(v.size() - 1, static_cast<size_t>(p * v.size()))];
+}
+
+void report(const char *path, unsigned clients, const Result &r)
+{
+    std::printf("{\"bench\":\"auth\",\"path\":\"%s\",\"clients\":%u,\"ok\":%zu,\"failed\":%u,"
+                "\"p50_us\":%.0f,\"p90_us\":%.0f,\"p99_us\":%.0f,\"max_us\":%.0f}\n",
+                path, clients, r.lat_us.size(), r.failed, pct(r.lat_us, 0.50), pct(r.lat_us, 0.90),
+                pct(r.lat_us, 0.99), r.lat_us.empty() ? 0.0 : r.lat_us.back());
+    std::fflush(stdout);
+}
+
+void usage(const char *argv0)
+{
+    std::fprintf(stderr, "usage: %s [--device PATH|auto] [--broker SOCK] [--reps N] [--clients N]\n", argv0);
+}
+
+}  // namespace
+
+int main(int argc, char **argv)
+{
+    std::string device = "auto";
+    std::string broker;
+    unsigned reps = 50;
+    unsigned clients = 1;
+
+    for (int i = 1; i < argc; i++) {
+        const char *val = (i + 1 < argc) ? argv[i + 1] : nullptr;
+        if (std::strcmp(argv[i], "--device") == 0 && val) {
+            device = val;
+            i++;
+        } else if (std::strcmp(argv[i], "--broker") == 0 && val) {
+            broker = val;
+            i++;
+        } else if (std::strcmp(argv[i], "--reps") == 0 && val) {
+            reps = static_cast<unsigned>(std::strtoul(val, nullptr, 0));
+            i++;
+        } else if (std::strcmp(argv[i], "--clients") == 0 && val) {
+            clients = static_cast<unsigned>(std::strtoul(val, nullptr, 0));
+            i++;
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (reps == 0 || clients == 0) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    roottap::KeyEntry key;
+    try {
+        roottap::DeviceSession s(device);
+        roottap::ctap2::MakeCredentialParams p;
+        p.rp_id = "pam://roottap-bench";
+        p.client_data_hash = roottap::ctap2::random_bytes(roottap::ctap2::kHashLen);
+        p.user_id = roottap::ctap2::random_bytes(16);
+        p.user_name = "bench";
+        roottap::ctap2::Credential c = roottap::ctap2::parse_make_credential(
+            s.cbor(roottap::ctap2::kMakeCredential, roottap::ctap2::make_credential(p), kTimeoutMs));
+        key = roottap::KeyEntry{ "bench", p.rp_id, c.id, c.public_key };
+    } catch (const std::exception &e) {
+        std::fprintf(stderr, "enroll: %s\n", e.what());
+        return 1;
+    }
+    std::vector<roottap::KeyEntry> keys{ key };
+
+    unsigned failed = 0;
+    Result direct = run([&] { return std::make_unique<roottap::DeviceSession>(device); }, keys, reps, clients);
+    report("direct", clients, direct);
+    failed += direct.failed;
+
+    if (!broker.empty()) {
+        Result brokered = run([&] { return std::make_unique<roottap::BrokerSession>(broker); }, keys, reps, clients);
+        report("broker", clients, brokered);
+        failed += brokered.failed;
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,154 @@
+// roottap-registry-bench: finding the key among many unrelated HID devices,
+// by a full sysfs scan (what every lookup cost before the Registry) and
+// from the Registry's cache, plus the cost of a plug/unplug uevent. Builds
+// a fake /sys/class/hidraw under a temporary directory; prints one JSON line
+// per operation to stdout.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+#include "roottap/registry.hpp"
+#include "roottap/transport.hpp"
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+// a boot keyboard; the kind of node that surrounds the key
+const uint8_t kKeyboardDesc[] = {
+    0x05, 0x01, 0x09, 0x06, 0xA1, 0x01, 0x05, 0x07, 0x19, 0xE0, 0x29, 0xE7, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01,
+    0x95, 0x08, 0x81, 0x02, 0x95, 0x01, 0x75, 0x08, 0x81, 0x01, 0x95, 0x05, 0x75, 0x01, 0x05, 0x08, 0x19, 0x01,
+    0x29, 0x05, 0x91, 0x02, 0x95, 0x01, 0x75, 0x03, 0x91, 0x01, 0x95, 0x06, 0x75, 0x08, 0x15, 0x00, 0x25, 0x65,
+    0x05, 0x07, 0x19, 0x00, 0x29, 0x65, 0x81, 0x00, 0xC0,
+};
+
+// the key's: usage page 0xF1D0, as in usb_hid.c's s_hid_report_desc
+const uint8_t kFidoDesc[] = {
+    0x06, 0xD0, 0xF1, 0x09, 0x01, 0xA1, 0x01, 0x09, 0x20, 0x15, 0x00, 0x26, 0xFF, 0x00, 0x75, 0x08,
+    0x95, 0x40, 0x81, 0x02, 0x09, 0x21, 0x15, 0x00, 0x26, 0xFF, 0x00, 0x75, 0x08, 0x95, 0x40, 0x91, 0x02, 0xC0,
+};
+
+const char *kSerial = "RT0001";
+
+void write_node(const std::string &root, unsigned n, const uint8_t *desc, size_t len, const std::string &uniq)
+{
+    std::string dir = root + "/hidraw" + std::to_string(n);
+    mkdir(dir.c_str(), 0755);
+    mkdir((dir + "/device").c_str(), 0755);
+    std::ofstream(dir + "/device/report_descriptor", std::ios::binary)
+        .write(reinterpret_cast<const char *>(desc), static_cast<std::streamsize>(len));
+    std::ofstream(dir + "/device/uevent") << "HID_NAME=dev" << n << "\nHID_UNIQ=" << uniq << "\n";
+}
+
+std::string uevent(const char *action, unsigned n)
+{
+    std::string name = "hidraw" + std::to_string(n);
+    std::string e = std::string(action) + "@/devices/virtual/hidraw/" + name;
+    e += '\0';
+    e += std::string("ACTION=") + action;
+    e += '\0';
+    e += "SUBSYSTEM=hidraw";
+    e += '\0';
+    e += "DEVNAME=" + name;
+    e += '\0';
+    return e;
+}
+
+template <typename Fn>
+void time_op(const char *op, unsigned devices, unsigned reps, Fn fn)
+{
+    std::vector<double> us;
+    us.reserve(reps);
+    for (unsigned i = 0; i < reps; i++) {
+        auto t0 = clock_type::now();
+        fn(i);
+        us.push_back(std::chrono::duration<double, std::micro>(clock_type::now() - t0).count());
+    }
+    std::sort(us.begin(), us.end());
+    double sum = 0;
+    for (double v : us) sum += v;
+    std::printf("{\"bench\":\"registry\",\"op\":\"%s\",\"devices\":%u,\"reps\":%u,\"mean_us\":%.2f,"
+                "\"p99_us\":%.2f}\n",
+                op, devices, reps, sum / reps, us[std::min(us.size() - 1, static_cast<size_t>(0.99 * us.size()))]);
+    std::fflush(stdout);
+}
+
+void usage(const char *argv0)
+{
+    std::fprintf(stderr, "usage: %s [--devices N] [--reps N]\n", argv0);
+}
+
+}  // namespace
+
+int main(int argc, char **argv)
+{
+    unsigned devices = 100;
+    unsigned reps = 200;
+    for (int i = 1; i < argc; i++) {
+        const char *val = (i + 1 < argc) ? argv[i + 1] : nullptr;
+        if (std::strcmp(argv[i], "--devices") == 0 && val) {
+            devices = static_cast<unsigned>(std::strtoul(val, nullptr, 0));
+            i++;
+        } else if (std::strcmp(argv[i], "--reps") == 0 && val) {
+            reps = static_cast<unsigned>(std::strtoul(val, nullptr, 0));
+            i++;
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (reps == 0) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    char tmpl[] = "/tmp/roottap-sysfs-XXXXXX";
+    if (!mkdtemp(tmpl)) {
+        std::perror("mkdtemp");
+        return 1;
+    }
+    const std::string root = tmpl;
+    // the key last, so a scan reads every other node first
+    for (unsigned n = 0; n < devices; n++) write_node(root, n, kKeyboardDesc, sizeof(kKeyboardDesc), "kbd");
+    write_node(root, devices, kFidoDesc, sizeof(kFidoDesc), kSerial);
+    const std::string spec = std::string("serial:") + kSerial;
+
+    int failed = 0;
+    time_op("scan", devices, reps, [&](unsigned) {
+        if (roottap::find_fido_devices(root).size() != 1) failed = 1;
+    });
+    time_op("cold", devices, reps, [&](unsigned) {
+        if (!roottap::Registry(root).find(spec)) failed = 1;
+    });
+
+    roottap::Registry reg(root);
+    reg.rescan();
+    time_op("cached", devices, reps, [&](unsigned) {
+        if (!reg.find(spec)) failed = 1;
+    });
+
+    // an unrelated device and the key coming and going
+    const std::string add_other = uevent("add", 0), remove_other = uevent("remove", 0);
+    const std::string add_key = uevent("add", devices), remove_key = uevent("remove", devices);
+    time_op("event_other", devices, reps, [&](unsigned i) {
+        const std::string &e = i % 2 ? add_other : remove_other;
+        reg.on_uevent(e.data(), e.size());
+    });
+    time_op("event_key", devices, reps, [&](unsigned i) {
+        const std::string &e = i % 2 ? add_key : remove_key;
+        reg.on_uevent(e.data(), e.size());
+    });
+    if (!reg.find(spec)) failed = 1;
+
+    std::error_code ec;
+    std::filesystem::remove_all(root, ec);
+    return failed;
+}
@@ -0,0 +1,242 @@
+// roottap-enroll: registers the key with many hosts and accounts at once.
+//
+// Targets are "HOST USER..." lines. Each (host, user) gets a MakeCredential
+// for RP "pam://HOST"; the first one waits for the phone, which approves it
+// with an enrollment grant (CORE_GRANT_ENROLL) covering the rest, so they
+// run back to back. A host's keys file (OUT/HOST/keys, the format of
+// roottap/keys.hpp) is written on a worker thread as soon as its last
+// credential is in, while the key works on the next host. Existing lines
+// for the same user and RP are replaced, others kept.
+//
+// Prints one JSON line per step with its timing to stdout.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "roottap/broker_proto.hpp"
+#include "roottap/ctap2.hpp"
+#include "roottap/keys.hpp"
+#include "roottap/session.hpp"
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+struct Target {
+    std::string host;
+    std::string user;
+};
+
+double us_since(clock_type::time_point t0)
+{
+    return std::chrono::duration<double, std::micro>(clock_type::now() - t0).count();
+}
+
+bool read_targets(const std::string &path, std::vector<Target> &out)
+{
+    std::ifstream f(path);
+    if (!f) return false;
+    std::string line;
+    while (std::getline(f, line)) {
+        size_t hash = line.find('#');
+        if (hash != std::string::npos) line.erase(hash);
+        std::istringstream in(line);
+        std::string host, user;
+        if (!(in >> host)) continue;
+        while (in >> user) out.push_back(Target{ host, user });
+    }
+    return true;
+}
+
+// OUT/HOST/keys with `fresh` in place of older lines for the same user/RP;
+// written to a temporary file and renamed so a reader never sees half of it
+void write_host(const std::string &out_dir, const std::string &host, const std::vector<roottap::KeyEntry> &fresh)
+{
+    namespace fs = std::filesystem;
+    fs::path dir = fs::path(out_dir) / host;
+    fs::create_directories(dir);
+    fs::path path = dir / "keys";
+
+    std::vector<std::string> lines;
+    std::ifstream old(path);
+    std::string line;
+    while (std::getline(old, line)) {
+        std::istringstream in(line);
+        std::string user, rp;
+        in >> user >> rp;
+        bool replaced = std::any_of(fresh.begin(), fresh.end(),
+                                    [&](const roottap::KeyEntry &k) { return k.user == user && k.rp_id == rp; });
+        if (!replaced) lines.push_back(line);
+    }
+    for (const roottap::KeyEntry &k : fresh) lines.push_back(roottap::format_key(k));
+
+    fs::path tmp = dir / "keys.tmp";
+    {
+        std::ofstream f(tmp, std::ios::trunc);
+        for (const std::string &l : lines) f << l << "\n";
+        if (!f.flush()) throw std::runtime_error(tmp.string() + ": write failed");
+    }
+    fs::rename(tmp, path);
+}
+
+std::unique_ptr<roottap::Session> open_session(const std::string &broker, const std::string &device)
+{
+    if (!broker.empty()) {
+        try {
+            return std::make_unique<roottap::BrokerSession>(broker);
+        } catch (const roottap::IoError &) {
+        }
+    }
+    return std::make_unique<roottap::DeviceSession>(device);
+}
+
+void usage(const char *argv0)
+{
+    std::fprintf(stderr,
+                 "usage: %s --targets FILE --out DIR [--device PATH|auto|serial:S] [--broker SOCK|none]"
+                 " [--timeout-ms N] [--rk]\n",
+                 argv0);
+}
+
+}  // namespace
+
+int main(int argc, char **argv)
+{
+    std::string targets_path, out_dir;
+    std::string device = "auto";
+    std::string broker = roottap::broker::kDefaultSocket;
+    int timeout_ms = 60000;
+    bool rk = false;
+
+    for (int i = 1; i < argc; i++) {
+        const char *val = (i + 1 < argc) ? argv[i + 1] : nullptr;
+        if (std::strcmp(argv[i], "--targets") == 0 && val) {
+            targets_path = val;
+            i++;
+        } else if (std::strcmp(argv[i], "--out") == 0 && val) {
+            out_dir = val;
+            i++;
+        } else if (std::strcmp(argv[i], "--device") == 0 && val) {
+            device = val;
+            i++;
+        } else if (std::strcmp(argv[i], "--broker") == 0 && val) {
+            broker = std::strcmp(val, "none") == 0 ? "" : val;
+            i++;
+        } else if (std::strcmp(argv[i], "--timeout-ms") == 0 && val) {
+            timeout_ms = std::atoi(val);
+            i++;
+        } else if (std::strcmp(argv[i], "--rk") == 0) {
+            rk = true;
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    std::vector<Target> targets;
+    if (targets_path.empty() || out_dir.empty() || timeout_ms <= 0) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (!read_targets(targets_path, targets) || targets.empty()) {
+        std::fprintf(stderr, "%s: no targets\n", targets_path.c_str());
+        return 2;
+    }
+    // a host's accounts together, so its file can go as soon as they are done
+    std::stable_sort(targets.begin(), targets.end(), [](const Target &a, const Target &b) { return a.host < b.host; });
+
+    auto t_total = clock_type::now();
+    std::unique_ptr<roottap::Session> s;
+    auto t0 = clock_type::now();
+    try {
+        s = open_session(broker, device);
+    } catch (const std::exception &e) {
+        std::fprintf(stderr, "open: %s\n", e.what());
+        return 1;
+    }
+    std::printf("{\"step\":\"open\",\"us\":%.0f}\n", us_since(t0));
+
+    std::vector<double> mc_us;
+    double approval_us = 0;
+    std::vector<roottap::KeyEntry> pending;   // the current host's
+    std::vector<std::future<void>> writes;
+    std::map<std::string, double> write_us;
+    std::mutex write_mu;
+    size_t failed_at = targets.size();
+
+    for (size_t i = 0; i < targets.size(); i++) {
+        const Target &t = targets[i];
+        roottap::ctap2::MakeCredentialParams p;
+        p.rp_id = "pam://" + t.host;
+        p.client_data_hash = roottap::ctap2::random_bytes(roottap::ctap2::kHashLen);
+        p.user_id = roottap::ctap2::random_bytes(16);
+        p.user_name = t.user;
+        p.rk = rk;
+
+        t0 = clock_type::now();
+        try {
+            roottap::ctap2::Credential c = roottap::ctap2::parse_make_credential(
+                s->cbor(roottap::ctap2::kMakeCredential, roottap::ctap2::make_credential(p), timeout_ms));
+            pending.push_back(roottap::KeyEntry{ t.user, p.rp_id, c.id, c.public_key });
+        } catch (const std::exception &e) {
+            std::fprintf(stderr, "%s %s: %s\n", t.host.c_str(), t.user.c_str(), e.what());
+            failed_at = i;
+            break;
+        }
+        // the first one includes the wait for the phone
+        if (i == 0) approval_us = us_since(t0);
+        else mc_us.push_back(us_since(t0));
+
+        if (i + 1 == targets.size() || targets[i + 1].host != t.host) {
+            writes.push_back(std::async(std::launch::async, [&, host = t.host, keys = std::move(pending)] {
+                auto tw = clock_type::now();
+                write_host(out_dir, host, keys);
+                std::lock_guard<std::mutex> lock(write_mu);
+                write_us[host] = us_since(tw);
+            }));
+            pending.clear();
+        }
+    }
+    auto t_wait = clock_type::now();
+    int rc = failed_at < targets.size() ? 1 : 0;
+    for (auto &w : writes) {
+        try {
+            w.get();
+        } catch (const std::exception &e) {
+            std::fprintf(stderr, "write: %s\n", e.what());
+            rc = 1;
+        }
+    }
+    double drain_us = us_since(t_wait);
+
+    std::sort(mc_us.begin(), mc_us.end());
+    auto pct = [&](double p) {
+        return mc_us.empty() ? 0.0 : mc_us[std::min(mc_us.size() - 1, static_cast<size_t>(p * mc_us.size()))];
+    };
+    double mc_sum = 0;
+    for (double v : mc_us) mc_sum += v;
+    double write_max = 0, write_sum = 0;
+    for (const auto &[host, us] : write_us) {
+        write_max = std::max(write_max, us);
+        write_sum += us;
+    }
+
+    std::printf("{\"step\":\"approval\",\"us\":%.0f}\n", approval_us);
+    std::printf("{\"step\":\"make_credential\",\"n\":%zu,\"mean_us\":%.0f,\"p50_us\":%.0f,\"p99_us\":%.0f}\n",
+                mc_us.size(), mc_us.empty() ? 0.0 : mc_sum / mc_us.size(), pct(0.50), pct(0.99));
+    std::printf("{\"step\":\"write\",\"files\":%zu,\"sum_us\":%.0f,\"max_us\":%.0f,\"drain_us\":%.0f}\n",
+                write_us.size(), write_sum, write_max, drain_us);
+    std::printf("{\"step\":\"total\",\"enrolled\":%zu,\"targets\":%zu,\"us\":%.0f}\n",
+                failed_at < targets.size() ? failed_at : targets.size(), targets.size(), us_since(t_total));
+    return rc;
+}
@@ -0,0 +1,373 @@
+// roottap-load: many automation jobs hitting the key at once. Allocates
+// --channels CTAPHID channels (one CTAPHID_INIT each) on one device, and
+// fires a weighted mix of GetInfo, GetAssertion, PING and CANCEL on them at
+// --rate requests per second for --duration seconds.
+//
+// Latency is measured from when a request was due, not when it went out,
+// so a key that falls behind shows it. Every --report seconds a "window"
+// JSON line goes to stdout; at the end a "total" line with a log-linear
+// latency histogram.
+//
+// GetAssertion uses a credential made at start-up and needs presence each
+// time: run the simulator with --up approve, or give the key a grant.
+// CANCEL is a GetAssertion cancelled right after it is sent.
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "roottap/ctap2.hpp"
+#include "roottap/ctaphid.hpp"
+#include "roottap/session.hpp"
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+enum Op { OP_INFO, OP_ASSERT, OP_PING, OP_CANCEL, OP_COUNT };
+const char *const kOpNames[OP_COUNT] = { "info", "assert", "ping", "cancel" };
+
+// Buckets of 1 us up to 8 us, then 8 per power of two (12.5% wide).
+class Histogram {
+  public:
+    static constexpr size_t kSub = 8;
+    static constexpr size_t kBuckets = kSub * 40;
+
+    void add(uint64_t us)
+    {
+        counts_[index(us)]++;
+        n_++;
+    }
+
+    void merge(const Histogram &o)
+    {
+        for (size_t i = 0; i < kBuckets; i++) counts_[i] += o.counts_[i];
+        n_ += o.n_;
+    }
+
+    uint64_t count() const { return n_; }
+
+    // upper bound of the bucket holding the p-th quantile
+    uint64_t quantile(double p) const
+    {
+        if (n_ == 0) return 0;
+        uint64_t want = static_cast<uint64_t>(p * static_cast<double>(n_ - 1)) + 1, seen = 0;
+        for (size_t i = 0; i < kBuckets; i++) {
+            seen += counts_[i];
+            if (seen >= want) return upper(i);
+        }
+        return upper(kBuckets - 1);
+    }
+
+    std::string json() const
+    {
+        std::ostringstream out;
+        out << "[";
+        bool first = true;
+        for (size_t i = 0; i < kBuckets; i++) {
+            if (!counts_[i]) continue;
+            out << (first ? "" : ",") << "[" << upper(i) << "," << counts_[i] << "]";
+            first = false;
+        }
+        out << "]";
+        return out.str();
+    }
+
+  private:
+    static size_t index(uint64_t v)
+    {
+        if (v < kSub) return static_cast<size_t>(v);
+        int msb = 63 - __builtin_clzll(v);
+        size_t i = static_cast<size_t>(msb - 2) * kSub + ((v >> (msb - 3)) & (kSub - 1));
+        return std::min(i, kBuckets - 1);
+    }
+
+    static uint64_t upper(size_t i)
+    {
+        if (i < kSub) return i;
+        int msb = static_cast<int>(i / kSub) + 2;
+        return ((static_cast<uint64_t>(kSub + i % kSub) + 1) << (msb - 3)) - 1;
+    }
+
+    std::array<uint64_t, kBuckets> counts_{};
+    uint64_t n_ = 0;
+};
+
+struct Stats {
+    Histogram lat;
+    uint64_t ops[OP_COUNT] = {};
+    uint64_t busy = 0;         // CTAPHID_ERR_CHANNEL_BUSY
+    uint64_t timeouts = 0;     // no answer in --timeout-ms
+    uint64_t errors = 0;       // other CTAPHID errors, CTAP2 errors, wrong answers
+    uint64_t cancelled = 0;    // CANCELs the key answered with KEEPALIVE_CANCEL
+
+    void merge(const Stats &o)
+    {
+        lat.merge(o.lat);
+        for (int i = 0; i < OP_COUNT; i++) ops[i] += o.ops[i];
+        busy += o.busy;
+        timeouts += o.timeouts;
+        errors += o.errors;
+        cancelled += o.cancelled;
+    }
+};
+
+struct Config {
+    std::string device = "auto";
+    unsigned channels = 4;
+    double rate = 100;       // requests/s over all channels, 0: as fast as they go
+    double duration_s = 10;
+    double report_s = 1;
+    int timeout_ms = 5000;
+    size_t ping_bytes = 64;
+    unsigned weights[OP_COUNT] = { 50, 30, 15, 5 };
+};
+
+struct Shared {
+    Config cfg;
+    std::shared_ptr<roottap::Device> dev;
+    std::string rp_id;
+    std::vector<uint8_t> cred_id;
+    clock_type::time_point start;
+    std::atomic<bool> stop{ false };
+    std::mutex mu;
+    Stats window;
+};
+
+std::vector<uint8_t> assertion_request(const Shared &sh)
+{
+    std::vector<uint8_t> req{ roottap::ctap2::kGetAssertion };
+    std::vector<uint8_t> cdh = roottap::ctap2::random_bytes(roottap::ctap2::kHashLen);
+    std::vector<uint8_t> p = roottap::ctap2::get_assertion(sh.rp_id, cdh, { sh.cred_id });
+    req.insert(req.end(), p.begin(), p.end());
+    return req;
+}
+
+// One request; counts its outcome in `st`.
+void run_op(Shared &sh, uint32_t cid, Op op, Stats &st)
+{
+    using namespace roottap;
+    const Config &cfg = sh.cfg;
+    st.ops[op]++;
+    try {
+        Message m;
+        std::vector<uint8_t> sent;
+        if (op == OP_INFO) {
+            m = sh.dev->transact(cid, ctaphid::kCbor, { ctap2::kGetInfo }, cfg.timeout_ms, false);
+        } else if (op == OP_PING) {
+            sent = ctap2::random_bytes(cfg.ping_bytes);
+            m = sh.dev->transact(cid, ctaphid::kPing, sent, cfg.timeout_ms, false);
+        } else if (op == OP_ASSERT) {
+            m = sh.dev->transact(cid, ctaphid::kCbor, assertion_request(sh), cfg.timeout_ms, false);
+        } else {
+            auto r = std::async(std::launch::async, [&] {
+                return sh.dev->transact(cid, ctaphid::kCbor, assertion_request(sh), cfg.timeout_ms, false);
+            });
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+            sh.dev->cancel(cid);
+            m = r.get();
+        }
+
+        if (m.cmd == ctaphid::kError) {
+            if (m.data.size() == 1 && m.data[0] == ctaphid::kErrChannelBusy) st.busy++;
+            else st.errors++;
+        } else if (op == OP_PING) {
+            if (m.cmd != ctaphid::kPing || m.data != sent) st.errors++;
+        } else if (m.cmd != ctaphid::kCbor || m.data.empty()) {
+            st.errors++;
+        } else if (op == OP_CANCEL && m.data[0] == ctap2::kErrKeepaliveCancel) {
+            st.cancelled++;
+        } else if (m.data[0] != ctap2::kOk) {
+            st.errors++;
+        }
+    } catch (const IoError &) {
+        st.timeouts++;
+        // the key may still be busy with it on this channel
+        try {
+            sh.dev->cancel(cid);
+        } catch (const IoError &) {
+        }
+    }
+}
+
+void worker(Shared &sh, uint32_t cid, unsigned index)
+{
+    const Config &cfg = sh.cfg;
+    std::mt19937 rng(index * 7919u + 1);
+    std::discrete_distribution<int> pick(std::begin(cfg.weights), std::end(cfg.weights));
+    // open loop: this channel's share of --rate, staggered across channels
+    auto interval = cfg.rate > 0 ? std::chrono::duration<double>(cfg.channels / cfg.rate) : std::chrono::duration<double>(0);
+    auto due = sh.start + std::chrono::duration_cast<clock_type::duration>(interval * (index / double(cfg.channels)));
+
+    while (!sh.stop) {
+        if (cfg.rate > 0) {
+            std::this_thread::sleep_until(due);
+            if (sh.stop) break;
+        } else {
+            due = clock_type::now();
+        }
+        Stats one;
+        run_op(sh, cid, static_cast<Op>(pick(rng)), one);
+        one.lat.add(static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(clock_type::now() - due).count()));
+        {
+            std::lock_guard<std::mutex> lock(sh.mu);
+            sh.window.merge(one);
+        }
+        due += std::chrono::duration_cast<clock_type::duration>(interval);
+    }
+}
+
+void print_stats(const char *kind, double t_s, double span_s, const Stats &st, bool hist)
+{
+    uint64_t n = st.lat.count();
+    std::printf("{\"load\":\"%s\",\"t_s\":%.1f,\"ops\":%llu,\"ops_per_s\":%.1f,\"p50_us\":%llu,\"p99_us\":%llu,"
+                "\"p999_us\":%llu,\"busy\":%llu,\"timeouts\":%llu,\"errors\":%llu,\"cancelled\":%llu,"
+                "\"busy_rate\":%.4f,\"timeout_rate\":%.4f",
+                kind, t_s, static_cast<unsigned long long>(n), span_s > 0 ? n / span_s : 0.0,
+                static_cast<unsigned long long>(st.lat.quantile(0.50)),
+                static_cast<unsigned long long>(st.lat.quantile(0.99)),
+                static_cast<unsigned long long>(st.lat.quantile(0.999)), static_cast<unsigned long long>(st.busy),
+                static_cast<unsigned long long>(st.timeouts), static_cast<unsigned long long>(st.errors),
+                static_cast<unsigned long long>(st.cancelled), n ? double(st.busy) / n : 0.0,
+                n ? double(st.timeouts) / n : 0.0);
+    if (hist) {
+        std::printf(",\"mix\":{");
+        for (int i = 0; i < OP_COUNT; i++) {
+            std::printf("%s\"%s\":%llu", i ? "," : "", kOpNames[i], static_cast<unsigned long long>(st.ops[i]));
+        }
+        std::printf("},\"hist\":%s", st.lat.json().c_str());
+    }
+    std::printf("}\n");
+    std::fflush(stdout);
+}
+
+// "info=50,assert=30,ping=15,cancel=5"; ops left out get 0
+bool parse_mix(const char *s, unsigned *weights)
+{
+    unsigned w[OP_COUNT] = {};
+    std::istringstream in(s);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        size_t eq = item.find('=');
+        if (eq == std::string::npos) return false;
+        std::string name = item.substr(0, eq);
+        int op = -1;
+        for (int i = 0; i < OP_COUNT; i++) {
+            if (name == kOpNames[i]) op = i;
+        }
+        if (op < 0) return false;
+        w[op] = static_cast<unsigned>(std::strtoul(item.c_str() + eq + 1, nullptr, 10));
+    }
+    if (std::all_of(std::begin(w), std::end(w), [](unsigned v) { return v == 0; })) return false;
+    std::copy(std::begin(w), std::end(w), weights);
+    return true;
+}
+
+void usage(const char *argv0)
+{
+    std::fprintf(stderr,
+                 "usage: %s [--device PATH|auto|serial:S] [--channels N] [--rate N] [--duration S] [--report S]\n"
+                 "          [--mix info=W,assert=W,ping=W,cancel=W] [--ping-bytes N] [--timeout-ms N]\n",
+                 argv0);
+}
+
+}  // namespace
+
+int main(int argc, char **argv)
+{
+    Shared sh;
+    Config &cfg = sh.cfg;
+    for (int i = 1; i < argc; i++) {
+        const char *val = (i + 1 < argc) ? argv[i + 1] : nullptr;
+        bool ok = val != nullptr;
+        if (std::strcmp(argv[i], "--device") == 0 && ok) cfg.device = val;
+        else if (std::strcmp(argv[i], "--channels") == 0 && ok) cfg.channels = std::strtoul(val, nullptr, 0);
+        else if (std::strcmp(argv[i], "--rate") == 0 && ok) cfg.rate = std::strtod(val, nullptr);
+        else if (std::strcmp(argv[i], "--duration") == 0 && ok) cfg.duration_s = std::strtod(val, nullptr);
+        else if (std::strcmp(argv[i], "--report") == 0 && ok) cfg.report_s = std::strtod(val, nullptr);
+        else if (std::strcmp(argv[i], "--mix") == 0 && ok) ok = parse_mix(val, cfg.weights);
+        else if (std::strcmp(argv[i], "--ping-bytes") == 0 && ok) cfg.ping_bytes = std::strtoul(val, nullptr, 0);
+        else if (std::strcmp(argv[i], "--timeout-ms") == 0 && ok) cfg.timeout_ms = std::atoi(val);
+        else ok = false;
+        if (!ok) {
+            usage(argv[0]);
+            return 2;
+        }
+        i++;
+    }
+    if (cfg.channels == 0 || cfg.rate < 0 || cfg.duration_s <= 0 || cfg.report_s <= 0 || cfg.timeout_ms <= 0 ||
+        cfg.ping_bytes > roottap::ctaphid::kMaxMessage) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    std::vector<uint32_t> cids;
+    try {
+        sh.dev = std::make_shared<roottap::Device>(roottap::open_transport(roottap::resolve_device(cfg.device)));
+        for (unsigned c = 0; c < cfg.channels; c++) cids.push_back(sh.dev->init().cid);
+
+        if (cfg.weights[OP_ASSERT] || cfg.weights[OP_CANCEL]) {
+            roottap::DeviceSession s(sh.dev);
+            roottap::ctap2::MakeCredentialParams p;
+            p.rp_id = "roottap-load";
+            p.client_data_hash = roottap::ctap2::random_bytes(roottap::ctap2::kHashLen);
+            p.user_id = roottap::ctap2::random_bytes(16);
+            p.user_name = "load";
+            sh.rp_id = p.rp_id;
+            sh.cred_id = roottap::ctap2::parse_make_credential(
+                             s.cbor(roottap::ctap2::kMakeCredential, roottap::ctap2::make_credential(p),
+                                    cfg.timeout_ms))
+                             .id;
+        }
+    } catch (const std::exception &e) {
+        std::fprintf(stderr, "setup: %s\n", e.what());
+        return 1;
+    }
+
+    sh.start = clock_type::now();
+    std::vector<std::thread> workers;
+    for (unsigned c = 0; c < cfg.channels; c++) workers.emplace_back(worker, std::ref(sh), cids[c], c);
+
+    Stats total;
+    auto end = sh.start + std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double>(cfg.duration_s));
+    auto last = sh.start;
+    while (clock_type::now() < end && sh.dev->alive()) {
+        auto next = std::min(end, last + std::chrono::duration_cast<clock_type::duration>(
+                                             std::chrono::duration<double>(cfg.report_s)));
+        std::this_thread::sleep_until(next);
+        Stats w;
+        {
+            std::lock_guard<std::mutex> lock(sh.mu);
+            std::swap(w, sh.window);
+        }
+        auto now = clock_type::now();
+        print_stats("window", std::chrono::duration<double>(now - sh.start).count(),
+                    std::chrono::duration<double>(now - last).count(), w, false);
+        total.merge(w);
+        last = now;
+    }
+    sh.stop = true;
+    for (auto &t : workers) t.join();
+    total.merge(sh.window);
+
+    double span = std::chrono::duration<double>(clock_type::now() - sh.start).count();
+    print_stats("total", span, span, total, true);
+    if (!sh.dev->alive()) {
+        std::fprintf(stderr, "%s: device gone\n", sh.dev->path().c_str());
+        return 1;
+    }
+    return 0;
+}
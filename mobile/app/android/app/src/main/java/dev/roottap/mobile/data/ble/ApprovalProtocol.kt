@@ -0,0 +1,93 @@
+package dev.roottap.mobile.data.ble
+
+import java.nio.ByteBuffer
+import java.security.SecureRandom
+import javax.crypto.Mac
+import javax.crypto.spec.SecretKeySpec
+
+/**
+ * Approval frames exchanged with the key (shared/protocol/schema/approval_v1.md).
+ * The key notifies a REQUEST; the phone answers with a RESPONSE whose HMAC
+ * under the pairing key covers the request frame, so an answer only counts
+ * for the request it was made for.
+ */
+object ApprovalProtocol {
+    const val VERSION: Byte = 1
+    const val TYPE_REQUEST: Byte = 0x01
+    const val TYPE_RESPONSE: Byte = 0x02
+    const val TYPE_REVOKE: Byte = 0x03
+    const val TYPE_PAIR: Byte = 0x10
+
+    const val KEY_LEN = 32
+    private const val REQ_HEAD = 61
+
+    const val SCOPE_NONE = 0
+    const val SCOPE_RP = 1
+    const val SCOPE_HOST = 2
+    const val SCOPE_ENROLL = 3
+
+    data class Request(
+        val frame: ByteArray,
+        val id: Int,
+        val ttlMs: Int,
+        val command: Int,
+        val rpIdHash: ByteArray?,
+        val rpId: String?,
+    )
+
+    /** The REQUEST in a notify, or null if it isn't one. */
+    fun parseRequest(frame: ByteArray): Request? {
+        if (frame.size < REQ_HEAD || frame[0] != VERSION || frame[1] != TYPE_REQUEST) return null
+        val b = ByteBuffer.wrap(frame)
+        val hasRp = (frame[27].toInt() and 0x01) != 0
+        val rpLen = frame[60].toInt() and 0xff
+        if (frame.size != REQ_HEAD + rpLen) return null
+        return Request(
+            frame = frame,
+            id = b.getInt(2),
+            ttlMs = b.getInt(22),
+            command = frame[26].toInt() and 0xff,
+            rpIdHash = if (hasRp) frame.copyOfRange(28, 60) else null,
+            rpId = if (hasRp && rpLen > 0) String(frame, REQ_HEAD, rpLen, Charsets.UTF_8) else null,
+        )
+    }
+
+    /** RESPONSE to `req`; the grant fields only matter when approving. */
+    fun response(
+        key: ByteArray,
+        req: Request,
+        approve: Boolean,
+        scope: Int = SCOPE_NONE,
+        minutes: Int = 0,
+        uses: Int = 0,
+    ): ByteArray {
+        val head = ByteBuffer.allocate(12)
+            .put(VERSION)
+            .put(TYPE_RESPONSE)
+            .putInt(req.id)
+            .put(if (approve) 1 else 0)
+            .put(scope.toByte())
+            .putShort(minutes.toShort())
+            .putShort(uses.toShort())
+            .array()
+        return head + hmac(key, req.frame, head)
+    }
+
+    /** REVOKE: drops every grant. `counter` must grow with each one sent. */
+    fun revoke(key: ByteArray, counter: Int): ByteArray {
+        val head = ByteBuffer.allocate(6).put(VERSION).put(TYPE_REVOKE).putInt(counter).array()
+        return head + hmac(key, head)
+    }
+
+    /** PAIR: hands the key the pairing key, once, over an encrypted link. */
+    fun pair(key: ByteArray): ByteArray = byteArrayOf(VERSION, TYPE_PAIR) + key
+
+    fun newKey(): ByteArray = ByteArray(KEY_LEN).also { SecureRandom().nextBytes(it) }
+
+    private fun hmac(key: ByteArray, vararg parts: ByteArray): ByteArray {
+        val mac = Mac.getInstance("HmacSHA256")
+        mac.init(SecretKeySpec(key, "HmacSHA256"))
+        parts.forEach { mac.update(it) }
+        return mac.doFinal()
+    }
+}
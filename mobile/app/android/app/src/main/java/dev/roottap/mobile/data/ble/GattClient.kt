@@ -3,6 +3,7 @@ package dev.roottap.mobile.data.ble
 import android.annotation.SuppressLint
 import android.bluetooth.*
 import android.content.Context
+import android.util.Base64
 import android.util.Log
 import kotlinx.coroutines.flow.MutableStateFlow
 import kotlinx.coroutines.flow.asStateFlow
@@ -32,6 +33,16 @@ class GattClient(
     private val tag = "RootTapGatt"
     private var notifReady = false
 
+    // Pairing key shared with the key; handed over on the first connection.
+    private val prefs = context.getSharedPreferences("roottap_approval", Context.MODE_PRIVATE)
+    private val pairingKey: ByteArray by lazy {
+        prefs.getString("key", null)?.let { Base64.decode(it, Base64.NO_WRAP) }
+            ?: ApprovalProtocol.newKey().also {
+                prefs.edit().putString("key", Base64.encodeToString(it, Base64.NO_WRAP)).apply()
+            }
+    }
+    private val requestMtu = 185   // a REQUEST with a 64-byte RP ID fits
+
     @SuppressLint("MissingPermission")
     fun connect(device: BluetoothDevice) {
         if (_connectionState.value != ConnectionState.DISCONNECTED) {
@@ -71,9 +82,9 @@ class GattClient(
             }
 
             if (newState == BluetoothProfile.STATE_CONNECTED) {
-                Log.d(tag, "Connected to $gattDeviceAddress, discovering services...")
+                Log.d(tag, "Connected to $gattDeviceAddress, requesting MTU...")
                 _connectionState.value = ConnectionState.CONNECTED
-                gatt.discoverServices()
+                if (!gatt.requestMtu(requestMtu)) gatt.discoverServices()
             } else if (newState == BluetoothProfile.STATE_DISCONNECTED) {
                 Log.d(tag, "Disconnected from $gattDeviceAddress")
                 // Always close the gatt object that has disconnected to release resources.
@@ -93,6 +104,12 @@ class GattClient(
             }
         }
 
+        @SuppressLint("MissingPermission")
+        override fun onMtuChanged(gatt: BluetoothGatt, mtu: Int, status: Int) {
+            Log.d(tag, "mtu=$mtu status=$status, discovering services...")
+            gatt.discoverServices()
+        }
+
         @SuppressLint("MissingPermission")
         override fun onServicesDiscovered(gatt: BluetoothGatt, status: Int) {
             if (status != BluetoothGatt.GATT_SUCCESS) {
@@ -127,16 +144,24 @@ class GattClient(
             if (!notifReady) return
             val value = characteristic.value ?: return
             Log.d(tag, "notify ${characteristic.uuid} value=${value.joinToString { "%02X".format(it) }}")
-            if (characteristic.uuid == notifyCharUuid && value.isNotEmpty() && value[0].toInt() == 0x01) {
-                // GPIO pressed -> respond with 0x01
-                write(byteArrayOf(0x01))
+            if (characteristic.uuid != notifyCharUuid) return
+            val req = ApprovalProtocol.parseRequest(value) ?: run {
+                Log.w(tag, "not an approval request")
+                return
             }
+            // approve whatever the key asks for; the RP is logged
+            Log.d(tag, "request ${"%08x".format(req.id)} cmd=${req.command} rp=${req.rpId}")
+            write(ApprovalProtocol.response(pairingKey, req, approve = true))
         }
 
         @SuppressLint("MissingPermission")
         override fun onDescriptorWrite(gatt: BluetoothGatt, descriptor: BluetoothGattDescriptor, status: Int) {
             Log.d(tag, "descriptor write ${descriptor.uuid} status=$status")
             notifReady = (status == BluetoothGatt.GATT_SUCCESS)
+            // The key keeps the first pairing key it gets and refuses
+            // later ones, so this is harmless once paired. The write needs
+            // an encrypted link, which bonds the phone on first use.
+            if (notifReady) write(ApprovalProtocol.pair(pairingKey), withResponse = true)
         }
 
         @SuppressLint("MissingPermission")
@@ -160,7 +185,7 @@ class GattClient(
     }
 
     @SuppressLint("MissingPermission")
-    private fun write(payload: ByteArray) {
+    private fun write(payload: ByteArray, withResponse: Boolean = false) {
         val g = gatt ?: return
         val c = writeChar ?: return
 
@@ -168,7 +193,7 @@ class GattClient(
 
         // Prefer WRITE_NO_RESPONSE if your char supports it (faster).
         val supportsNoResp = (c.properties and BluetoothGattCharacteristic.PROPERTY_WRITE_NO_RESPONSE) != 0
-        c.writeType = if (supportsNoResp)
+        c.writeType = if (supportsNoResp && !withResponse)
             BluetoothGattCharacteristic.WRITE_TYPE_NO_RESPONSE
         else
             BluetoothGattCharacteristic.WRITE_TYPE_DEFAULT
@@ -0,0 +1,67 @@
+#!/usr/bin/env python3
+"""Writes approval_v1.json: fixed approval frames (schema/approval_v1.md)
+with their MACs, and frames the key must reject."""
+import hashlib
+import hmac
+import json
+import struct
+import sys
+
+KEY = bytes(range(32))
+CHALLENGE = bytes(range(0xa0, 0xb0))
+
+
+def request(rid, rp_id, command=0x02, ttl_ms=30000):
+    rp = rp_id.encode()
+    flags = 1 if rp_id else 0
+    rp_hash = hashlib.sha256(rp).digest() if rp_id else bytes(32)
+    return (bytes([1, 0x01]) + struct.pack(">I", rid) + CHALLENGE + struct.pack(">I", ttl_ms)
+            + bytes([command, flags]) + rp_hash + bytes([len(rp)]) + rp)
+
+
+def response(req, verdict, scope=0, minutes=0, uses=0, rid=None):
+    if rid is None:
+        rid = struct.unpack(">I", req[2:6])[0]
+    head = bytes([1, 0x02]) + struct.pack(">IBBHH", rid, verdict, scope, minutes, uses)
+    return head + hmac.new(KEY, req + head, hashlib.sha256).digest()
+
+
+def revoke(counter):
+    head = bytes([1, 0x03]) + struct.pack(">I", counter)
+    return head + hmac.new(KEY, head, hashlib.sha256).digest()
+
+
+def main():
+    req = request(0x01020304, "example.com")
+    req_none = request(7, "", command=0x07)
+    good = response(req, 1)
+    tampered = bytearray(response(req, 1))
+    tampered[6] = 0                      # verdict flipped after signing
+    vectors = {
+        "key": KEY.hex(),
+        "valid": [
+            {"name": "approve", "request": req.hex(), "response": good.hex()},
+            {"name": "approve_grant_rp", "request": req.hex(),
+             "response": response(req, 1, scope=1, minutes=15, uses=10).hex()},
+            {"name": "deny", "request": req.hex(), "response": response(req, 0).hex()},
+            {"name": "reset_no_rp", "request": req_none.hex(), "response": response(req_none, 1).hex()},
+            {"name": "revoke", "revoke": revoke(1).hex()},
+        ],
+        "invalid": [
+            {"name": "tampered_verdict", "request": req.hex(), "response": bytes(tampered).hex(),
+             "error": "mac"},
+            {"name": "other_request", "request": req.hex(), "response": response(req_none, 1, rid=0x01020304).hex(),
+             "error": "mac"},
+            {"name": "unknown_id", "request": req.hex(), "response": response(req, 1, rid=0x01020305).hex(),
+             "error": "unknown"},
+            {"name": "short", "request": req.hex(), "response": good[:-1].hex(), "error": "format"},
+            {"name": "bad_version", "request": req.hex(), "response": (b"\x02" + good[1:]).hex(),
+             "error": "format"},
+        ],
+    }
+    json.dump(vectors, sys.stdout, indent=2)
+    sys.stdout.write("\n")
+
+
+if __name__ == "__main__":
+    main()